@@ -0,0 +1,263 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Cache of AFC directory listings and entry kinds for the file explorer.
+//!
+//! Listing a directory costs one `list_dir` plus a stat per entry (two for
+//! symlinks). Listings are kept briefly so back/forward navigation is
+//! instant; entry kinds live longer, so re-listing a large folder after a
+//! change only stats the names that are new. Writes and deletes made through
+//! IOManager or `AfcServices` invalidate the affected paths.
+//!
+//! Entries are scoped by device and AFC flavour (see `scope`), since AFC2
+//! and house-arrest containers have different roots.
+
+use crate::afc_pool::AfcPoolKind;
+use lru::LruCache;
+use once_cell::sync::Lazy;
+use std::num::NonZeroUsize;
+use std::sync::{Arc, Mutex};
+use std::time::{Duration, Instant};
+
+const LISTING_CAPACITY: usize = 128;
+const KIND_CAPACITY: usize = 64 * 1024;
+/// Changes made on the device itself (a new photo) show up after this.
+const LISTING_TTL: Duration = Duration::from_secs(5);
+const KIND_TTL: Duration = Duration::from_secs(300);
+
+/// Entry names of one directory with whether each is a directory, symlinks
+/// resolved.
+pub type Listing = Arc<Vec<(String, bool)>>;
+
+#[derive(Clone, Debug, Eq, Hash, PartialEq)]
+struct CacheKey {
+    scope: String,
+    path: String,
+}
+
+struct MetadataCache {
+    listings: LruCache<CacheKey, (Instant, Listing)>,
+    kinds: LruCache<CacheKey, (Instant, bool)>,
+}
+
+static CACHE: Lazy<Mutex<MetadataCache>> = Lazy::new(|| Mutex::new(MetadataCache::new()));
+
+impl MetadataCache {
+    fn new() -> Self {
+        Self {
+            listings: LruCache::new(
+                NonZeroUsize::new(LISTING_CAPACITY).expect("listing capacity is non-zero"),
+            ),
+            kinds: LruCache::new(
+                NonZeroUsize::new(KIND_CAPACITY).expect("kind capacity is non-zero"),
+            ),
+        }
+    }
+
+    fn listing(&mut self, key: &CacheKey, now: Instant) -> Option<Listing> {
+        match self.listings.get(key) {
+            Some((at, listing)) if now.duration_since(*at) < LISTING_TTL => Some(listing.clone()),
+            Some(_) => {
+                self.listings.pop(key);
+                None
+            }
+            None => None,
+        }
+    }
+
+    fn kind(&mut self, key: &CacheKey, now: Instant) -> Option<bool> {
+        match self.kinds.get(key) {
+            Some((at, is_dir)) if now.duration_since(*at) < KIND_TTL => Some(*is_dir),
+            Some(_) => {
+                self.kinds.pop(key);
+                None
+            }
+            None => None,
+        }
+    }
+
+    /// Drops `path`, everything below it and the listing of its parent.
+    fn invalidate(&mut self, scope: &str, path: &str) {
+        let affected = |key: &CacheKey| key.scope == scope && is_same_or_below(&key.path, path);
+
+        let listings: Vec<CacheKey> = self
+            .listings
+            .iter()
+            .map(|(key, _)| key)
+            .filter(|key| affected(key))
+            .cloned()
+            .collect();
+        for key in listings {
+            self.listings.pop(&key);
+        }
+        let kinds: Vec<CacheKey> = self
+            .kinds
+            .iter()
+            .map(|(key, _)| key)
+            .filter(|key| affected(key))
+            .cloned()
+            .collect();
+        for key in kinds {
+            self.kinds.pop(&key);
+        }
+
+        if let Some(parent) = parent_path(path) {
+            self.listings.pop(&key(scope, &parent));
+        }
+    }
+}
+
+fn cache() -> std::sync::MutexGuard<'static, MetadataCache> {
+    CACHE.lock().expect("AFC metadata cache mutex poisoned")
+}
+
+fn key(scope: &str, path: &str) -> CacheKey {
+    CacheKey {
+        scope: scope.to_string(),
+        path: normalize(path),
+    }
+}
+
+/// Collapses repeated slashes and drops a trailing one, so `//DCIM/` and
+/// `/DCIM` share entries.
+fn normalize(path: &str) -> String {
+    let mut normalized = String::with_capacity(path.len() + 1);
+    for part in path.split('/').filter(|part| !part.is_empty()) {
+        normalized.push('/');
+        normalized.push_str(part);
+    }
+    if normalized.is_empty() {
+        normalized.push('/');
+    }
+    normalized
+}
+
+fn is_same_or_below(candidate: &str, path: &str) -> bool {
+    let path = normalize(path);
+    path == "/"
+        || candidate == path
+        || candidate
+            .strip_prefix(path.as_str())
+            .is_some_and(|rest| rest.starts_with('/'))
+}
+
+fn parent_path(path: &str) -> Option<String> {
+    let path = normalize(path);
+    let (parent, _) = path.rsplit_once('/')?;
+    Some(if parent.is_empty() { "/" } else { parent }.to_string())
+}
+
+/// Cache scope for one device and AFC flavour.
+pub fn scope(udid: &str, kind: &AfcPoolKind) -> String {
+    match kind {
+        AfcPoolKind::Standard => format!("{udid}|afc"),
+        AfcPoolKind::Afc2 => format!("{udid}|afc2"),
+        AfcPoolKind::HouseArrest(bundle_id) => format!("{udid}|house-arrest|{bundle_id}"),
+    }
+}
+
+pub fn listing(scope: &str, path: &str) -> Option<Listing> {
+    cache().listing(&key(scope, path), Instant::now())
+}
+
+pub fn store_listing(scope: &str, path: &str, listing: Listing) {
+    let now = Instant::now();
+    let mut cache = cache();
+    for (name, is_dir) in listing.iter() {
+        cache
+            .kinds
+            .put(key(scope, &format!("{path}/{name}")), (now, *is_dir));
+    }
+    cache.listings.put(key(scope, path), (now, listing));
+}
+
+/// Whether `path` is a directory, if known.
+pub fn kind(scope: &str, path: &str) -> Option<bool> {
+    cache().kind(&key(scope, path), Instant::now())
+}
+
+/// Forgets `path`, anything below it and its parent's listing. Call after
+/// creating, writing or deleting `path` on the device.
+pub fn invalidate(scope: &str, path: &str) {
+    cache().invalidate(scope, path);
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn listing_of(names: &[(&str, bool)]) -> Listing {
+        Arc::new(
+            names
+                .iter()
+                .map(|(name, is_dir)| (name.to_string(), *is_dir))
+                .collect(),
+        )
+    }
+
+    #[test]
+    fn paths_normalize_and_relate() {
+        assert_eq!(normalize("//DCIM//100APPLE/"), "/DCIM/100APPLE");
+        assert_eq!(normalize(""), "/");
+        assert_eq!(parent_path("/DCIM/100APPLE").as_deref(), Some("/DCIM"));
+        assert_eq!(parent_path("/DCIM").as_deref(), Some("/"));
+        assert!(is_same_or_below("/DCIM/100APPLE", "/DCIM"));
+        assert!(!is_same_or_below("/DCIMX", "/DCIM"));
+    }
+
+    #[test]
+    fn invalidation_covers_the_path_its_children_and_its_parent_listing() {
+        let mut cache = MetadataCache::new();
+        let now = Instant::now();
+        for (path, listing) in [
+            ("/", listing_of(&[("DCIM", true)])),
+            ("/DCIM", listing_of(&[("100APPLE", true)])),
+            ("/DCIM/100APPLE", listing_of(&[("IMG_0001.HEIC", false)])),
+            ("/Downloads", listing_of(&[])),
+        ] {
+            cache.listings.put(key("dev|afc", path), (now, listing));
+        }
+        cache
+            .kinds
+            .put(key("dev|afc", "/DCIM/100APPLE/IMG_0001.HEIC"), (now, false));
+        cache
+            .listings
+            .put(key("other|afc", "/DCIM"), (now, listing_of(&[])));
+
+        cache.invalidate("dev|afc", "/DCIM/100APPLE/");
+
+        assert!(
+            cache
+                .listing(&key("dev|afc", "/DCIM/100APPLE"), now)
+                .is_none()
+        );
+        assert!(cache.listing(&key("dev|afc", "/DCIM"), now).is_none());
+        assert!(
+            cache
+                .kind(&key("dev|afc", "/DCIM/100APPLE/IMG_0001.HEIC"), now)
+                .is_none()
+        );
+        assert!(cache.listing(&key("dev|afc", "/"), now).is_some());
+        assert!(cache.listing(&key("dev|afc", "/Downloads"), now).is_some());
+        assert!(cache.listing(&key("other|afc", "/DCIM"), now).is_some());
+    }
+
+    #[test]
+    fn listings_expire_before_kinds() {
+        let mut cache = MetadataCache::new();
+        let then = Instant::now();
+        cache
+            .listings
+            .put(key("dev|afc", "/DCIM"), (then, listing_of(&[])));
+        cache.kinds.put(key("dev|afc", "/DCIM/a"), (then, true));
+
+        let later = then + LISTING_TTL;
+        assert!(cache.listing(&key("dev|afc", "/DCIM"), later).is_none());
+        assert_eq!(cache.kind(&key("dev|afc", "/DCIM/a"), later), Some(true));
+        assert!(
+            cache
+                .kind(&key("dev|afc", "/DCIM/a"), then + KIND_TTL)
+                .is_none()
+        );
+    }
+}
@@ -0,0 +1,550 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Bounded pool of AFC sessions per device.
+//!
+//! A single AFC session serializes every request, so one long read (an export,
+//! a video preview) used to stall thumbnails and browsing for the whole device.
+//! The pool hands out exclusive leases on up to `max_sessions` sessions, opens
+//! extra sessions only when every existing one is busy, and returns them to an
+//! idle list when the lease is dropped. Sessions that sat idle for a while are
+//! probed before reuse (a probe that does not answer in time counts as dead),
+//! and leases can be marked broken so a dead session is never handed out
+//! again.
+
+use ::log::{debug, warn};
+use anyhow::Context;
+use idevice::{IdeviceError, IdeviceService, afc::AfcClient, provider::IdeviceProvider};
+use std::future::Future;
+use std::ops::{Deref, DerefMut};
+use std::sync::atomic::{AtomicBool, AtomicU64, Ordering};
+use std::sync::{Arc, Mutex as StdMutex};
+use std::time::{Duration, Instant};
+use tokio::sync::{Mutex, OwnedMutexGuard, OwnedSemaphorePermit, Semaphore};
+
+use crate::utils;
+
+pub const AFC_POOL_MAX_SESSIONS: usize = 4;
+pub const AFC2_POOL_MAX_SESSIONS: usize = 2;
+const HEALTH_CHECK_AFTER: Duration = Duration::from_secs(10);
+/// A wedged device never answers the probe; don't let it hold `lease()`.
+const HEALTH_CHECK_TIMEOUT: Duration = Duration::from_secs(3);
+
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub enum AfcPoolKind {
+    Standard,
+    Afc2,
+    /// An app's Documents container. Only pooled for the lifetime of one job,
+    /// since each session is vended for a single bundle.
+    HouseArrest(String),
+}
+
+impl AfcPoolKind {
+    fn description(&self) -> &'static str {
+        match self {
+            Self::Standard => "afc",
+            Self::Afc2 => "afc2",
+            Self::HouseArrest(_) => "house_arrest",
+        }
+    }
+}
+
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct AfcPoolStats {
+    pub created: u64,
+    pub reused: u64,
+    pub discarded: u64,
+    pub idle: usize,
+}
+
+/// A session the pool can check before handing it out again.
+trait PooledSession: Send + Sized {
+    fn probe(&mut self) -> impl Future<Output = Result<(), String>> + Send;
+}
+
+impl PooledSession for AfcClient {
+    async fn probe(&mut self) -> Result<(), String> {
+        self.get_file_info("/")
+            .await
+            .map(|_| ())
+            .map_err(|err| err.to_string())
+    }
+}
+
+struct IdleSession<C> {
+    client: C,
+    since: Instant,
+}
+
+/// Client-agnostic bookkeeping: the idle list and the permits that bound the
+/// number of sessions in use.
+struct SessionSlots<C> {
+    idle: StdMutex<Vec<IdleSession<C>>>,
+    permits: Arc<Semaphore>,
+    probe_timeout: Duration,
+    closed: AtomicBool,
+    created: AtomicU64,
+    reused: AtomicU64,
+    discarded: AtomicU64,
+}
+
+/// Exclusive use of one pooled session. Dropping the lease returns the session
+/// to the pool unless it was marked broken.
+pub struct Lease<C> {
+    client: Option<C>,
+    slots: Arc<SessionSlots<C>>,
+    broken: bool,
+    _permit: OwnedSemaphorePermit,
+}
+
+pub type AfcLease = Lease<AfcClient>;
+
+#[derive(Clone)]
+pub struct AfcPool {
+    inner: Arc<AfcPoolInner>,
+}
+
+struct AfcPoolInner {
+    udid: String,
+    kind: AfcPoolKind,
+    provider: Arc<Mutex<Box<dyn IdeviceProvider>>>,
+    max_sessions: usize,
+    slots: Arc<SessionSlots<AfcClient>>,
+}
+
+/// Where an AFC user gets its session from. Device-wide pools only cover AFC
+/// and AFC2; house-arrest clients are shared or pooled per job.
+#[derive(Clone)]
+pub enum AfcSource {
+    Shared(Arc<Mutex<AfcClient>>),
+    Pool(AfcPool),
+}
+
+pub enum AfcHandle {
+    Shared(OwnedMutexGuard<AfcClient>),
+    Leased(AfcLease),
+    /// A client opened for one job, such as a house-arrest container.
+    Owned(AfcClient),
+}
+
+impl<C> SessionSlots<C> {
+    fn new(max_sessions: usize) -> Self {
+        Self {
+            idle: StdMutex::new(Vec::new()),
+            permits: Arc::new(Semaphore::new(max_sessions.max(1))),
+            probe_timeout: HEALTH_CHECK_TIMEOUT,
+            closed: AtomicBool::new(false),
+            created: AtomicU64::new(0),
+            reused: AtomicU64::new(0),
+            discarded: AtomicU64::new(0),
+        }
+    }
+
+    async fn acquire(&self) -> Option<OwnedSemaphorePermit> {
+        self.permits.clone().acquire_owned().await.ok()
+    }
+
+    fn take_idle(&self) -> Option<IdleSession<C>> {
+        let session = self.idle.lock().expect("AFC pool mutex poisoned").pop()?;
+        self.reused.fetch_add(1, Ordering::Relaxed);
+        Some(session)
+    }
+
+    fn put_back(&self, client: C) {
+        if self.closed.load(Ordering::SeqCst) {
+            return;
+        }
+        self.idle
+            .lock()
+            .expect("AFC pool mutex poisoned")
+            .push(IdleSession {
+                client,
+                since: Instant::now(),
+            });
+    }
+
+    fn close(&self) {
+        self.closed.store(true, Ordering::SeqCst);
+        self.permits.close();
+        self.idle.lock().expect("AFC pool mutex poisoned").clear();
+    }
+
+    fn stats(&self) -> AfcPoolStats {
+        AfcPoolStats {
+            created: self.created.load(Ordering::Relaxed),
+            reused: self.reused.load(Ordering::Relaxed),
+            discarded: self.discarded.load(Ordering::Relaxed),
+            idle: self.idle.lock().map(|idle| idle.len()).unwrap_or(0),
+        }
+    }
+}
+
+impl<C: PooledSession> SessionSlots<C> {
+    /// Waits for a free slot, then reuses an idle session or opens a new one
+    /// with `connect`. `None` once the pool is closed.
+    async fn lease<F, Fut>(
+        self: &Arc<Self>,
+        label: &str,
+        connect: F,
+    ) -> Option<anyhow::Result<Lease<C>>>
+    where
+        F: FnOnce() -> Fut,
+        Fut: Future<Output = anyhow::Result<C>>,
+    {
+        let permit = self.acquire().await?;
+        if let Some(client) = self.take_live(label).await {
+            return Some(Ok(Lease::new(client, self.clone(), permit)));
+        }
+
+        let client = match connect().await {
+            Ok(client) => client,
+            Err(err) => return Some(Err(err)),
+        };
+        let created = self.created.fetch_add(1, Ordering::Relaxed) + 1;
+        debug!("AFC pool opened session: {label} created={created}");
+        Some(Ok(Lease::new(client, self.clone(), permit)))
+    }
+
+    /// Pops idle sessions until one is usable. Those idle for longer than
+    /// `HEALTH_CHECK_AFTER` must answer a probe within `probe_timeout`.
+    async fn take_live(&self, label: &str) -> Option<C> {
+        while let Some(idle) = self.take_idle() {
+            let mut client = idle.client;
+            if idle.since.elapsed() < HEALTH_CHECK_AFTER {
+                return Some(client);
+            }
+
+            let error = match tokio::time::timeout(self.probe_timeout, client.probe()).await {
+                Ok(Ok(())) => return Some(client),
+                Ok(Err(err)) => err,
+                Err(_) => format!("no answer within {:?}", self.probe_timeout),
+            };
+            self.discarded.fetch_add(1, Ordering::Relaxed);
+            debug!("AFC pool dropped stale session: {label} error={error}");
+        }
+        None
+    }
+}
+
+impl<C> Lease<C> {
+    fn new(client: C, slots: Arc<SessionSlots<C>>, permit: OwnedSemaphorePermit) -> Self {
+        Self {
+            client: Some(client),
+            slots,
+            broken: false,
+            _permit: permit,
+        }
+    }
+
+    /// Drops the session instead of returning it to the pool.
+    pub fn mark_broken(&mut self) {
+        self.broken = true;
+    }
+}
+
+impl<C> Deref for Lease<C> {
+    type Target = C;
+
+    fn deref(&self) -> &C {
+        self.client
+            .as_ref()
+            .expect("lease holds a client until drop")
+    }
+}
+
+impl<C> DerefMut for Lease<C> {
+    fn deref_mut(&mut self) -> &mut C {
+        self.client
+            .as_mut()
+            .expect("lease holds a client until drop")
+    }
+}
+
+impl<C> Drop for Lease<C> {
+    fn drop(&mut self) {
+        let Some(client) = self.client.take() else {
+            return;
+        };
+        if self.broken {
+            self.slots.discarded.fetch_add(1, Ordering::Relaxed);
+            return;
+        }
+        // The permit is released after this body runs, so the next waiter
+        // always finds the session on the idle list.
+        self.slots.put_back(client);
+    }
+}
+
+impl AfcPool {
+    pub fn new(
+        udid: impl Into<String>,
+        kind: AfcPoolKind,
+        provider: Arc<Mutex<Box<dyn IdeviceProvider>>>,
+        max_sessions: usize,
+    ) -> Self {
+        Self {
+            inner: Arc::new(AfcPoolInner {
+                udid: udid.into(),
+                kind,
+                provider,
+                max_sessions: max_sessions.max(1),
+                slots: Arc::new(SessionSlots::new(max_sessions)),
+            }),
+        }
+    }
+
+    /// Waits for a free session slot, then reuses an idle session or opens a
+    /// new one.
+    pub async fn lease(&self) -> anyhow::Result<AfcLease> {
+        let inner = &self.inner;
+        let label = format!("udid={} kind={}", inner.udid, inner.kind.description());
+        inner
+            .slots
+            .lease(&label, || self.connect())
+            .await
+            .unwrap_or_else(|| {
+                Err(anyhow::anyhow!(
+                    "{} pool for {} is closed",
+                    inner.kind.description(),
+                    inner.udid
+                ))
+            })
+    }
+
+    async fn connect(&self) -> anyhow::Result<AfcClient> {
+        let inner = &self.inner;
+        let provider = inner.provider.lock().await;
+        let client = match &inner.kind {
+            AfcPoolKind::Standard => AfcClient::connect(provider.as_ref()).await,
+            AfcPoolKind::Afc2 => AfcClient::new_afc2(provider.as_ref()).await,
+            AfcPoolKind::HouseArrest(bundle_id) => {
+                utils::vend_app_documents(provider.as_ref(), bundle_id).await
+            }
+        };
+        client.with_context(|| {
+            format!(
+                "failed to open {} session for {}",
+                inner.kind.description(),
+                inner.udid
+            )
+        })
+    }
+
+    /// Rejects new leases and drops idle sessions. Outstanding leases finish
+    /// normally and are discarded when returned.
+    pub fn close(&self) {
+        let stats = self.stats();
+        self.inner.slots.close();
+        debug!(
+            "AFC pool closed: udid={} kind={} created={} reused={} discarded={}",
+            self.inner.udid,
+            self.inner.kind.description(),
+            stats.created,
+            stats.reused,
+            stats.discarded
+        );
+    }
+
+    pub fn stats(&self) -> AfcPoolStats {
+        self.inner.slots.stats()
+    }
+
+    pub fn udid(&self) -> &str {
+        &self.inner.udid
+    }
+
+    pub fn kind(&self) -> &AfcPoolKind {
+        &self.inner.kind
+    }
+
+    pub fn max_sessions(&self) -> usize {
+        self.inner.max_sessions
+    }
+}
+
+impl AfcSource {
+    pub async fn lease(&self) -> anyhow::Result<AfcHandle> {
+        match self {
+            Self::Shared(afc) => Ok(AfcHandle::Shared(afc.clone().lock_owned().await)),
+            Self::Pool(pool) => Ok(AfcHandle::Leased(pool.lease().await?)),
+        }
+    }
+}
+
+impl AfcHandle {
+    /// Marks a pooled session broken after a transport-level failure. AFC
+    /// status errors such as a missing file leave the session usable.
+    pub fn note_error(&mut self, err: &IdeviceError) {
+        if matches!(err, IdeviceError::Afc(_) | IdeviceError::NotFound) {
+            return;
+        }
+        if let Self::Leased(lease) = self {
+            warn!("AFC pool discarding session after error: {err}");
+            lease.mark_broken();
+        }
+    }
+}
+
+impl Deref for AfcHandle {
+    type Target = AfcClient;
+
+    fn deref(&self) -> &AfcClient {
+        match self {
+            Self::Shared(guard) => guard,
+            Self::Leased(lease) => lease,
+            Self::Owned(client) => client,
+        }
+    }
+}
+
+impl DerefMut for AfcHandle {
+    fn deref_mut(&mut self) -> &mut AfcClient {
+        match self {
+            Self::Shared(guard) => guard,
+            Self::Leased(lease) => lease,
+            Self::Owned(client) => client,
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    async fn lease(slots: &Arc<SessionSlots<u32>>, next_id: &mut u32) -> Lease<u32> {
+        let permit = slots.acquire().await.expect("pool is open");
+        if let Some(idle) = slots.take_idle() {
+            return Lease::new(idle.client, slots.clone(), permit);
+        }
+        *next_id += 1;
+        slots.created.fetch_add(1, Ordering::Relaxed);
+        Lease::new(*next_id, slots.clone(), permit)
+    }
+
+    #[tokio::test]
+    async fn returned_sessions_are_reused() {
+        let slots = Arc::new(SessionSlots::new(2));
+        let mut next_id = 0;
+
+        let first = lease(&slots, &mut next_id).await;
+        assert_eq!(*first, 1);
+        drop(first);
+        let again = lease(&slots, &mut next_id).await;
+
+        assert_eq!(*again, 1);
+        assert_eq!(slots.stats().created, 1);
+        assert_eq!(slots.stats().reused, 1);
+    }
+
+    #[tokio::test]
+    async fn extra_sessions_open_only_while_others_are_busy() {
+        let slots = Arc::new(SessionSlots::new(2));
+        let mut next_id = 0;
+
+        let first = lease(&slots, &mut next_id).await;
+        let second = lease(&slots, &mut next_id).await;
+        assert_eq!((*first, *second), (1, 2));
+        assert!(slots.permits.clone().try_acquire_owned().is_err());
+
+        drop(second);
+        let third = lease(&slots, &mut next_id).await;
+        assert_eq!(*third, 2);
+        assert_eq!(slots.stats().created, 2);
+    }
+
+    #[tokio::test]
+    async fn broken_sessions_are_not_returned() {
+        let slots = Arc::new(SessionSlots::new(1));
+        let mut next_id = 0;
+
+        let mut first = lease(&slots, &mut next_id).await;
+        first.mark_broken();
+        drop(first);
+
+        assert_eq!(slots.stats().idle, 0);
+        assert_eq!(slots.stats().discarded, 1);
+        assert_eq!(*lease(&slots, &mut next_id).await, 2);
+    }
+
+    /// Stand-in session whose probe answers, fails or never returns.
+    #[derive(Debug)]
+    struct ProbedSession {
+        id: u32,
+        probe: Option<Result<(), String>>,
+    }
+
+    impl PooledSession for ProbedSession {
+        async fn probe(&mut self) -> Result<(), String> {
+            match self.probe.clone() {
+                Some(result) => result,
+                None => std::future::pending().await,
+            }
+        }
+    }
+
+    async fn lease_probed(
+        slots: &Arc<SessionSlots<ProbedSession>>,
+        id: u32,
+        probe: Option<Result<(), String>>,
+    ) -> Lease<ProbedSession> {
+        slots
+            .lease("test", || async move { Ok(ProbedSession { id, probe }) })
+            .await
+            .expect("pool is open")
+            .expect("session opens")
+    }
+
+    /// Leaves one idle session that has sat past `HEALTH_CHECK_AFTER`.
+    async fn stale_pool(probe: Option<Result<(), String>>) -> Arc<SessionSlots<ProbedSession>> {
+        let mut slots = SessionSlots::new(1);
+        slots.probe_timeout = Duration::from_millis(20);
+        let slots = Arc::new(slots);
+        drop(lease_probed(&slots, 1, probe).await);
+        for idle in slots.idle.lock().expect("idle list").iter_mut() {
+            idle.since -= HEALTH_CHECK_AFTER * 2;
+        }
+        slots
+    }
+
+    #[tokio::test]
+    async fn stale_session_that_answers_the_probe_is_reused() {
+        let slots = stale_pool(Some(Ok(()))).await;
+
+        let lease = lease_probed(&slots, 2, Some(Ok(()))).await;
+
+        assert_eq!(lease.id, 1);
+        assert_eq!(slots.stats().created, 1);
+        assert_eq!(slots.stats().discarded, 0);
+    }
+
+    #[tokio::test]
+    async fn stale_session_that_fails_or_hangs_the_probe_is_replaced() {
+        for probe in [Some(Err("connection reset".to_string())), None] {
+            let slots = stale_pool(probe.clone()).await;
+
+            let lease = tokio::time::timeout(
+                Duration::from_secs(1),
+                lease_probed(&slots, 2, Some(Ok(()))),
+            )
+            .await
+            .expect("lease must not wait on a wedged probe");
+
+            assert_eq!(lease.id, 2, "probe {probe:?}");
+            assert_eq!(slots.stats().created, 2);
+            assert_eq!(slots.stats().discarded, 1);
+        }
+    }
+
+    #[tokio::test]
+    async fn closed_pool_rejects_leases_and_drops_returns() {
+        let slots = Arc::new(SessionSlots::new(1));
+        let mut next_id = 0;
+
+        let outstanding = lease(&slots, &mut next_id).await;
+        slots.close();
+        drop(outstanding);
+
+        assert!(slots.acquire().await.is_none());
+        assert_eq!(slots.stats().idle, 0);
+    }
+}
@@ -1,26 +1,36 @@
 // SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
+use crate::afc_metadata_cache;
+use crate::afc_pool::{AfcPoolKind, AfcSource};
 use crate::device_ctx;
 use crate::media_streamer::MediaStreamSession;
 use crate::qt_threading::QtThreading;
 use crate::utils::{heic_to_qimage, image_to_b64, is_heic_file};
 use crate::{RUNTIME, qvariantmap_insert, run_sync};
 use base64::{Engine as _, engine::general_purpose};
+use idevice::afc::FileInfo;
 use idevice::afc::opcode::AfcFopenMode;
-use idevice::afc::{AfcClient, FileInfo};
 use log::{debug, error, info, warn};
 use macros::QtThreading;
 use qmetaobject::prelude::*;
 use qttypes::{QStringList, QVariantMap};
-use std::{collections::HashSet, path::Component, sync::Arc};
-use tokio::sync::Mutex;
+use std::sync::Arc;
+use std::sync::atomic::{AtomicUsize, Ordering};
+use std::time::{Duration, Instant};
+use std::{collections::HashSet, path::Component};
+use tokio::sync::mpsc;
+
+/// Entries stat'ed per lease.
+const LIST_STAT_BATCH: usize = 64;
+/// Minimum gap between two `check_is_dir_and_list_partial` signals.
+const LIST_PARTIAL_INTERVAL: Duration = Duration::from_millis(100);
 
 #[allow(non_snake_case)]
 #[derive(QObject, Default, QtThreading)]
 pub struct AfcServices {
     base: qt_base_class!(trait QObject),
-    afc: Option<Arc<Mutex<AfcClient>>>,
+    afc: Option<AfcSource>,
     udid: String,
     // file_to_buffer: qt_method!(fn(self, file_path: QString) -> QByteArray),
     // get_file_size: qt_method!(fn(self, path: QString) -> i64),
@@ -30,6 +40,12 @@ pub struct AfcServices {
         success: bool,
         entries: QVariantMap
     ),
+    /// Entries of `path` stat'ed so far, while a large listing is in flight.
+    /// Each signal only carries entries not sent before.
+    check_is_dir_and_list_partial: qt_signal!(
+        path: QString,
+        entries: QVariantMap
+    ),
     fileToBase64ImgReady: qt_signal!(file_path: QString, source: QString),
     fileToBase64ImgFailed: qt_signal!(file_path: QString, error: QString),
     file_to_base64_img: qt_method!(fn(&self, file_path: QString)),
@@ -54,7 +70,7 @@ pub struct AfcServices {
 
 impl AfcServices {
     pub fn from_afc_client(
-        afc_client: Arc<Mutex<AfcClient>>,
+        afc_client: AfcSource,
         /* udid is for debugging purposes */
         udid: String,
         //only required for hause_arrest afc
@@ -67,7 +83,7 @@ impl AfcServices {
         service
     }
 
-    fn afc_client(&self, operation: &str) -> Option<Arc<Mutex<AfcClient>>> {
+    fn afc_client(&self, operation: &str) -> Option<AfcSource> {
         let Some(afc) = self.afc.as_ref() else {
             let udid = if self.udid.is_empty() {
                 "unknown"
@@ -81,6 +97,17 @@ impl AfcServices {
         Some(afc.clone())
     }
 
+    fn cache_scope(&self) -> String {
+        match self.afc.as_ref() {
+            Some(AfcSource::Pool(pool)) => afc_metadata_cache::scope(pool.udid(), pool.kind()),
+            // Shared clients are only handed out for house-arrest containers.
+            _ => afc_metadata_cache::scope(
+                &self.udid,
+                &AfcPoolKind::HouseArrest(self.bundle_id.to_string()),
+            ),
+        }
+    }
+
     fn file_to_base64_img(&self, file_path: QString) {
         let Some(afc) = self.afc_client("load a preview image") else {
             return;
@@ -90,7 +117,7 @@ impl AfcServices {
 
         RUNTIME.spawn(async move {
             let result: anyhow::Result<QString> = async {
-                let mut afc = afc.lock().await;
+                let mut afc = afc.lease().await?;
                 let mut file = afc.open(&path, AfcFopenMode::RdOnly).await?;
                 let read_result = file.read_entire().await;
                 file.close().await.ok();
@@ -137,10 +164,11 @@ impl AfcServices {
         let qt_thread = self.qt_thread();
 
         RUNTIME.spawn(async move {
-            let result = {
-                let mut afc = afc.lock().await;
-                afc.get_file_info(&path).await
-            };
+            let result: anyhow::Result<FileInfo> = async {
+                let mut afc = afc.lease().await?;
+                Ok(afc.get_file_info(&path).await?)
+            }
+            .await;
 
             let signal_path = QString::from(path.clone());
             qt_thread.queue(move |service| match result {
@@ -164,6 +192,7 @@ impl AfcServices {
         };
         let request_id = request_id.to_string();
         let paths: Vec<String> = paths.into_iter().map(|path| path.to_string()).collect();
+        let cache_scope = self.cache_scope();
         let qt_thread = self.qt_thread();
 
         RUNTIME.spawn(async move {
@@ -171,7 +200,19 @@ impl AfcServices {
             let mut failed_items = 0_i32;
             let mut first_error = None;
             let mut seen_paths = HashSet::new();
-            let mut afc = afc.lock().await;
+            let mut afc = match afc.lease().await {
+                Ok(afc) => afc,
+                Err(err) => {
+                    warn!("AFC batch deletion could not get a session: {err}");
+                    let request_id = QString::from(request_id);
+                    let failed_items = paths.len() as i32;
+                    let first_error = QString::from(err.to_string());
+                    qt_thread.queue(move |service| {
+                        service.deletePathsFinished(request_id, 0, failed_items, first_error);
+                    });
+                    return;
+                }
+            };
 
             for path in paths {
                 if !seen_paths.insert(path.clone()) {
@@ -202,6 +243,8 @@ impl AfcServices {
                     }
                 }
                 .await;
+                // A failed recursive delete may still have removed children.
+                afc_metadata_cache::invalidate(&cache_scope, &path);
 
                 match result {
                     Ok(()) => successful_items += 1,
@@ -229,52 +272,87 @@ impl AfcServices {
     }
 
     fn check_is_dir_and_list(&self, path: QString) {
-        let Some(afc_arc) = self.afc_client("list a directory") else {
+        let Some(afc_source) = self.afc_client("list a directory") else {
             return;
         };
+        let cache_scope = self.cache_scope();
         let path_str = path.to_string();
         let qt_thread = self.qt_thread();
+
+        if let Some(listing) = afc_metadata_cache::listing(&cache_scope, &path_str) {
+            let map = entries_to_qvariant_map(listing.iter().map(|(name, is_dir)| (name, *is_dir)));
+            qt_thread.queue(move |q| {
+                q.check_is_dir_and_list_finished(true, map);
+            });
+            return;
+        }
+
         RUNTIME.spawn(async move {
-            let mut map = QVariantMap::default();
-            let mut afc = afc_arc.lock().await;
-            let success = match afc.list_dir(&path_str).await {
-                Ok(list) => {
-                    for name in list {
-                        // ui already has up/down buttons maybe unnecessary
-                        if name == "." || name == ".." {
-                            continue;
-                        }
-                        let full_path = format!("{}/{}", path_str, name);
-                        let is_dir = match afc.get_file_info(&full_path).await {
-                            Ok(info) if info.st_ifmt == "S_IFLNK" => {
-                                match afc.get_file_info_resolved(&full_path).await {
-                                    Ok(resolved) => resolved.info.st_ifmt == "S_IFDIR",
-                                    Err(e) => {
-                                        warn!(
-                                            "Failed to resolve AFC symbolic link {full_path}: {e}"
-                                        );
-                                        false
-                                    }
-                                }
-                            }
-                            Ok(info) => info.st_ifmt == "S_IFDIR",
-                            Err(e) => {
-                                warn!("Failed to get AFC file info for {full_path}: {e}");
-                                false
-                            }
-                        };
-                        map.insert(QString::from(name), QVariant::from(&is_dir));
-                    }
-                    true
-                }
+            let names = match list_dir_names(&afc_source, &path_str).await {
+                Ok(names) => names,
                 Err(e) => {
                     eprintln!("Failed to read directory {path_str}: {e}");
-                    false
+                    qt_thread.queue(move |q| {
+                        q.check_is_dir_and_list_finished(false, QVariantMap::default());
+                    });
+                    return;
+                }
+            };
+
+            // Kinds seen in an earlier listing need no stat.
+            let mut entries = Vec::with_capacity(names.len());
+            let mut unknown = Vec::new();
+            for name in names {
+                match afc_metadata_cache::kind(&cache_scope, &format!("{path_str}/{name}")) {
+                    Some(is_dir) => entries.push((name, is_dir)),
+                    None => unknown.push(name),
+                }
+            }
+
+            // A shared client serves one request at a time anyway. A pool
+            // keeps one session back so thumbnails and previews still get one.
+            let workers = match &afc_source {
+                AfcSource::Shared(_) => 1,
+                AfcSource::Pool(pool) => pool.max_sessions().saturating_sub(1).max(1),
+            };
+            let cursor = AtomicUsize::new(0);
+            let (sender, mut receiver) = mpsc::unbounded_channel();
+            let stat_workers =
+                futures::future::join_all((0..workers).map(|_| {
+                    stat_entries(&afc_source, &path_str, &unknown, &cursor, sender.clone())
+                }));
+            drop(sender);
+
+            let mut complete = true;
+            let collect = async {
+                let mut pending = entries.clone();
+                let mut last_partial: Option<Instant> = None;
+                while let Some(batch) = receiver.recv().await {
+                    for (name, is_dir) in batch {
+                        // A failed stat is shown as a file but not cached.
+                        complete &= is_dir.is_some();
+                        let is_dir = is_dir.unwrap_or(false);
+                        pending.push((name.clone(), is_dir));
+                        entries.push((name, is_dir));
+                    }
+                    if last_partial.is_none_or(|at| at.elapsed() >= LIST_PARTIAL_INTERVAL) {
+                        last_partial = Some(Instant::now());
+                        let map = entries_to_qvariant_map(pending.drain(..));
+                        let path = QString::from(path_str.as_str());
+                        qt_thread.queue(move |q| {
+                            q.check_is_dir_and_list_partial(path, map);
+                        });
+                    }
                 }
             };
+            tokio::join!(stat_workers, collect);
 
+            let map = entries_to_qvariant_map(entries.iter().map(|(name, is_dir)| (name, *is_dir)));
+            if complete {
+                afc_metadata_cache::store_listing(&cache_scope, &path_str, Arc::new(entries));
+            }
             qt_thread.queue(move |q| {
-                q.check_is_dir_and_list_finished(success, map);
+                q.check_is_dir_and_list_finished(true, map);
             });
         });
     }
@@ -343,15 +421,26 @@ impl AfcServices {
     }
 
     fn delete_path(&self, path: QString) -> bool {
-        let Some(afc_arc) = self.afc_client("delete a path") else {
+        let Some(afc_source) = self.afc_client("delete a path") else {
             return false;
         };
         let path_str = path.to_string();
+        let cache_scope = self.cache_scope();
 
         run_sync(async move {
-            let mut afc = afc_arc.lock().await;
+            let mut afc = match afc_source.lease().await {
+                Ok(afc) => afc,
+                Err(e) => {
+                    eprintln!("delete_path: delete({path_str}) failed: {e}");
+                    return false;
+                }
+            };
 
-            match afc.remove(&path_str).await {
+            let removed = afc.remove(&path_str).await;
+            // Only now, so a listing fetched meanwhile is not cached with the
+            // deleted entry for a whole TTL.
+            afc_metadata_cache::invalidate(&cache_scope, &path_str);
+            match removed {
                 Ok(_) => true,
                 Err(e) => {
                     eprintln!("delete_path: delete({path_str}) failed: {e}");
@@ -362,6 +451,84 @@ impl AfcServices {
     }
 }
 
+/// Entry names of `path`, without `.` and `..`; the UI has its own
+/// navigation buttons.
+async fn list_dir_names(afc_source: &AfcSource, path: &str) -> anyhow::Result<Vec<String>> {
+    let mut afc = afc_source.lease().await?;
+    match afc.list_dir(path).await {
+        Ok(names) => Ok(names
+            .into_iter()
+            .filter(|name| name != "." && name != "..")
+            .collect()),
+        Err(err) => {
+            afc.note_error(&err);
+            Err(err.into())
+        }
+    }
+}
+
+/// Stats batches of `names` inside `dir` until the shared cursor runs out,
+/// sending whether each is a directory, or `None` if it could not be told.
+async fn stat_entries(
+    afc_source: &AfcSource,
+    dir: &str,
+    names: &[String],
+    cursor: &AtomicUsize,
+    sender: mpsc::UnboundedSender<Vec<(String, Option<bool>)>>,
+) {
+    loop {
+        let start = cursor.fetch_add(LIST_STAT_BATCH, Ordering::Relaxed);
+        if start >= names.len() {
+            return;
+        }
+        let batch = &names[start..(start + LIST_STAT_BATCH).min(names.len())];
+
+        let mut afc = match afc_source.lease().await {
+            Ok(afc) => afc,
+            Err(e) => {
+                warn!("No AFC session to stat entries of {dir}: {e}");
+                let _ = sender.send(batch.iter().map(|name| (name.clone(), None)).collect());
+                continue;
+            }
+        };
+        let mut stats = Vec::with_capacity(batch.len());
+        for name in batch {
+            let full_path = format!("{dir}/{name}");
+            let is_dir = match afc.get_file_info(&full_path).await {
+                Ok(info) if info.st_ifmt == "S_IFLNK" => {
+                    match afc.get_file_info_resolved(&full_path).await {
+                        Ok(resolved) => Some(resolved.info.st_ifmt == "S_IFDIR"),
+                        Err(e) => {
+                            warn!("Failed to resolve AFC symbolic link {full_path}: {e}");
+                            afc.note_error(&e);
+                            None
+                        }
+                    }
+                }
+                Ok(info) => Some(info.st_ifmt == "S_IFDIR"),
+                Err(e) => {
+                    warn!("Failed to get AFC file info for {full_path}: {e}");
+                    afc.note_error(&e);
+                    None
+                }
+            };
+            stats.push((name.clone(), is_dir));
+        }
+        drop(afc);
+        if sender.send(stats).is_err() {
+            return;
+        }
+    }
+}
+
+fn entries_to_qvariant_map<S: AsRef<str>>(entries: impl Iterator<Item = (S, bool)>) -> QVariantMap {
+    let mut map = QVariantMap::default();
+    for (name, is_dir) in entries {
+        map.insert(QString::from(name.as_ref()), QVariant::from(&is_dir));
+    }
+    map
+}
+
 fn image_mime_type(path: &str) -> &'static str {
     let extension = std::path::Path::new(path)
         .extension()
@@ -1,12 +1,18 @@
 // SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
-use crate::{RUNTIME, device_ctx::get_device, qt_threading::QtThreading, qvariantmap_insert};
+use crate::ipa_tee::{self, DownloadProgress, Reconciled};
+use crate::{
+    RUNTIME, device_ctx::get_device, ipa_staging, qt_threading::QtThreading, qvariantmap_insert,
+    utils,
+};
 use anyhow::Context;
-use idevice::utils::installation::install_package_with_callback;
+use idevice::IdeviceService;
+use idevice::afc::{AfcClient, opcode::AfcFopenMode};
+use idevice::installation_proxy::InstallationProxyClient;
 use ipatool::error::IpaToolError;
 use ipatool::{DownloadArgs, IpaTool};
-use log::{debug, error, info};
+use log::{debug, error, info, warn};
 use macros::QtThreading;
 use qmetaobject::prelude::*;
 use qttypes::QVariantMap;
@@ -15,9 +21,11 @@ use std::{
     path::{Path, PathBuf},
     sync::{
         Arc,
+        atomic::AtomicBool,
         mpsc::{self, SyncSender},
     },
 };
+use tokio::sync::watch;
 use tokio::task::JoinHandle;
 
 enum AuthCodeResponse {
@@ -51,6 +59,87 @@ impl Drop for TaskDirectory {
         }
     }
 }
+/// Downloads `bundle_id` into `task_dir` and streams it to `device_path`
+/// as it arrives (see `ipa_tee`). If streaming fails or ipatool shrank the
+/// file while patching it, the finished IPA is uploaded again in full.
+async fn download_and_stage(
+    tool: &IpaTool,
+    bundle_id: String,
+    task_dir: &Path,
+    afc: &mut AfcClient,
+    device_path: &str,
+    on_download: impl Fn(f64) + Send + Sync + 'static,
+) -> anyhow::Result<()> {
+    let (progress_tx, progress_rx) = watch::channel(DownloadProgress::default());
+    let progress_tx = Arc::new(progress_tx);
+    // The sidecar is written again only once the streamed copy reconciles.
+    ipa_staging::clear_staged(afc, device_path).await;
+    let mut remote = afc
+        .open(device_path, AfcFopenMode::WrOnly)
+        .await
+        .with_context(|| format!("Failed to create {device_path} on the device"))?;
+
+    let downloading = async {
+        let callback_tx = progress_tx.clone();
+        let downloaded = tool
+            .download_with_progress(
+                DownloadArgs {
+                    bundle_id,
+                    output_path: Some(task_dir.to_string_lossy().into_owned()),
+                    external_version_id: None,
+                    acquire_license: true,
+                },
+                move |downloaded, total| {
+                    callback_tx.send_modify(|state| state.downloaded = downloaded as u64);
+                    let progress = total
+                        .filter(|total| *total > 0)
+                        .map(|total| (downloaded as f64 / total as f64) * 0.5)
+                        .unwrap_or(-1.0);
+                    on_download(progress);
+                },
+            )
+            .await;
+        progress_tx.send_modify(|state| state.finished = true);
+        downloaded
+    };
+    let (downloaded, followed) = tokio::join!(
+        downloading,
+        ipa_tee::follow(task_dir, progress_rx, &mut remote, |_| {})
+    );
+    let ipa_path = PathBuf::from(downloaded.context("Failed to download the IPA")?);
+
+    let reconciled = match followed {
+        Ok(followed) => ipa_tee::reconcile(&ipa_path, &followed, &mut remote).await,
+        Err(err) => Err(err),
+    };
+    let _ = remote.close().await;
+    let (size, digest) = match reconciled {
+        Ok(Reconciled::Staged {
+            size,
+            digest,
+            rewritten,
+        }) => {
+            debug!(
+                "Streamed IPA to {device_path}; rewrote {rewritten} of {size} bytes after download"
+            );
+            (size, digest)
+        }
+        other => {
+            if let Err(err) = other {
+                warn!("Streaming the IPA during download failed, uploading it again: {err}");
+            }
+            let local = tokio::fs::File::open(&ipa_path)
+                .await
+                .with_context(|| format!("Failed to open {}", ipa_path.display()))?;
+            ipa_staging::upload(afc, local, device_path, &AtomicBool::new(false), |_| {})
+                .await
+                .context("Failed to upload the IPA")?
+        }
+    };
+    ipa_staging::mark_staged(afc, device_path, &digest, size).await?;
+    Ok(())
+}
+
 #[allow(non_snake_case)]
 #[derive(QObject, Default, QtThreading)]
 pub struct Apps {
@@ -421,33 +510,39 @@ impl Apps {
                 let device = get_device(&udid).await?;
                 let task_dir =
                     TaskDirectory::create(&std::env::temp_dir(), &task_id_for_task).await?;
+                let device_path = ipa_staging::staging_path(&format!("{bundle_id}.ipa"));
                 let progress_qt = q_thread.clone();
                 let progress_task_id = task_id_for_task.clone();
-                let ipa_path = tool
-                    .download_with_progress(
-                        DownloadArgs {
-                            bundle_id,
-                            output_path: Some(task_dir.path.to_string_lossy().into_owned()),
-                            external_version_id: None,
-                            acquire_license: true,
-                        },
-                        move |downloaded, total| {
-                            let progress = total
-                                .filter(|total| *total > 0)
-                                .map(|total| (downloaded as f64 / total as f64) * 0.5)
-                                .unwrap_or(-1.0);
-                            let id = progress_task_id.clone();
-                            progress_qt.queue(move |apps| {
-                                apps.installAppProgress(
-                                    QString::from(id),
-                                    progress,
-                                    QString::from("download"),
-                                );
-                            });
-                        },
+                let on_download = move |progress: f64| {
+                    let id = progress_task_id.clone();
+                    progress_qt.queue(move |apps| {
+                        apps.installAppProgress(
+                            QString::from(id),
+                            progress,
+                            QString::from("download"),
+                        );
+                    });
+                };
+
+                {
+                    let mut afc = device.afc_pool.lease().await?;
+                    utils::ensure_public_staging(&mut afc)
+                        .await
+                        .context("Failed to prepare the device for the IPA upload")?;
+                    let staged = download_and_stage(
+                        &tool,
+                        bundle_id,
+                        &task_dir.path,
+                        &mut afc,
+                        &device_path,
+                        on_download,
                     )
-                    .await
-                    .context("Failed to download the IPA")?;
+                    .await;
+                    if staged.is_err() {
+                        afc.mark_broken();
+                    }
+                    staged?;
+                }
 
                 let installing_qt = q_thread.clone();
                 let installing_task_id = task_id_for_task.clone();
@@ -459,31 +554,36 @@ impl Apps {
                     );
                 });
 
-                let provider = device.provider.lock().await;
+                let mut installer = {
+                    let provider = device.provider.lock().await;
+                    InstallationProxyClient::connect(provider.as_ref())
+                        .await
+                        .context("Failed to connect to Installation Proxy")?
+                };
                 let callback_qt = q_thread.clone();
                 let callback_task_id = task_id_for_task.clone();
-                install_package_with_callback(
-                    provider.as_ref(),
-                    &ipa_path,
-                    None,
-                    move |(percentage, ())| {
-                        let qt = callback_qt.clone();
-                        let id = callback_task_id.clone();
-                        async move {
-                            let progress = 0.5 + (percentage.min(100) as f64 / 200.0);
-                            qt.queue(move |apps| {
-                                apps.installAppProgress(
-                                    QString::from(id),
-                                    progress,
-                                    QString::from("install"),
-                                );
-                            });
-                        }
-                    },
-                    (),
-                )
-                .await
-                .context("Failed to install the IPA")?;
+                installer
+                    .install_with_callback(
+                        device_path,
+                        None,
+                        move |(percentage, ())| {
+                            let qt = callback_qt.clone();
+                            let id = callback_task_id.clone();
+                            async move {
+                                let progress = 0.5 + (percentage.min(100) as f64 / 200.0);
+                                qt.queue(move |apps| {
+                                    apps.installAppProgress(
+                                        QString::from(id),
+                                        progress,
+                                        QString::from("install"),
+                                    );
+                                });
+                            }
+                        },
+                        (),
+                    )
+                    .await
+                    .context("Failed to install the IPA")?;
 
                 Ok(())
             }
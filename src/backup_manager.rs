@@ -4,6 +4,7 @@
 use crate::{
     RUNTIME,
     list_model::ListModel,
+    progress_bus::ProgressJob,
     qt_threading::{QtThread, QtThreading},
     qvariantmap_insert,
 };
@@ -37,6 +38,7 @@ use std::{
     io::{Read, Write},
     path::{Path, PathBuf},
     pin::Pin,
+    sync::Arc,
     time::{Duration, SystemTime},
 };
 use tokio::task::JoinHandle;
@@ -595,7 +597,7 @@ struct iDescriptorBackupDelegate {
     #[allow(dead_code)]
     root: String,
     udid: QString,
-    // start_time: Arc<Mutex<Option<Instant>>>,
+    progress: Arc<ProgressJob>,
 }
 
 impl iDescriptorBackupDelegate {
@@ -605,13 +607,22 @@ impl iDescriptorBackupDelegate {
         root: String,
         udid: QString,
     ) -> Self {
+        let progress_thread = qt_thread.clone();
+        let progress_udid = udid.clone();
+        let progress = ProgressJob::new(operation, move |snapshot| {
+            let udid = progress_udid.clone();
+            let progress = snapshot.fraction();
+            progress_thread.queue(move |manager| {
+                manager.progressUpdate(udid, progress);
+            });
+        });
         Self {
             fs: FsBackupDelegate,
             qt_thread,
             operation,
             root,
             udid,
-            // start_time: Arc::new(Mutex::new(None)),
+            progress: Arc::new(progress),
         }
     }
 }
@@ -692,34 +703,14 @@ impl BackupDelegate for iDescriptorBackupDelegate {
     }
 
     fn on_progress(&self, bytes_done: u64, bytes_total: u64, overall_progress: f64) {
-        // let _elapsed = {
-        //     let mut start = self.start_time.lock().unwrap();
-        //     let start = start.get_or_insert_with(Instant::now);
-        //     start.elapsed()
-        // };
-
-        let progress = if bytes_total > 0 {
-            bytes_done as f64 / bytes_total as f64
-        } else if overall_progress >= 0.0 {
-            overall_progress / 100.0
+        // Without a byte count only the percentage is known; report it in
+        // basis points so the bus still sees a done/total pair.
+        if bytes_total > 0 {
+            self.progress.report("", bytes_done, bytes_total);
         } else {
-            0.0
+            let percent = overall_progress.clamp(0.0, 100.0);
+            self.progress.report("", (percent * 100.0) as u64, 10_000);
         }
-        .clamp(0.0, 1.0);
-
-        // FIXME: It's way too inaccurate
-        // let time_remaining = if progress > 0.0 && progress < 1.0 {
-        //     let total = Duration::from_secs_f64(elapsed.as_secs_f64() / progress);
-        //     Self::translated_time_remaining(total.saturating_sub(elapsed).as_secs())
-        // } else {
-        //     QString::default()
-        // };
-
-        let udid = self.udid.clone();
-        self.qt_thread.queue(move |manager| {
-            debug!("Progress: {}", progress);
-            manager.progressUpdate(udid, progress);
-        });
     }
 }
 
@@ -0,0 +1,294 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Recycled byte buffers for AFC reads in the image pipeline.
+//!
+//! Buffers are bucketed into power-of-two size classes and go back to their
+//! class when the `PooledBuffer` is dropped, so a gallery scroll reuses a
+//! handful of allocations instead of allocating one per thumbnail.
+
+use once_cell::sync::Lazy;
+use std::ops::{Deref, DerefMut};
+use std::sync::Mutex;
+use std::sync::atomic::{AtomicU64, AtomicUsize, Ordering};
+
+const MIN_CLASS_SHIFT: u32 = 16; // 64 KiB
+const MAX_CLASS_SHIFT: u32 = 26; // 64 MiB
+const CLASS_COUNT: usize = (MAX_CLASS_SHIFT - MIN_CLASS_SHIFT + 1) as usize;
+const MAX_BUFFERS_PER_CLASS: usize = 16;
+const MAX_RETAINED_BYTES: usize = 96 * 1024 * 1024;
+
+static POOL: Lazy<BufferPool> = Lazy::new(BufferPool::new);
+
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct BufferPoolStats {
+    pub allocations: u64,
+    pub reuses: u64,
+    pub released: u64,
+    pub retained_bytes: usize,
+}
+
+pub struct BufferPool {
+    classes: Vec<Mutex<Vec<Vec<u8>>>>,
+    retained_bytes: AtomicUsize,
+    allocations: AtomicU64,
+    reuses: AtomicU64,
+    released: AtomicU64,
+}
+
+/// A buffer whose visible length can be anywhere up to its size class. The
+/// backing storage is always initialized, so reads can target it directly.
+pub struct PooledBuffer {
+    storage: Vec<u8>,
+    len: usize,
+    pool: &'static BufferPool,
+}
+
+/// Takes a zero-or-stale-filled buffer of exactly `len` visible bytes from the
+/// global pool.
+pub fn take(len: usize) -> PooledBuffer {
+    POOL.take(len)
+}
+
+pub fn stats() -> BufferPoolStats {
+    POOL.stats()
+}
+
+fn class_index(len: usize) -> Option<usize> {
+    let shift = len
+        .max(1 << MIN_CLASS_SHIFT)
+        .checked_next_power_of_two()?
+        .trailing_zeros();
+    (shift <= MAX_CLASS_SHIFT).then(|| (shift - MIN_CLASS_SHIFT) as usize)
+}
+
+fn class_size(index: usize) -> usize {
+    1 << (MIN_CLASS_SHIFT as usize + index)
+}
+
+impl BufferPool {
+    fn new() -> Self {
+        Self {
+            classes: (0..CLASS_COUNT).map(|_| Mutex::new(Vec::new())).collect(),
+            retained_bytes: AtomicUsize::new(0),
+            allocations: AtomicU64::new(0),
+            reuses: AtomicU64::new(0),
+            released: AtomicU64::new(0),
+        }
+    }
+
+    fn take(&'static self, len: usize) -> PooledBuffer {
+        let storage = match class_index(len) {
+            Some(index) => {
+                let reused = self.classes[index]
+                    .lock()
+                    .expect("buffer pool mutex poisoned")
+                    .pop();
+                match reused {
+                    Some(storage) => {
+                        self.retained_bytes
+                            .fetch_sub(storage.len(), Ordering::Relaxed);
+                        self.reuses.fetch_add(1, Ordering::Relaxed);
+                        storage
+                    }
+                    None => {
+                        self.allocations.fetch_add(1, Ordering::Relaxed);
+                        vec![0u8; class_size(index)]
+                    }
+                }
+            }
+            // Oversized requests are served but never retained.
+            None => {
+                self.allocations.fetch_add(1, Ordering::Relaxed);
+                vec![0u8; len]
+            }
+        };
+
+        PooledBuffer {
+            storage,
+            len,
+            pool: self,
+        }
+    }
+
+    fn give_back(&self, storage: Vec<u8>) {
+        if storage.is_empty() {
+            return;
+        }
+
+        let Some(index) =
+            class_index(storage.len()).filter(|index| class_size(*index) == storage.len())
+        else {
+            self.released.fetch_add(1, Ordering::Relaxed);
+            return;
+        };
+
+        let size = storage.len();
+        if self.retained_bytes.fetch_add(size, Ordering::Relaxed) + size > MAX_RETAINED_BYTES {
+            self.retained_bytes.fetch_sub(size, Ordering::Relaxed);
+            self.released.fetch_add(1, Ordering::Relaxed);
+            return;
+        }
+
+        let mut class = self.classes[index]
+            .lock()
+            .expect("buffer pool mutex poisoned");
+        if class.len() >= MAX_BUFFERS_PER_CLASS {
+            drop(class);
+            self.retained_bytes.fetch_sub(size, Ordering::Relaxed);
+            self.released.fetch_add(1, Ordering::Relaxed);
+            return;
+        }
+        class.push(storage);
+    }
+
+    fn stats(&self) -> BufferPoolStats {
+        BufferPoolStats {
+            allocations: self.allocations.load(Ordering::Relaxed),
+            reuses: self.reuses.load(Ordering::Relaxed),
+            released: self.released.load(Ordering::Relaxed),
+            retained_bytes: self.retained_bytes.load(Ordering::Relaxed),
+        }
+    }
+}
+
+impl PooledBuffer {
+    /// A zero-length buffer that never touches the pool, for error paths.
+    pub fn empty() -> Self {
+        Self {
+            storage: Vec::new(),
+            len: 0,
+            pool: &POOL,
+        }
+    }
+
+    pub fn truncate(&mut self, len: usize) {
+        self.len = self.len.min(len);
+    }
+
+    /// Extends the visible length to `len`, moving the contents into a larger
+    /// size class when the current one is too small.
+    pub fn grow_to(&mut self, len: usize) {
+        if len <= self.storage.len() {
+            self.len = self.len.max(len);
+            return;
+        }
+
+        let mut larger = self.pool.take(len);
+        larger.storage[..self.len].copy_from_slice(&self.storage[..self.len]);
+        std::mem::swap(&mut self.storage, &mut larger.storage);
+        self.len = len;
+    }
+}
+
+impl Deref for PooledBuffer {
+    type Target = [u8];
+
+    fn deref(&self) -> &[u8] {
+        &self.storage[..self.len]
+    }
+}
+
+impl DerefMut for PooledBuffer {
+    fn deref_mut(&mut self) -> &mut [u8] {
+        &mut self.storage[..self.len]
+    }
+}
+
+impl Drop for PooledBuffer {
+    fn drop(&mut self) {
+        self.pool.give_back(std::mem::take(&mut self.storage));
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::time::Instant;
+
+    fn leaked_pool() -> &'static BufferPool {
+        Box::leak(Box::new(BufferPool::new()))
+    }
+
+    #[test]
+    fn rounds_requests_up_to_size_classes() {
+        assert_eq!(class_index(0), Some(0));
+        assert_eq!(class_index(64 * 1024), Some(0));
+        assert_eq!(class_index(64 * 1024 + 1), Some(1));
+        assert_eq!(class_index(3 * 1024 * 1024), Some(6));
+        assert_eq!(class_size(6), 4 * 1024 * 1024);
+        assert_eq!(class_index(64 * 1024 * 1024 + 1), None);
+    }
+
+    #[test]
+    fn repeated_reads_reuse_one_allocation() {
+        let pool = leaked_pool();
+        for round in 0..1_000 {
+            let mut buf = pool.take(300_000 + round);
+            buf[0] = round as u8;
+            assert_eq!(buf.len(), 300_000 + round);
+        }
+
+        let stats = pool.stats();
+        assert_eq!(stats.allocations, 1);
+        assert_eq!(stats.reuses, 999);
+    }
+
+    #[test]
+    fn grow_preserves_contents_and_recycles_the_old_class() {
+        let pool = leaked_pool();
+        let mut buf = pool.take(4);
+        buf.copy_from_slice(b"heic");
+        buf.grow_to(100_000);
+
+        assert_eq!(&buf[..4], b"heic");
+        assert_eq!(buf.len(), 100_000);
+        buf.truncate(10);
+        assert_eq!(buf.len(), 10);
+        drop(buf);
+
+        let stats = pool.stats();
+        assert_eq!(stats.allocations, 2);
+        assert_eq!(stats.retained_bytes, 64 * 1024 + 128 * 1024);
+    }
+
+    #[test]
+    fn oversized_buffers_are_not_retained() {
+        let pool = leaked_pool();
+        drop(pool.take(65 * 1024 * 1024));
+
+        let stats = pool.stats();
+        assert_eq!(stats.released, 1);
+        assert_eq!(stats.retained_bytes, 0);
+    }
+
+    #[test]
+    #[ignore = "benchmark; run with --ignored --nocapture"]
+    fn bench_pooled_vs_fresh_allocations() {
+        const ROUNDS: usize = 20_000;
+        const LEN: usize = 2 * 1024 * 1024;
+
+        let started = Instant::now();
+        for round in 0..ROUNDS {
+            let mut buf = vec![0u8; LEN];
+            buf[round % LEN] = 1;
+            std::hint::black_box(&buf);
+        }
+        let fresh = started.elapsed();
+
+        let pool = leaked_pool();
+        let started = Instant::now();
+        for round in 0..ROUNDS {
+            let mut buf = pool.take(LEN);
+            buf[round % LEN] = 1;
+            std::hint::black_box(&buf);
+        }
+        let pooled = started.elapsed();
+
+        println!(
+            "fresh: {ROUNDS} allocations in {fresh:?}; pooled: {} allocations in {pooled:?}",
+            pool.stats().allocations
+        );
+        assert_eq!(pool.stats().allocations, 1);
+    }
+}
@@ -0,0 +1,353 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Content-hash index of an export destination, so exporting the same photo
+//! from several devices into one archive keeps a single copy.
+//!
+//! The index lives in the archive folder as `.idescriptor-content.index` and
+//! covers every export into that folder or below it. Each line records one
+//! file the app wrote there:
+//!
+//! ```text
+//! size mtime-ns head-sha256 full-sha256 relative/path
+//! ```
+//!
+//! The head hash covers the first `HEAD_BYTES`, which one device read can
+//! check before anything is copied; the full hash is computed while the
+//! export writes. A device file matches when its size and head hash do and
+//! every indexed file with that key has the same full hash. An indexed file
+//! is only linked to while its size and modified time are still the ones
+//! recorded, so a copy edited in place since is never reused. Lines are only
+//! appended; a later line for a path replaces an earlier one.
+
+use crate::transfer_pipeline::ChunkObserver;
+use sha2::{Digest as _, Sha256};
+use std::collections::{HashMap, HashSet};
+use std::fs::{File, Metadata, OpenOptions};
+use std::io::{self, Read, Write};
+use std::path::{Path, PathBuf};
+use std::sync::Mutex;
+use std::time::UNIX_EPOCH;
+
+pub const INDEX_FILE_NAME: &str = ".idescriptor-content.index";
+/// Bytes covered by the head hash; small enough for a single AFC read.
+pub const HEAD_BYTES: usize = 64 * 1024;
+const HASH_CHUNK: usize = 1024 * 1024;
+
+pub type Digest = [u8; 32];
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct ContentDigest {
+    pub head: Digest,
+    pub full: Digest,
+}
+
+pub struct ContentIndex {
+    root: PathBuf,
+    state: Mutex<IndexState>,
+}
+
+/// An indexed file as it was on disk when recorded.
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+struct IndexedFile {
+    size: u64,
+    mtime_ns: i64,
+    digest: ContentDigest,
+}
+
+#[derive(Default)]
+struct IndexState {
+    files: HashMap<String, IndexedFile>,
+    /// Indexed paths by size and head hash.
+    keys: HashMap<(u64, Digest), Vec<String>>,
+    sizes: HashSet<u64>,
+    log: Option<File>,
+}
+
+impl IndexState {
+    fn insert(&mut self, path: String, file: IndexedFile) {
+        if let Some(old) = self.files.insert(path.clone(), file) {
+            if let Some(paths) = self.keys.get_mut(&(old.size, old.digest.head)) {
+                paths.retain(|candidate| *candidate != path);
+            }
+        }
+        self.keys
+            .entry((file.size, file.digest.head))
+            .or_default()
+            .push(path);
+        self.sizes.insert(file.size);
+    }
+}
+
+impl ContentIndex {
+    /// Opens the index of the nearest folder at or above `destination` that
+    /// has one, or starts a new one in `destination`.
+    pub fn open(destination: &Path) -> io::Result<Self> {
+        let root = destination
+            .ancestors()
+            .find(|dir| dir.join(INDEX_FILE_NAME).is_file())
+            .unwrap_or(destination)
+            .to_path_buf();
+        std::fs::create_dir_all(&root)?;
+
+        let path = root.join(INDEX_FILE_NAME);
+        let mut state = IndexState::default();
+        match std::fs::read_to_string(&path) {
+            Ok(contents) => {
+                for (path, file) in contents.lines().filter_map(parse_line) {
+                    state.insert(path, file);
+                }
+            }
+            Err(err) if err.kind() == io::ErrorKind::NotFound => {}
+            Err(err) => return Err(err),
+        }
+        state.log = Some(OpenOptions::new().create(true).append(true).open(&path)?);
+        Ok(Self {
+            root,
+            state: Mutex::new(state),
+        })
+    }
+
+    pub fn root(&self) -> &Path {
+        &self.root
+    }
+
+    fn lock(&self) -> io::Result<std::sync::MutexGuard<'_, IndexState>> {
+        self.state
+            .lock()
+            .map_err(|_| io::Error::other("Content index is poisoned"))
+    }
+
+    /// Whether any indexed file has `size` bytes, before paying for a head
+    /// read.
+    pub fn has_size(&self, size: u64) -> bool {
+        size > 0 && self.lock().is_ok_and(|state| state.sizes.contains(&size))
+    }
+
+    /// An indexed file with this size and head hash that is still on disk as
+    /// recorded, as long as every such file has the same content.
+    pub fn find(&self, size: u64, head: &Digest) -> Option<(PathBuf, ContentDigest)> {
+        let state = self.lock().ok()?;
+        let paths = state.keys.get(&(size, *head))?;
+        let digest = state.files.get(paths.first()?)?.digest;
+        if paths.iter().any(|path| {
+            state
+                .files
+                .get(path)
+                .is_none_or(|other| other.digest != digest)
+        }) {
+            return None;
+        }
+        paths
+            .iter()
+            .filter_map(|path| {
+                let recorded = state.files.get(path)?;
+                let metadata = std::fs::metadata(self.root.join(path)).ok()?;
+                (metadata.len() == recorded.size
+                    && modified_ns(&metadata) == Some(recorded.mtime_ns))
+                .then(|| self.root.join(path))
+            })
+            .next()
+            .map(|path| (path, digest))
+    }
+
+    /// Adds a file written under the index root, as it is on disk now (call
+    /// once its modified time is final).
+    pub fn record(&self, local_path: &Path, digest: ContentDigest) -> io::Result<()> {
+        let Some(path) = relative_key(&self.root, local_path) else {
+            return Ok(());
+        };
+        let metadata = std::fs::metadata(local_path)?;
+        let Some(mtime_ns) = modified_ns(&metadata) else {
+            return Ok(());
+        };
+        let file = IndexedFile {
+            size: metadata.len(),
+            mtime_ns,
+            digest,
+        };
+        if file.size == 0 {
+            return Ok(());
+        }
+        let mut state = self.lock()?;
+        if state.files.get(&path) == Some(&file) {
+            return Ok(());
+        }
+        let line = format!(
+            "{} {mtime_ns} {} {} {path}\n",
+            file.size,
+            hex::encode(digest.head),
+            hex::encode(digest.full)
+        );
+        if let Some(log) = state.log.as_mut() {
+            log.write_all(line.as_bytes())?;
+        }
+        state.insert(path, file);
+        Ok(())
+    }
+}
+
+fn relative_key(root: &Path, local_path: &Path) -> Option<String> {
+    let relative = local_path.strip_prefix(root).ok()?;
+    let parts: Option<Vec<&str>> = relative.iter().map(|part| part.to_str()).collect();
+    let key = parts?.join("/");
+    (!key.is_empty() && !key.contains('\n')).then_some(key)
+}
+
+/// Modified time in nanoseconds since the epoch, for files after 1970.
+fn modified_ns(metadata: &Metadata) -> Option<i64> {
+    let since_epoch = metadata.modified().ok()?.duration_since(UNIX_EPOCH).ok()?;
+    i64::try_from(since_epoch.as_nanos()).ok()
+}
+
+fn parse_line(line: &str) -> Option<(String, IndexedFile)> {
+    let mut fields = line.splitn(5, ' ');
+    let size = fields.next()?.parse().ok()?;
+    let mtime_ns = fields.next()?.parse().ok()?;
+    let head = parse_digest(fields.next()?)?;
+    let full = parse_digest(fields.next()?)?;
+    let path = fields.next().filter(|path| !path.is_empty())?;
+    Some((
+        path.to_string(),
+        IndexedFile {
+            size,
+            mtime_ns,
+            digest: ContentDigest { head, full },
+        },
+    ))
+}
+
+fn parse_digest(text: &str) -> Option<Digest> {
+    hex::decode(text).ok()?.try_into().ok()
+}
+
+/// Hashes a stream chunk by chunk, in the order it is written.
+#[derive(Default)]
+pub struct StreamHasher {
+    head: Sha256,
+    full: Sha256,
+    seen: usize,
+}
+
+impl StreamHasher {
+    pub fn update(&mut self, bytes: &[u8]) {
+        let head = HEAD_BYTES.saturating_sub(self.seen).min(bytes.len());
+        self.head.update(&bytes[..head]);
+        self.full.update(bytes);
+        self.seen = self.seen.saturating_add(bytes.len());
+    }
+
+    pub fn finish(self) -> ContentDigest {
+        ContentDigest {
+            head: self.head.finalize().into(),
+            full: self.full.finalize().into(),
+        }
+    }
+}
+
+impl ChunkObserver for StreamHasher {
+    fn observe(&mut self, chunk: &[u8]) {
+        self.update(chunk);
+    }
+}
+
+/// Hash of the first `HEAD_BYTES` of a file, given at least that many bytes
+/// (or the whole file).
+pub fn head_digest(bytes: &[u8]) -> Digest {
+    Sha256::digest(&bytes[..bytes.len().min(HEAD_BYTES)]).into()
+}
+
+/// Hashes a local file, for files that were not written in one stream.
+/// Blocking.
+pub fn hash_file(path: &Path) -> io::Result<ContentDigest> {
+    let mut file = File::open(path)?;
+    let mut hasher = StreamHasher::default();
+    let mut buffer = vec![0; HASH_CHUNK];
+    loop {
+        let read = file.read(&mut buffer)?;
+        if read == 0 {
+            return Ok(hasher.finish());
+        }
+        hasher.update(&buffer[..read]);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn temp_root() -> PathBuf {
+        std::env::temp_dir().join(format!("idescriptor-content-{}", uuid::Uuid::new_v4()))
+    }
+
+    fn payload(len: usize, seed: u8) -> Vec<u8> {
+        (0..len).map(|index| (index % 251) as u8 ^ seed).collect()
+    }
+
+    fn hash(bytes: &[u8]) -> ContentDigest {
+        let mut hasher = StreamHasher::default();
+        for chunk in bytes.chunks(10_000) {
+            hasher.update(chunk);
+        }
+        hasher.finish()
+    }
+
+    #[test]
+    fn streamed_hash_matches_file_hash_and_head() {
+        let root = temp_root();
+        std::fs::create_dir_all(&root).expect("temp dir");
+        let bytes = payload(3 * HEAD_BYTES + 17, 0);
+        let path = root.join("IMG_0001.HEIC");
+        std::fs::write(&path, &bytes).expect("written");
+
+        let digest = hash(&bytes);
+        assert_eq!(hash_file(&path).expect("hashed"), digest);
+        assert_eq!(digest.head, head_digest(&bytes));
+        assert_eq!(digest.head, head_digest(&bytes[..HEAD_BYTES]));
+        let _ = std::fs::remove_dir_all(&root);
+    }
+
+    #[test]
+    fn finds_files_recorded_under_an_ancestor_index() {
+        let root = temp_root();
+        let first = root.join("iPhone");
+        std::fs::create_dir_all(&first).expect("temp dir");
+        let bytes = payload(HEAD_BYTES + 100, 1);
+        let path = first.join("IMG_0001.HEIC");
+        std::fs::write(&path, &bytes).expect("written");
+        let digest = hash(&bytes);
+        {
+            let index = ContentIndex::open(&root).expect("opened");
+            index.record(&path, digest).expect("recorded");
+        }
+
+        let index = ContentIndex::open(&root.join("iPad")).expect("reopened");
+        assert_eq!(index.root(), root);
+        let size = bytes.len() as u64;
+        assert!(index.has_size(size));
+        assert_eq!(index.find(size, &digest.head), Some((path.clone(), digest)));
+        assert_eq!(index.find(size, &head_digest(&payload(100, 2))), None);
+
+        // Same head, different content: the head alone cannot pick a copy.
+        let mut other = bytes.clone();
+        *other.last_mut().expect("not empty") ^= 0xff;
+        let other_path = first.join("IMG_0002.HEIC");
+        std::fs::write(&other_path, &other).expect("written");
+        index.record(&other_path, hash(&other)).expect("recorded");
+        assert_eq!(index.find(size, &digest.head), None);
+
+        std::fs::write(&other_path, &bytes).expect("rewritten");
+        index.record(&other_path, digest).expect("re-recorded");
+        assert_eq!(index.find(size, &digest.head), Some((path.clone(), digest)));
+
+        // A copy changed since it was recorded, even at the same size, is
+        // not linked to.
+        File::options()
+            .write(true)
+            .open(&path)
+            .and_then(|file| file.set_modified(UNIX_EPOCH + std::time::Duration::from_secs(1)))
+            .expect("touched");
+        assert_eq!(index.find(size, &digest.head), Some((other_path, digest)));
+        let _ = std::fs::remove_dir_all(&root);
+    }
+}
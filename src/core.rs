@@ -27,6 +27,7 @@ use tokio::sync::Mutex;
 use tokio::sync::oneshot;
 use tokio::task::JoinHandle;
 
+use crate::afc_pool::{AFC_POOL_MAX_SESSIONS, AFC2_POOL_MAX_SESSIONS, AfcPool, AfcPoolKind};
 use crate::device_ctx::{
     DeviceServices, InsertDeviceResult, clean_device_from_app_state_if_current, iOSVersion,
     insert_device,
@@ -1120,14 +1121,33 @@ async fn init_idescriptor_device<
         (None, None)
     };
 
+    let provider: Arc<Mutex<Box<dyn idevice::provider::IdeviceProvider>>> =
+        Arc::new(Mutex::new(Box::new(provider)));
+    let afc_pool = AfcPool::new(
+        udid.clone(),
+        AfcPoolKind::Standard,
+        provider.clone(),
+        AFC_POOL_MAX_SESSIONS,
+    );
+    let afc2_pool = afc2.as_ref().map(|_| {
+        AfcPool::new(
+            udid.clone(),
+            AfcPoolKind::Afc2,
+            provider.clone(),
+            AFC2_POOL_MAX_SESSIONS,
+        )
+    });
+
     let device_services = DeviceServices {
         connection_id,
         afc: Arc::new(Mutex::new(afc_client)),
         afc2,
+        afc_pool,
+        afc2_pool,
         diag: Arc::new(Mutex::new(diag_relay)),
         heartbeat_task,
         video_streams: Arc::new(Mutex::new(HashMap::new())),
-        provider: Arc::new(Mutex::new(Box::new(provider))),
+        provider,
         lockdown: Arc::new(Mutex::new(lc)),
         ios_version: iOSVersion::from_str(&ios_version),
     };
@@ -0,0 +1,379 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! CPU-only worker pool for thumbnail and image decoding.
+//!
+//! Decodes used to share tokio's blocking pool with `block_in_place` SQLite
+//! queries, `run_sync` AFC bridges and backup I/O, so a slow device could
+//! starve the decoder. This pool owns one thread per core and never runs I/O
+//! bound work. Each worker has its own deque: the owner pops the newest task
+//! (so the rows the user is looking at right now decode first) and idle
+//! workers steal the oldest task from their neighbours.
+
+use ::log::{debug, error};
+use once_cell::sync::Lazy;
+use std::cell::Cell;
+use std::collections::VecDeque;
+use std::panic::{AssertUnwindSafe, catch_unwind};
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::sync::{Arc, Condvar, Mutex};
+use std::thread;
+use std::time::{Duration, Instant};
+use tokio::sync::oneshot;
+
+const MAX_WORKERS: usize = 16;
+const IDLE_WAIT: Duration = Duration::from_millis(500);
+const STATS_LOG_INTERVAL: u64 = 500;
+
+static POOL: Lazy<DecodePool> = Lazy::new(|| DecodePool::new(default_worker_count()));
+
+thread_local! {
+    static WORKER_INDEX: Cell<Option<usize>> = const { Cell::new(None) };
+}
+
+type Job = Box<dyn FnOnce() + Send + 'static>;
+
+struct Task {
+    job: Job,
+    queued_at: Instant,
+}
+
+#[derive(Default)]
+struct Counters {
+    submitted: AtomicU64,
+    completed: AtomicU64,
+    stolen: AtomicU64,
+    panicked: AtomicU64,
+    total_wait_us: AtomicU64,
+    max_wait_us: AtomicU64,
+}
+
+struct Shared {
+    queues: Vec<Mutex<VecDeque<Task>>>,
+    pending: AtomicUsize,
+    next_queue: AtomicUsize,
+    shutdown: AtomicBool,
+    sleep_lock: Mutex<()>,
+    wake: Condvar,
+    counters: Counters,
+}
+
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct DecodePoolStats {
+    pub workers: usize,
+    pub queue_depth: usize,
+    pub submitted: u64,
+    pub completed: u64,
+    pub stolen: u64,
+    pub panicked: u64,
+    pub average_wait: Duration,
+    pub max_wait: Duration,
+}
+
+pub struct DecodePool {
+    shared: Arc<Shared>,
+}
+
+/// Runs `decode` on the shared decode pool and waits for the result.
+/// Returns `None` if the task panicked.
+pub async fn run<F, T>(decode: F) -> Option<T>
+where
+    F: FnOnce() -> T + Send + 'static,
+    T: Send + 'static,
+{
+    POOL.submit(decode).await.ok()
+}
+
+pub fn stats() -> DecodePoolStats {
+    POOL.stats()
+}
+
+fn default_worker_count() -> usize {
+    // std only exposes logical CPUs; leave one for the Qt and tokio threads
+    // on machines large enough to spare it.
+    let logical = thread::available_parallelism()
+        .map(|count| count.get())
+        .unwrap_or(4);
+    let workers = if logical > 4 { logical - 1 } else { logical };
+    workers.clamp(1, MAX_WORKERS)
+}
+
+impl DecodePool {
+    pub fn new(workers: usize) -> Self {
+        let workers = workers.max(1);
+        let shared = Arc::new(Shared {
+            queues: (0..workers).map(|_| Mutex::new(VecDeque::new())).collect(),
+            pending: AtomicUsize::new(0),
+            next_queue: AtomicUsize::new(0),
+            shutdown: AtomicBool::new(false),
+            sleep_lock: Mutex::new(()),
+            wake: Condvar::new(),
+            counters: Counters::default(),
+        });
+
+        for index in 0..workers {
+            let worker_shared = Arc::clone(&shared);
+            if let Err(err) = thread::Builder::new()
+                .name(format!("decode-{index}"))
+                .spawn(move || worker_loop(worker_shared, index))
+            {
+                // The remaining workers steal from this queue, so a missing
+                // thread only costs throughput.
+                error!("decode_pool: failed to spawn worker {index}: {err}");
+            }
+        }
+
+        Self { shared }
+    }
+
+    /// Queues `decode` and returns a receiver for its result. The receiver
+    /// errors if the task panicked.
+    pub fn submit<F, T>(&self, decode: F) -> oneshot::Receiver<T>
+    where
+        F: FnOnce() -> T + Send + 'static,
+        T: Send + 'static,
+    {
+        let (tx, rx) = oneshot::channel();
+        let job: Job = Box::new(move || {
+            let _ = tx.send(decode());
+        });
+
+        // Work submitted from a worker stays local; everything else is spread
+        // round-robin so each owner's LIFO pop sees recent requests.
+        let shared = &self.shared;
+        let queue = WORKER_INDEX
+            .with(|index| index.get())
+            .filter(|index| *index < shared.queues.len())
+            .unwrap_or_else(|| {
+                shared.next_queue.fetch_add(1, Ordering::Relaxed) % shared.queues.len()
+            });
+
+        shared.queues[queue]
+            .lock()
+            .expect("decode queue mutex poisoned")
+            .push_back(Task {
+                job,
+                queued_at: Instant::now(),
+            });
+        shared.pending.fetch_add(1, Ordering::SeqCst);
+        shared.counters.submitted.fetch_add(1, Ordering::Relaxed);
+
+        let _guard = shared
+            .sleep_lock
+            .lock()
+            .expect("decode sleep mutex poisoned");
+        shared.wake.notify_one();
+
+        rx
+    }
+
+    pub fn stats(&self) -> DecodePoolStats {
+        self.shared.stats()
+    }
+}
+
+impl Drop for DecodePool {
+    fn drop(&mut self) {
+        self.shared.shutdown.store(true, Ordering::SeqCst);
+        let _guard = self
+            .shared
+            .sleep_lock
+            .lock()
+            .expect("decode sleep mutex poisoned");
+        self.shared.wake.notify_all();
+    }
+}
+
+impl Shared {
+    fn find_task(&self, index: usize) -> Option<(Task, bool)> {
+        if let Some(task) = self.queues[index]
+            .lock()
+            .expect("decode queue mutex poisoned")
+            .pop_back()
+        {
+            return Some((task, false));
+        }
+
+        let count = self.queues.len();
+        (1..count).find_map(|offset| {
+            self.queues[(index + offset) % count]
+                .lock()
+                .expect("decode queue mutex poisoned")
+                .pop_front()
+                .map(|task| (task, true))
+        })
+    }
+
+    fn record_start(&self, task: &Task, stolen: bool) {
+        let wait_us = task.queued_at.elapsed().as_micros().min(u64::MAX as u128) as u64;
+        self.counters
+            .total_wait_us
+            .fetch_add(wait_us, Ordering::Relaxed);
+        self.counters
+            .max_wait_us
+            .fetch_max(wait_us, Ordering::Relaxed);
+        if stolen {
+            self.counters.stolen.fetch_add(1, Ordering::Relaxed);
+        }
+    }
+
+    fn stats(&self) -> DecodePoolStats {
+        let completed = self.counters.completed.load(Ordering::Relaxed);
+        let started = completed + self.counters.panicked.load(Ordering::Relaxed);
+        let total_wait_us = self.counters.total_wait_us.load(Ordering::Relaxed);
+        DecodePoolStats {
+            workers: self.queues.len(),
+            queue_depth: self.pending.load(Ordering::SeqCst),
+            submitted: self.counters.submitted.load(Ordering::Relaxed),
+            completed,
+            stolen: self.counters.stolen.load(Ordering::Relaxed),
+            panicked: self.counters.panicked.load(Ordering::Relaxed),
+            average_wait: Duration::from_micros(total_wait_us.checked_div(started).unwrap_or(0)),
+            max_wait: Duration::from_micros(self.counters.max_wait_us.load(Ordering::Relaxed)),
+        }
+    }
+}
+
+fn worker_loop(shared: Arc<Shared>, index: usize) {
+    WORKER_INDEX.with(|cell| cell.set(Some(index)));
+
+    loop {
+        let Some((task, stolen)) = shared.find_task(index) else {
+            let guard = shared
+                .sleep_lock
+                .lock()
+                .expect("decode sleep mutex poisoned");
+            if shared.shutdown.load(Ordering::SeqCst) {
+                return;
+            }
+            if shared.pending.load(Ordering::SeqCst) == 0 {
+                // The timeout only guards against a wakeup that went to a
+                // worker which then lost the race for the task.
+                let _ = shared.wake.wait_timeout(guard, IDLE_WAIT);
+            }
+            continue;
+        };
+
+        shared.pending.fetch_sub(1, Ordering::SeqCst);
+        shared.record_start(&task, stolen);
+
+        if catch_unwind(AssertUnwindSafe(task.job)).is_err() {
+            shared.counters.panicked.fetch_add(1, Ordering::Relaxed);
+            error!("decode_pool: decode task panicked on worker {index}");
+            continue;
+        }
+
+        let completed = shared.counters.completed.fetch_add(1, Ordering::Relaxed) + 1;
+        if completed % STATS_LOG_INTERVAL == 0 {
+            let stats = shared.stats();
+            debug!(
+                "decode_pool: workers={} queue_depth={} completed={} stolen={} panicked={} avg_wait_ms={:.2} max_wait_ms={:.2}",
+                stats.workers,
+                stats.queue_depth,
+                stats.completed,
+                stats.stolen,
+                stats.panicked,
+                stats.average_wait.as_secs_f64() * 1000.0,
+                stats.max_wait.as_secs_f64() * 1000.0,
+            );
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::sync::mpsc;
+
+    #[tokio::test]
+    async fn returns_results_and_updates_stats() {
+        let pool = DecodePool::new(2);
+        let results =
+            futures::future::join_all((0..32).map(|value| pool.submit(move || value * 2)))
+                .await
+                .into_iter()
+                .map(|result| result.expect("task completed"))
+                .sum::<i32>();
+
+        assert_eq!(results, (0..32).map(|value| value * 2).sum::<i32>());
+        let stats = pool.stats();
+        assert_eq!(stats.submitted, 32);
+        assert_eq!(stats.completed, 32);
+        assert_eq!(stats.queue_depth, 0);
+    }
+
+    #[test]
+    fn owner_runs_newest_task_first() {
+        let pool = DecodePool::new(1);
+        let (gate_tx, gate_rx) = mpsc::channel::<()>();
+        let (order_tx, order_rx) = mpsc::channel();
+
+        let blocker = pool.submit(move || {
+            let _ = gate_rx.recv();
+        });
+        // Let the worker pick up the blocker before queueing the rest.
+        while pool.stats().queue_depth != 0 {
+            thread::yield_now();
+        }
+
+        for value in 0..3 {
+            let order_tx = order_tx.clone();
+            let _ = pool.submit(move || {
+                let _ = order_tx.send(value);
+            });
+        }
+        gate_tx.send(()).expect("worker is waiting");
+        drop(blocker);
+
+        let order: Vec<i32> = (0..3)
+            .map(|_| {
+                order_rx
+                    .recv_timeout(Duration::from_secs(5))
+                    .expect("task ran")
+            })
+            .collect();
+        assert_eq!(order, [2, 1, 0]);
+    }
+
+    #[test]
+    fn idle_workers_steal_from_a_busy_queue() {
+        let pool = DecodePool::new(2);
+        let (gate_tx, gate_rx) = mpsc::channel::<()>();
+        let (done_tx, done_rx) = mpsc::channel();
+
+        // Park one worker on the blocker, then pile every task onto queue 0.
+        // Either the blocked owner's queue gets stolen from, or the blocker
+        // itself was stolen; both count.
+        let _blocker = pool.submit(move || {
+            let _ = gate_rx.recv();
+        });
+        while pool.stats().queue_depth != 0 {
+            thread::yield_now();
+        }
+        for value in 0..4 {
+            pool.shared.next_queue.store(0, Ordering::Relaxed);
+            let done_tx = done_tx.clone();
+            let _ = pool.submit(move || {
+                let _ = done_tx.send(value);
+            });
+        }
+
+        for _ in 0..4 {
+            done_rx
+                .recv_timeout(Duration::from_secs(5))
+                .expect("stolen task ran while the owner was blocked");
+        }
+        gate_tx.send(()).ok();
+        assert!(pool.stats().stolen >= 1);
+    }
+
+    #[tokio::test]
+    async fn worker_survives_a_panicking_task() {
+        let pool = DecodePool::new(1);
+        let panicked = pool.submit(|| -> i32 { panic!("decoder exploded") });
+        assert!(panicked.await.is_err());
+
+        assert_eq!(pool.submit(|| 7).await.ok(), Some(7));
+        assert_eq!(pool.stats().panicked, 1);
+    }
+}
@@ -12,6 +12,7 @@ use std::path::{Path, PathBuf};
 use crate::list_model::ListModel;
 use crate::{
     RUNTIME,
+    progress_bus::ProgressJob,
     qt_threading::{QtThread, QtThreading},
     qvariantmap_insert,
 };
@@ -630,31 +631,37 @@ async fn download_and_extract(
     let mut file = tokio::fs::File::create(&tmp_zip).await?;
     let mut stream = response.bytes_stream();
 
+    let progress_version = version.to_string();
+    let progress = ProgressJob::new("developer-disk-image", move |snapshot| {
+        if snapshot.total == 0 {
+            return;
+        }
+        let progress = snapshot.fraction() * 100.0;
+        let version_str = progress_version.clone();
+        qt_thread.queue(move |q| {
+            let model_index = {
+                let model = q.image_model.borrow();
+                model
+                    .values
+                    .iter()
+                    .position(|item| item.version.to_string() == version_str)
+            };
+            if let Some(model_index) = model_index {
+                q.image_model.borrow_mut().mutate(model_index, |item| {
+                    item.progress = progress;
+                });
+            }
+            q.downloadProgressForIndex(index, QString::from(version_str), progress);
+        });
+    });
+
     while let Some(chunk) = stream.next().await {
         let chunk = chunk?;
         file.write_all(&chunk).await?;
         downloaded += chunk.len() as u64;
-
-        if total > 0 {
-            let progress = (downloaded as f64 / total as f64) * 100.0;
-            let version_str = version.to_string();
-            qt_thread.queue(move |q| {
-                let model_index = {
-                    let model = q.image_model.borrow();
-                    model
-                        .values
-                        .iter()
-                        .position(|item| item.version.to_string() == version_str)
-                };
-                if let Some(model_index) = model_index {
-                    q.image_model.borrow_mut().mutate(model_index, |item| {
-                        item.progress = progress;
-                    });
-                }
-                q.downloadProgressForIndex(index, QString::from(version_str), progress);
-            });
-        }
+        progress.report(version, downloaded, total);
     }
+    drop(progress);
     file.flush().await?;
     drop(file);
 
@@ -10,6 +10,7 @@ use std::sync::Arc;
 use tokio::sync::Mutex;
 use tokio::task::JoinHandle;
 
+use crate::afc_pool::{AfcPool, AfcSource};
 use crate::{image_cache, image_loader, media_streamer::MediaStreamSession};
 
 #[derive(Clone)]
@@ -69,6 +70,10 @@ pub struct DeviceServices {
     pub connection_id: u64,
     pub afc: Arc<Mutex<AfcClient>>,
     pub afc2: Option<Arc<Mutex<AfcClient>>>,
+    /// Extra sessions for long or parallel transfers so they do not queue
+    /// behind the shared `afc` client.
+    pub afc_pool: AfcPool,
+    pub afc2_pool: Option<AfcPool>,
     pub diag: Arc<Mutex<DiagnosticsRelayClient>>,
     pub heartbeat_task: Option<Arc<JoinHandle<()>>>,
     pub video_streams: Arc<Mutex<HashMap<String, MediaStreamSession>>>,
@@ -77,6 +82,16 @@ pub struct DeviceServices {
     pub ios_version: iOSVersion,
 }
 
+impl DeviceServices {
+    pub fn afc_source(&self, afc2: bool) -> Option<AfcSource> {
+        if afc2 {
+            self.afc2_pool.clone().map(AfcSource::Pool)
+        } else {
+            Some(AfcSource::Pool(self.afc_pool.clone()))
+        }
+    }
+}
+
 static APP_DEVICE_STATE: Lazy<Mutex<HashMap<String, DeviceServices>>> =
     Lazy::new(|| Mutex::new(HashMap::new()));
 
@@ -128,6 +143,11 @@ async fn clean_removed_device(udid: &str, svc: DeviceServices, abort_heartbeat:
         session.shutdown().await;
     }
 
+    svc.afc_pool.close();
+    if let Some(pool) = &svc.afc2_pool {
+        pool.close();
+    }
+
     image_cache::clear_for_udid(udid);
 }
 
@@ -4,10 +4,13 @@
 use qmetaobject::prelude::*;
 use qttypes::{QStringList, QVariantList, QVariantMap};
 
+use crate::afc_pool::AfcSource;
 use crate::constants::FS_GALLERY_PROVIDER_NAME;
 use crate::device_ctx;
 use crate::gallery_fs_provider::build_fs_provider;
 use crate::gallery_sqlite_provider::{build_sqlite_provider, build_sqlite_vfs_provider};
+use crate::io_manager;
+use crate::local_sink::LocalSink;
 use crate::qt_threading::QtThreading;
 use crate::utils::{MediaFileType, create_album_info, media_file_type};
 use crate::{RUNTIME, qvariantmap_insert};
@@ -24,6 +27,11 @@ use tokio::io::{AsyncReadExt, AsyncWriteExt};
 
 pub type GalleryFuture<T> = Pin<Box<dyn Future<Output = anyhow::Result<T>> + Send>>;
 
+/// Items per `query_album_page` call; a few screens of thumbnails.
+const ALBUM_PAGE_SIZE: usize = 240;
+/// Items per page fed to an album export.
+const EXPORT_PAGE_SIZE: usize = 1000;
+
 pub trait GalleryProvider: Send + Sync {
     fn read_albums(&self) -> GalleryFuture<(Vec<GalleryAlbum>, i32)>;
     fn reload(&self) -> GalleryFuture<(Vec<GalleryAlbum>, i32)>;
@@ -33,6 +41,17 @@ pub trait GalleryProvider: Send + Sync {
         media_filter: GalleryMediaFilter,
         most_recent_first: bool,
     ) -> GalleryFuture<Vec<String>>;
+    /// Lists up to `limit` items of an album, resuming after `cursor` (`None`
+    /// for the first page). Only the returned page is read, so the first
+    /// screen costs the same however large the album is.
+    fn query_album_page(
+        &self,
+        id: i32,
+        media_filter: GalleryMediaFilter,
+        most_recent_first: bool,
+        cursor: Option<String>,
+        limit: usize,
+    ) -> GalleryFuture<AlbumPage>;
     fn query_gallery_size(&self) -> GalleryFuture<u64>;
     fn name(&self) -> String;
 }
@@ -63,6 +82,14 @@ pub struct GalleryAlbum {
     pub preview_path: String,
 }
 
+/// One page of an album. `next_cursor` is opaque to callers and is handed
+/// back to fetch the following page; it is `None` once the album is done.
+#[derive(Debug, Default, Eq, PartialEq)]
+pub struct AlbumPage {
+    pub paths: Vec<String>,
+    pub next_cursor: Option<String>,
+}
+
 #[derive(Clone, Copy, Debug, Eq, PartialEq)]
 pub enum GalleryMediaFilter {
     All,
@@ -121,21 +148,25 @@ pub struct Query {
     reload: qt_method!(fn(&mut self)),
     read_albums: qt_method!(fn(&mut self)),
     query_album: qt_method!(fn(&mut self, id: i32, media_filter: i32, most_recent_first: bool)),
-    resolve_album_export:
-        qt_method!(fn(&mut self, request_id: QString, album_id: i32, album_name: QString)),
+    query_album_page: qt_method!(
+        fn(&mut self, id: i32, media_filter: i32, most_recent_first: bool, cursor: QString)
+    ),
+    feed_album_export: qt_method!(fn(&mut self, request_id: QString, album_id: i32)),
     albumQueried: qt_signal!(id: i32, media_filter: i32, most_recent_first: bool, items: QStringList),
+    albumPageQueried: qt_signal!(
+        id: i32,
+        media_filter: i32,
+        most_recent_first: bool,
+        cursor: QString,
+        items: QStringList,
+        next_cursor: QString
+    ),
     albumQueryFailed: qt_signal!(
         id: i32,
         media_filter: i32,
         most_recent_first: bool,
         error: QString
     ),
-    albumExportResolved: qt_signal!(
-        request_id: QString,
-        album_id: i32,
-        album_name: QString,
-        items: QStringList
-    ),
     gallerySizeQueried: qt_signal!(size: u64),
     reloadFinished: qt_signal!(success: bool, revision: i32, error: QString),
     is_init: bool,
@@ -191,21 +222,35 @@ impl Query {
                     .await
                     .ok_or_else(|| anyhow::anyhow!("device connection is no longer current"))?;
                 let prov = match gallery_backend {
-                    GalleryBackend::Fs => build_fs_provider(device.afc).await?,
+                    GalleryBackend::Fs => {
+                        build_fs_provider(AfcSource::Pool(device.afc_pool)).await?
+                    }
                     GalleryBackend::Sqlite => {
                         build_sqlite_provider(device.afc, ios_version).await?
                     }
                     GalleryBackend::SqliteVfs => {
-                        build_sqlite_vfs_provider(device.afc, device.provider, ios_version).await?
+                        let udid = device.afc_pool.udid().to_string();
+                        build_sqlite_vfs_provider(device.afc, device.provider, udid, ios_version)
+                            .await?
                     }
                 };
 
                 if gallery_backend == GalleryBackend::Fs {
-                    //FIXME:untill there is a better way to query the gallery size for fs backend, we will just return 0
-                    // let gallery_size = prov.query_gallery_size().await?;
+                    // Sizing stats every file, so report 0 straight away and
+                    // the real size once the index has it.
                     qt_thread.queue(move |s| {
                         s.gallerySizeQueried(0);
                     });
+                    let sizing = prov.clone();
+                    let sizing_thread = qt_thread.clone();
+                    RUNTIME.spawn(async move {
+                        match sizing.query_gallery_size().await {
+                            Ok(size) => sizing_thread.queue(move |s| {
+                                s.gallerySizeQueried(size);
+                            }),
+                            Err(e) => debug!("Failed to size the FS gallery: {e}"),
+                        }
+                    });
                     /*
                         Better not do this for fs backend
                         as this will most likely succeed
@@ -258,7 +303,7 @@ impl Query {
                     */
                     if gallery_backend != GalleryBackend::Fs {
                         let fs_res: anyhow::Result<Arc<dyn GalleryProvider>> = async {
-                            let afc_arc = device_ctx::get_device_for_connection_opt(
+                            let afc_pool = device_ctx::get_device_for_connection_opt(
                                 udid_clone_for_fallback,
                                 connection_id,
                             )
@@ -266,8 +311,8 @@ impl Query {
                             .ok_or_else(|| {
                                 anyhow::anyhow!("device connection is no longer current")
                             })?
-                            .afc;
-                            let prov = build_fs_provider(afc_arc).await?;
+                            .afc_pool;
+                            let prov = build_fs_provider(AfcSource::Pool(afc_pool)).await?;
                             prov.read_albums().await?;
                             Ok(prov)
                         }
@@ -499,46 +544,111 @@ impl Query {
         });
     }
 
-    fn resolve_album_export(&mut self, request_id: QString, album_id: i32, album_name: QString) {
-        let provider = match &self.provider {
-            Some(provider) => provider.clone(),
-            None => return,
+    /// Fetches the page after `cursor` (empty for the first one). The reply
+    /// echoes `cursor` so the view can drop pages of an earlier listing, and
+    /// an empty `next_cursor` means the album has been fully listed.
+    fn query_album_page(
+        &mut self,
+        id: i32,
+        media_filter: i32,
+        most_recent_first: bool,
+        cursor: QString,
+    ) {
+        let media_filter = GalleryMediaFilter::from_i32(media_filter);
+        let media_filter_id = media_filter.as_i32();
+        let Some(provider) = self.provider.clone() else {
+            self.albumQueryFailed(
+                id,
+                media_filter_id,
+                most_recent_first,
+                QString::from("Gallery provider is not initialized"),
+            );
+            return;
         };
 
-        let request_id = request_id.to_string();
-        let album_name = album_name.to_string();
+        let revision = self.revision;
         let q_thread = self.qt_thread();
-
+        let cursor = cursor.to_string();
+        let after = Some(cursor.clone()).filter(|cursor| !cursor.is_empty());
         RUNTIME.spawn(async move {
-            match provider
-                .query_album(album_id, GalleryMediaFilter::All, true)
-                .await
-            {
-                Ok(paths) => {
-                    let mut list = QStringList::default();
-                    for path in paths {
-                        list.push(QString::from(path));
+            let result = provider
+                .query_album_page(id, media_filter, most_recent_first, after, ALBUM_PAGE_SIZE)
+                .await;
+            q_thread.queue(move |q| {
+                if q.revision != revision {
+                    debug!(
+                        "Discarding stale album page for revision {revision}; current revision is {}",
+                        q.revision
+                    );
+                    return;
+                }
+                match result {
+                    Ok(page) => {
+                        let mut items = QStringList::default();
+                        for path in page.paths {
+                            items.push(QString::from(path));
+                        }
+                        let next_cursor = QString::from(page.next_cursor.unwrap_or_default());
+                        q.albumPageQueried(
+                            id,
+                            media_filter_id,
+                            most_recent_first,
+                            QString::from(cursor),
+                            items,
+                            next_cursor,
+                        );
                     }
-
-                    q_thread.queue(move |q| {
-                        q.albumExportResolved(
-                            QString::from(request_id),
-                            album_id,
-                            QString::from(album_name),
-                            list,
+                    Err(e) => {
+                        warn!("Error querying album page: {e}");
+                        q.albumQueryFailed(
+                            id,
+                            media_filter_id,
+                            most_recent_first,
+                            QString::from(e.to_string()),
                         );
-                    });
+                    }
                 }
-                Err(e) => {
-                    println!("Error resolving album export {}", e.to_string());
-                    q_thread.queue(move |q| {
-                        q.albumExportResolved(
-                            QString::from(request_id),
-                            album_id,
-                            QString::from(album_name),
-                            QStringList::default(),
-                        );
-                    });
+            });
+        });
+    }
+
+    /// Lists an album page by page into the export feed for `request_id`,
+    /// which `IOManager::start_feed_export` copies as the pages arrive.
+    fn feed_album_export(&mut self, request_id: QString, album_id: i32) {
+        let request_id = request_id.to_string();
+        let feed = io_manager::open_export_feed(&request_id);
+        let Some(provider) = self.provider.clone() else {
+            let _ = feed.try_send(Err(anyhow::anyhow!("Gallery provider is not initialized")));
+            return;
+        };
+
+        RUNTIME.spawn(async move {
+            let mut cursor = None;
+            loop {
+                let page = match provider
+                    .query_album_page(
+                        album_id,
+                        GalleryMediaFilter::All,
+                        true,
+                        cursor.take(),
+                        EXPORT_PAGE_SIZE,
+                    )
+                    .await
+                {
+                    Ok(page) => page,
+                    Err(e) => {
+                        warn!("Error listing album {album_id} for export: {e}");
+                        let _ = feed.send(Err(e)).await;
+                        return;
+                    }
+                };
+                if feed.send(Ok(page.paths)).await.is_err() {
+                    debug!("Album export {request_id} ended before album {album_id} was listed");
+                    return;
+                }
+                match page.next_cursor {
+                    Some(next) => cursor = Some(next),
+                    None => return,
                 }
             }
         });
@@ -584,18 +694,22 @@ pub async fn export_afc_file(
 ) -> anyhow::Result<()> {
     let mut remote_file = afc.open(remote_path, AfcFopenMode::RdOnly).await?;
     let transfer_result: anyhow::Result<()> = async {
-        let mut local_file = tokio::fs::File::create(local_path).await?;
+        let mut local_file = LocalSink::create(local_path, None).await?;
         let mut chunk = vec![0u8; crate::io_manager::DEFAULT_CHUNK_SIZE];
 
-        loop {
-            let n = remote_file.read(&mut chunk).await?;
-            if n == 0 {
-                break;
+        let copied: anyhow::Result<()> = async {
+            loop {
+                let n = remote_file.read(&mut chunk).await?;
+                if n == 0 {
+                    return Ok(());
+                }
+                local_file.write_all(&chunk[..n]).await?;
             }
-            local_file.write_all(&chunk[..n]).await?;
         }
-
-        local_file.flush().await?;
+        .await;
+        let shutdown = local_file.shutdown().await;
+        copied?;
+        shutdown?;
         Ok(())
     }
     .await;
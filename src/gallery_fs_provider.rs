@@ -1,21 +1,60 @@
 // SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
+use crate::afc_pool::AfcSource;
 use crate::constants::{DCIM_REMOTE_PATH, FS_GALLERY_PROVIDER_NAME};
 use crate::gallery::{
-    GalleryAlbum, GalleryFuture, GalleryMediaFilter, GalleryProvider, apple_dcim_folder_id,
-    is_apple_dcim_folder, is_previewable_media_file, matches_media_filter,
+    AlbumPage, GalleryAlbum, GalleryFuture, GalleryMediaFilter, GalleryProvider,
+    apple_dcim_folder_id, is_apple_dcim_folder, is_previewable_media_file, matches_media_filter,
 };
+use crate::gallery_index::{GalleryIndex, IndexedAsset};
+use ::log::{debug, warn};
 use anyhow::Context;
-use idevice::afc::AfcClient;
+use std::collections::{HashMap, HashSet};
 use std::sync::Arc;
+use std::sync::atomic::{AtomicUsize, Ordering};
 use tokio::sync::Mutex;
 
+/// Pooled sessions statting one folder at a time.
+const STAT_WORKERS: usize = 3;
+/// Files a worker stats per lease.
+const STAT_BATCH: usize = 64;
+
+type FolderCache = Arc<Mutex<HashMap<i32, FolderListing>>>;
+
 struct FsGalleryProvider {
-    afc: Arc<Mutex<AfcClient>>,
+    afc: AfcSource,
+    /// Listings of `NNNAPPLE` folders; kept across reloads and trusted while
+    /// the folder's modification time is unchanged.
+    folders: FolderCache,
+    /// Folders listed in full so far; cleared on reload.
+    index: Arc<Mutex<GalleryIndex>>,
     name: String,
 }
 
+#[derive(Clone)]
+struct FolderListing {
+    modified: String,
+    /// Media file names, sorted.
+    names: Arc<Vec<String>>,
+    /// Stats of those files, once a full listing got all of them.
+    assets: Option<Arc<Vec<IndexedAsset>>>,
+}
+
+/// Stats of a folder's media files. An incomplete set, where some file
+/// failed to stat, is neither cached nor indexed.
+struct FolderAssets {
+    assets: Arc<Vec<IndexedAsset>>,
+    complete: bool,
+}
+
+/// Result of statting a list of names.
+struct StatedFiles {
+    assets: Vec<IndexedAsset>,
+    /// Files whose stat failed, as opposed to directories left out.
+    failed: usize,
+}
+
 impl GalleryProvider for FsGalleryProvider {
     fn name(&self) -> String {
         self.name.clone()
@@ -23,11 +62,19 @@ impl GalleryProvider for FsGalleryProvider {
 
     fn read_albums(&self) -> GalleryFuture<(Vec<GalleryAlbum>, i32)> {
         let afc = self.afc.clone();
-        Box::pin(async move { Ok((read_fs_albums(afc).await?, 0)) })
+        let folders = self.folders.clone();
+        let index = self.index.clone();
+        Box::pin(async move { Ok((read_fs_albums(&afc, &folders, &index).await?, 0)) })
     }
 
     fn reload(&self) -> GalleryFuture<(Vec<GalleryAlbum>, i32)> {
-        self.read_albums()
+        let afc = self.afc.clone();
+        let folders = self.folders.clone();
+        let index = self.index.clone();
+        Box::pin(async move {
+            index.lock().await.clear();
+            Ok((read_fs_albums(&afc, &folders, &index).await?, 0))
+        })
     }
 
     fn query_album(
@@ -37,125 +84,356 @@ impl GalleryProvider for FsGalleryProvider {
         most_recent_first: bool,
     ) -> GalleryFuture<Vec<String>> {
         let afc = self.afc.clone();
-        let folder_path = format!("{}/{}APPLE", DCIM_REMOTE_PATH, id);
+        let folders = self.folders.clone();
+        let index = self.index.clone();
 
         Box::pin(async move {
-            let mut afc = afc.lock().await;
-            let file_names = afc.list_dir(&folder_path).await?;
-            let mut items = Vec::new();
-            for file_name in file_names {
-                if file_name == "."
-                    || file_name == ".."
-                    || !matches_media_filter(&file_name, media_filter)
-                {
+            if let Some(paths) = index
+                .lock()
+                .await
+                .album(id, media_filter, most_recent_first)
+            {
+                return Ok(paths);
+            }
+
+            let folder = folder_assets(&afc, &folders, id).await?;
+            if !folder.complete {
+                // Ordered like an indexed album, but not kept.
+                let mut partial = GalleryIndex::default();
+                partial.insert_album(id, folder.assets.iter().cloned());
+                return partial
+                    .album(id, media_filter, most_recent_first)
+                    .context("Album was not indexed");
+            }
+            let mut index = index.lock().await;
+            index.insert_album(id, folder.assets.iter().cloned());
+            index
+                .album(id, media_filter, most_recent_first)
+                .context("Album was not indexed")
+        })
+    }
+
+    /// Pages by file name rather than modification time: DCIM names count up
+    /// in capture order, and sorting by name needs no per-file stat, so only
+    /// the files on the returned page are looked at.
+    fn query_album_page(
+        &self,
+        id: i32,
+        media_filter: GalleryMediaFilter,
+        most_recent_first: bool,
+        cursor: Option<String>,
+        limit: usize,
+    ) -> GalleryFuture<AlbumPage> {
+        let afc = self.afc.clone();
+        let folders = self.folders.clone();
+
+        Box::pin(async move {
+            let folder_path = folder_path(id);
+            let listing = folder_listing(&afc, &folders, id).await?;
+            let mut remaining = names_after(
+                listing.names.to_vec(),
+                media_filter,
+                most_recent_first,
+                cursor.as_deref(),
+            );
+            let more = remaining.len() > limit.max(1);
+            remaining.truncate(limit.max(1));
+
+            // Directories named like media are the only thing a stat can
+            // rule out; a stat'ed listing already has.
+            let files: HashSet<String> = match &listing.assets {
+                Some(assets) => assets.iter().map(|asset| asset.path.clone()).collect(),
+                None => stat_files(&afc, &folder_path, &remaining)
+                    .await?
+                    .assets
+                    .into_iter()
+                    .map(|asset| asset.path)
+                    .collect(),
+            };
+            let next_cursor = remaining.last().cloned().filter(|_| more);
+            let paths = remaining
+                .iter()
+                .map(|file_name| format!("{}/{}", folder_path, file_name))
+                .filter(|path| files.contains(path))
+                .collect();
+
+            Ok(AlbumPage { paths, next_cursor })
+        })
+    }
+
+    /// Indexes every DCIM folder not listed yet and sums the sizes. Folders
+    /// whose stats are cached and still current cost one stat each; one that
+    /// could not be stat'ed in full counts what was, without being indexed.
+    fn query_gallery_size(&self) -> GalleryFuture<u64> {
+        let afc = self.afc.clone();
+        let folders = self.folders.clone();
+        let index = self.index.clone();
+
+        Box::pin(async move {
+            let mut unindexed = 0;
+            for folder_name in list_dcim(&afc).await? {
+                let Some(id) = apple_dcim_folder_id(&folder_name) else {
+                    continue;
+                };
+                if index.lock().await.has_album(id) {
                     continue;
                 }
+                match folder_assets(&afc, &folders, id).await {
+                    Ok(folder) if folder.complete => index
+                        .lock()
+                        .await
+                        .insert_album(id, folder.assets.iter().cloned()),
+                    Ok(folder) => {
+                        unindexed += folder.assets.iter().map(|asset| asset.size).sum::<u64>()
+                    }
+                    Err(e) => println!("Skipping DCIM folder {}: {}", folder_name, e),
+                }
+            }
+            Ok(index.lock().await.total_size() + unindexed)
+        })
+    }
+}
+
+fn folder_path(id: i32) -> String {
+    format!("{}/{}APPLE", DCIM_REMOTE_PATH, id)
+}
+
+async fn list_dcim(afc: &AfcSource) -> anyhow::Result<Vec<String>> {
+    let mut handle = afc.lease().await?;
+    match handle.list_dir(DCIM_REMOTE_PATH).await {
+        Ok(names) => Ok(names),
+        Err(e) => {
+            handle.note_error(&e);
+            Err(e).context("Failed to list /DCIM")
+        }
+    }
+}
+
+/// Media file names of folder `id`. The folder is stat'ed every time, but
+/// only listed again when its modification time moved.
+async fn folder_listing(
+    afc: &AfcSource,
+    folders: &FolderCache,
+    id: i32,
+) -> anyhow::Result<FolderListing> {
+    let path = folder_path(id);
+    let mut handle = afc.lease().await?;
+    let info = match handle.get_file_info(&path).await {
+        Ok(info) => info,
+        Err(e) => {
+            handle.note_error(&e);
+            return Err(e).with_context(|| format!("Failed to stat {path}"));
+        }
+    };
+    if info.st_ifmt != "S_IFDIR" {
+        anyhow::bail!("{path} is not a folder");
+    }
 
+    let modified = info.modified.to_string();
+    if let Some(cached) = folders.lock().await.get(&id) {
+        if cached.modified == modified {
+            return Ok(cached.clone());
+        }
+    }
+
+    let mut names = match handle.list_dir(&path).await {
+        Ok(names) => names,
+        Err(e) => {
+            handle.note_error(&e);
+            return Err(e).with_context(|| format!("Failed to list {path}"));
+        }
+    };
+    drop(handle);
+    names.retain(|name| name != "." && name != ".." && is_previewable_media_file(name));
+    names.sort();
+
+    let listing = FolderListing {
+        modified,
+        names: Arc::new(names),
+        assets: None,
+    };
+    folders.lock().await.insert(id, listing.clone());
+    Ok(listing)
+}
+
+/// Stats of every media file in folder `id`, from the cache while the folder
+/// is unchanged. Only a complete set is cached, so a transient error does not
+/// hide files until the folder next changes.
+async fn folder_assets(
+    afc: &AfcSource,
+    folders: &FolderCache,
+    id: i32,
+) -> anyhow::Result<FolderAssets> {
+    let listing = folder_listing(afc, folders, id).await?;
+    if let Some(assets) = listing.assets {
+        return Ok(FolderAssets {
+            assets,
+            complete: true,
+        });
+    }
+
+    let path = folder_path(id);
+    let stated = stat_files(afc, &path, &listing.names).await?;
+    let assets = Arc::new(stated.assets);
+    if stated.failed > 0 {
+        warn!(
+            "Could not stat {} files of {path}; not caching its listing",
+            stated.failed
+        );
+        return Ok(FolderAssets {
+            assets,
+            complete: false,
+        });
+    }
+    if let Some(cached) = folders.lock().await.get_mut(&id) {
+        if cached.modified == listing.modified {
+            cached.assets = Some(assets.clone());
+        }
+    }
+    Ok(FolderAssets {
+        assets,
+        complete: true,
+    })
+}
+
+/// Stats `names` inside `folder_path` in batches spread over several pooled
+/// sessions, so a large folder does not pay one round trip per file in
+/// sequence. Directories and files that fail to stat are left out, the latter
+/// counted; the assets are in no particular order. Fails if no session can
+/// be leased, rather than dropping a whole batch.
+async fn stat_files(
+    afc: &AfcSource,
+    folder_path: &str,
+    names: &[String],
+) -> anyhow::Result<StatedFiles> {
+    let workers = match afc {
+        AfcSource::Pool(_) => STAT_WORKERS,
+        AfcSource::Shared(_) => 1,
+    };
+    let cursor = &AtomicUsize::new(0);
+    let batches = futures::future::try_join_all((0..workers).map(|_| async move {
+        let mut stated = StatedFiles {
+            assets: Vec::new(),
+            failed: 0,
+        };
+        loop {
+            let start = cursor.fetch_add(STAT_BATCH, Ordering::Relaxed);
+            if start >= names.len() {
+                return anyhow::Ok(stated);
+            }
+            let batch = &names[start..(start + STAT_BATCH).min(names.len())];
+
+            let mut handle = afc
+                .lease()
+                .await
+                .with_context(|| format!("No AFC session to stat files of {folder_path}"))?;
+            for file_name in batch {
                 let file_path = format!("{}/{}", folder_path, file_name);
-                match afc.get_file_info(&file_path).await {
-                    Ok(info) if info.st_ifmt != "S_IFDIR" => {
-                        items.push((file_path, info.modified));
-                    }
+                match handle.get_file_info(&file_path).await {
+                    Ok(info) if info.st_ifmt != "S_IFDIR" => stated.assets.push(IndexedAsset {
+                        path: file_path,
+                        sort_key: info.modified.and_utc().timestamp_micros(),
+                        size: info.size as u64,
+                    }),
                     Ok(_) => {}
                     Err(e) => {
-                        println!("Skipping DCIM file {}: {}", file_path, e);
+                        handle.note_error(&e);
+                        debug!("Skipping DCIM file {file_path}: {e}");
+                        stated.failed += 1;
                     }
                 }
             }
+        }
+    }))
+    .await?;
+
+    Ok(batches.into_iter().fold(
+        StatedFiles {
+            assets: Vec::new(),
+            failed: 0,
+        },
+        |mut all, batch| {
+            all.assets.extend(batch.assets);
+            all.failed += batch.failed;
+            all
+        },
+    ))
+}
 
-            items.sort_by(|a, b| {
-                let ordering = a.1.cmp(&b.1).then_with(|| a.0.cmp(&b.0));
+/// Media file names of a DCIM folder in paging order, starting after
+/// `cursor`.
+fn names_after(
+    mut file_names: Vec<String>,
+    media_filter: GalleryMediaFilter,
+    most_recent_first: bool,
+    cursor: Option<&str>,
+) -> Vec<String> {
+    file_names.retain(|name| {
+        name != "."
+            && name != ".."
+            && matches_media_filter(name, media_filter)
+            && cursor.is_none_or(|cursor| {
                 if most_recent_first {
-                    ordering.reverse()
+                    name.as_str() < cursor
                 } else {
-                    ordering
+                    name.as_str() > cursor
                 }
-            });
-
-            Ok(items.into_iter().map(|(path, _)| path).collect())
-        })
-    }
-
-    // TODO: can we do something here?
-    fn query_gallery_size(&self) -> GalleryFuture<u64> {
-        Box::pin(async move { Ok(0) })
+            })
+    });
+    file_names.sort();
+    if most_recent_first {
+        file_names.reverse();
     }
+    file_names
 }
 
-async fn read_fs_albums(afc: Arc<Mutex<AfcClient>>) -> anyhow::Result<Vec<GalleryAlbum>> {
-    let mut afc = afc.lock().await;
-
-    let mut folder_names = afc
-        .list_dir(DCIM_REMOTE_PATH)
-        .await
-        .context("Failed to list /DCIM")?;
-
+async fn read_fs_albums(
+    afc: &AfcSource,
+    folders: &FolderCache,
+    index: &Mutex<GalleryIndex>,
+) -> anyhow::Result<Vec<GalleryAlbum>> {
+    let mut folder_names = list_dcim(afc).await?;
     folder_names.retain(|name| name != "." && name != ".." && is_apple_dcim_folder(name));
     folder_names.sort();
 
     let mut albums = Vec::new();
     for folder_name in folder_names {
-        let folder_path = format!("{}/{}", DCIM_REMOTE_PATH, folder_name);
-        let info = match afc.get_file_info(&folder_path).await {
-            Ok(info) => info,
-            Err(e) => {
-                println!("Skipping DCIM folder {}: {}", folder_path, e);
-                continue;
-            }
-        };
-
-        if info.st_ifmt != "S_IFDIR" {
+        let Some(album_id) = apple_dcim_folder_id(&folder_name) else {
             continue;
-        }
-
-        let mut file_names = match afc.list_dir(&folder_path).await {
-            Ok(names) => names,
+        };
+        let listing = match folder_listing(afc, folders, album_id).await {
+            Ok(listing) => listing,
             Err(e) => {
-                println!("Skipping unreadable DCIM folder {}: {}", folder_path, e);
+                println!("Skipping DCIM folder {}: {}", folder_name, e);
                 continue;
             }
         };
-
-        file_names.retain(|name| name != "." && name != ".." && is_previewable_media_file(name));
-        // file_names.sort();
-
-        let mut paths = Vec::new();
-        for file_name in &file_names {
-            let file_path = format!("{}/{}", folder_path, file_name);
-            paths.push(file_path);
-            break;
-            // match afc.get_file_info(&file_path).await {
-            //     Ok(info) if info.st_ifmt != "S_IFDIR" => paths.push(file_path),
-            //     Ok(_) => {}
-            //     Err(e) => {
-            //         println!("Skipping DCIM file {}: {}", file_path, e);
-            //     }
-            // }
-        }
-
-        if paths.is_empty() {
-            continue;
-        }
-
-        let Some(album_id) = apple_dcim_folder_id(&folder_name) else {
+        let Some(preview_name) = listing.names.first() else {
             continue;
         };
+
+        // An indexed folder has been stat'ed, so subfolders are left out.
+        let item_count = index
+            .lock()
+            .await
+            .album_count(album_id, GalleryMediaFilter::All)
+            .unwrap_or(listing.names.len());
         albums.push(GalleryAlbum {
             id: album_id,
+            preview_path: format!("{}/{}", folder_path(album_id), preview_name),
             name: folder_name,
-            item_count: file_names.len() as i32,
-            preview_path: paths[0].clone(),
+            item_count: item_count as i32,
         });
     }
 
     Ok(albums)
 }
 
-pub async fn build_fs_provider(
-    afc: Arc<Mutex<AfcClient>>,
-) -> anyhow::Result<Arc<dyn GalleryProvider>> {
+pub async fn build_fs_provider(afc: AfcSource) -> anyhow::Result<Arc<dyn GalleryProvider>> {
     Ok(Arc::new(FsGalleryProvider {
         afc,
+        folders: Arc::new(Mutex::new(HashMap::new())),
+        index: Arc::new(Mutex::new(GalleryIndex::default())),
         name: FS_GALLERY_PROVIDER_NAME.into(),
     }))
 }
@@ -0,0 +1,269 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! In-memory index of a device's gallery, shared by the gallery providers.
+//!
+//! Assets are kept once in columns (path, sort key, size) and addressed by a
+//! dense id. Each album is the list of its ids in ascending sort order, and a
+//! bitset per media kind says which ids are images and which are videos. Once
+//! an album is indexed, switching the media filter or the sort direction is
+//! a walk over its ids instead of another SQL query or directory listing.
+//!
+//! Albums are indexed the first time they are listed in full; providers
+//! clear the whole index when they reload.
+
+use crate::gallery::{AlbumPage, GalleryMediaFilter};
+use crate::utils::{MediaFileType, media_file_type};
+use std::collections::HashMap;
+
+#[derive(Clone)]
+pub struct IndexedAsset {
+    pub path: String,
+    /// Orders an album: `Z_PK` for SQLite, modification time for DCIM.
+    pub sort_key: i64,
+    pub size: u64,
+}
+
+#[derive(Default)]
+struct Bitset {
+    words: Vec<u64>,
+}
+
+impl Bitset {
+    fn insert(&mut self, id: u32) {
+        let word = id as usize / 64;
+        if self.words.len() <= word {
+            self.words.resize(word + 1, 0);
+        }
+        self.words[word] |= 1 << (id % 64);
+    }
+
+    fn contains(&self, id: u32) -> bool {
+        self.words
+            .get(id as usize / 64)
+            .is_some_and(|word| word & (1 << (id % 64)) != 0)
+    }
+}
+
+#[derive(Default)]
+pub struct GalleryIndex {
+    paths: Vec<String>,
+    sort_keys: Vec<i64>,
+    sizes: Vec<u64>,
+    ids: HashMap<String, u32>,
+    images: Bitset,
+    videos: Bitset,
+    /// Members of each indexed album, ascending by sort key, then path.
+    albums: HashMap<i32, Vec<u32>>,
+}
+
+impl GalleryIndex {
+    pub fn clear(&mut self) {
+        *self = Self::default();
+    }
+
+    pub fn has_album(&self, album: i32) -> bool {
+        self.albums.contains_key(&album)
+    }
+
+    /// Replaces the contents of `album`. An asset already indexed through
+    /// another album keeps its id and columns.
+    pub fn insert_album(&mut self, album: i32, assets: impl IntoIterator<Item = IndexedAsset>) {
+        let mut members: Vec<u32> = assets.into_iter().map(|asset| self.intern(asset)).collect();
+        members.sort_by(|a, b| {
+            let (a, b) = (*a as usize, *b as usize);
+            self.sort_keys[a]
+                .cmp(&self.sort_keys[b])
+                .then_with(|| self.paths[a].cmp(&self.paths[b]))
+        });
+        members.dedup();
+        self.albums.insert(album, members);
+    }
+
+    fn intern(&mut self, asset: IndexedAsset) -> u32 {
+        if let Some(&id) = self.ids.get(&asset.path) {
+            return id;
+        }
+
+        let id = self.paths.len() as u32;
+        match media_file_type(&asset.path) {
+            MediaFileType::Image | MediaFileType::Heic => self.images.insert(id),
+            MediaFileType::Video => self.videos.insert(id),
+            MediaFileType::Unsupported => {}
+        }
+        self.ids.insert(asset.path.clone(), id);
+        self.paths.push(asset.path);
+        self.sort_keys.push(asset.sort_key);
+        self.sizes.push(asset.size);
+        id
+    }
+
+    fn matches(&self, id: u32, filter: GalleryMediaFilter) -> bool {
+        match filter {
+            GalleryMediaFilter::All => self.images.contains(id) || self.videos.contains(id),
+            GalleryMediaFilter::Images => self.images.contains(id),
+            GalleryMediaFilter::Videos => self.videos.contains(id),
+        }
+    }
+
+    fn ordered<'a>(
+        &'a self,
+        members: &'a [u32],
+        filter: GalleryMediaFilter,
+        most_recent_first: bool,
+    ) -> impl Iterator<Item = u32> + 'a {
+        let ids: Box<dyn Iterator<Item = &u32>> = if most_recent_first {
+            Box::new(members.iter().rev())
+        } else {
+            Box::new(members.iter())
+        };
+        ids.copied().filter(move |id| self.matches(*id, filter))
+    }
+
+    /// Paths of an indexed album, or `None` if it has not been indexed yet.
+    pub fn album(
+        &self,
+        album: i32,
+        filter: GalleryMediaFilter,
+        most_recent_first: bool,
+    ) -> Option<Vec<String>> {
+        let members = self.albums.get(&album)?;
+        Some(
+            self.ordered(members, filter, most_recent_first)
+                .map(|id| self.paths[id as usize].clone())
+                .collect(),
+        )
+    }
+
+    pub fn album_count(&self, album: i32, filter: GalleryMediaFilter) -> Option<usize> {
+        let members = self.albums.get(&album)?;
+        Some(self.ordered(members, filter, false).count())
+    }
+
+    /// One page of an indexed album, resuming after the item whose sort key
+    /// is `after`. The cursor is that sort key, so it only identifies an item
+    /// when keys are unique, as `Z_PK` is.
+    pub fn album_page(
+        &self,
+        album: i32,
+        filter: GalleryMediaFilter,
+        most_recent_first: bool,
+        after: Option<i64>,
+        limit: usize,
+    ) -> Option<AlbumPage> {
+        let members = self.albums.get(&album)?;
+        let key = |id: &u32| self.sort_keys[*id as usize];
+        let members = match after {
+            None => members.as_slice(),
+            Some(after) if most_recent_first => {
+                &members[..members.partition_point(|id| key(id) < after)]
+            }
+            Some(after) => &members[members.partition_point(|id| key(id) <= after)..],
+        };
+
+        let limit = limit.max(1);
+        let mut matching = self.ordered(members, filter, most_recent_first);
+        let mut page = AlbumPage::default();
+        let mut last = None;
+        for id in matching.by_ref().take(limit) {
+            page.paths.push(self.paths[id as usize].clone());
+            last = Some(id);
+        }
+        if page.paths.len() == limit && matching.next().is_some() {
+            page.next_cursor = last.map(|id| key(&id).to_string());
+        }
+        Some(page)
+    }
+
+    /// Bytes taken by every asset indexed so far.
+    pub fn total_size(&self) -> u64 {
+        self.sizes.iter().sum()
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn asset(path: &str, sort_key: i64, size: u64) -> IndexedAsset {
+        IndexedAsset {
+            path: path.to_string(),
+            sort_key,
+            size,
+        }
+    }
+
+    fn sample() -> GalleryIndex {
+        let mut index = GalleryIndex::default();
+        index.insert_album(
+            1,
+            [
+                asset("/DCIM/100APPLE/IMG_0003.MOV", 30, 300),
+                asset("/DCIM/100APPLE/IMG_0001.JPG", 10, 100),
+                asset("/DCIM/100APPLE/IMG_0002.HEIC", 20, 200),
+                asset("/DCIM/100APPLE/.thumbs", 40, 1),
+            ],
+        );
+        index.insert_album(
+            2,
+            [
+                asset("/DCIM/100APPLE/IMG_0002.HEIC", 20, 200),
+                asset("/DCIM/101APPLE/IMG_0004.JPG", 50, 400),
+            ],
+        );
+        index
+    }
+
+    #[test]
+    fn filters_and_orders_come_from_the_index() {
+        let index = sample();
+        assert_eq!(
+            index.album(1, GalleryMediaFilter::All, true).unwrap(),
+            [
+                "/DCIM/100APPLE/IMG_0003.MOV",
+                "/DCIM/100APPLE/IMG_0002.HEIC",
+                "/DCIM/100APPLE/IMG_0001.JPG",
+            ]
+        );
+        assert_eq!(
+            index.album(1, GalleryMediaFilter::Images, false).unwrap(),
+            [
+                "/DCIM/100APPLE/IMG_0001.JPG",
+                "/DCIM/100APPLE/IMG_0002.HEIC"
+            ]
+        );
+        assert_eq!(index.album_count(1, GalleryMediaFilter::Videos), Some(1));
+        assert_eq!(index.album_count(2, GalleryMediaFilter::All), Some(2));
+        assert!(index.album(3, GalleryMediaFilter::All, true).is_none());
+        // The shared HEIC is counted once.
+        assert_eq!(index.total_size(), 1001);
+    }
+
+    #[test]
+    fn pages_resume_after_the_sort_key() {
+        let index = sample();
+        let first = index
+            .album_page(1, GalleryMediaFilter::All, true, None, 2)
+            .unwrap();
+        assert_eq!(
+            first.paths,
+            [
+                "/DCIM/100APPLE/IMG_0003.MOV",
+                "/DCIM/100APPLE/IMG_0002.HEIC"
+            ]
+        );
+        assert_eq!(first.next_cursor.as_deref(), Some("20"));
+
+        let rest = index
+            .album_page(1, GalleryMediaFilter::All, true, Some(20), 2)
+            .unwrap();
+        assert_eq!(rest.paths, ["/DCIM/100APPLE/IMG_0001.JPG"]);
+        assert_eq!(rest.next_cursor, None);
+
+        let oldest = index
+            .album_page(1, GalleryMediaFilter::Images, false, Some(10), 1)
+            .unwrap();
+        assert_eq!(oldest.paths, ["/DCIM/100APPLE/IMG_0002.HEIC"]);
+        assert_eq!(oldest.next_cursor, None);
+    }
+}
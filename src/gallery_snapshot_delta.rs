@@ -0,0 +1,324 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Incremental refresh of the local Photos.sqlite snapshot.
+//!
+//! The snapshot provider used to copy Photos.sqlite and its WAL again
+//! whenever their size or modification time changed. AFC cannot checksum a
+//! remote range, so changed ranges are found from the WAL instead:
+//!
+//! * Within one WAL generation (same header, so same salts) frames are only
+//!   appended and committed frames are never rewritten. The local WAL is
+//!   brought up to date by fetching whatever follows its last commit.
+//! * While the generation stays the same, the database file only changes by
+//!   checkpointing frames of that WAL, so only the pages those frames name
+//!   can differ. Page 1 is always refetched and its header checked against
+//!   the remote size.
+//!
+//! Anything else (a WAL reset, a missing local file, a page size mismatch)
+//! asks the caller for a full copy.
+
+use anyhow::Context;
+use idevice::afc::AfcClient;
+use idevice::afc::opcode::AfcFopenMode;
+use std::collections::BTreeSet;
+use std::io::SeekFrom;
+use std::ops::Range;
+use std::path::Path;
+use tokio::io::{AsyncReadExt, AsyncSeekExt, AsyncWriteExt};
+
+pub const WAL_HEADER_LEN: usize = 32;
+const WAL_FRAME_HEADER_LEN: usize = 24;
+const WAL_MAGIC: [u32; 2] = [0x377f_0682, 0x377f_0683];
+/// Pages this close together are fetched in one read.
+const MERGE_GAP_PAGES: u64 = 8;
+
+pub type WalHeader = [u8; WAL_HEADER_LEN];
+
+#[derive(Debug, PartialEq, Eq)]
+pub enum Refresh {
+    Patched { fetched: u64 },
+    FullCopyNeeded,
+}
+
+fn be_u32(bytes: &[u8], offset: usize) -> u32 {
+    u32::from_be_bytes(bytes[offset..offset + 4].try_into().expect("four bytes"))
+}
+
+/// The header of a WAL file, if `bytes` starts with one.
+pub fn wal_header(bytes: &[u8]) -> Option<WalHeader> {
+    let header: WalHeader = bytes.get(..WAL_HEADER_LEN)?.try_into().ok()?;
+    WAL_MAGIC.contains(&be_u32(&header, 0)).then_some(header)
+}
+
+fn wal_page_size(header: &WalHeader) -> u64 {
+    be_u32(header, 8) as u64
+}
+
+/// Frames of the header's generation as (offset, page number, is commit),
+/// stopping at the first frame written by another generation or cut short.
+fn frames(wal: &[u8]) -> Vec<(usize, u32, bool)> {
+    let Some(header) = wal_header(wal) else {
+        return Vec::new();
+    };
+    let frame_len = WAL_FRAME_HEADER_LEN + wal_page_size(&header) as usize;
+    let mut frames = Vec::new();
+    let mut offset = WAL_HEADER_LEN;
+    while offset + frame_len <= wal.len() {
+        let frame = &wal[offset..offset + WAL_FRAME_HEADER_LEN];
+        if frame[8..16] != header[16..24] {
+            break;
+        }
+        frames.push((offset, be_u32(frame, 0), be_u32(frame, 4) != 0));
+        offset += frame_len;
+    }
+    frames
+}
+
+/// Where the last committed frame ends; everything after it may still be
+/// rewritten by the transaction in progress.
+pub fn committed_end(wal: &[u8]) -> usize {
+    let frame_len = wal_header(wal).map_or(0, |header| {
+        WAL_FRAME_HEADER_LEN + wal_page_size(&header) as usize
+    });
+    frames(wal)
+        .iter()
+        .rev()
+        .find(|(_, _, commit)| *commit)
+        .map_or(WAL_HEADER_LEN, |(offset, _, _)| offset + frame_len)
+}
+
+/// Every page a checkpoint of this WAL could have written.
+pub fn frame_pages(wal: &[u8]) -> BTreeSet<u32> {
+    frames(wal).into_iter().map(|(_, page, _)| page).collect()
+}
+
+/// Byte ranges covering `pages`, merging near neighbours and clipped to
+/// `file_size`.
+fn page_ranges(pages: &BTreeSet<u32>, page_size: u64, file_size: u64) -> Vec<Range<u64>> {
+    let mut ranges: Vec<Range<u64>> = Vec::new();
+    for &page in pages {
+        let start = (page as u64).saturating_sub(1) * page_size;
+        if page == 0 || start >= file_size {
+            continue;
+        }
+        let end = (start + page_size).min(file_size);
+        match ranges.last_mut() {
+            Some(last) if start <= last.end + MERGE_GAP_PAGES * page_size => last.end = end,
+            _ => ranges.push(start..end),
+        }
+    }
+    ranges
+}
+
+/// Page size from a database header; 1 stands for 65536.
+fn database_page_size(header: &[u8]) -> Option<u64> {
+    match u16::from_be_bytes(header.get(16..18)?.try_into().ok()?) {
+        1 => Some(65536),
+        size => Some(size as u64),
+    }
+}
+
+/// Whether page 1 says the database is `size` bytes long. Only trusted when
+/// the header's version-valid-for matches its change counter.
+fn header_matches_size(header: &[u8], page_size: u64, size: u64) -> bool {
+    if header.len() < 100 || be_u32(header, 92) != be_u32(header, 24) {
+        return true;
+    }
+    be_u32(header, 28) as u64 * page_size == size
+}
+
+pub async fn read_local_wal_header(path: &Path) -> Option<WalHeader> {
+    let mut file = tokio::fs::File::open(path).await.ok()?;
+    let mut header = [0u8; WAL_HEADER_LEN];
+    file.read_exact(&mut header).await.ok()?;
+    wal_header(&header)
+}
+
+/// Copies `ranges` of `remote_path` into the same offsets of `local`.
+async fn fetch_ranges(
+    afc: &mut AfcClient,
+    remote_path: &str,
+    ranges: &[Range<u64>],
+    local: &mut tokio::fs::File,
+) -> anyhow::Result<u64> {
+    let mut remote = afc
+        .open(remote_path, AfcFopenMode::RdOnly)
+        .await
+        .with_context(|| format!("Failed to open {remote_path}"))?;
+    let copied: anyhow::Result<u64> = async {
+        let mut buffer = Vec::new();
+        let mut fetched = 0;
+        for range in ranges {
+            buffer.resize((range.end - range.start) as usize, 0);
+            remote.seek(SeekFrom::Start(range.start)).await?;
+            remote.read_exact(&mut buffer).await?;
+            local.seek(SeekFrom::Start(range.start)).await?;
+            local.write_all(&buffer).await?;
+            fetched += buffer.len() as u64;
+        }
+        Ok(fetched)
+    }
+    .await;
+    let closed = remote.close().await;
+    let fetched = copied.with_context(|| format!("Failed to read {remote_path}"))?;
+    closed.with_context(|| format!("Failed to close {remote_path}"))?;
+    Ok(fetched)
+}
+
+/// Appends what the remote WAL gained since the local copy was taken.
+pub async fn refresh_wal(
+    afc: &mut AfcClient,
+    remote_path: &str,
+    local_path: &Path,
+    remote_size: u64,
+) -> anyhow::Result<Refresh> {
+    let Ok(local_wal) = tokio::fs::read(local_path).await else {
+        return Ok(Refresh::FullCopyNeeded);
+    };
+    let Some(local_header) = wal_header(&local_wal) else {
+        return Ok(Refresh::FullCopyNeeded);
+    };
+    let resume_from = committed_end(&local_wal) as u64;
+    if remote_size < resume_from {
+        return Ok(Refresh::FullCopyNeeded);
+    }
+
+    let mut local = tokio::fs::OpenOptions::new()
+        .read(true)
+        .write(true)
+        .open(local_path)
+        .await
+        .with_context(|| format!("Failed to open {}", local_path.display()))?;
+    let mut remote_header = [0u8; WAL_HEADER_LEN];
+    {
+        let mut remote = afc
+            .open(remote_path, AfcFopenMode::RdOnly)
+            .await
+            .with_context(|| format!("Failed to open {remote_path}"))?;
+        let read = remote.read_exact(&mut remote_header).await;
+        let closed = remote.close().await;
+        read.with_context(|| format!("Failed to read {remote_path}"))?;
+        closed.with_context(|| format!("Failed to close {remote_path}"))?;
+    }
+    if remote_header != local_header {
+        return Ok(Refresh::FullCopyNeeded);
+    }
+
+    let fetched = fetch_ranges(afc, remote_path, &[resume_from..remote_size], &mut local).await?;
+    local.set_len(remote_size).await?;
+    local.flush().await?;
+    Ok(Refresh::Patched { fetched })
+}
+
+/// Refetches the database pages named by the (already refreshed) local WAL.
+/// Only valid while the WAL generation is the one the local database was
+/// taken under; the caller checks that.
+pub async fn refresh_database(
+    afc: &mut AfcClient,
+    remote_path: &str,
+    local_path: &Path,
+    remote_size: u64,
+    wal_path: &Path,
+) -> anyhow::Result<Refresh> {
+    let Ok(wal) = tokio::fs::read(wal_path).await else {
+        return Ok(Refresh::FullCopyNeeded);
+    };
+    let Some(wal_header) = wal_header(&wal) else {
+        return Ok(Refresh::FullCopyNeeded);
+    };
+    let page_size = wal_page_size(&wal_header);
+    let mut local = match tokio::fs::OpenOptions::new()
+        .read(true)
+        .write(true)
+        .open(local_path)
+        .await
+    {
+        Ok(local) => local,
+        Err(_) => return Ok(Refresh::FullCopyNeeded),
+    };
+    let mut header = [0u8; 100];
+    if local.read_exact(&mut header).await.is_err()
+        || database_page_size(&header) != Some(page_size)
+    {
+        return Ok(Refresh::FullCopyNeeded);
+    }
+
+    let mut pages = frame_pages(&wal);
+    pages.insert(1);
+    let ranges = page_ranges(&pages, page_size, remote_size);
+    let fetched = fetch_ranges(afc, remote_path, &ranges, &mut local).await?;
+    local.set_len(remote_size).await?;
+    local.flush().await?;
+
+    local.seek(SeekFrom::Start(0)).await?;
+    local.read_exact(&mut header).await?;
+    if !header_matches_size(&header, page_size, remote_size) {
+        return Ok(Refresh::FullCopyNeeded);
+    }
+    Ok(Refresh::Patched { fetched })
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const PAGE: usize = 512;
+
+    fn header(salt: u8) -> Vec<u8> {
+        let mut header = vec![0u8; WAL_HEADER_LEN];
+        header[0..4].copy_from_slice(&WAL_MAGIC[0].to_be_bytes());
+        header[8..12].copy_from_slice(&(PAGE as u32).to_be_bytes());
+        header[16..24].fill(salt);
+        header
+    }
+
+    fn push_frame(wal: &mut Vec<u8>, page: u32, commit: bool, salt: u8) {
+        wal.extend_from_slice(&page.to_be_bytes());
+        wal.extend_from_slice(&u32::from(commit).to_be_bytes());
+        wal.extend_from_slice(&[salt; 8]);
+        wal.extend_from_slice(&[0; 8]);
+        wal.extend(std::iter::repeat_n(page as u8, PAGE));
+    }
+
+    #[test]
+    fn frames_stop_at_another_generation_and_commits_bound_the_tail() {
+        let mut wal = header(7);
+        push_frame(&mut wal, 3, false, 7);
+        push_frame(&mut wal, 9, true, 7);
+        push_frame(&mut wal, 4, false, 7);
+        push_frame(&mut wal, 12, true, 1);
+        wal.extend_from_slice(&[0; 10]);
+
+        let frame_len = WAL_FRAME_HEADER_LEN + PAGE;
+        assert_eq!(frame_pages(&wal), BTreeSet::from([3, 4, 9]));
+        assert_eq!(committed_end(&wal), WAL_HEADER_LEN + 2 * frame_len);
+        assert_eq!(committed_end(&header(7)), WAL_HEADER_LEN);
+        assert!(wal_header(&[0; WAL_HEADER_LEN]).is_none());
+    }
+
+    #[test]
+    fn nearby_pages_share_a_read_and_ranges_stop_at_the_file_end() {
+        let page = PAGE as u64;
+        let pages = BTreeSet::from([1, 2, 5, 40, 41, 100]);
+        assert_eq!(
+            page_ranges(&pages, page, 41 * page - 10),
+            vec![0..5 * page, 39 * page..41 * page - 10]
+        );
+    }
+
+    #[test]
+    fn header_size_is_only_trusted_when_valid() {
+        let mut header = [0u8; 100];
+        header[16..18].copy_from_slice(&1u16.to_be_bytes());
+        assert_eq!(database_page_size(&header), Some(65536));
+
+        header[24..28].copy_from_slice(&5u32.to_be_bytes());
+        header[28..32].copy_from_slice(&3u32.to_be_bytes());
+        header[92..96].copy_from_slice(&5u32.to_be_bytes());
+        assert!(header_matches_size(&header, 4096, 3 * 4096));
+        assert!(!header_matches_size(&header, 4096, 4 * 4096));
+        header[92..96].copy_from_slice(&4u32.to_be_bytes());
+        assert!(header_matches_size(&header, 4096, 4 * 4096));
+    }
+}
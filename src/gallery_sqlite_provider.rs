@@ -10,9 +10,11 @@ use crate::constants::{
     RECENTS_QUERY, SQLITE_GALLERY_PROVIDER_NAME, SQLITE_VFS_GALLERY_PROVIDER_NAME,
 };
 use crate::gallery::{
-    GalleryAlbum, GalleryFuture, GalleryMediaFilter, GalleryProvider, export_afc_file,
+    AlbumPage, GalleryAlbum, GalleryFuture, GalleryMediaFilter, GalleryProvider, export_afc_file,
     matches_media_filter,
 };
+use crate::gallery_index::{GalleryIndex, IndexedAsset};
+use crate::gallery_snapshot_delta::{self, Refresh};
 use crate::gallery_sqlite_vfs::{GalleryVfsRegistration, open_gallery_vfs_connection};
 use crate::utils::TempDirGuard;
 use ::log::{debug, info, warn};
@@ -25,6 +27,7 @@ use rusqlite::{Connection, OptionalExtension};
 use std::collections::HashMap;
 use std::path::{Path, PathBuf};
 use std::sync::Arc;
+use std::time::Instant;
 use tokio::sync::Mutex;
 
 #[derive(Clone, Copy, Debug, Eq, Hash, PartialEq)]
@@ -66,12 +69,25 @@ struct RemoteFileMetadata {
 
 type SnapshotMetadata = HashMap<SnapshotFile, Option<RemoteFileMetadata>>;
 
+/// Room for every album statement (an index and two page queries for each of
+/// five album kinds) plus the album listing queries.
+const STATEMENT_CACHE_CAPACITY: usize = 32;
+/// Rows the background indexer reads per hold of the provider state, so
+/// page requests get the connection between chunks.
+const INDEX_CHUNK_ROWS: usize = 2_000;
+
 struct SqliteProviderState {
     connection: Option<Connection>,
     vfs_registration: Option<GalleryVfsRegistration>,
     assets_table_name: String,
     assets_table_album_column: String,
     committed_metadata: SnapshotMetadata,
+    queries: AlbumQueries,
+    /// Albums listed so far from `connection`; cleared whenever it is reopened.
+    index: GalleryIndex,
+    /// Bumped whenever `connection` is reopened, so an album read from the
+    /// previous one is not indexed.
+    generation: u64,
 }
 
 #[derive(Clone)]
@@ -81,6 +97,7 @@ enum SqliteProviderSource {
     },
     Vfs {
         provider: Arc<Mutex<Box<dyn IdeviceProvider>>>,
+        udid: String,
     },
 }
 
@@ -129,12 +146,13 @@ impl GalleryProvider for SqliteGalleryProvider {
 
         Box::pin(async move {
             let _refresh_guard = refresh_lock.lock().await;
-            if let SqliteProviderSource::Vfs { provider } = source {
+            if let SqliteProviderSource::Vfs { provider, udid } = source {
                 let mut state = state.lock().await;
                 tokio::task::block_in_place(|| close_connection(&mut state))?;
                 state.vfs_registration = None;
 
-                let (connection, registration) = open_gallery_vfs_connection(afc, provider).await?;
+                let (connection, registration) =
+                    open_gallery_vfs_connection(afc, provider, &udid).await?;
                 let prepared = tokio::task::block_in_place(|| {
                     (|| -> anyhow::Result<_> {
                         let (assets_table_name, assets_table_album_column) =
@@ -159,8 +177,11 @@ impl GalleryProvider for SqliteGalleryProvider {
 
                 state.connection = Some(connection);
                 state.vfs_registration = Some(registration);
+                state.queries = AlbumQueries::new(&assets_table_name, &assets_table_album_column);
                 state.assets_table_name = assets_table_name;
                 state.assets_table_album_column = assets_table_album_column;
+                state.index.clear();
+                state.generation += 1;
                 return Ok(albums);
             }
 
@@ -176,26 +197,37 @@ impl GalleryProvider for SqliteGalleryProvider {
             close_connection(&mut state)?;
 
             let mut afc = afc.lock().await;
-            for snapshot_file in SnapshotFile::ALL {
+            let wal_path = temp_dir.join(SnapshotFile::Wal.local_name());
+            let previous_wal_header =
+                gallery_snapshot_delta::read_local_wal_header(&wal_path).await;
+            // The WAL goes first: whether its generation survived decides if
+            // the database can be patched from its frames.
+            for snapshot_file in [SnapshotFile::Wal, SnapshotFile::Database, SnapshotFile::Shm] {
                 let local_path = temp_dir.join(snapshot_file.local_name());
                 let remote_file_metadata = remote_metadata.get(&snapshot_file).cloned().flatten();
 
                 match remote_file_metadata {
-                    Some(_) => {
+                    Some(metadata) => {
                         if snapshot_file_changed(
                             &state.committed_metadata,
                             &remote_metadata,
                             snapshot_file,
                         ) {
-                            info!(
-                                "Reloading changed gallery snapshot file {}",
-                                snapshot_file.remote_path()
-                            );
-                            export_afc_file(&mut afc, snapshot_file.remote_path(), &local_path)
-                                .await
-                                .with_context(|| {
-                                    format!("Failed to refresh {}", snapshot_file.remote_path())
-                                })?;
+                            let same_wal_generation = previous_wal_header.is_some()
+                                && previous_wal_header
+                                    == gallery_snapshot_delta::read_local_wal_header(&wal_path)
+                                        .await;
+                            refresh_snapshot_file(
+                                &mut afc,
+                                snapshot_file,
+                                &local_path,
+                                metadata.size as u64,
+                                same_wal_generation.then_some(wal_path.as_path()),
+                            )
+                            .await
+                            .with_context(|| {
+                                format!("Failed to refresh {}", snapshot_file.remote_path())
+                            })?;
                         }
                     }
                     None => {
@@ -224,9 +256,12 @@ impl GalleryProvider for SqliteGalleryProvider {
 
             state.connection = Some(connection);
             state.vfs_registration = None;
+            state.queries = AlbumQueries::new(&assets_table_name, &assets_table_album_column);
             state.assets_table_name = assets_table_name;
             state.assets_table_album_column = assets_table_album_column;
             state.committed_metadata = remote_metadata;
+            state.index.clear();
+            state.generation += 1;
             Ok(albums)
         })
     }
@@ -240,17 +275,66 @@ impl GalleryProvider for SqliteGalleryProvider {
         let state = self.state.clone();
 
         Box::pin(async move {
-            match id {
-                FAVS_ALBUM_ID => query_favs_album(state, media_filter, most_recent_first).await,
-                RECENTS_ALBUM_ID => {
-                    query_recents_album(state, media_filter, most_recent_first).await
-                }
-                RECENTLY_DELETED_ALBUM_ID => {
-                    query_recently_deleted_album(state, media_filter, most_recent_first).await
-                }
-                HIDDEN_ALBUM_ID => query_hidden_album(state, media_filter, most_recent_first).await,
-                _ => query_sqlite_album(state, id, media_filter, most_recent_first).await,
+            let mut state = state.lock().await;
+            tokio::task::block_in_place(|| {
+                index_sqlite_album(&mut state, id)?;
+                state
+                    .index
+                    .album(id, media_filter, most_recent_first)
+                    .context("Album was not indexed")
+            })
+        })
+    }
+
+    fn query_album_page(
+        &self,
+        id: i32,
+        media_filter: GalleryMediaFilter,
+        most_recent_first: bool,
+        cursor: Option<String>,
+        limit: usize,
+    ) -> GalleryFuture<AlbumPage> {
+        let state = self.state.clone();
+
+        Box::pin(async move {
+            let after = parse_page_cursor(cursor.as_deref())?;
+            let guard = state.lock().await;
+            if let Some(page) =
+                guard
+                    .index
+                    .album_page(id, media_filter, most_recent_first, after, limit)
+            {
+                return Ok(page);
+            }
+
+            let page = tokio::task::block_in_place(|| {
+                let connection = guard
+                    .connection
+                    .as_ref()
+                    .context("SQLite gallery connection is closed")?;
+                let (sql, album_id) = guard.queries.for_album(id);
+                read_sqlite_page(
+                    connection,
+                    sql.page(most_recent_first),
+                    album_id,
+                    media_filter,
+                    most_recent_first,
+                    after,
+                    limit,
+                )
+            })?;
+            drop(guard);
+
+            // Index the rest of the album behind the first page, so the
+            // following pages and filter or order changes skip SQL.
+            if after.is_none() {
+                tokio::spawn(async move {
+                    if let Err(e) = index_sqlite_album_in_background(&state, id).await {
+                        debug!("Failed to index album {id}: {e}");
+                    }
+                });
             }
+            Ok(page)
         })
     }
 
@@ -296,6 +380,7 @@ pub async fn build_sqlite_provider(
     let temp_dir_guard = TempDirGuard::new(temp_dir);
 
     let remote_metadata = {
+        let started = Instant::now();
         let mut afc_guard = afc.lock().await;
         let metadata = read_remote_snapshot_metadata(&mut afc_guard).await?;
         for snapshot_file in SnapshotFile::ALL {
@@ -315,6 +400,13 @@ pub async fn build_sqlite_provider(
                 None => {}
             }
         }
+        // Compare with the gallery VFS summary logged when it closes.
+        let copied: usize = metadata.values().flatten().map(|file| file.size).sum();
+        info!(
+            "Copied gallery snapshot ({:.1} MiB) in {} ms",
+            copied as f64 / (1024.0 * 1024.0),
+            started.elapsed().as_millis()
+        );
         metadata
     };
 
@@ -329,9 +421,12 @@ pub async fn build_sqlite_provider(
         state: Arc::new(Mutex::new(SqliteProviderState {
             connection: Some(connection),
             vfs_registration: None,
+            queries: AlbumQueries::new(&assets_table_name, &assets_table_album_column),
             assets_table_name,
             assets_table_album_column,
             committed_metadata: remote_metadata,
+            index: GalleryIndex::default(),
+            generation: 0,
         })),
         refresh_lock: Arc::new(Mutex::new(())),
         afc,
@@ -344,10 +439,11 @@ pub async fn build_sqlite_provider(
 pub async fn build_sqlite_vfs_provider(
     afc: Arc<Mutex<AfcClient>>,
     provider: Arc<Mutex<Box<dyn IdeviceProvider>>>,
+    udid: String,
     ios_version: u32,
 ) -> anyhow::Result<Arc<dyn GalleryProvider>> {
     let (connection, registration) =
-        open_gallery_vfs_connection(afc.clone(), provider.clone()).await?;
+        open_gallery_vfs_connection(afc.clone(), provider.clone(), &udid).await?;
     let (assets_table_name, assets_table_album_column) =
         match tokio::task::block_in_place(|| validate_vfs_connection(&connection)) {
             Ok(schema) => schema,
@@ -362,13 +458,16 @@ pub async fn build_sqlite_vfs_provider(
         state: Arc::new(Mutex::new(SqliteProviderState {
             connection: Some(connection),
             vfs_registration: Some(registration),
+            queries: AlbumQueries::new(&assets_table_name, &assets_table_album_column),
             assets_table_name,
             assets_table_album_column,
             committed_metadata: SnapshotMetadata::new(),
+            index: GalleryIndex::default(),
+            generation: 0,
         })),
         refresh_lock: Arc::new(Mutex::new(())),
         afc,
-        source: SqliteProviderSource::Vfs { provider },
+        source: SqliteProviderSource::Vfs { provider, udid },
         ios_version,
         name: SQLITE_VFS_GALLERY_PROVIDER_NAME.into(),
     }))
@@ -411,6 +510,51 @@ fn is_missing_file_error(error: &IdeviceError) -> bool {
     )
 }
 
+/// Brings one local snapshot file up to date, fetching only what changed
+/// when `gallery_snapshot_delta` can tell. `wal_path` is set when the WAL
+/// generation the local database was taken under is still current.
+async fn refresh_snapshot_file(
+    afc: &mut AfcClient,
+    snapshot_file: SnapshotFile,
+    local_path: &Path,
+    remote_size: u64,
+    wal_path: Option<&Path>,
+) -> anyhow::Result<()> {
+    let started = Instant::now();
+    let remote_path = snapshot_file.remote_path();
+    let delta = match (snapshot_file, wal_path) {
+        (SnapshotFile::Wal, _) => {
+            gallery_snapshot_delta::refresh_wal(afc, remote_path, local_path, remote_size).await
+        }
+        (SnapshotFile::Database, Some(wal_path)) => {
+            gallery_snapshot_delta::refresh_database(
+                afc,
+                remote_path,
+                local_path,
+                remote_size,
+                wal_path,
+            )
+            .await
+        }
+        _ => Ok(Refresh::FullCopyNeeded),
+    };
+
+    match delta {
+        Ok(Refresh::Patched { fetched }) => {
+            info!(
+                "Patched gallery snapshot file {remote_path}: fetched {fetched} of {remote_size} bytes in {} ms",
+                started.elapsed().as_millis()
+            );
+            return Ok(());
+        }
+        Ok(Refresh::FullCopyNeeded) => {}
+        Err(error) => warn!("Incremental refresh of {remote_path} failed, copying it: {error:#}"),
+    }
+
+    info!("Reloading changed gallery snapshot file {remote_path}");
+    export_afc_file(afc, remote_path, local_path).await
+}
+
 fn snapshot_file_changed(
     committed: &SnapshotMetadata,
     current: &SnapshotMetadata,
@@ -444,6 +588,7 @@ fn open_and_validate_connection(path: &Path) -> anyhow::Result<(Connection, Stri
         anyhow::bail!("Gallery database validation failed: {quick_check}");
     }
 
+    connection.set_prepared_statement_cache_capacity(STATEMENT_CACHE_CAPACITY);
     let (assets_table_name, assets_table_album_column) = discover_assets_table(&connection)?;
     Ok((connection, assets_table_name, assets_table_album_column))
 }
@@ -455,6 +600,7 @@ fn validate_vfs_connection(connection: &Connection) -> anyhow::Result<(String, S
     //         row.get::<_, i64>(0)
     //     })
     //     .context("Failed to read the gallery schema through the AFC VFS")?;
+    connection.set_prepared_statement_cache_capacity(STATEMENT_CACHE_CAPACITY);
     discover_assets_table(connection)
 }
 
@@ -543,199 +689,256 @@ fn read_albums_from_connection(
     Ok((albums, failed_albums_count))
 }
 
-async fn query_sqlite_album(
-    state: Arc<Mutex<SqliteProviderState>>,
-    id: i32,
-    media_filter: GalleryMediaFilter,
-    most_recent_first: bool,
-) -> anyhow::Result<Vec<String>> {
-    let state = state.lock().await;
-    tokio::task::block_in_place(|| {
-        let connection = state
-            .connection
-            .as_ref()
-            .context("SQLite gallery connection is closed")?;
-        let mut paths = Vec::new();
-        let query = format!(
-            "{} ORDER BY ZASSET.Z_PK {}",
-            ALBUM_CONTENTS_QUERY_TEMPLATE
-                .replace("{table}", &state.assets_table_name)
-                .replace("{album}", &state.assets_table_album_column),
-            sqlite_order_direction(most_recent_first),
-        );
-        debug!("Executing query: {}", query);
-        debug!("With album id: {}", id);
-        let mut stmt = connection.prepare(&query)?;
-
-        let row_iter = stmt.query_map([id], |r| {
-            let fdir: String = r.get(0)?;
-            let fname: String = r.get(1)?;
-            Ok((fdir, fname))
-        })?;
+fn sqlite_order_direction(most_recent_first: bool) -> &'static str {
+    if most_recent_first { "DESC" } else { "ASC" }
+}
 
-        for item in row_iter {
-            let (fdir, fname) = item?;
-            let path = join_device_path(&fdir, &fname);
-            if matches_media_filter(&path, media_filter) {
-                paths.push(path);
-            }
+/// Album content SQL for one connection, resolved against its schema when
+/// the connection is adopted. Statements are prepared through the connection's
+/// cache, so switching albums reuses them instead of preparing again, which
+/// over the VFS can mean fetching schema pages from the device.
+#[derive(Default)]
+struct AlbumQueries {
+    contents: AlbumSql,
+    favs: AlbumSql,
+    recents: AlbumSql,
+    hidden: AlbumSql,
+    recently_deleted: AlbumSql,
+}
+
+#[derive(Default)]
+struct AlbumSql {
+    /// Every row, oldest first, for the index.
+    index: String,
+    newest_first: String,
+    oldest_first: String,
+}
+
+impl AlbumQueries {
+    fn new(assets_table_name: &str, assets_table_album_column: &str) -> Self {
+        let contents = ALBUM_CONTENTS_QUERY_TEMPLATE
+            .replace("{table}", assets_table_name)
+            .replace("{album}", assets_table_album_column);
+        Self {
+            // The album id takes the first parameter.
+            contents: AlbumSql::new(&contents, 2),
+            favs: AlbumSql::new(FAVS_QUERY, 1),
+            recents: AlbumSql::new(RECENTS_QUERY, 1),
+            hidden: AlbumSql::new(HIDDEN_QUERY, 1),
+            recently_deleted: AlbumSql::new(RECENTLY_DELETED_QUERY, 1),
         }
+    }
 
-        Ok(paths)
-    })
+    /// The SQL for album `id` and the album id it binds, if any.
+    fn for_album(&self, id: i32) -> (&AlbumSql, Option<i32>) {
+        match id {
+            FAVS_ALBUM_ID => (&self.favs, None),
+            RECENTS_ALBUM_ID => (&self.recents, None),
+            RECENTLY_DELETED_ALBUM_ID => (&self.recently_deleted, None),
+            HIDDEN_ALBUM_ID => (&self.hidden, None),
+            _ => (&self.contents, Some(id)),
+        }
+    }
 }
 
-fn sqlite_order_direction(most_recent_first: bool) -> &'static str {
-    if most_recent_first { "DESC" } else { "ASC" }
+impl AlbumSql {
+    fn new(query: &str, first_param: usize) -> Self {
+        Self {
+            index: sqlite_index_query(query),
+            newest_first: sqlite_page_query(query, true, first_param),
+            oldest_first: sqlite_page_query(query, false, first_param),
+        }
+    }
+
+    fn page(&self, most_recent_first: bool) -> &str {
+        if most_recent_first {
+            &self.newest_first
+        } else {
+            &self.oldest_first
+        }
+    }
 }
 
-fn sqlite_ordered_query(query: &str, most_recent_first: bool) -> String {
-    query.replace(
-        "ORDER BY ZASSET.Z_PK DESC",
-        &format!(
-            "ORDER BY ZASSET.Z_PK {}",
-            sqlite_order_direction(most_recent_first)
-        ),
-    )
+/// An album content query that also selects `ZASSET.Z_PK`, without its
+/// ordering, ready for another condition to be appended.
+fn keyed_query(query: &str) -> String {
+    query
+        .trim_end()
+        .trim_end_matches("ORDER BY ZASSET.Z_PK DESC")
+        .trim_end()
+        .replacen("SELECT", "SELECT ZASSET.Z_PK,", 1)
 }
 
-async fn query_favs_album(
-    state: Arc<Mutex<SqliteProviderState>>,
-    media_filter: GalleryMediaFilter,
-    most_recent_first: bool,
-) -> anyhow::Result<Vec<String>> {
-    let state = state.lock().await;
-    tokio::task::block_in_place(|| {
-        let connection = state
-            .connection
-            .as_ref()
-            .context("SQLite gallery connection is closed")?;
-        let mut paths = Vec::new();
-
-        //favs album
-        let query = sqlite_ordered_query(FAVS_QUERY, most_recent_first);
-        let mut favs_stmt = connection.prepare(&query)?;
-
-        let favs_iter = favs_stmt.query_map([], |r| {
-            let fname: String = r.get(0)?;
-            let fdir: String = r.get(1)?;
-            Ok((fname, fdir))
-        })?;
+/// Every row of an album content query, oldest first.
+fn sqlite_index_query(query: &str) -> String {
+    format!("{} ORDER BY ZASSET.Z_PK ASC", keyed_query(query))
+}
 
-        for fav_item in favs_iter {
-            let (fname, fdir) = fav_item?;
-            let path = join_device_path(&fdir, &fname);
-            if matches_media_filter(&path, media_filter) {
-                paths.push(path);
-            }
-        }
+/// Turns an album content query into a keyset page: rows resume after the
+/// key bound at `?{first_param}` and at most `?{first_param + 1}` are
+/// returned.
+fn sqlite_page_query(query: &str, most_recent_first: bool, first_param: usize) -> String {
+    let comparison = if most_recent_first { "<" } else { ">" };
+    format!(
+        "{} AND ZASSET.Z_PK {comparison} ?{} ORDER BY ZASSET.Z_PK {} LIMIT ?{}",
+        keyed_query(query),
+        first_param,
+        sqlite_order_direction(most_recent_first),
+        first_param + 1,
+    )
+}
 
-        Ok(paths)
-    })
+/// Page cursors are the `Z_PK` of the last item returned, whether the page
+/// came from SQL or from the index.
+fn parse_page_cursor(cursor: Option<&str>) -> anyhow::Result<Option<i64>> {
+    cursor
+        .map(|cursor| {
+            cursor
+                .parse::<i64>()
+                .with_context(|| format!("Invalid album page cursor {cursor:?}"))
+        })
+        .transpose()
 }
 
-async fn query_recents_album(
-    state: Arc<Mutex<SqliteProviderState>>,
-    media_filter: GalleryMediaFilter,
-    most_recent_first: bool,
-) -> anyhow::Result<Vec<String>> {
-    let state = state.lock().await;
-    tokio::task::block_in_place(|| {
-        let connection = state
-            .connection
-            .as_ref()
-            .context("SQLite gallery connection is closed")?;
-        let mut paths = Vec::new();
-
-        //recents album
-        let query = sqlite_ordered_query(RECENTS_QUERY, most_recent_first);
-        let mut recents_stmt = connection.prepare(&query)?;
-
-        let recents_iter = recents_stmt.query_map([], |r| {
-            let fname: String = r.get(0)?;
-            let fdir: String = r.get(1)?;
-            Ok((fname, fdir))
-        })?;
+fn row_path(row: &rusqlite::Row<'_>) -> rusqlite::Result<String> {
+    let fdir: String = row.get("ZDIRECTORY")?;
+    let fname: String = row.get("ZFILENAME")?;
+    Ok(join_device_path(&fdir, &fname))
+}
 
-        for recent_item in recents_iter {
-            let (fname, fdir) = recent_item?;
-            let path = join_device_path(&fdir, &fname);
-            if matches_media_filter(&path, media_filter) {
-                paths.push(path);
-            }
-        }
+/// Adds album `id` to the index unless it is already there.
+fn index_sqlite_album(state: &mut SqliteProviderState, id: i32) -> anyhow::Result<()> {
+    if state.index.has_album(id) {
+        return Ok(());
+    }
 
-        Ok(paths)
-    })
+    let connection = state
+        .connection
+        .as_ref()
+        .context("SQLite gallery connection is closed")?;
+    let (sql, album_id) = state.queries.for_album(id);
+    debug!("Indexing album {id}");
+    let mut stmt = connection.prepare_cached(&sql.index)?;
+    let assets = stmt
+        .query_map(rusqlite::params_from_iter(album_id), indexed_asset)?
+        .collect::<rusqlite::Result<Vec<_>>>()?;
+    state.index.insert_album(id, assets);
+    Ok(())
 }
 
-async fn query_hidden_album(
-    state: Arc<Mutex<SqliteProviderState>>,
-    media_filter: GalleryMediaFilter,
-    most_recent_first: bool,
-) -> anyhow::Result<Vec<String>> {
-    let state = state.lock().await;
-    tokio::task::block_in_place(|| {
-        let connection = state
-            .connection
-            .as_ref()
-            .context("SQLite gallery connection is closed")?;
-        let mut paths = Vec::new();
-
-        let query = sqlite_ordered_query(HIDDEN_QUERY, most_recent_first);
-        let mut hidden_stmt = connection.prepare(&query)?;
-
-        let hidden_iter = hidden_stmt.query_map([], |r| {
-            let fname: String = r.get(0)?;
-            let fdir: String = r.get(1)?;
-            Ok((fname, fdir))
+/// Like `index_sqlite_album`, but reads the album a chunk at a time and only
+/// holds the state while a chunk is read and when the album is added, so
+/// page requests are not stuck behind a large album.
+async fn index_sqlite_album_in_background(
+    state: &Mutex<SqliteProviderState>,
+    id: i32,
+) -> anyhow::Result<()> {
+    let mut assets = Vec::new();
+    let mut after = i64::MIN;
+    let mut generation = None;
+    loop {
+        let guard = state.lock().await;
+        if guard.index.has_album(id) || generation.is_some_and(|g| g != guard.generation) {
+            return Ok(());
+        }
+        generation = Some(guard.generation);
+
+        let chunk = tokio::task::block_in_place(|| {
+            let connection = guard
+                .connection
+                .as_ref()
+                .context("SQLite gallery connection is closed")?;
+            let (sql, album_id) = guard.queries.for_album(id);
+            let mut params: Vec<i64> = album_id.map(i64::from).into_iter().collect();
+            params.extend([after, INDEX_CHUNK_ROWS as i64]);
+            let mut stmt = connection.prepare_cached(sql.page(false))?;
+            let chunk = stmt
+                .query_map(rusqlite::params_from_iter(params), indexed_asset)?
+                .collect::<rusqlite::Result<Vec<_>>>()?;
+            anyhow::Ok(chunk)
         })?;
+        drop(guard);
 
-        for hidden_item in hidden_iter {
-            let (fname, fdir) = hidden_item?;
-            let path = join_device_path(&fdir, &fname);
-            if matches_media_filter(&path, media_filter) {
-                paths.push(path);
-            }
+        let last_chunk = chunk.len() < INDEX_CHUNK_ROWS;
+        if let Some(last) = chunk.last() {
+            after = last.sort_key;
+        }
+        assets.extend(chunk);
+        if last_chunk {
+            break;
         }
+    }
+
+    let mut state = state.lock().await;
+    if generation == Some(state.generation) && !state.index.has_album(id) {
+        debug!(
+            "Indexed album {id} in the background: {} assets",
+            assets.len()
+        );
+        state.index.insert_album(id, assets);
+    }
+    Ok(())
+}
 
-        Ok(paths)
+fn indexed_asset(row: &rusqlite::Row<'_>) -> rusqlite::Result<IndexedAsset> {
+    Ok(IndexedAsset {
+        path: row_path(row)?,
+        sort_key: row.get("Z_PK")?,
+        // Sizes come from GALLERY_TOTAL_SIZE_QUERY on this backend.
+        size: 0,
     })
 }
 
-async fn query_recently_deleted_album(
-    state: Arc<Mutex<SqliteProviderState>>,
+/// Reads one page with `page_query`, one of the `AlbumSql` page statements,
+/// skipping rows the media filter rejects. The cursor is the `Z_PK` of the
+/// last item returned, so a page never depends on how many rows came before
+/// it.
+fn read_sqlite_page(
+    connection: &Connection,
+    page_query: &str,
+    album_id: Option<i32>,
     media_filter: GalleryMediaFilter,
     most_recent_first: bool,
-) -> anyhow::Result<Vec<String>> {
-    let state = state.lock().await;
-    tokio::task::block_in_place(|| {
-        let connection = state
-            .connection
-            .as_ref()
-            .context("SQLite gallery connection is closed")?;
-        let mut paths = Vec::new();
-
-        //recently deleted album
-        let query = sqlite_ordered_query(RECENTLY_DELETED_QUERY, most_recent_first);
-        let mut recently_deleted_stmt = connection.prepare(&query)?;
-
-        let recently_deleted_iter = recently_deleted_stmt.query_map([], |r| {
-            let fname: String = r.get(0)?;
-            let fdir: String = r.get(1)?;
-            Ok((fname, fdir))
-        })?;
-
-        for deleted_item in recently_deleted_iter {
-            let (fname, fdir) = deleted_item?;
-            let path = join_device_path(&fdir, &fname);
+    after: Option<i64>,
+    limit: usize,
+) -> anyhow::Result<AlbumPage> {
+    let limit = limit.max(1);
+    let mut after = after.unwrap_or(if most_recent_first {
+        i64::MAX
+    } else {
+        i64::MIN
+    });
+    let mut stmt = connection.prepare_cached(page_query)?;
+    let mut paths = Vec::with_capacity(limit);
+
+    // Filtered-out rows leave the page short; keep scanning until it fills
+    // or the album runs out.
+    loop {
+        let mut params: Vec<i64> = album_id.map(i64::from).into_iter().collect();
+        params.extend([after, limit as i64]);
+        let mut rows = stmt.query(rusqlite::params_from_iter(params))?;
+        let mut scanned = 0;
+        while let Some(row) = rows.next()? {
+            scanned += 1;
+            after = row.get("Z_PK")?;
+            let path = row_path(row)?;
             if matches_media_filter(&path, media_filter) {
                 paths.push(path);
+                if paths.len() == limit {
+                    return Ok(AlbumPage {
+                        paths,
+                        next_cursor: Some(after.to_string()),
+                    });
+                }
             }
         }
-
-        Ok(paths)
-    })
+        if scanned < limit {
+            return Ok(AlbumPage {
+                paths,
+                next_cursor: None,
+            });
+        }
+    }
 }
 
 fn join_device_path(dir: &str, file_name: &str) -> String {
@@ -744,7 +947,7 @@ fn join_device_path(dir: &str, file_name: &str) -> String {
 
 //used in init
 fn explore_recents_album(conn: &Connection) -> anyhow::Result<(String, String, i32)> {
-    let mut recents_stmt = conn.prepare(RECENTS_ALBUM_QUERY)?;
+    let mut recents_stmt = conn.prepare_cached(RECENTS_ALBUM_QUERY)?;
 
     let recents_row = recents_stmt
         .query_row([], |r| {
@@ -760,7 +963,7 @@ fn explore_recents_album(conn: &Connection) -> anyhow::Result<(String, String, i
 }
 
 fn explore_favs_album(conn: &Connection) -> anyhow::Result<(String, String, i32)> {
-    let mut favs_stmt = conn.prepare(FAVS_ALBUM_QUERY)?;
+    let mut favs_stmt = conn.prepare_cached(FAVS_ALBUM_QUERY)?;
 
     let favs_row = favs_stmt
         .query_row([], |r| {
@@ -776,7 +979,7 @@ fn explore_favs_album(conn: &Connection) -> anyhow::Result<(String, String, i32)
 }
 
 fn explore_hidden_album(conn: &Connection) -> anyhow::Result<(String, String, i32)> {
-    let mut hidden_stmt = conn.prepare(HIDDEN_ALBUM_QUERY)?;
+    let mut hidden_stmt = conn.prepare_cached(HIDDEN_ALBUM_QUERY)?;
 
     let hidden_row = hidden_stmt
         .query_row([], |r| {
@@ -792,7 +995,7 @@ fn explore_hidden_album(conn: &Connection) -> anyhow::Result<(String, String, i3
 }
 
 fn explore_recently_deleted(conn: &Connection) -> anyhow::Result<(String, String, i32)> {
-    let mut recently_deleted_stmt = conn.prepare(RECENTLY_DELETED_ALBUM_QUERY)?;
+    let mut recently_deleted_stmt = conn.prepare_cached(RECENTLY_DELETED_ALBUM_QUERY)?;
 
     let recently_deleted_row = recently_deleted_stmt
         .query_row([], |r| {
@@ -815,7 +1018,7 @@ fn explore_other_albums(
 ) -> anyhow::Result<(Vec<GalleryAlbum>, i32)> {
     let query = album_query(ios_ver, assets_table_name, assets_table_album_column);
 
-    let mut stmt = conn.prepare(&query)?;
+    let mut stmt = conn.prepare_cached(&query)?;
     let rows_iter = stmt.query_map([], |row| {
         let album_id: i32 = row.get(0)?;
         let title: String = row.get(1)?;
@@ -992,14 +1195,173 @@ mod tests {
             RECENTLY_DELETED_QUERY,
             HIDDEN_QUERY,
         ] {
+            connection.prepare(&sqlite_index_query(query)).unwrap();
             connection
-                .prepare(&sqlite_ordered_query(query, true))
+                .prepare(&sqlite_page_query(query, true, 1))
                 .unwrap();
             connection
-                .prepare(&sqlite_ordered_query(query, false))
+                .prepare(&sqlite_page_query(query, false, 1))
                 .unwrap();
         }
 
         connection.prepare(HIDDEN_ALBUM_QUERY).unwrap();
     }
+
+    /// Album 7 holding `count` assets; every third one is a video.
+    fn sample_gallery(count: i64) -> Connection {
+        let connection = Connection::open_in_memory().unwrap();
+        connection
+            .execute_batch(
+                "CREATE TABLE ZASSET (
+                    Z_PK INTEGER,
+                    ZFILENAME TEXT,
+                    ZDIRECTORY TEXT,
+                    ZFAVORITE INTEGER,
+                    ZTRASHEDSTATE INTEGER,
+                    ZVISIBILITYSTATE INTEGER,
+                    ZHIDDEN INTEGER
+                );
+                CREATE TABLE ZGENERICALBUM (Z_PK INTEGER);
+                CREATE TABLE Z_28ASSETS (Z_28ALBUMS INTEGER, Z_3ASSETS INTEGER);
+                INSERT INTO ZGENERICALBUM VALUES (7);",
+            )
+            .unwrap();
+        for pk in 1..=count {
+            let name = if pk % 3 == 0 {
+                format!("IMG_{pk}.MOV")
+            } else {
+                format!("IMG_{pk}.JPG")
+            };
+            connection
+                .execute(
+                    "INSERT INTO ZASSET VALUES (?1, ?2, 'DCIM/100APPLE', ?3, 0, 0, 0)",
+                    rusqlite::params![pk, name, pk % 2],
+                )
+                .unwrap();
+            connection
+                .execute("INSERT INTO Z_28ASSETS VALUES (7, ?1)", [pk])
+                .unwrap();
+        }
+        connection
+    }
+
+    #[test]
+    fn album_pages_resume_after_the_cursor_and_skip_filtered_rows() {
+        let connection = sample_gallery(7);
+        let queries = AlbumQueries::new("Z_28ASSETS", "Z_28ALBUMS");
+
+        let recents = |cursor: Option<&str>| {
+            let (sql, album_id) = queries.for_album(RECENTS_ALBUM_ID);
+            read_sqlite_page(
+                &connection,
+                sql.page(true),
+                album_id,
+                GalleryMediaFilter::Images,
+                true,
+                parse_page_cursor(cursor).unwrap(),
+                2,
+            )
+            .unwrap()
+        };
+        let first = recents(None);
+        assert_eq!(
+            first.paths,
+            ["DCIM/100APPLE/IMG_7.JPG", "DCIM/100APPLE/IMG_5.JPG"]
+        );
+        let second = recents(first.next_cursor.as_deref());
+        assert_eq!(
+            second.paths,
+            ["DCIM/100APPLE/IMG_4.JPG", "DCIM/100APPLE/IMG_2.JPG"]
+        );
+        let last = recents(second.next_cursor.as_deref());
+        assert_eq!(last.paths, ["DCIM/100APPLE/IMG_1.JPG"]);
+        assert_eq!(last.next_cursor, None);
+
+        let (sql, album_id) = queries.for_album(7);
+        let oldest = read_sqlite_page(
+            &connection,
+            sql.page(false),
+            album_id,
+            GalleryMediaFilter::Videos,
+            false,
+            None,
+            5,
+        )
+        .unwrap();
+        assert_eq!(
+            oldest.paths,
+            ["DCIM/100APPLE/IMG_3.MOV", "DCIM/100APPLE/IMG_6.MOV"]
+        );
+        assert_eq!(oldest.next_cursor, None);
+    }
+
+    fn sample_state(count: i64) -> SqliteProviderState {
+        SqliteProviderState {
+            connection: Some(sample_gallery(count)),
+            vfs_registration: None,
+            assets_table_name: "Z_28ASSETS".to_string(),
+            assets_table_album_column: "Z_28ALBUMS".to_string(),
+            committed_metadata: SnapshotMetadata::new(),
+            queries: AlbumQueries::new("Z_28ASSETS", "Z_28ALBUMS"),
+            index: GalleryIndex::default(),
+            generation: 0,
+        }
+    }
+
+    #[tokio::test(flavor = "multi_thread")]
+    async fn background_index_read_in_chunks_matches_a_full_index() {
+        let count = INDEX_CHUNK_ROWS as i64 * 2 + 3;
+        let mut expected = sample_state(count);
+        index_sqlite_album(&mut expected, 7).unwrap();
+        let state = Mutex::new(sample_state(count));
+
+        index_sqlite_album_in_background(&state, 7).await.unwrap();
+
+        let state = state.lock().await;
+        let album = |index: &GalleryIndex| index.album(7, GalleryMediaFilter::All, true);
+        assert_eq!(
+            album(&state.index).map(|paths| paths.len()),
+            Some(count as usize)
+        );
+        assert_eq!(album(&state.index), album(&expected.index));
+    }
+
+    /// Times first pages of alternating albums with and without the
+    /// statement cache. Run with
+    /// `cargo test --release album_switch -- --ignored --nocapture`.
+    #[test]
+    #[ignore = "benchmark; needs a large Photos.sqlite"]
+    fn album_switch_benchmark() {
+        const SWITCHES: usize = 2_000;
+        let connection = sample_gallery(20_000);
+        connection.set_prepared_statement_cache_capacity(STATEMENT_CACHE_CAPACITY);
+        let queries = AlbumQueries::new("Z_28ASSETS", "Z_28ALBUMS");
+        let albums = [RECENTS_ALBUM_ID, 7, FAVS_ALBUM_ID, HIDDEN_ALBUM_ID];
+
+        let run = |cached: bool| {
+            let started = Instant::now();
+            for switch in 0..SWITCHES {
+                if !cached {
+                    connection.flush_prepared_statement_cache();
+                }
+                let most_recent_first = switch % 2 == 0;
+                let (sql, album_id) = queries.for_album(albums[switch % albums.len()]);
+                read_sqlite_page(
+                    &connection,
+                    sql.page(most_recent_first),
+                    album_id,
+                    GalleryMediaFilter::All,
+                    most_recent_first,
+                    None,
+                    240,
+                )
+                .unwrap();
+            }
+            started.elapsed() / SWITCHES as u32
+        };
+
+        let prepared = run(false);
+        let cached = run(true);
+        println!("album switch: prepared each time {prepared:?}, cached {cached:?}");
+    }
 }
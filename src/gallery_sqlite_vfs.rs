@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
 use crate::constants::{PHOTOS_SQLITE_REMOTE_PATH, PHOTOS_SQLITE_WAL_REMOTE_PATH};
+use crate::gallery_vfs_cache::DiskBlocks;
 use crate::run_sync;
 use anyhow::{Context, anyhow};
 use idevice::afc::AfcClient;
@@ -10,7 +11,7 @@ use idevice::afc::file::OwnedFileDescriptor;
 use idevice::afc::opcode::AfcFopenMode;
 use idevice::provider::IdeviceProvider;
 use idevice::{IdeviceError, IdeviceService};
-use log::{debug, warn};
+use log::{debug, info, warn};
 use lru::LruCache;
 use once_cell::sync::Lazy;
 use rusqlite::{Connection, OpenFlags};
@@ -22,15 +23,27 @@ use std::io::{Error, ErrorKind, SeekFrom};
 use std::num::NonZeroUsize;
 use std::ops::Range;
 use std::sync::atomic::{AtomicU64, Ordering};
-use std::sync::{Arc, Mutex as StdMutex, OnceLock, RwLock};
-use std::time::Duration;
+use std::sync::{Arc, Mutex as StdMutex, MutexGuard as StdMutexGuard, OnceLock, RwLock};
+use std::time::{Duration, Instant};
 use tokio::io::AsyncSeekExt;
-use tokio::sync::Mutex;
+use tokio::sync::{Mutex, OwnedMutexGuard, watch};
 
 pub const GALLERY_AFC_VFS_NAME: &str = "idescriptor-afc-gallery";
 //TODO: test on linux and windows
-const CACHE_BLOCK_SIZE: usize = 1024 * 1024;
-const CACHE_BLOCK_COUNT: usize = 64;
+const CACHE_BLOCK_SIZE: usize = 128 * 1024;
+/// 64 MiB of cached blocks.
+const CACHE_BLOCK_COUNT: usize = 512;
+/// Blocks fetched per miss: one for scattered B-tree probes, up to 2 MiB for
+/// scans.
+const MIN_FETCH_BLOCKS: u64 = 1;
+const INITIAL_FETCH_BLOCKS: u64 = 4;
+const MAX_FETCH_BLOCKS: u64 = 16;
+/// Consecutive block steps before reads count as a scan and read-ahead
+/// starts.
+const SEQUENTIAL_STREAK: u32 = 2;
+/// Photos.sqlite descriptors, each on its own AFC connection. Misses use any
+/// free one; read-ahead is spread over all but the first.
+const FETCH_LANES: usize = 3;
 const SNAPSHOT_ATTEMPTS: usize = 3;
 
 static REGISTER_RESULT: OnceLock<Result<(), String>> = OnceLock::new();
@@ -44,13 +57,61 @@ struct RemoteMetadata {
     modified: String,
 }
 
+type FetchLane = Arc<Mutex<Option<OwnedFileDescriptor>>>;
+
 struct RemoteDatabase {
-    file: Arc<Mutex<Option<OwnedFileDescriptor>>>,
+    lanes: Vec<FetchLane>,
     //FIXME: remove if not needed
     #[allow(dead_code)]
     metadata_afc: Arc<Mutex<AfcClient>>,
     expected: RemoteMetadata,
-    cache: StdMutex<LruCache<u64, Arc<Vec<u8>>>>,
+    blocks: Arc<StdMutex<BlockState>>,
+    /// Blocks kept from earlier sessions; see `gallery_vfs_cache`.
+    disk: Option<Arc<DiskBlocks>>,
+    stats: Arc<VfsStats>,
+}
+
+struct BlockState {
+    cache: LruCache<u64, Arc<Vec<u8>>>,
+    /// Blocks being fetched; the receiver closes once the fetch is done.
+    in_flight: HashMap<u64, watch::Receiver<()>>,
+    pattern: AccessPattern,
+}
+
+/// Follows which block SQLite reads next and sizes fetches to match.
+#[derive(Debug)]
+struct AccessPattern {
+    last: Option<u64>,
+    streak: u32,
+    window: u64,
+}
+
+/// A run of blocks this reader has promised to fetch. Dropping it without
+/// completing wakes any waiters, who then fetch the blocks themselves.
+struct Claim {
+    first: u64,
+    count: u64,
+    _done: watch::Sender<()>,
+}
+
+enum Lookup {
+    Hit(Arc<Vec<u8>>),
+    OnDisk(Arc<DiskBlocks>),
+    Pending(watch::Receiver<()>),
+    Miss(Claim),
+}
+
+/// How the block cache performed, logged when the database is closed.
+#[derive(Default)]
+struct VfsStats {
+    hits: AtomicU64,
+    disk_hits: AtomicU64,
+    /// Blocks that were already on their way from a read-ahead.
+    read_ahead_waits: AtomicU64,
+    misses: AtomicU64,
+    stalled_micros: AtomicU64,
+    fetched_bytes: AtomicU64,
+    read_ahead_bytes: AtomicU64,
 }
 /*
   vfs is still experimental and doesn't provide much benefit over local copy of the Photos.sqlite file,
@@ -139,45 +200,114 @@ async fn close_registered_database(virtual_path: String) -> anyhow::Result<()> {
         return Ok(());
     };
 
-    let file = database.main.file.lock().await.take();
-    if let Some(file) = file {
-        file.close()
-            .await
-            .context("Failed to close Photos.sqlite AFC descriptor")?;
-        debug!("Closed Photos.sqlite AFC descriptor for gallery VFS generation {virtual_path}");
+    info!(
+        "Gallery VFS generation {virtual_path}: {}",
+        database
+            .main
+            .stats
+            .summary(database.main.expected.size as u64)
+    );
+    if let Some(disk) = database.main.disk.clone() {
+        match tokio::task::spawn_blocking(move || disk.persist()).await {
+            Ok(Ok(())) => {}
+            Ok(Err(error)) => warn!("Failed to save the gallery VFS disk cache: {error}"),
+            Err(error) => warn!("Gallery VFS disk cache worker failed: {error}"),
+        }
     }
+    for lane in &database.main.lanes {
+        let file = lane.lock().await.take();
+        if let Some(file) = file {
+            file.close()
+                .await
+                .context("Failed to close Photos.sqlite AFC descriptor")?;
+        }
+    }
+    debug!("Closed Photos.sqlite AFC descriptors for gallery VFS generation {virtual_path}");
     Ok(())
 }
 
-pub async fn open_gallery_vfs_connection(
-    afc: Arc<Mutex<AfcClient>>,
-    provider: Arc<Mutex<Box<dyn IdeviceProvider>>>,
-) -> anyhow::Result<(Connection, GalleryVfsRegistration)> {
-    ensure_vfs_registered()?;
+async fn open_disk_blocks(udid: &str, metadata: &RemoteMetadata) -> Option<Arc<DiskBlocks>> {
+    let udid = udid.to_string();
+    let size = metadata.size as u64;
+    let modified = metadata.modified.clone();
+    let opened = tokio::task::spawn_blocking(move || {
+        DiskBlocks::open(&udid, size, &modified, CACHE_BLOCK_SIZE)
+    })
+    .await;
+    match opened {
+        Ok(Ok(disk)) => {
+            debug!(
+                "Gallery VFS disk cache holds {} blocks of this database",
+                disk.block_count()
+            );
+            Some(disk)
+        }
+        Ok(Err(error)) => {
+            warn!("Gallery VFS continues without its disk cache: {error}");
+            None
+        }
+        Err(error) => {
+            warn!("Gallery VFS disk cache worker failed: {error}");
+            None
+        }
+    }
+}
 
-    let (main_metadata, wal) = capture_stable_remote_files(afc.clone()).await?;
-    debug!("Creating dedicated AFC connection for the gallery VFS");
-    let dedicated_afc = {
+async fn open_fetch_lane(
+    provider: &Arc<Mutex<Box<dyn IdeviceProvider>>>,
+) -> anyhow::Result<OwnedFileDescriptor> {
+    let afc = {
         let provider = provider.lock().await;
         AfcClient::connect(provider.as_ref())
             .await
             .context("Failed to create the gallery VFS AFC connection")?
     };
-    debug!("Opening Photos.sqlite on the dedicated gallery VFS AFC connection");
-    let main_file = dedicated_afc
-        .open_owned(PHOTOS_SQLITE_REMOTE_PATH, AfcFopenMode::RdOnly)
+    afc.open_owned(PHOTOS_SQLITE_REMOTE_PATH, AfcFopenMode::RdOnly)
         .await
-        .context("Failed to open Photos.sqlite for the gallery VFS")?;
+        .context("Failed to open Photos.sqlite for the gallery VFS")
+}
+
+pub async fn open_gallery_vfs_connection(
+    afc: Arc<Mutex<AfcClient>>,
+    provider: Arc<Mutex<Box<dyn IdeviceProvider>>>,
+    udid: &str,
+) -> anyhow::Result<(Connection, GalleryVfsRegistration)> {
+    ensure_vfs_registered()?;
+
+    let (main_metadata, wal) = capture_stable_remote_files(afc.clone()).await?;
+    let disk = open_disk_blocks(udid, &main_metadata).await;
+    debug!("Opening Photos.sqlite on dedicated gallery VFS AFC connections");
+    let mut lanes = vec![Arc::new(Mutex::new(Some(
+        open_fetch_lane(&provider).await?,
+    )))];
+    for _ in 1..FETCH_LANES {
+        match open_fetch_lane(&provider).await {
+            Ok(file) => lanes.push(Arc::new(Mutex::new(Some(file)))),
+            Err(error) => {
+                warn!(
+                    "Gallery VFS continues with {} AFC connection(s): {error}",
+                    lanes.len()
+                );
+                break;
+            }
+        }
+    }
 
     let virtual_path = format!("idescriptor-gallery-{}.sqlite", uuid::Uuid::new_v4());
     let database = Arc::new(GalleryVfsDatabase {
         main: RemoteDatabase {
-            file: Arc::new(Mutex::new(Some(main_file))),
+            lanes,
             metadata_afc: afc,
             expected: main_metadata,
-            cache: StdMutex::new(LruCache::new(
-                NonZeroUsize::new(CACHE_BLOCK_COUNT).expect("cache capacity is non-zero"),
-            )),
+            blocks: Arc::new(StdMutex::new(BlockState {
+                cache: LruCache::new(
+                    NonZeroUsize::new(CACHE_BLOCK_COUNT).expect("cache capacity is non-zero"),
+                ),
+                in_flight: HashMap::new(),
+                pattern: AccessPattern::default(),
+            })),
+            disk,
+            stats: Arc::new(VfsStats::default()),
         },
         wal: wal.map(Arc::new),
         wal_index: Arc::new(StdMutex::new(WalIndexState::default())),
@@ -357,24 +487,78 @@ impl RemoteDatabase {
         }
     }
 
-    fn cached_block(&self, block_index: u64) -> Result<Arc<Vec<u8>>, Error> {
-        if let Some(block) = self
-            .cache
+    fn lock_blocks(&self) -> Result<StdMutexGuard<'_, BlockState>, Error> {
+        self.blocks
             .lock()
-            .map_err(|_| Error::other("Gallery VFS cache lock is poisoned"))?
-            .get(&block_index)
-            .cloned()
-        {
-            return Ok(block);
-        }
+            .map_err(|_| Error::other("Gallery VFS cache lock is poisoned"))
+    }
 
-        let offset = block_index * CACHE_BLOCK_SIZE as u64;
-        let read_len = (self.expected.size as u64)
-            .saturating_sub(offset)
-            .min(CACHE_BLOCK_SIZE as u64) as usize;
+    fn block_count(&self) -> u64 {
+        (self.expected.size as u64).div_ceil(CACHE_BLOCK_SIZE as u64)
+    }
+
+    fn cached_block(&self, block_index: u64) -> Result<Arc<Vec<u8>>, Error> {
+        let started = Instant::now();
+        let (lookup, read_ahead) = {
+            let mut state = self.lock_blocks()?;
+            let window = state.pattern.observe(block_index);
+            let lookup = match state.cache.get(&block_index) {
+                Some(block) => Lookup::Hit(block.clone()),
+                None => match (state.in_flight.get(&block_index), self.on_disk(block_index)) {
+                    (Some(pending), _) => Lookup::Pending(pending.clone()),
+                    (None, Some(disk)) => Lookup::OnDisk(disk),
+                    (None, None) => Lookup::Miss(self.claim(&mut state, block_index, window)),
+                },
+            };
+            let read_ahead = if state.pattern.is_sequential() {
+                self.claim_read_ahead(&mut state, block_index, window)
+            } else {
+                Vec::new()
+            };
+            (lookup, read_ahead)
+        };
+        self.spawn_read_ahead(read_ahead);
+
+        let claim = match lookup {
+            Lookup::Hit(block) => {
+                self.stats.hits.fetch_add(1, Ordering::Relaxed);
+                return Ok(block);
+            }
+            Lookup::OnDisk(disk) => match disk.load(block_index) {
+                Ok(bytes) => {
+                    let block = Arc::new(bytes);
+                    self.lock_blocks()?.cache.put(block_index, block.clone());
+                    self.stats.disk_hits.fetch_add(1, Ordering::Relaxed);
+                    return Ok(block);
+                }
+                Err(error) => {
+                    warn!("Gallery VFS disk cache block {block_index} is unreadable: {error}");
+                    disk.forget(block_index);
+                    let mut state = self.lock_blocks()?;
+                    self.claim(&mut state, block_index, MIN_FETCH_BLOCKS)
+                }
+            },
+            Lookup::Pending(mut pending) => {
+                run_sync(async move {
+                    let _ = pending.changed().await;
+                });
+                let mut state = self.lock_blocks()?;
+                if let Some(block) = state.cache.get(&block_index).cloned() {
+                    self.stats.read_ahead_waits.fetch_add(1, Ordering::Relaxed);
+                    self.stats.record_stall(started);
+                    return Ok(block);
+                }
+                // The read-ahead failed; fetch just this block.
+                self.claim(&mut state, block_index, MIN_FETCH_BLOCKS)
+            }
+            Lookup::Miss(claim) => claim,
+        };
+
+        let offset = claim.first * CACHE_BLOCK_SIZE as u64;
+        let read_len = self.claim_len(&claim);
         // let expected = self.expected.clone();
         // let metadata_afc = self.metadata_afc.clone();
-        let file = self.file.clone();
+        let lanes = self.lanes.clone();
         let bytes = run_sync(async move {
             //TODO: should we do this?
             // let current = {
@@ -390,30 +574,286 @@ impl RemoteDatabase {
             //     ));
             // }
 
-            let mut file = file.lock().await;
-            let file = file
-                .as_mut()
-                .ok_or_else(|| Error::other("Photos.sqlite AFC descriptor is closed"))?;
-            file.seek(SeekFrom::Start(offset))
-                .await
-                .map_err(to_io_error)?;
-            let bytes = file.read_n(read_len).await.map_err(to_io_error)?;
-            if bytes.len() != read_len {
-                return Err(Error::new(
-                    ErrorKind::UnexpectedEof,
-                    "AFC returned a short Photos.sqlite read",
-                ));
+            let mut file = free_lane(&lanes).await;
+            read_run(&mut file, offset, read_len).await
+        });
+        let first = claim.first;
+        let block = complete_claim(&self.blocks, claim, bytes.as_deref().ok())?;
+        let bytes = bytes?;
+        // Off the SQLite thread: storing may sync the block file.
+        if let Some(disk) = self.disk.clone() {
+            crate::RUNTIME.spawn_blocking(move || {
+                if let Err(error) = disk.store(first, &bytes) {
+                    warn!("Failed to store gallery VFS blocks on disk: {error}");
+                }
+            });
+        }
+
+        self.stats.misses.fetch_add(1, Ordering::Relaxed);
+        self.stats
+            .fetched_bytes
+            .fetch_add(read_len as u64, Ordering::Relaxed);
+        self.stats.record_stall(started);
+        block.ok_or_else(|| Error::other("Gallery VFS lost a fetched block"))
+    }
+
+    /// Claims up to `max` blocks from `first` that are neither cached nor
+    /// already being fetched. `first` itself must be free.
+    fn claim(&self, state: &mut BlockState, first: u64, max: u64) -> Claim {
+        let count = self.free_run(state, first, max);
+        claim_blocks(state, first, count)
+    }
+
+    /// How many blocks from `first`, up to `max`, are free to fetch.
+    fn free_run(&self, state: &BlockState, first: u64, max: u64) -> u64 {
+        let end = first.saturating_add(max).min(self.block_count());
+        let mut count = 1;
+        while first + count < end && self.is_free(state, first + count) {
+            count += 1;
+        }
+        count
+    }
+
+    /// Whether `index` still has to come from the device.
+    fn is_free(&self, state: &BlockState, index: u64) -> bool {
+        !state.cache.contains(&index)
+            && !state.in_flight.contains_key(&index)
+            && self.on_disk(index).is_none()
+    }
+
+    fn on_disk(&self, index: u64) -> Option<Arc<DiskBlocks>> {
+        self.disk.clone().filter(|disk| disk.contains(index))
+    }
+
+    /// Keeps a window of blocks past `block_index` cached or on its way.
+    /// Nothing is claimed while at least half the window is still ahead, so
+    /// read-ahead goes out in large runs instead of a block at a time.
+    fn claim_read_ahead(
+        &self,
+        state: &mut BlockState,
+        block_index: u64,
+        window: u64,
+    ) -> Vec<Claim> {
+        let block_count = self.block_count();
+        let mut next = block_index + 1;
+        while next < block_count && next <= block_index + window && !self.is_free(state, next) {
+            next += 1;
+        }
+        if next >= block_count || next - block_index - 1 >= window.div_ceil(2) {
+            return Vec::new();
+        }
+
+        let count = self.free_run(state, next, window);
+        let lanes = self.lanes.len().saturating_sub(1).max(1) as u64;
+        split_run(next, count, lanes)
+            .into_iter()
+            .map(|(first, count)| claim_blocks(state, first, count))
+            .collect()
+    }
+
+    fn claim_len(&self, claim: &Claim) -> usize {
+        let offset = claim.first * CACHE_BLOCK_SIZE as u64;
+        (self.expected.size as u64)
+            .saturating_sub(offset)
+            .min(claim.count * CACHE_BLOCK_SIZE as u64) as usize
+    }
+
+    fn spawn_read_ahead(&self, claims: Vec<Claim>) {
+        let read_ahead_lanes = if self.lanes.len() > 1 {
+            &self.lanes[1..]
+        } else {
+            &self.lanes[..]
+        };
+        for (index, claim) in claims.into_iter().enumerate() {
+            let lane = read_ahead_lanes[index % read_ahead_lanes.len()].clone();
+            let blocks = self.blocks.clone();
+            let disk = self.disk.clone();
+            let stats = self.stats.clone();
+            let offset = claim.first * CACHE_BLOCK_SIZE as u64;
+            let read_len = self.claim_len(&claim);
+            crate::RUNTIME.spawn(async move {
+                let mut file = lane.lock_owned().await;
+                let bytes = read_run(&mut file, offset, read_len).await;
+                drop(file);
+                match &bytes {
+                    Ok(_) => {
+                        stats
+                            .read_ahead_bytes
+                            .fetch_add(read_len as u64, Ordering::Relaxed);
+                        stats
+                            .fetched_bytes
+                            .fetch_add(read_len as u64, Ordering::Relaxed);
+                    }
+                    Err(error) => debug!("Gallery VFS read-ahead at {offset} failed: {error}"),
+                }
+                let first = claim.first;
+                if let Err(error) = complete_claim(&blocks, claim, bytes.as_deref().ok()) {
+                    warn!("Gallery VFS read-ahead could not be stored: {error}");
+                }
+                if let (Some(disk), Ok(bytes)) = (disk, bytes) {
+                    let stored =
+                        tokio::task::spawn_blocking(move || disk.store(first, &bytes)).await;
+                    if let Ok(Err(error)) = stored {
+                        warn!("Failed to store gallery VFS blocks on disk: {error}");
+                    }
+                }
+            });
+        }
+    }
+}
+
+impl Default for AccessPattern {
+    fn default() -> Self {
+        Self {
+            last: None,
+            streak: 0,
+            window: INITIAL_FETCH_BLOCKS,
+        }
+    }
+}
+
+impl AccessPattern {
+    /// Records a read of `block` and returns how many blocks to fetch at a
+    /// time. Stepping to the next block grows the window; jumping elsewhere
+    /// shrinks it. Rereading the same block changes nothing.
+    fn observe(&mut self, block: u64) -> u64 {
+        match self.last {
+            None => {}
+            Some(last) if block == last => return self.window,
+            Some(last) if block == last + 1 => {
+                self.streak += 1;
+                if self.is_sequential() {
+                    self.window = (self.window * 2).min(MAX_FETCH_BLOCKS);
+                }
+            }
+            _ => {
+                self.streak = 0;
+                self.window = (self.window / 2).max(MIN_FETCH_BLOCKS);
+            }
+        }
+        self.last = Some(block);
+        self.window
+    }
+
+    fn is_sequential(&self) -> bool {
+        self.streak >= SEQUENTIAL_STREAK
+    }
+}
+
+impl VfsStats {
+    fn record_stall(&self, started: Instant) {
+        self.stalled_micros
+            .fetch_add(started.elapsed().as_micros() as u64, Ordering::Relaxed);
+    }
+
+    fn summary(&self, database_size: u64) -> String {
+        let hits = self.hits.load(Ordering::Relaxed);
+        let disk_hits = self.disk_hits.load(Ordering::Relaxed);
+        let waits = self.read_ahead_waits.load(Ordering::Relaxed);
+        let misses = self.misses.load(Ordering::Relaxed);
+        let stalled_ms = self.stalled_micros.load(Ordering::Relaxed) as f64 / 1000.0;
+        let lookups = (hits + disk_hits + waits + misses).max(1);
+        let stalls = (waits + misses).max(1);
+        let mib = |bytes: u64| bytes as f64 / (1024.0 * 1024.0);
+        format!(
+            "{:.1}% hit rate ({hits} hits, {disk_hits} from disk, {waits} read-ahead waits, \
+             {misses} misses), \
+             {:.2} ms mean stall, {stalled_ms:.0} ms stalled in total, \
+             fetched {:.1} MiB ({:.1} MiB read-ahead) of {:.1} MiB",
+            (hits + disk_hits) as f64 * 100.0 / lookups as f64,
+            stalled_ms / stalls as f64,
+            mib(self.fetched_bytes.load(Ordering::Relaxed)),
+            mib(self.read_ahead_bytes.load(Ordering::Relaxed)),
+            mib(database_size),
+        )
+    }
+}
+
+fn claim_blocks(state: &mut BlockState, first: u64, count: u64) -> Claim {
+    let (done, pending) = watch::channel(());
+    for index in first..first + count {
+        state.in_flight.insert(index, pending.clone());
+    }
+    Claim {
+        first,
+        count,
+        _done: done,
+    }
+}
+
+/// Caches the blocks of a finished fetch (nothing if it failed), releases
+/// the claim and returns its first block.
+fn complete_claim(
+    blocks: &StdMutex<BlockState>,
+    claim: Claim,
+    bytes: Option<&[u8]>,
+) -> Result<Option<Arc<Vec<u8>>>, Error> {
+    let mut state = blocks
+        .lock()
+        .map_err(|_| Error::other("Gallery VFS cache lock is poisoned"))?;
+    let mut first = None;
+    if let Some(bytes) = bytes {
+        for (offset, chunk) in bytes.chunks(CACHE_BLOCK_SIZE).enumerate() {
+            let block = Arc::new(chunk.to_vec());
+            if offset == 0 {
+                first = Some(block.clone());
             }
-            Ok(bytes)
-        })?;
+            state.cache.put(claim.first + offset as u64, block);
+        }
+    }
+    for index in claim.first..claim.first + claim.count {
+        state.in_flight.remove(&index);
+    }
+    Ok(first)
+}
 
-        let block = Arc::new(bytes);
-        self.cache
-            .lock()
-            .map_err(|_| Error::other("Gallery VFS cache lock is poisoned"))?
-            .put(block_index, block.clone());
-        Ok(block)
+/// Splits `count` blocks from `first` into at most `parts` contiguous runs
+/// of near-equal length.
+fn split_run(first: u64, count: u64, parts: u64) -> Vec<(u64, u64)> {
+    let parts = parts.clamp(1, count.max(1));
+    let base = count / parts;
+    let extra = count % parts;
+    let mut next = first;
+    (0..parts)
+        .map(|part| {
+            let len = base + u64::from(part < extra);
+            let run = (next, len);
+            next += len;
+            run
+        })
+        .filter(|(_, len)| *len > 0)
+        .collect()
+}
+
+/// The first idle descriptor, or the first one once it frees up.
+async fn free_lane(lanes: &[FetchLane]) -> OwnedMutexGuard<Option<OwnedFileDescriptor>> {
+    for lane in lanes {
+        if let Ok(file) = lane.clone().try_lock_owned() {
+            return file;
+        }
+    }
+    lanes[0].clone().lock_owned().await
+}
+
+async fn read_run(
+    file: &mut Option<OwnedFileDescriptor>,
+    offset: u64,
+    read_len: usize,
+) -> Result<Vec<u8>, Error> {
+    let file = file
+        .as_mut()
+        .ok_or_else(|| Error::other("Photos.sqlite AFC descriptor is closed"))?;
+    file.seek(SeekFrom::Start(offset))
+        .await
+        .map_err(to_io_error)?;
+    let bytes = file.read_n(read_len).await.map_err(to_io_error)?;
+    if bytes.len() != read_len {
+        return Err(Error::new(
+            ErrorKind::UnexpectedEof,
+            "AFC returned a short Photos.sqlite read",
+        ));
     }
+    Ok(bytes)
 }
 
 fn to_io_error(error: impl std::fmt::Display) -> Error {
@@ -672,3 +1112,36 @@ impl WalIndex for GalleryWalIndex {
         Ok(())
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn fetch_window_grows_on_scans_and_shrinks_on_jumps() {
+        let mut pattern = AccessPattern::default();
+        assert_eq!(pattern.observe(10), INITIAL_FETCH_BLOCKS);
+        assert_eq!(pattern.observe(10), INITIAL_FETCH_BLOCKS);
+        pattern.observe(11);
+        assert!(!pattern.is_sequential());
+        for block in 12..20 {
+            pattern.observe(block);
+        }
+        assert!(pattern.is_sequential());
+        assert_eq!(pattern.window, MAX_FETCH_BLOCKS);
+
+        for block in [400, 7, 90, 3, 250] {
+            pattern.observe(block);
+        }
+        assert!(!pattern.is_sequential());
+        assert_eq!(pattern.window, MIN_FETCH_BLOCKS);
+    }
+
+    #[test]
+    fn runs_split_evenly_across_lanes() {
+        assert_eq!(split_run(8, 16, 2), vec![(8, 8), (16, 8)]);
+        assert_eq!(split_run(0, 5, 2), vec![(0, 3), (3, 2)]);
+        assert_eq!(split_run(3, 1, 4), vec![(3, 1)]);
+        assert_eq!(split_run(3, 0, 2), Vec::new());
+    }
+}
@@ -0,0 +1,339 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! On-disk cache of Photos.sqlite blocks for the gallery VFS.
+//!
+//! Each VFS generation used to start with an empty memory cache, so reopening
+//! the gallery fetched the schema, album tables and index roots again. Blocks
+//! the VFS fetches are now also written to a sparse local copy of the
+//! database, one per device, next to an index of which blocks it holds. The
+//! index is stamped with the remote size and modification time (and the
+//! block size); a copy taken from a different database is discarded when the
+//! cache is opened.
+//!
+//! The index is only rewritten after the block file has been synced, so a
+//! block marked present always holds the bytes that were fetched.
+
+use crate::local_sink::{read_exact_at, write_all_at};
+use once_cell::sync::Lazy;
+use std::collections::HashMap;
+use std::fs::{File, OpenOptions};
+use std::io;
+use std::path::{Path, PathBuf};
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, Weak};
+
+const ROOT_DIR: &str = "idescriptor-vfs-cache";
+const BLOCKS_FILE: &str = "Photos.sqlite.blocks";
+const INDEX_FILE: &str = "Photos.sqlite.index";
+/// Blocks stored between index rewrites; a crash forgets at most this many.
+const PERSIST_EVERY: usize = 64;
+
+/// Caches open right now, so two generations of the same database share one
+/// index instead of overwriting each other's.
+static OPEN: Lazy<Mutex<HashMap<PathBuf, Weak<DiskBlocks>>>> =
+    Lazy::new(|| Mutex::new(HashMap::new()));
+static NEXT_TEMPORARY: AtomicU64 = AtomicU64::new(0);
+
+pub struct DiskBlocks {
+    dir: PathBuf,
+    stamp: String,
+    block_size: usize,
+    size: u64,
+    file: File,
+    index: Mutex<IndexState>,
+    /// Held while the index is rewritten, so snapshots land in order.
+    saving: Mutex<()>,
+}
+
+struct IndexState {
+    present: Vec<u8>,
+    unsaved: usize,
+}
+
+impl DiskBlocks {
+    /// Opens the cache for `udid`, keeping earlier blocks only if they came
+    /// from a database of this size and modification time.
+    pub fn open(udid: &str, size: u64, modified: &str, block_size: usize) -> io::Result<Arc<Self>> {
+        Self::open_in(
+            &std::env::temp_dir().join(ROOT_DIR),
+            udid,
+            size,
+            modified,
+            block_size,
+        )
+    }
+
+    fn open_in(
+        root: &Path,
+        udid: &str,
+        size: u64,
+        modified: &str,
+        block_size: usize,
+    ) -> io::Result<Arc<Self>> {
+        let dir = root.join(sanitize(udid));
+        let stamp = format!("v1 {block_size} {size} {modified}");
+        let mut open = OPEN
+            .lock()
+            .map_err(|_| io::Error::other("Gallery VFS disk cache registry is poisoned"))?;
+        if let Some(existing) = open.get(&dir).and_then(Weak::upgrade) {
+            if existing.stamp == stamp {
+                return Ok(existing);
+            }
+        }
+
+        std::fs::create_dir_all(&dir)?;
+        let blocks_path = dir.join(BLOCKS_FILE);
+        let bitmap_len = (size.div_ceil(block_size as u64) as usize).div_ceil(8);
+        let present = match read_index(&dir.join(INDEX_FILE), &stamp) {
+            Some(present) if present.len() == bitmap_len && blocks_path.exists() => present,
+            _ => {
+                // Unlink rather than truncate: an older generation may still
+                // be writing to the previous file.
+                remove_if_present(&dir.join(INDEX_FILE))?;
+                remove_if_present(&blocks_path)?;
+                vec![0; bitmap_len]
+            }
+        };
+        let file = OpenOptions::new()
+            .read(true)
+            .write(true)
+            .create(true)
+            .truncate(false)
+            .open(&blocks_path)?;
+        file.set_len(size)?;
+
+        let blocks = Arc::new(Self {
+            dir: dir.clone(),
+            stamp,
+            block_size,
+            size,
+            file,
+            index: Mutex::new(IndexState {
+                present,
+                unsaved: 0,
+            }),
+            saving: Mutex::new(()),
+        });
+        open.retain(|_, cache| cache.strong_count() > 0);
+        open.insert(dir, Arc::downgrade(&blocks));
+        Ok(blocks)
+    }
+
+    fn lock_index(&self) -> io::Result<std::sync::MutexGuard<'_, IndexState>> {
+        self.index
+            .lock()
+            .map_err(|_| io::Error::other("Gallery VFS disk cache index is poisoned"))
+    }
+
+    pub fn contains(&self, block: u64) -> bool {
+        self.lock_index()
+            .is_ok_and(|index| is_set(&index.present, block))
+    }
+
+    pub fn block_count(&self) -> usize {
+        self.lock_index().map_or(0, |index| {
+            index
+                .present
+                .iter()
+                .map(|byte| byte.count_ones() as usize)
+                .sum()
+        })
+    }
+
+    pub fn load(&self, block: u64) -> io::Result<Vec<u8>> {
+        let offset = block * self.block_size as u64;
+        let len = self.size.saturating_sub(offset).min(self.block_size as u64) as usize;
+        let mut bytes = vec![0; len];
+        read_exact_at(&self.file, &mut bytes, offset)?;
+        Ok(bytes)
+    }
+
+    /// Writes consecutive blocks starting at `first` and marks them present.
+    pub fn store(&self, first: u64, bytes: &[u8]) -> io::Result<()> {
+        write_all_at(&self.file, bytes, first * self.block_size as u64)?;
+        let count = bytes.len().div_ceil(self.block_size);
+        let persist = {
+            let mut index = self.lock_index()?;
+            for block in first..first + count as u64 {
+                set(&mut index.present, block);
+            }
+            index.unsaved += count;
+            index.unsaved >= PERSIST_EVERY
+        };
+        if persist { self.persist() } else { Ok(()) }
+    }
+
+    /// Forgets a block that could not be read back.
+    pub fn forget(&self, block: u64) {
+        if let Ok(mut index) = self.lock_index() {
+            clear(&mut index.present, block);
+        }
+    }
+
+    /// Syncs the block file, then records which blocks it holds.
+    pub fn persist(&self) -> io::Result<()> {
+        let _saving = self
+            .saving
+            .lock()
+            .map_err(|_| io::Error::other("Gallery VFS disk cache writer is poisoned"))?;
+        // Snapshot first: every block in it was written before the sync below.
+        let present = {
+            let mut index = self.lock_index()?;
+            index.unsaved = 0;
+            index.present.clone()
+        };
+        self.file.sync_data()?;
+
+        let mut contents = Vec::with_capacity(self.stamp.len() + 1 + present.len());
+        contents.extend_from_slice(self.stamp.as_bytes());
+        contents.push(b'\n');
+        contents.extend_from_slice(&present);
+        // Every writer gets its own temp file; generations of one database
+        // share the directory.
+        let temporary = self.dir.join(format!(
+            "{INDEX_FILE}.{}-{}.tmp",
+            std::process::id(),
+            NEXT_TEMPORARY.fetch_add(1, Ordering::Relaxed)
+        ));
+        std::fs::write(&temporary, contents)?;
+        let open = OPEN
+            .lock()
+            .map_err(|_| io::Error::other("Gallery VFS disk cache registry is poisoned"))?;
+        // A generation replaced by a newer database must not put its index
+        // over the newer one.
+        let current = open
+            .get(&self.dir)
+            .is_some_and(|cache| std::ptr::eq(cache.as_ptr(), self));
+        if !current {
+            return remove_if_present(&temporary);
+        }
+        std::fs::rename(&temporary, self.dir.join(INDEX_FILE))
+    }
+}
+
+fn read_index(path: &Path, stamp: &str) -> Option<Vec<u8>> {
+    let contents = std::fs::read(path).ok()?;
+    let newline = contents.iter().position(|byte| *byte == b'\n')?;
+    (&contents[..newline] == stamp.as_bytes()).then(|| contents[newline + 1..].to_vec())
+}
+
+fn remove_if_present(path: &Path) -> io::Result<()> {
+    match std::fs::remove_file(path) {
+        Err(error) if error.kind() != io::ErrorKind::NotFound => Err(error),
+        _ => Ok(()),
+    }
+}
+
+fn sanitize(udid: &str) -> String {
+    udid.chars()
+        .map(|character| {
+            if character.is_ascii_alphanumeric() || character == '-' {
+                character
+            } else {
+                '_'
+            }
+        })
+        .collect()
+}
+
+fn is_set(bitmap: &[u8], block: u64) -> bool {
+    bitmap
+        .get((block / 8) as usize)
+        .is_some_and(|byte| byte & (1 << (block % 8)) != 0)
+}
+
+fn set(bitmap: &mut [u8], block: u64) {
+    if let Some(byte) = bitmap.get_mut((block / 8) as usize) {
+        *byte |= 1 << (block % 8);
+    }
+}
+
+fn clear(bitmap: &mut [u8], block: u64) {
+    if let Some(byte) = bitmap.get_mut((block / 8) as usize) {
+        *byte &= !(1 << (block % 8));
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    const BLOCK: usize = 4096;
+
+    fn temp_root() -> PathBuf {
+        std::env::temp_dir().join(format!("idescriptor-vfs-cache-{}", uuid::Uuid::new_v4()))
+    }
+
+    fn block(fill: u8, len: usize) -> Vec<u8> {
+        vec![fill; len]
+    }
+
+    #[test]
+    fn blocks_survive_reopening_an_unchanged_database() {
+        let root = temp_root();
+        let size = (3 * BLOCK + 100) as u64;
+        {
+            let cache =
+                DiskBlocks::open_in(&root, "00008030-ABC", size, "1700", BLOCK).expect("opened");
+            let mut run = block(1, BLOCK);
+            run.extend(block(2, BLOCK));
+            cache.store(1, &run).expect("stored");
+            cache.store(3, &block(3, 100)).expect("stored tail");
+            cache.persist().expect("persisted");
+        }
+
+        let cache =
+            DiskBlocks::open_in(&root, "00008030-ABC", size, "1700", BLOCK).expect("reopened");
+        assert!(!cache.contains(0));
+        assert_eq!(cache.block_count(), 3);
+        assert_eq!(cache.load(2).expect("loaded"), block(2, BLOCK));
+        assert_eq!(cache.load(3).expect("loaded tail"), block(3, 100));
+        let _ = std::fs::remove_dir_all(&root);
+    }
+
+    #[test]
+    fn a_changed_database_starts_from_scratch() {
+        let root = temp_root();
+        let size = (2 * BLOCK) as u64;
+        {
+            let cache = DiskBlocks::open_in(&root, "dev", size, "1700", BLOCK).expect("opened");
+            cache.store(0, &block(7, BLOCK)).expect("stored");
+            cache.persist().expect("persisted");
+        }
+
+        let cache = DiskBlocks::open_in(&root, "dev", size, "1800", BLOCK).expect("reopened");
+        assert!(!cache.contains(0));
+        assert_eq!(cache.block_count(), 0);
+        let _ = std::fs::remove_dir_all(&root);
+    }
+
+    #[test]
+    fn a_replaced_generation_does_not_overwrite_the_newer_index() {
+        let root = temp_root();
+        let size = (2 * BLOCK) as u64;
+        let old = DiskBlocks::open_in(&root, "dev", size, "1700", BLOCK).expect("opened");
+        let new = DiskBlocks::open_in(&root, "dev", size, "1800", BLOCK).expect("opened newer");
+        new.store(1, &block(8, BLOCK)).expect("stored");
+        new.persist().expect("persisted");
+
+        old.store(0, &block(7, BLOCK))
+            .expect("stored in old generation");
+        old.persist().expect("old persist is a no-op");
+        drop((old, new));
+
+        let cache = DiskBlocks::open_in(&root, "dev", size, "1800", BLOCK).expect("reopened");
+        assert!(cache.contains(1));
+        assert!(!cache.contains(0));
+        let leftovers = std::fs::read_dir(root.join("dev"))
+            .expect("cache dir")
+            .filter(|entry| {
+                entry
+                    .as_ref()
+                    .is_ok_and(|entry| entry.file_name().to_string_lossy().ends_with(".tmp"))
+            })
+            .count();
+        assert_eq!(leftovers, 0);
+        let _ = std::fs::remove_dir_all(&root);
+    }
+}
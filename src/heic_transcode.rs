@@ -0,0 +1,261 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! HEIC to JPEG/PNG conversion for exports.
+//!
+//! libheif decodes with the container's rotation and mirroring applied, so
+//! the pixels come out upright. The photo's Exif block is carried over into
+//! the new file (an APP1 segment for JPEG, an `eXIf` chunk for PNG) with its
+//! orientation reset to 1, so viewers do not rotate the image a second time
+//! while capture time, camera and location survive the conversion.
+
+use crate::utils::{encode_qimage, heic_to_qimage_with_exif};
+use std::path::{Path, PathBuf};
+
+const JPEG_QUALITY: i32 = 92;
+const ORIENTATION_TAG: u16 = 0x0112;
+const TIFF_SHORT: u16 = 3;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub enum TranscodeFormat {
+    Jpeg,
+    Png,
+}
+
+impl TranscodeFormat {
+    /// The export setting: 0 keeps HEIC files as they are.
+    pub fn from_i32(value: i32) -> Option<Self> {
+        match value {
+            1 => Some(Self::Jpeg),
+            2 => Some(Self::Png),
+            _ => None,
+        }
+    }
+
+    /// `heic_path` with this format's extension, in the same case.
+    pub fn output_path(self, heic_path: &Path) -> PathBuf {
+        let extension = match self {
+            Self::Jpeg => "jpg",
+            Self::Png => "png",
+        };
+        let uppercase = heic_path
+            .extension()
+            .and_then(|extension| extension.to_str())
+            .is_some_and(|extension| extension.chars().all(|c| c.is_ascii_uppercase()));
+        heic_path.with_extension(if uppercase {
+            extension.to_ascii_uppercase()
+        } else {
+            extension.to_string()
+        })
+    }
+}
+
+/// Decodes a HEIC file and encodes it as `format`. CPU-bound; callers run it
+/// on the decode pool.
+pub fn transcode(heic: &[u8], format: TranscodeFormat) -> Result<Vec<u8>, String> {
+    let (image, exif) = heic_to_qimage_with_exif(heic);
+    let encoded = encode_qimage(&image, format == TranscodeFormat::Png, JPEG_QUALITY);
+    if encoded.is_empty() {
+        return Err("Failed to decode HEIC image".to_string());
+    }
+
+    let Some(tiff) = exif_tiff(&exif) else {
+        return Ok(encoded);
+    };
+    let mut tiff = tiff.to_vec();
+    reset_orientation(&mut tiff);
+    Ok(match format {
+        TranscodeFormat::Jpeg => embed_jpeg_exif(encoded, &tiff),
+        TranscodeFormat::Png => embed_png_exif(encoded, &tiff),
+    })
+}
+
+/// The TIFF structure inside a HEIF Exif block, which starts with a
+/// big-endian offset from the end of that field to the TIFF header.
+fn exif_tiff(block: &[u8]) -> Option<&[u8]> {
+    let offset = u32::from_be_bytes(block.get(..4)?.try_into().ok()?) as usize;
+    let tiff = block.get(4usize.checked_add(offset)?..)?;
+    (tiff.starts_with(b"II*\0") || tiff.starts_with(b"MM\0*")).then_some(tiff)
+}
+
+/// Sets the orientation tag of IFD0 to 1 (upright), if there is one.
+fn reset_orientation(tiff: &mut [u8]) -> bool {
+    let little = tiff.starts_with(b"II");
+    let read_u16 = |bytes: &[u8], at: usize| -> Option<u16> {
+        let bytes: [u8; 2] = bytes.get(at..at + 2)?.try_into().ok()?;
+        Some(if little {
+            u16::from_le_bytes(bytes)
+        } else {
+            u16::from_be_bytes(bytes)
+        })
+    };
+    let read_u32 = |bytes: &[u8], at: usize| -> Option<u32> {
+        let bytes: [u8; 4] = bytes.get(at..at + 4)?.try_into().ok()?;
+        Some(if little {
+            u32::from_le_bytes(bytes)
+        } else {
+            u32::from_be_bytes(bytes)
+        })
+    };
+    let Some(ifd) = read_u32(tiff, 4).map(|ifd| ifd as usize) else {
+        return false;
+    };
+    let Some(count) = read_u16(tiff, ifd) else {
+        return false;
+    };
+
+    for entry in (0..count as usize).map(|index| ifd + 2 + index * 12) {
+        if read_u16(tiff, entry) != Some(ORIENTATION_TAG) {
+            continue;
+        }
+        if read_u16(tiff, entry + 2) != Some(TIFF_SHORT) {
+            return false;
+        }
+        let upright = if little {
+            1_u16.to_le_bytes()
+        } else {
+            1_u16.to_be_bytes()
+        };
+        return match tiff.get_mut(entry + 8..entry + 10) {
+            Some(value) => {
+                value.copy_from_slice(&upright);
+                true
+            }
+            None => false,
+        };
+    }
+    false
+}
+
+/// Inserts an Exif APP1 segment after SOI and any JFIF APP0 segment. A block
+/// too large for one segment is left out.
+fn embed_jpeg_exif(jpeg: Vec<u8>, tiff: &[u8]) -> Vec<u8> {
+    let length = 2 + 6 + tiff.len();
+    if !jpeg.starts_with(&[0xFF, 0xD8]) || length > u16::MAX as usize {
+        return jpeg;
+    }
+    let mut at = 2;
+    if jpeg.get(2..4) == Some(&[0xFF, 0xE0]) {
+        if let Some(app0) = jpeg.get(4..6) {
+            at = (4 + u16::from_be_bytes([app0[0], app0[1]]) as usize).min(jpeg.len());
+        }
+    }
+
+    let mut output = Vec::with_capacity(jpeg.len() + 2 + length);
+    output.extend_from_slice(&jpeg[..at]);
+    output.extend_from_slice(&[0xFF, 0xE1]);
+    output.extend_from_slice(&(length as u16).to_be_bytes());
+    output.extend_from_slice(b"Exif\0\0");
+    output.extend_from_slice(tiff);
+    output.extend_from_slice(&jpeg[at..]);
+    output
+}
+
+/// Inserts an `eXIf` chunk right after IHDR.
+fn embed_png_exif(png: Vec<u8>, tiff: &[u8]) -> Vec<u8> {
+    // Signature (8) plus IHDR: length (4), type (4), data (13), CRC (4).
+    const AFTER_IHDR: usize = 8 + 4 + 4 + 13 + 4;
+    if png.len() < AFTER_IHDR || png.get(12..16) != Some(b"IHDR") {
+        return png;
+    }
+
+    let mut output = Vec::with_capacity(png.len() + 12 + tiff.len());
+    output.extend_from_slice(&png[..AFTER_IHDR]);
+    output.extend_from_slice(&(tiff.len() as u32).to_be_bytes());
+    output.extend_from_slice(b"eXIf");
+    output.extend_from_slice(tiff);
+    output.extend_from_slice(&crc32(b"eXIf".iter().chain(tiff)).to_be_bytes());
+    output.extend_from_slice(&png[AFTER_IHDR..]);
+    output
+}
+
+/// CRC-32 as PNG chunks use it.
+fn crc32<'a>(bytes: impl Iterator<Item = &'a u8>) -> u32 {
+    let mut crc = !0_u32;
+    for byte in bytes {
+        crc ^= *byte as u32;
+        for _ in 0..8 {
+            crc = if crc & 1 != 0 {
+                (crc >> 1) ^ 0xEDB8_8320
+            } else {
+                crc >> 1
+            };
+        }
+    }
+    !crc
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    /// A big-endian TIFF with IFD0 holding orientation 6 and one other tag.
+    fn tiff() -> Vec<u8> {
+        let mut tiff = b"MM\0*".to_vec();
+        tiff.extend_from_slice(&8_u32.to_be_bytes());
+        tiff.extend_from_slice(&2_u16.to_be_bytes());
+        for (tag, value) in [(0x010F_u16, 0x4150_u16), (ORIENTATION_TAG, 6)] {
+            tiff.extend_from_slice(&tag.to_be_bytes());
+            tiff.extend_from_slice(&TIFF_SHORT.to_be_bytes());
+            tiff.extend_from_slice(&1_u32.to_be_bytes());
+            tiff.extend_from_slice(&value.to_be_bytes());
+            tiff.extend_from_slice(&[0, 0]);
+        }
+        tiff.extend_from_slice(&0_u32.to_be_bytes());
+        tiff
+    }
+
+    #[test]
+    fn exif_block_orientation_is_reset() {
+        let mut block = 6_u32.to_be_bytes().to_vec();
+        block.extend_from_slice(b"Exif\0\0");
+        block.extend_from_slice(&tiff());
+        let mut found = exif_tiff(&block).expect("tiff found").to_vec();
+        assert_eq!(found, tiff());
+
+        assert!(reset_orientation(&mut found));
+        assert_eq!(&found[30..32], &1_u16.to_be_bytes());
+        // The other tag is untouched.
+        assert_eq!(&found[18..20], &0x4150_u16.to_be_bytes());
+        assert!(exif_tiff(&[0, 0, 0, 9, 1]).is_none());
+    }
+
+    #[test]
+    fn exif_goes_after_jfif_and_ihdr() {
+        let mut jpeg = vec![0xFF, 0xD8, 0xFF, 0xE0, 0x00, 0x04, 0xAA, 0xBB];
+        jpeg.extend_from_slice(&[0xFF, 0xD9]);
+        let tiff = tiff();
+        let with_exif = embed_jpeg_exif(jpeg.clone(), &tiff);
+        assert_eq!(&with_exif[..8], &jpeg[..8]);
+        assert_eq!(&with_exif[8..10], &[0xFF, 0xE1]);
+        assert_eq!(
+            u16::from_be_bytes([with_exif[10], with_exif[11]]) as usize,
+            8 + tiff.len()
+        );
+        assert_eq!(&with_exif[12..18], b"Exif\0\0");
+        assert!(with_exif.ends_with(&[0xFF, 0xD9]));
+
+        let mut png = b"\x89PNG\r\n\x1a\n".to_vec();
+        png.extend_from_slice(&13_u32.to_be_bytes());
+        png.extend_from_slice(b"IHDR");
+        png.extend_from_slice(&[0; 13 + 4]);
+        png.extend_from_slice(b"IEND");
+        let with_exif = embed_png_exif(png.clone(), &tiff);
+        assert_eq!(&with_exif[37..41], b"eXIf");
+        assert!(with_exif.ends_with(b"IEND"));
+        assert_eq!(crc32(b"IEND".iter()), 0xAE42_6082);
+    }
+
+    #[test]
+    fn output_keeps_the_extension_case() {
+        assert_eq!(
+            TranscodeFormat::Jpeg.output_path(Path::new("/out/IMG_0001.HEIC")),
+            Path::new("/out/IMG_0001.JPG")
+        );
+        assert_eq!(
+            TranscodeFormat::Png.output_path(Path::new("/out/photo.heic")),
+            Path::new("/out/photo.png")
+        );
+        assert_eq!(TranscodeFormat::from_i32(0), None);
+    }
+}
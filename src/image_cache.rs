@@ -98,6 +98,19 @@ pub fn get(udid: &str, path: &str, afc2: bool, width: u32, height: u32) -> Optio
         .map(|entry| entry.image.clone())
 }
 
+/// Checks for an entry without promoting it, so prefetch bookkeeping does not
+/// disturb the LRU order of images that are actually on screen.
+pub fn contains(udid: &str, path: &str, afc2: bool, width: u32, height: u32) -> bool {
+    CACHE
+        .lock()
+        .map(|guard| {
+            guard
+                .entries
+                .contains(&CacheKey::new(udid, path, afc2, width, height))
+        })
+        .unwrap_or(false)
+}
+
 pub fn insert(udid: &str, path: &str, afc2: bool, width: u32, height: u32, img: QImage) {
     if let Ok(mut guard) = CACHE.lock() {
         guard.insert(CacheKey::new(udid, path, afc2, width, height), img);
@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
 use crate::RUNTIME;
+use crate::buffer_pool::{self, PooledBuffer};
 use crate::device_ctx;
 use crate::qt_threading::{QtThread, QtThreading};
 use crate::utils::{
@@ -16,16 +17,17 @@ use macros::QtThreading;
 use once_cell::sync::Lazy;
 use priority_queue::PriorityQueue;
 use qmetaobject::prelude::*;
-use qttypes::{QImage, QString};
+use qttypes::{QImage, QString, QStringList};
 use std::cmp::Reverse;
-use std::collections::HashMap;
+use std::collections::{HashMap, HashSet, VecDeque};
 use std::sync::{
     Arc, Mutex,
     atomic::{AtomicU64, Ordering},
 };
+use std::time::{Duration, Instant};
 use tokio::{
     io::AsyncReadExt,
-    sync::{Notify, Semaphore},
+    sync::{Notify, OwnedSemaphorePermit, Semaphore},
 };
 use tokio_util::sync::CancellationToken;
 
@@ -34,11 +36,19 @@ use tokio_util::sync::CancellationToken;
 pub struct ImageLoader {
     base: qt_base_class!(trait QObject),
 
+    prefetch_thumbnails: qt_method!(
+        fn(&self, udid: QString, file_paths: QStringList, afc2: bool, width: u32, height: u32)
+    ),
+
     thumbnailReady: qt_signal!(file_path: QString, row: u32, afc2: bool),
 }
 
 static POOL_SEM: Lazy<Arc<Semaphore>> = Lazy::new(|| Arc::new(Semaphore::new(10)));
-static DECODE_SEM: Lazy<Arc<Semaphore>> = Lazy::new(|| Arc::new(Semaphore::new(10)));
+// Video frame extraction pulls bytes over AFC through `AfcReader` while it
+// decodes, so it stays on the blocking pool instead of tying up a decode worker.
+static VIDEO_FRAME_SEM: Lazy<Arc<Semaphore>> = Lazy::new(|| Arc::new(Semaphore::new(4)));
+static PREFETCH_SEM: Lazy<Arc<Semaphore>> =
+    Lazy::new(|| Arc::new(Semaphore::new(PREFETCH_CONCURRENCY)));
 static SCHEDULER: Lazy<Arc<Scheduler>> = Lazy::new(|| {
     let scheduler = Arc::new(Scheduler::new());
     let worker_scheduler = Arc::clone(&scheduler);
@@ -49,6 +59,18 @@ static SCHEDULER: Lazy<Arc<Scheduler>> = Lazy::new(|| {
 });
 static NEXT_SEQ: AtomicU64 = AtomicU64::new(0);
 
+// Prefetch only ever borrows idle capacity: it needs a free POOL_SEM permit in
+// addition to its own, and never more than this many jobs run at once.
+const PREFETCH_CONCURRENCY: usize = 2;
+const PREFETCH_QUEUE_LIMIT: usize = 512;
+// Per-device budget for speculative reads so warming the cache does not
+// starve exports or video streams sharing the same AFC connection.
+const PREFETCH_BYTES_PER_SEC: f64 = 8.0 * 1024.0 * 1024.0;
+const PREFETCH_BURST_BYTES: f64 = 16.0 * 1024.0 * 1024.0;
+// Video thumbnails only read the container header and a few frames; charge a
+// flat estimate instead of the file size.
+const VIDEO_PREFETCH_COST: usize = 2 * 1024 * 1024;
+
 #[derive(Clone, Debug, Hash, Eq, PartialEq)]
 struct JobKey {
     udid: String,
@@ -67,12 +89,62 @@ struct JobPayload {
 struct InFlightJob {
     cancellation: CancellationToken,
     payloads: Vec<JobPayload>,
+    // Cleared when a foreground request attaches to a running prefetch job,
+    // after which the job must run to completion.
+    prefetch: bool,
 }
 
 struct QueueState {
     pq: PriorityQueue<JobKey, (u32, Reverse<u64>)>,
     payloads: HashMap<JobKey, Vec<JobPayload>>,
     in_flight: HashMap<JobKey, InFlightJob>,
+    prefetch: VecDeque<JobKey>,
+    budgets: HashMap<String, PrefetchBudget>,
+}
+
+/// Token bucket that throttles prefetch reads for one device. The balance may
+/// go negative because the real cost is only known after a file has been read.
+struct PrefetchBudget {
+    tokens: f64,
+    updated: Instant,
+}
+
+impl PrefetchBudget {
+    fn new(now: Instant) -> Self {
+        Self {
+            tokens: PREFETCH_BURST_BYTES,
+            updated: now,
+        }
+    }
+
+    fn refill(&mut self, now: Instant) {
+        let elapsed = now.saturating_duration_since(self.updated).as_secs_f64();
+        self.tokens = (self.tokens + elapsed * PREFETCH_BYTES_PER_SEC).min(PREFETCH_BURST_BYTES);
+        self.updated = now;
+    }
+
+    fn has_tokens(&mut self, now: Instant) -> bool {
+        self.refill(now);
+        self.tokens > 0.0
+    }
+
+    fn charge(&mut self, bytes: usize, now: Instant) {
+        self.refill(now);
+        self.tokens -= bytes as f64;
+    }
+
+    fn retry_after(&self) -> Duration {
+        if self.tokens > 0.0 {
+            return Duration::ZERO;
+        }
+        Duration::from_secs_f64((-self.tokens + 1.0) / PREFETCH_BYTES_PER_SEC)
+    }
+}
+
+enum LoadOutcome {
+    Ready,
+    Skipped,
+    Yielded,
 }
 
 struct Scheduler {
@@ -87,6 +159,8 @@ impl Scheduler {
                 pq: PriorityQueue::new(),
                 payloads: HashMap::new(),
                 in_flight: HashMap::new(),
+                prefetch: VecDeque::new(),
+                budgets: HashMap::new(),
             }),
             notify: Notify::new(),
         }
@@ -101,10 +175,15 @@ impl Scheduler {
             if let Some(job) = guard.in_flight.get_mut(&key) {
                 if !job.cancellation.is_cancelled() {
                     job.payloads.push(payload);
+                    job.prefetch = false;
                 }
                 return;
             }
 
+            if let Some(index) = guard.prefetch.iter().position(|queued| *queued == key) {
+                guard.prefetch.remove(index);
+            }
+
             guard.payloads.entry(key.clone()).or_default().push(payload);
 
             if guard.pq.get_priority(&key).is_some() {
@@ -117,6 +196,29 @@ impl Scheduler {
         self.notify.notify_one();
     }
 
+    fn enqueue_prefetch(&self, keys: Vec<JobKey>) {
+        let queued = {
+            let mut guard = self.state.lock().expect("scheduler mutex poisoned");
+            let state = &mut *guard;
+            let hints = keys
+                .into_iter()
+                .filter(|key| {
+                    !state.in_flight.contains_key(key)
+                        && !state.payloads.contains_key(key)
+                        && !crate::image_cache::contains(
+                            &key.udid, &key.path, key.afc2, key.width, key.height,
+                        )
+                })
+                .collect();
+            push_prefetch_hints(&mut state.prefetch, hints, PREFETCH_QUEUE_LIMIT);
+            !state.prefetch.is_empty()
+        };
+
+        if queued {
+            self.notify.notify_one();
+        }
+    }
+
     fn pop_next(&self) -> Option<(JobKey, CancellationToken)> {
         let mut guard = self.state.lock().expect("scheduler mutex poisoned");
         let (key, _) = guard.pq.pop()?;
@@ -127,11 +229,126 @@ impl Scheduler {
             InFlightJob {
                 cancellation: cancellation.clone(),
                 payloads,
+                prefetch: false,
             },
         );
         Some((key, cancellation))
     }
 
+    /// Picks the next prefetch job whose device still has budget. On failure
+    /// returns how long to wait before the budget allows another attempt, or
+    /// `None` when only a new request or a finished job can unblock the lane.
+    fn pop_prefetch(
+        &self,
+    ) -> Result<(JobKey, CancellationToken, [OwnedSemaphorePermit; 2]), Option<Duration>> {
+        let mut guard = self.state.lock().expect("scheduler mutex poisoned");
+        let state = &mut *guard;
+        if !state.pq.is_empty() {
+            return Err(None);
+        }
+
+        let now = Instant::now();
+        let mut retry_after: Option<Duration> = None;
+        let mut index = 0;
+        let mut candidate = None;
+        while index < state.prefetch.len() {
+            let key = &state.prefetch[index];
+            if state.in_flight.contains_key(key)
+                || crate::image_cache::contains(
+                    &key.udid, &key.path, key.afc2, key.width, key.height,
+                )
+            {
+                state.prefetch.remove(index);
+                continue;
+            }
+
+            let budget = state
+                .budgets
+                .entry(key.udid.clone())
+                .or_insert_with(|| PrefetchBudget::new(now));
+            if budget.has_tokens(now) {
+                candidate = Some(index);
+                break;
+            }
+
+            let wait = budget.retry_after();
+            retry_after = Some(retry_after.map_or(wait, |current| current.min(wait)));
+            index += 1;
+        }
+
+        let Some(index) = candidate else {
+            return Err(retry_after);
+        };
+        let Ok(prefetch_permit) = PREFETCH_SEM.clone().try_acquire_owned() else {
+            return Err(None);
+        };
+        let Ok(pool_permit) = POOL_SEM.clone().try_acquire_owned() else {
+            return Err(None);
+        };
+
+        let key = state
+            .prefetch
+            .remove(index)
+            .expect("prefetch candidate index is in range");
+        let cancellation = CancellationToken::new();
+        state.in_flight.insert(
+            key.clone(),
+            InFlightJob {
+                cancellation: cancellation.clone(),
+                payloads: Vec::new(),
+                prefetch: true,
+            },
+        );
+        Ok((key, cancellation, [prefetch_permit, pool_permit]))
+    }
+
+    /// True when a still-speculative job should step aside for queued
+    /// foreground work.
+    fn should_yield(&self, key: &JobKey) -> bool {
+        let guard = self.state.lock().expect("scheduler mutex poisoned");
+        !guard.pq.is_empty() && guard.in_flight.get(key).is_some_and(|job| job.prefetch)
+    }
+
+    /// Charges bytes read by a speculative job to its device's budget.
+    /// Foreground jobs are never throttled, so they are not charged.
+    fn charge_prefetch(&self, key: &JobKey, bytes: usize) {
+        let now = Instant::now();
+        let mut guard = self.state.lock().expect("scheduler mutex poisoned");
+        if !guard.in_flight.get(key).is_some_and(|job| job.prefetch) {
+            return;
+        }
+        guard
+            .budgets
+            .entry(key.udid.clone())
+            .or_insert_with(|| PrefetchBudget::new(now))
+            .charge(bytes, now);
+    }
+
+    /// Puts a yielded prefetch job back at the head of the lane. If a
+    /// foreground request attached after the yield decision, the job moves to
+    /// the foreground queue instead so its payloads are not lost.
+    fn yield_prefetch(&self, key: JobKey) {
+        {
+            let mut guard = self.state.lock().expect("scheduler mutex poisoned");
+            let Some(job) = guard.in_flight.remove(&key) else {
+                return;
+            };
+            if job.cancellation.is_cancelled() {
+                return;
+            }
+
+            if let Some(row) = job.payloads.iter().map(|payload| payload.row).min() {
+                let seq = NEXT_SEQ.fetch_add(1, Ordering::Relaxed);
+                guard.payloads.insert(key.clone(), job.payloads);
+                guard.pq.push(key, (row, Reverse(seq)));
+            } else if !guard.prefetch.contains(&key) {
+                guard.prefetch.push_front(key);
+            }
+        }
+
+        self.notify.notify_one();
+    }
+
     fn finish(&self, key: &JobKey) -> Vec<JobPayload> {
         self.state
             .lock()
@@ -157,6 +374,9 @@ impl Scheduler {
                 guard.payloads.remove(key);
             }
 
+            guard.prefetch.retain(|key| key.udid != udid);
+            guard.budgets.remove(udid);
+
             let active_cancellations = guard
                 .in_flight
                 .iter()
@@ -179,168 +399,205 @@ impl Scheduler {
 
     async fn run(self: Arc<Self>) {
         loop {
-            let Some((key, cancellation)) = self.pop_next() else {
-                self.notify.notified().await;
+            if let Some((key, cancellation)) = self.pop_next() {
+                let permit = tokio::select! {
+                    _ = cancellation.cancelled() => {
+                        let _ = self.finish(&key);
+                        continue;
+                    }
+                    result = POOL_SEM.clone().acquire_owned() => {
+                        match result {
+                            Ok(permit) => permit,
+                            Err(err) => {
+                                let _ = self.finish(&key);
+                                error!("image_loader: semaphore acquire failed: {err}");
+                                continue;
+                            }
+                        }
+                    }
+                };
+
+                self.spawn_job(key, cancellation, vec![permit]);
                 continue;
-            };
+            }
 
-            let permit = tokio::select! {
-                _ = cancellation.cancelled() => {
-                    let _ = self.finish(&key);
-                    continue;
+            match self.pop_prefetch() {
+                Ok((key, cancellation, permits)) => {
+                    self.spawn_job(key, cancellation, permits.into());
                 }
-                result = POOL_SEM.clone().acquire_owned() => {
-                    match result {
-                        Ok(permit) => permit,
-                        Err(err) => {
-                            let _ = self.finish(&key);
-                            error!("image_loader: semaphore acquire failed: {err}");
-                            continue;
-                        }
+                Err(Some(retry_after)) => {
+                    tokio::select! {
+                        _ = self.notify.notified() => {}
+                        _ = tokio::time::sleep(retry_after) => {}
                     }
                 }
-            };
+                Err(None) => self.notify.notified().await,
+            }
+        }
+    }
 
-            let scheduler = Arc::clone(&self);
-            RUNTIME.spawn(async move {
-                let _permit = permit;
-                let result: anyhow::Result<bool> = async {
-                    if cancellation.is_cancelled() {
-                        return Ok(false);
+    fn spawn_job(
+        self: &Arc<Self>,
+        key: JobKey,
+        cancellation: CancellationToken,
+        permits: Vec<OwnedSemaphorePermit>,
+    ) {
+        let scheduler = Arc::clone(self);
+        RUNTIME.spawn(async move {
+            let result = load_thumbnail(&scheduler, &key, &cancellation).await;
+
+            if let Ok(LoadOutcome::Yielded) = result {
+                debug!(
+                    "image_loader: prefetch of {} yielded to foreground work",
+                    key.path
+                );
+                drop(permits);
+                scheduler.yield_prefetch(key);
+                return;
+            }
+
+            let payloads = scheduler.finish(&key);
+            // Released permits may unblock the prefetch lane, which is polled
+            // rather than woken by the semaphores themselves.
+            drop(permits);
+            scheduler.notify.notify_one();
+
+            match result {
+                Ok(LoadOutcome::Ready) => {
+                    let afc2 = key.afc2;
+                    for payload in payloads {
+                        let row = payload.row;
+                        let path_for_qt = payload.path_for_qt;
+                        payload.qt_thread.queue(move |backend_qobj| {
+                            backend_qobj.thumbnailReady(path_for_qt, row, afc2);
+                        });
                     }
+                }
+                Ok(LoadOutcome::Skipped) | Ok(LoadOutcome::Yielded) => {}
+                Err(err) => {
+                    error!("image_loader: thumbnail job failed: {err}");
+                }
+            }
+        });
+    }
+}
 
-                    let device = device_ctx::get_device(key.udid.as_str()).await?;
-                    let connection_id = device.connection_id;
-                    let afc_arc = if key.afc2 {
-                        device.afc2.ok_or_else(|| {
-                            anyhow::anyhow!("AFC2 is unavailable for device {}", key.udid)
-                        })?
-                    } else {
-                        device.afc
-                    };
-
-                    let img = match media_file_type(&key.path) {
-                        MediaFileType::Video => {
-                            // FIXME: can we do something better here ?
-                            let reader =
-                                AfcReader::new(key.udid.clone(), key.path.clone(), afc_arc);
-
-                            let f_size = reader.get_size().await?;
-                            if cancellation.is_cancelled() {
-                                return Ok(false);
-                            }
-                            if !(f_size > 0) {
-                                anyhow::bail!("File size is invalid for {}", key.path);
-                            };
-
-                            let Some(img) = decode_image(&cancellation, move || {
-                                generate_thumbnail(
-                                    &reader,
-                                    f_size,
-                                    key.width as i32,
-                                    key.height as i32,
-                                )
-                            })
-                            .await?
-                            else {
-                                return Ok(false);
-                            };
-                            img
-                        }
-                        MediaFileType::Heic => {
-                            let buf = {
-                                let mut afc = afc_arc.lock().await;
-                                if cancellation.is_cancelled() {
-                                    return Ok(false);
-                                }
-
-                                file_to_buffer(&mut afc, &key.path).await?
-                            };
-
-                            if cancellation.is_cancelled() {
-                                return Ok(false);
-                            }
+async fn load_thumbnail(
+    scheduler: &Scheduler,
+    key: &JobKey,
+    cancellation: &CancellationToken,
+) -> anyhow::Result<LoadOutcome> {
+    if cancellation.is_cancelled() {
+        return Ok(LoadOutcome::Skipped);
+    }
 
-                            let width = key.width;
-                            let height = key.height;
-                            let Some(img) = decode_image(&cancellation, move || {
-                                scale_image_to_fit(heic_to_qimage(&buf), width, height)
-                            })
-                            .await?
-                            else {
-                                return Ok(false);
-                            };
-                            img
-                        }
-                        MediaFileType::Image => {
-                            let buf = {
-                                let mut afc = afc_arc.lock().await;
-                                if cancellation.is_cancelled() {
-                                    return Ok(false);
-                                }
-
-                                file_to_buffer(&mut afc, &key.path).await?
-                            };
-
-                            if cancellation.is_cancelled() {
-                                return Ok(false);
-                            }
+    let device = device_ctx::get_device(key.udid.as_str()).await?;
+    let connection_id = device.connection_id;
+    let afc_source = device
+        .afc_source(key.afc2)
+        .ok_or_else(|| anyhow::anyhow!("AFC2 is unavailable for device {}", key.udid))?;
 
-                            let width = key.width;
-                            let height = key.height;
-                            let Some(img) = decode_image(&cancellation, move || {
-                                create_image_from_buffer(&buf, width, height)
-                            })
-                            .await?
-                            else {
-                                return Ok(false);
-                            };
-                            img
-                        }
-                        MediaFileType::Unsupported => {
-                            anyhow::bail!("Unsupported media file {}", key.path);
-                        }
-                    };
+    if scheduler.should_yield(key) {
+        return Ok(LoadOutcome::Yielded);
+    }
 
-                    if cancellation.is_cancelled()
-                        || device_ctx::get_device_for_connection_opt(
-                            key.udid.as_str(),
-                            connection_id,
-                        )
-                        .await
-                        .is_none()
-                    {
-                        return Ok(false);
-                    }
+    let img = match media_file_type(&key.path) {
+        MediaFileType::Video => {
+            // FIXME: can we do something better here ?
+            let reader = AfcReader::new(key.udid.clone(), key.path.clone(), afc_source);
 
-                    crate::image_cache::insert(
-                        &key.udid, &key.path, key.afc2, key.width, key.height, img,
-                    );
+            let f_size = reader.get_size().await?;
+            if cancellation.is_cancelled() {
+                return Ok(LoadOutcome::Skipped);
+            }
+            if !(f_size > 0) {
+                anyhow::bail!("File size is invalid for {}", key.path);
+            };
 
-                    Ok(true)
+            scheduler.charge_prefetch(key, VIDEO_PREFETCH_COST);
+            let width = key.width as i32;
+            let height = key.height as i32;
+            let Some(img) = extract_video_frame(cancellation, move || {
+                generate_thumbnail(&reader, f_size, width, height)
+            })
+            .await?
+            else {
+                return Ok(LoadOutcome::Skipped);
+            };
+            img
+        }
+        MediaFileType::Heic | MediaFileType::Image => {
+            let buf = {
+                let mut afc = afc_source.lease().await?;
+                if cancellation.is_cancelled() {
+                    return Ok(LoadOutcome::Skipped);
                 }
-                .await;
-
-                let payloads = scheduler.finish(&key);
-                match result {
-                    Ok(true) => {
-                        let afc2 = key.afc2;
-                        for payload in payloads {
-                            let row = payload.row;
-                            let path_for_qt = payload.path_for_qt;
-                            payload.qt_thread.queue(move |backend_qobj| {
-                                backend_qobj.thumbnailReady(path_for_qt, row, afc2);
-                            });
-                        }
-                    }
-                    Ok(false) => {}
-                    Err(err) => {
-                        error!("image_loader: thumbnail job failed: {err}");
-                    }
+
+                file_to_buffer(&mut afc, &key.path).await?
+            };
+            scheduler.charge_prefetch(key, buf.len());
+
+            if cancellation.is_cancelled() {
+                return Ok(LoadOutcome::Skipped);
+            }
+            // The bytes are already charged; decoding is what would compete
+            // with the foreground here.
+            if scheduler.should_yield(key) {
+                return Ok(LoadOutcome::Yielded);
+            }
+
+            let width = key.width;
+            let height = key.height;
+            let heic = matches!(media_file_type(&key.path), MediaFileType::Heic);
+            let Some(img) = decode_image(cancellation, move || {
+                if heic {
+                    scale_image_to_fit(heic_to_qimage(&buf), width, height)
+                } else {
+                    create_image_from_buffer(&buf, width, height)
                 }
-            });
+            })
+            .await?
+            else {
+                return Ok(LoadOutcome::Skipped);
+            };
+            img
+        }
+        MediaFileType::Unsupported => {
+            anyhow::bail!("Unsupported media file {}", key.path);
         }
+    };
+
+    if cancellation.is_cancelled()
+        || device_ctx::get_device_for_connection_opt(key.udid.as_str(), connection_id)
+            .await
+            .is_none()
+    {
+        return Ok(LoadOutcome::Skipped);
     }
+
+    crate::image_cache::insert(&key.udid, &key.path, key.afc2, key.width, key.height, img);
+
+    Ok(LoadOutcome::Ready)
+}
+
+/// Moves `hints` to the head of the prefetch lane, nearest first. Newer hints
+/// win over older ones because they describe where the user is scrolling now;
+/// whatever falls past `limit` is stale and dropped.
+fn push_prefetch_hints(queue: &mut VecDeque<JobKey>, hints: Vec<JobKey>, limit: usize) {
+    let mut seen = HashSet::new();
+    let hints: Vec<_> = hints
+        .into_iter()
+        .filter(|key| seen.insert(key.clone()))
+        .collect();
+    if hints.is_empty() {
+        return;
+    }
+
+    queue.retain(|key| !seen.contains(key));
+    for key in hints.into_iter().rev() {
+        queue.push_front(key);
+    }
+    queue.truncate(limit);
 }
 
 pub fn cancel_for_udid(udid: &str) {
@@ -353,38 +610,71 @@ async fn decode_image<F>(
     cancellation: &CancellationToken,
     decode: F,
 ) -> anyhow::Result<Option<QImage>>
+where
+    F: FnOnce() -> QImage + Send + 'static,
+{
+    let task_cancellation = cancellation.clone();
+    let decoded = crate::decode_pool::run(move || {
+        // Jobs cancelled while queued are dropped without decoding.
+        (!task_cancellation.is_cancelled()).then(decode)
+    });
+
+    tokio::select! {
+        _ = cancellation.cancelled() => Ok(None),
+        result = decoded => {
+            result.context("image_loader: decoder task panicked")
+        }
+    }
+}
+
+async fn extract_video_frame<F>(
+    cancellation: &CancellationToken,
+    extract: F,
+) -> anyhow::Result<Option<QImage>>
 where
     F: FnOnce() -> QImage + Send + 'static,
 {
     let permit = tokio::select! {
         _ = cancellation.cancelled() => return Ok(None),
-        result = DECODE_SEM.clone().acquire_owned() => {
-            result.context("image_loader: decoder semaphore is closed")?
+        result = VIDEO_FRAME_SEM.clone().acquire_owned() => {
+            result.context("image_loader: video frame semaphore is closed")?
         }
     };
 
     let image = tokio::task::spawn_blocking(move || {
         let _permit = permit;
-        decode()
+        extract()
     })
     .await
-    .context("image_loader: decoder task failed")?;
+    .context("image_loader: video frame task failed")?;
 
     Ok(Some(image))
 }
 
-async fn file_to_buffer(afc: &mut AfcClient, path: &str) -> anyhow::Result<Vec<u8>> {
-    let mut buf = Vec::new();
+/// Reads a whole file into a pooled buffer presized from its reported size,
+/// so the bytes land in the buffer the decoder consumes.
+async fn file_to_buffer(afc: &mut AfcClient, path: &str) -> anyhow::Result<PooledBuffer> {
+    let expected_size = afc
+        .get_file_info(path)
+        .await
+        .map(|info| usize::try_from(info.size).unwrap_or(0))
+        .unwrap_or(0);
+    // One spare byte lets EOF be detected without a second grow.
+    let mut buf = buffer_pool::take(expected_size.saturating_add(1));
 
     let mut fd = afc
         .open(path, AfcFopenMode::RdOnly)
         .await
         .with_context(|| format!("file_to_buffer: failed to open {path}"))?;
 
-    let mut chunk = vec![0u8; crate::io_manager::DEFAULT_CHUNK_SIZE];
-
+    let mut filled = 0;
     loop {
-        let n = match fd.read(&mut chunk).await {
+        if filled == buf.len() {
+            // The file grew since it was stat'ed.
+            buf.grow_to(filled + crate::io_manager::DEFAULT_CHUNK_SIZE);
+        }
+
+        let n = match fd.read(&mut buf[filled..]).await {
             Ok(n) => n,
             Err(e) => {
                 fd.close().await.ok();
@@ -394,8 +684,9 @@ async fn file_to_buffer(afc: &mut AfcClient, path: &str) -> anyhow::Result<Vec<u
         if n == 0 {
             break;
         }
-        buf.extend_from_slice(&chunk[..n]);
+        filled += n;
     }
+    buf.truncate(filled);
     fd.close()
         .await
         .with_context(|| format!("file_to_buffer: failed to close {path}"))?;
@@ -432,4 +723,99 @@ impl ImageLoader {
 
         SCHEDULER.enqueue(key, payload, row);
     }
+
+    /// Warms the cache for thumbnails the view is likely to need next, such as
+    /// the rows past the viewport in the scroll direction. Paths are ordered
+    /// nearest first. Work only runs while no foreground request is waiting.
+    fn prefetch_thumbnails(
+        &self,
+        udid: QString,
+        file_paths: QStringList,
+        afc2: bool,
+        width: u32,
+        height: u32,
+    ) {
+        let udid = udid.to_string();
+        let keys = file_paths
+            .into_iter()
+            .map(|path| JobKey {
+                udid: udid.clone(),
+                path: path.to_string(),
+                afc2,
+                width,
+                height,
+            })
+            .filter(|key| !matches!(media_file_type(&key.path), MediaFileType::Unsupported))
+            .collect::<Vec<_>>();
+
+        if keys.is_empty() {
+            return;
+        }
+
+        SCHEDULER.enqueue_prefetch(keys);
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn key(path: &str) -> JobKey {
+        JobKey {
+            udid: "udid".to_string(),
+            path: path.to_string(),
+            afc2: false,
+            width: 240,
+            height: 240,
+        }
+    }
+
+    fn paths(queue: &VecDeque<JobKey>) -> Vec<&str> {
+        queue.iter().map(|key| key.path.as_str()).collect()
+    }
+
+    #[test]
+    fn newer_prefetch_hints_move_to_the_front_in_order() {
+        let mut queue = VecDeque::new();
+        push_prefetch_hints(&mut queue, vec![key("a"), key("b"), key("c")], 8);
+        push_prefetch_hints(&mut queue, vec![key("d"), key("b")], 8);
+
+        assert_eq!(paths(&queue), ["d", "b", "a", "c"]);
+    }
+
+    #[test]
+    fn prefetch_hints_are_deduplicated_and_bounded() {
+        let mut queue = VecDeque::new();
+        push_prefetch_hints(&mut queue, vec![key("a"), key("b")], 3);
+        push_prefetch_hints(&mut queue, vec![key("c"), key("c"), key("d")], 3);
+
+        assert_eq!(paths(&queue), ["c", "d", "a"]);
+    }
+
+    #[test]
+    fn prefetch_budget_blocks_until_refilled() {
+        let start = Instant::now();
+        let mut budget = PrefetchBudget::new(start);
+        assert!(budget.has_tokens(start));
+
+        budget.charge(
+            (PREFETCH_BURST_BYTES + PREFETCH_BYTES_PER_SEC) as usize,
+            start,
+        );
+        assert!(!budget.has_tokens(start));
+        let wait = budget.retry_after();
+        assert!(wait >= Duration::from_millis(999) && wait <= Duration::from_millis(1001));
+
+        let later = start + Duration::from_millis(1100);
+        assert!(budget.has_tokens(later));
+    }
+
+    #[test]
+    fn prefetch_budget_refill_is_capped_at_burst() {
+        let start = Instant::now();
+        let mut budget = PrefetchBudget::new(start);
+        budget.refill(start + Duration::from_secs(3600));
+
+        assert_eq!(budget.tokens, PREFETCH_BURST_BYTES);
+    }
 }
@@ -2,27 +2,68 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
 use crate::{
-    RUNTIME, device_ctx,
+    RUNTIME, afc_metadata_cache,
+    afc_pool::{AfcHandle, AfcPool, AfcPoolKind},
+    content_index::{self, ContentDigest, ContentIndex, StreamHasher},
+    decode_pool, device_ctx,
+    heic_transcode::{self, TranscodeFormat},
+    local_sink::{self, LocalSink},
+    progress_bus,
     qt_threading::{QtThread, QtThreading},
+    settings_manager::SettingsManager,
+    sync_manifest::{self, ManifestEntry, SyncManifest},
+    transfer_journal::{CHECKPOINT_BYTES, JournalEntry, TransferJournal, journal_key},
+    transfer_pipeline::{self, PipelineError},
     utils,
 };
-use idevice::IdeviceService;
+use futures::StreamExt;
 use idevice::afc::{AfcClient, FileInfo, opcode::AfcFopenMode};
 use log::{debug, error, info, warn};
 use macros::QtThreading;
+use once_cell::sync::Lazy;
 use qmetaobject::prelude::*;
 use qttypes::QStringList;
 use std::{
-    collections::{HashMap, HashSet},
+    collections::{BTreeMap, BTreeSet, HashMap, HashSet, VecDeque},
+    io::{self, SeekFrom},
     path::{Path, PathBuf},
     sync::{
         Arc, Mutex,
-        atomic::{AtomicBool, Ordering},
+        atomic::{AtomicBool, AtomicI64, AtomicU64, AtomicUsize, Ordering},
     },
+    time::Duration,
+};
+use tokio::{
+    fs,
+    io::{AsyncReadExt, AsyncSeekExt, AsyncWriteExt},
+    sync::mpsc,
 };
-use tokio::{fs, io::AsyncWriteExt};
 
 pub static DEFAULT_CHUNK_SIZE: usize = 1024 * 1024;
+/// Concurrent sessions one export job uses, leaving one of the device pool's
+/// sessions for thumbnails and browsing.
+const EXPORT_WORKERS: usize = 3;
+/// Files below this size are copied in batches on one session.
+const SMALL_FILE_LIMIT: u64 = 2 * 1024 * 1024;
+const SMALL_BATCH_FILES: usize = 32;
+const STAT_BATCH: usize = 64;
+/// Files at least this large are split into ranges copied in parallel.
+const RANGE_SPLIT_THRESHOLD: u64 = 64 * 1024 * 1024;
+const RANGE_SIZE: u64 = 16 * 1024 * 1024;
+/// Pages a feed holds before its lister waits for the export to catch up.
+const EXPORT_FEED_PAGES: usize = 4;
+/// How long a feed waits for its `start_feed_export`. An unclaimed feed is
+/// dropped, which also stops the task listing into it.
+const EXPORT_FEED_CLAIM_TIMEOUT: Duration = Duration::from_secs(60);
+
+pub type ExportFeedSender = mpsc::Sender<anyhow::Result<Vec<String>>>;
+type ExportFeed = mpsc::Receiver<anyhow::Result<Vec<String>>>;
+
+/// Feeds opened for jobs `start_feed_export` has not picked up yet, each
+/// with the serial `open_export_feed` gave it.
+static EXPORT_FEEDS: Lazy<Mutex<HashMap<String, (u64, ExportFeed)>>> =
+    Lazy::new(|| Mutex::new(HashMap::new()));
+static NEXT_EXPORT_FEED: AtomicU64 = AtomicU64::new(0);
 
 #[derive(QObject, Default, QtThreading)]
 #[allow(non_snake_case)]
@@ -88,15 +129,22 @@ pub struct IOManager {
             hause_arrest_afc: QString,
         )
     ),
+    start_feed_export: qt_method!(
+        fn(&self, udid: QString, job_id: QString, source: QString, destination_dir: QString)
+    ),
     has_active_tasks: qt_method!(fn(&self) -> bool),
+    start_sync: qt_method!(
+        fn(
+            &self,
+            udid: QString,
+            job_id: QString,
+            device_paths: QStringList,
+            destination_dir: QString,
+            delete_missing: bool,
+        )
+    ),
     cancel_job: qt_method!(fn(&self, job_id: QString)),
     cancel_all_jobs: qt_method!(fn(&self)),
-    fileTransferProgress: qt_signal!(
-        job_id: QString,
-        file_name: QString,
-        bytes_transferred: i64,
-        total_bytes: i64
-    ),
     exportItemFinished: qt_signal!(
         job_id: QString,
         file_name: QString,
@@ -154,6 +202,16 @@ enum AfcKind {
     HouseArrest(String),
 }
 
+#[derive(Clone, Copy)]
+enum ExportMode {
+    Copy,
+    /// Mirror into the destination, copying only files the sync manifest does
+    /// not already record with the same size and mtime.
+    Sync {
+        delete_missing: bool,
+    },
+}
+
 impl AfcKind {
     fn description(&self) -> String {
         match self {
@@ -162,6 +220,14 @@ impl AfcKind {
             AfcKind::HouseArrest(bundle_id) => format!("house-arrest:{bundle_id}"),
         }
     }
+
+    fn pool_kind(&self) -> AfcPoolKind {
+        match self {
+            AfcKind::Standard => AfcPoolKind::Standard,
+            AfcKind::Afc2 => AfcPoolKind::Afc2,
+            AfcKind::HouseArrest(bundle_id) => AfcPoolKind::HouseArrest(bundle_id.clone()),
+        }
+    }
 }
 
 impl IOManager {
@@ -188,7 +254,76 @@ impl IOManager {
             destination_dir,
             AfcKind::Standard,
             allow_directories,
+            ExportMode::Copy,
+        );
+    }
+
+    /// Exports the paths sent to the feed `open_export_feed` opened for
+    /// `job_id`, starting on the first page while the rest is still listed.
+    /// `source` names what the feed lists (such as an album) and keys the
+    /// job's resume journal.
+    fn start_feed_export(
+        &self,
+        udid: QString,
+        job_id: QString,
+        source: QString,
+        destination_dir: QString,
+    ) {
+        let udid = udid.to_string();
+        let job_id = job_id.to_string();
+        let source = source.to_string();
+        let destination_dir = destination_dir.to_string();
+        let feed = EXPORT_FEEDS
+            .lock()
+            .expect("IOManager export feeds mutex poisoned")
+            .remove(&job_id)
+            .map(|(_, feed)| feed);
+        info!(
+            "IOManager feed export requested: job_id={job_id} udid={udid} source={source} destination_dir={destination_dir}"
         );
+        let dedupe = SettingsManager::dedupe_exports_enabled();
+        let transcode = SettingsManager::heic_export_transcode();
+        let cancel_flag = self.register_job(&job_id);
+        let jobs = self.jobs.clone();
+        let qt_thread = self.qt_thread();
+
+        RUNTIME.spawn(async move {
+            let Some(feed) = feed else {
+                error!("IOManager feed export has no feed: job_id={job_id}");
+                finish_export_job(&qt_thread, job_id.clone(), true, 0, 0, 0);
+                unregister_job(&jobs, &job_id);
+                return;
+            };
+            let (pool, job_scoped) = match export_pool(&udid, AfcKind::Standard).await {
+                Ok(pool) => pool,
+                Err(err) => {
+                    error!(
+                        "IOManager feed export failed to create AFC client: job_id={job_id} udid={udid}: {err}"
+                    );
+                    finish_export_job(&qt_thread, job_id.clone(), true, 0, 0, 0);
+                    unregister_job(&jobs, &job_id);
+                    return;
+                }
+            };
+
+            handle_feed_export(
+                pool.clone(),
+                job_id,
+                &udid,
+                &source,
+                feed,
+                destination_dir,
+                qt_thread,
+                jobs,
+                cancel_flag,
+                dedupe,
+                transcode,
+            )
+            .await;
+            if job_scoped {
+                pool.close();
+            }
+        });
     }
 
     fn start_export_with_afc2(
@@ -206,6 +341,7 @@ impl IOManager {
             destination_dir,
             AfcKind::Afc2,
             allow_directories,
+            ExportMode::Copy,
         );
     }
 
@@ -225,6 +361,7 @@ impl IOManager {
             destination_dir,
             AfcKind::HouseArrest(hause_arrest_afc.to_string()),
             allow_directories,
+            ExportMode::Copy,
         );
     }
 
@@ -271,6 +408,27 @@ impl IOManager {
         );
     }
 
+    /// Incremental mirror of `device_paths` (typically `/DCIM`) into
+    /// `destination_dir`. Directories are always allowed.
+    fn start_sync(
+        &self,
+        udid: QString,
+        job_id: QString,
+        device_paths: QStringList,
+        destination_dir: QString,
+        delete_missing: bool,
+    ) {
+        self.spawn_export(
+            udid,
+            job_id,
+            device_paths,
+            destination_dir,
+            AfcKind::Standard,
+            true,
+            ExportMode::Sync { delete_missing },
+        );
+    }
+
     fn cancel_job(&self, job_id: QString) {
         let job_id_str = job_id.to_string();
         let guard = self.jobs.lock().expect("IOManager jobs map mutex poisoned");
@@ -298,6 +456,7 @@ impl IOManager {
         destination_dir: QString,
         afc_kind: AfcKind,
         allow_directories: bool,
+        mode: ExportMode,
     ) {
         let udid = udid.to_string();
         let job_id = job_id.to_string();
@@ -305,12 +464,26 @@ impl IOManager {
         let items = qstring_list_to_vec(device_paths);
         let item_count = items.len();
         let afc_kind_description = afc_kind.description();
+        let flags = match mode {
+            ExportMode::Sync { .. } => "sync",
+            ExportMode::Copy if allow_directories => "dirs",
+            ExportMode::Copy => "",
+        };
+        let journal_key = job_journal_key(
+            &udid,
+            &afc_kind_description,
+            &destination_dir,
+            &items,
+            flags,
+        );
         info!(
             "IOManager export requested: job_id={job_id} udid={udid} items={item_count} destination_dir={destination_dir} afc={afc_kind_description}"
         );
         if item_count == 0 {
             warn!("IOManager export requested with no items: job_id={job_id}");
         }
+        let dedupe = SettingsManager::dedupe_exports_enabled();
+        let transcode = SettingsManager::heic_export_transcode();
         let cancel_flag = self.register_job(&job_id);
         let jobs = self.jobs.clone();
         let qt_thread = self.qt_thread();
@@ -319,10 +492,10 @@ impl IOManager {
             debug!(
                 "IOManager export creating AFC client: job_id={job_id} udid={udid} afc={afc_kind_description}"
             );
-            let mut afc = match create_afc_client(&udid, afc_kind).await {
-                Ok(afc) => {
-                    debug!("IOManager export AFC client ready: job_id={job_id}");
-                    afc
+            let (pool, job_scoped) = match export_pool(&udid, afc_kind).await {
+                Ok(pool) => {
+                    debug!("IOManager export AFC pool ready: job_id={job_id}");
+                    pool
                 }
                 Err(err) => {
                     error!(
@@ -335,7 +508,7 @@ impl IOManager {
             };
 
             handle_start_export(
-                &mut afc,
+                pool.clone(),
                 job_id.clone(),
                 items,
                 destination_dir,
@@ -343,8 +516,15 @@ impl IOManager {
                 jobs,
                 cancel_flag,
                 allow_directories,
+                mode,
+                journal_key,
+                dedupe,
+                transcode,
             )
             .await;
+            if job_scoped {
+                pool.close();
+            }
         });
     }
 
@@ -362,6 +542,9 @@ impl IOManager {
         let items = qstring_list_to_vec(local_paths);
         let item_count = items.len();
         let afc_kind_description = afc_kind.description();
+        let cache_scope = afc_metadata_cache::scope(&udid, &afc_kind.pool_kind());
+        let journal_key =
+            job_journal_key(&udid, &afc_kind_description, &destination_dir, &items, "");
         info!(
             "IOManager import requested: job_id={job_id} udid={udid} items={item_count} destination_dir={destination_dir} afc={afc_kind_description}"
         );
@@ -395,12 +578,15 @@ impl IOManager {
                 &mut afc,
                 job_id.clone(),
                 items,
-                destination_dir,
+                destination_dir.clone(),
                 qt_thread,
                 jobs,
                 cancel_flag,
+                journal_key,
             )
             .await;
+            // Even a failed import may have written some files.
+            afc_metadata_cache::invalidate(&cache_scope, &destination_dir);
         });
     }
 
@@ -423,7 +609,37 @@ fn qstring_list_to_vec(paths: QStringList) -> Vec<String> {
     paths.into_iter().map(|path| path.to_string()).collect()
 }
 
-async fn create_afc_client(udid: &str, afc_kind: AfcKind) -> anyhow::Result<AfcClient> {
+/// Opens the feed a later `start_feed_export` for `job_id` reads. Sending
+/// waits while `EXPORT_FEED_PAGES` pages are queued, so listing stays just
+/// ahead of copying, and fails once the job has ended or been cancelled, or
+/// if no job claimed the feed within `EXPORT_FEED_CLAIM_TIMEOUT`.
+pub fn open_export_feed(job_id: &str) -> ExportFeedSender {
+    let (sender, feed) = mpsc::channel(EXPORT_FEED_PAGES);
+    let serial = NEXT_EXPORT_FEED.fetch_add(1, Ordering::Relaxed);
+    EXPORT_FEEDS
+        .lock()
+        .expect("IOManager export feeds mutex poisoned")
+        .insert(job_id.to_string(), (serial, feed));
+
+    let job_id = job_id.to_string();
+    RUNTIME.spawn(async move {
+        tokio::time::sleep(EXPORT_FEED_CLAIM_TIMEOUT).await;
+        let mut feeds = EXPORT_FEEDS
+            .lock()
+            .expect("IOManager export feeds mutex poisoned");
+        // A later feed for the same job id is not this one's to drop.
+        if feeds
+            .get(&job_id)
+            .is_some_and(|(opened, _)| *opened == serial)
+        {
+            feeds.remove(&job_id);
+            warn!("IOManager dropped unclaimed export feed: job_id={job_id}");
+        }
+    });
+    sender
+}
+
+async fn create_afc_client(udid: &str, afc_kind: AfcKind) -> anyhow::Result<AfcHandle> {
     let afc_kind_description = afc_kind.description();
     debug!("IOManager resolving device for AFC client: udid={udid} afc={afc_kind_description}");
     let device = device_ctx::get_device_opt(udid)
@@ -431,17 +647,52 @@ async fn create_afc_client(udid: &str, afc_kind: AfcKind) -> anyhow::Result<AfcC
         .ok_or_else(|| anyhow::anyhow!("device {udid} not found"))?;
 
     match afc_kind {
-        AfcKind::Standard => Ok(AfcClient::connect(device.provider.lock().await.as_ref()).await?),
-        AfcKind::Afc2 => Ok(AfcClient::new_afc2(device.provider.lock().await.as_ref()).await?),
+        AfcKind::Standard => Ok(AfcHandle::Leased(device.afc_pool.lease().await?)),
+        AfcKind::Afc2 => {
+            let pool = device
+                .afc2_pool
+                .ok_or_else(|| anyhow::anyhow!("AFC2 is unavailable for device {udid}"))?;
+            Ok(AfcHandle::Leased(pool.lease().await?))
+        }
         AfcKind::HouseArrest(bundle_id) => {
             let provider = device.provider.lock().await;
-            Ok(utils::vend_app_documents(provider.as_ref(), &bundle_id).await?)
+            Ok(AfcHandle::Owned(
+                utils::vend_app_documents(provider.as_ref(), &bundle_id).await?,
+            ))
+        }
+    }
+}
+
+/// Sessions an export fans out over. Standard and AFC2 exports share the
+/// device pools; a house-arrest container gets a pool for this job only,
+/// which the caller closes afterwards (the `bool`).
+async fn export_pool(udid: &str, afc_kind: AfcKind) -> anyhow::Result<(AfcPool, bool)> {
+    let device = device_ctx::get_device_opt(udid)
+        .await
+        .ok_or_else(|| anyhow::anyhow!("device {udid} not found"))?;
+
+    match afc_kind {
+        AfcKind::Standard => Ok((device.afc_pool.clone(), false)),
+        AfcKind::Afc2 => {
+            let pool = device
+                .afc2_pool
+                .ok_or_else(|| anyhow::anyhow!("AFC2 is unavailable for device {udid}"))?;
+            Ok((pool, false))
         }
+        AfcKind::HouseArrest(bundle_id) => Ok((
+            AfcPool::new(
+                udid,
+                AfcPoolKind::HouseArrest(bundle_id),
+                device.provider.clone(),
+                EXPORT_WORKERS,
+            ),
+            true,
+        )),
     }
 }
 
 async fn handle_start_export(
-    afc: &mut AfcClient,
+    pool: AfcPool,
     job_id: String,
     device_paths: Vec<String>,
     destination_dir: String,
@@ -449,75 +700,176 @@ async fn handle_start_export(
     jobs: Arc<Mutex<HashMap<String, Arc<AtomicBool>>>>,
     cancel_flag: Arc<AtomicBool>,
     allow_directories: bool,
+    mode: ExportMode,
+    journal_key: String,
+    dedupe: bool,
+    transcode: Option<TranscodeFormat>,
 ) {
-    let mut successful = 0_i32;
-    let mut failed = 0_i32;
-    let mut total_bytes = 0_i64;
-    let mut cancelled = false;
-
     debug!(
         "IOManager export job started: job_id={job_id} items={}",
         device_paths.len()
     );
 
-    for device_path in device_paths {
+    // A sync compares device paths with the files on disk, so it keeps HEIC
+    // files as they are.
+    let transcode = transcode.filter(|_| matches!(mode, ExportMode::Copy));
+    let mut sync = match mode {
+        ExportMode::Copy => None,
+        ExportMode::Sync { delete_missing } => {
+            Some(SyncState::load(&destination_dir, delete_missing).await)
+        }
+    };
+
+    let journal = open_journal(
+        Path::new(&destination_dir),
+        format!(".idescriptor-export-{journal_key}.journal"),
+    )
+    .await;
+    let content_index = match dedupe {
+        true => open_content_index(&destination_dir).await,
+        false => None,
+    };
+    let mut tally = ExportTally::default();
+    let journal = export_batch(
+        &pool,
+        &job_id,
+        device_paths,
+        &destination_dir,
+        &qt_thread,
+        &cancel_flag,
+        allow_directories,
+        journal,
+        OutputKey::Index,
+        sync.as_mut(),
+        content_index.as_ref(),
+        transcode,
+        &mut tally,
+    )
+    .await;
+
+    let cancelled = cancel_flag.load(Ordering::Relaxed);
+    if cancelled {
+        info!("IOManager export job cancellation observed: job_id={job_id}");
+    }
+    let ExportTally {
+        successful,
+        failed,
+        total_bytes,
+        succeeded_items,
+    } = tally;
+    if let Some(journal) = journal {
+        close_journal(journal, cancelled || failed > 0);
+    }
+    if let Some(sync) = sync {
+        sync.finish(&succeeded_items, !cancelled && failed == 0)
+            .await;
+    }
+    finish_export_job(
+        &qt_thread,
+        job_id.clone(),
+        cancelled,
+        successful,
+        failed,
+        total_bytes,
+    );
+    info!(
+        "IOManager export job finished: job_id={job_id} cancelled={cancelled} successful={successful} failed={failed} total_bytes={total_bytes}"
+    );
+    unregister_job(&jobs, &job_id);
+}
+
+/// Copies pages as they arrive. Each page is planned and run on its own. One
+/// journal, keyed on `source` rather than on the listed paths, covers every
+/// page and remembers outputs by device path, so a resumed export finds it
+/// even when the source has changed and page boundaries have shifted.
+/// Dropping the feed at the end stops the lister.
+async fn handle_feed_export(
+    pool: AfcPool,
+    job_id: String,
+    udid: &str,
+    source: &str,
+    mut feed: ExportFeed,
+    destination_dir: String,
+    qt_thread: QtThread<IOManager>,
+    jobs: Arc<Mutex<HashMap<String, Arc<AtomicBool>>>>,
+    cancel_flag: Arc<AtomicBool>,
+    dedupe: bool,
+    transcode: Option<TranscodeFormat>,
+) {
+    debug!("IOManager feed export job started: job_id={job_id}");
+    let afc_kind_description = AfcKind::Standard.description();
+    let content_index = match dedupe {
+        true => open_content_index(&destination_dir).await,
+        false => None,
+    };
+    let journal_key = job_journal_key(
+        udid,
+        &afc_kind_description,
+        &destination_dir,
+        &[source.to_string()],
+        "feed",
+    );
+    let mut journal = open_journal(
+        Path::new(&destination_dir),
+        format!(".idescriptor-export-{journal_key}.journal"),
+    )
+    .await;
+    let mut tally = ExportTally::default();
+    while let Some(page) = feed.recv().await {
         if cancel_flag.load(Ordering::Relaxed) {
-            cancelled = true;
-            info!("IOManager export job cancellation observed: job_id={job_id}");
             break;
         }
+        let device_paths = match page {
+            Ok(device_paths) => device_paths,
+            Err(err) => {
+                // The rest of the source was never listed.
+                error!("IOManager export feed failed: job_id={job_id}: {err}");
+                tally.failed += 1;
+                break;
+            }
+        };
+        if device_paths.is_empty() {
+            continue;
+        }
+        debug!(
+            "IOManager feed export page: job_id={job_id} items={}",
+            device_paths.len()
+        );
 
-        debug!("IOManager export item requested: job_id={job_id} device_path={device_path}");
-        match export_single_item(
-            afc,
-            &device_path,
-            &destination_dir,
+        journal = export_batch(
+            &pool,
             &job_id,
+            device_paths,
+            &destination_dir,
             &qt_thread,
             &cancel_flag,
-            allow_directories,
+            false,
+            journal,
+            OutputKey::Source,
+            None,
+            content_index.as_ref(),
+            transcode,
+            &mut tally,
         )
-        .await
-        {
-            Ok(result) if result.success => {
-                successful += 1;
-                total_bytes += result.bytes_transferred;
-                debug!(
-                    "IOManager export item finished: job_id={job_id} device_path={device_path} bytes={}",
-                    result.bytes_transferred
-                );
-                emit_export_item_finished(&qt_thread, &job_id, &device_path, result, true);
-            }
-            Ok(result) => {
-                failed += 1;
-                warn!(
-                    "IOManager export item did not complete successfully: job_id={job_id} device_path={device_path} bytes={} error={}",
-                    result.bytes_transferred,
-                    result.error_message.as_deref().unwrap_or("cancelled")
-                );
-                emit_export_item_finished(&qt_thread, &job_id, &device_path, result, false);
-            }
-            Err(err) => {
-                failed += 1;
-                error!(
-                    "IOManager export item failed: job_id={job_id} device_path={device_path}: {err}"
-                );
-                let file_name = file_name_for_path(&device_path);
-                let job_id_signal = job_id.clone();
-                qt_thread.queue(move |mgr| {
-                    mgr.exportItemFinished(
-                        QString::from(job_id_signal),
-                        QString::from(file_name),
-                        QString::default(),
-                        false,
-                        0,
-                        QString::from(err),
-                    );
-                });
-            }
-        }
+        .await;
+        // Indices restart with every page; only a sync reads them.
+        tally.succeeded_items.clear();
     }
+    drop(feed);
 
+    let cancelled = cancel_flag.load(Ordering::Relaxed);
+    if cancelled {
+        info!("IOManager export job cancellation observed: job_id={job_id}");
+    }
+    let ExportTally {
+        successful,
+        failed,
+        total_bytes,
+        ..
+    } = tally;
+    if let Some(journal) = journal {
+        close_journal(journal, cancelled || failed > 0);
+    }
     finish_export_job(
         &qt_thread,
         job_id.clone(),
@@ -527,11 +879,134 @@ async fn handle_start_export(
         total_bytes,
     );
     info!(
-        "IOManager export job finished: job_id={job_id} cancelled={cancelled} successful={successful} failed={failed} total_bytes={total_bytes}"
+        "IOManager feed export job finished: job_id={job_id} cancelled={cancelled} successful={successful} failed={failed} total_bytes={total_bytes}"
     );
     unregister_job(&jobs, &job_id);
 }
 
+/// Plans and copies one list of device paths, adding its items to `tally`,
+/// and hands the journal back so the caller decides whether to keep it.
+async fn export_batch(
+    pool: &AfcPool,
+    job_id: &str,
+    device_paths: Vec<String>,
+    destination_dir: &str,
+    qt_thread: &QtThread<IOManager>,
+    cancel_flag: &Arc<AtomicBool>,
+    allow_directories: bool,
+    journal: Option<TransferJournal>,
+    output_key: OutputKey,
+    sync: Option<&mut SyncState>,
+    content_index: Option<&Arc<ContentIndex>>,
+    transcode: Option<TranscodeFormat>,
+    tally: &mut ExportTally,
+) -> Option<TransferJournal> {
+    let (done_tx, mut done_rx) = mpsc::unbounded_channel();
+    let (conversions_tx, conversions_rx) = mpsc::unbounded_channel();
+    let plan = plan_export(
+        pool,
+        job_id,
+        device_paths,
+        destination_dir,
+        allow_directories,
+        cancel_flag,
+        journal.as_ref(),
+        output_key,
+        sync,
+        content_index,
+        transcode,
+    )
+    .await;
+    let planned_paths = match transcode {
+        Some(_) => plan
+            .units
+            .iter()
+            .map(|unit| unit.file().local_path.clone())
+            .collect(),
+        None => HashSet::new(),
+    };
+    // Progress continues from earlier pages of a feed. Skipped and resumed
+    // bytes count as done from the start.
+    let transferred = plan
+        .items
+        .iter()
+        .map(|item| item.transferred.load(Ordering::SeqCst).max(0) as u64)
+        .fold(tally.progress_done, u64::saturating_add);
+    let total_bytes = plan
+        .items
+        .iter()
+        .map(|item| item.total_bytes.max(0) as u64)
+        .fold(tally.progress_total, u64::saturating_add);
+    let engine = ExportEngine {
+        pool: pool.clone(),
+        job_id: job_id.to_string(),
+        qt_thread: qt_thread.clone(),
+        cancel_flag: cancel_flag.clone(),
+        items: plan.items,
+        queue: Mutex::new(plan.units),
+        done_tx,
+        journal,
+        content_index: content_index.cloned(),
+        transcode,
+        conversions: Mutex::new(transcode.map(|_| conversions_tx)),
+        planned_paths,
+        transferred: AtomicU64::new(transferred),
+        total_bytes,
+    };
+    for (index, item) in engine.items.iter().enumerate() {
+        // Items with nothing to copy (failures, empty directories) are done
+        // already, unless the job was cancelled while planning.
+        if item.pending_units.load(Ordering::SeqCst) == 0 && !cancel_flag.load(Ordering::Relaxed) {
+            let _ = engine.done_tx.send(index);
+        }
+    }
+
+    // Items finish in whatever order the workers get to them; signals go out
+    // in request order.
+    let mut reorder = ReorderBuffer::default();
+    {
+        let workers = async {
+            futures::future::join_all((0..EXPORT_WORKERS).map(|_| engine.run_worker())).await;
+            engine
+                .conversions
+                .lock()
+                .expect("export conversions mutex poisoned")
+                .take();
+        };
+        // HEIC conversion overlaps the transfers still running.
+        let workers = futures::future::join(workers, engine.run_conversions(conversions_rx));
+        tokio::pin!(workers);
+        let mut workers_done = false;
+        while !workers_done {
+            tokio::select! {
+                _ = &mut workers => workers_done = true,
+                Some(index) = done_rx.recv() => {
+                    for ready in reorder.push(index) {
+                        engine.finish_item(ready, tally);
+                    }
+                }
+            }
+        }
+    }
+    while let Ok(index) = done_rx.try_recv() {
+        for ready in reorder.push(index) {
+            engine.finish_item(ready, tally);
+        }
+    }
+
+    // Cancellation leaves items unfinished. Report the ones that had started,
+    // in order, and drop the rest like the sequential loop used to.
+    for index in reorder.next()..engine.items.len() {
+        if !engine.items[index].started.load(Ordering::SeqCst) {
+            break;
+        }
+        engine.finish_item(index, tally);
+    }
+    tally.progress_done = engine.transferred.load(Ordering::SeqCst);
+    tally.progress_total = engine.total_bytes;
+    engine.journal
+}
+
 async fn handle_start_import(
     afc: &mut AfcClient,
     job_id: String,
@@ -540,6 +1015,7 @@ async fn handle_start_import(
     qt_thread: QtThread<IOManager>,
     jobs: Arc<Mutex<HashMap<String, Arc<AtomicBool>>>>,
     cancel_flag: Arc<AtomicBool>,
+    journal_key: String,
 ) {
     let mut successful = 0_i32;
     let mut failed = 0_i32;
@@ -550,6 +1026,12 @@ async fn handle_start_import(
         "IOManager import job started: job_id={job_id} items={}",
         local_paths.len()
     );
+    // The destination is on the device, so import journals live locally.
+    let journal = open_journal(
+        &std::env::temp_dir().join("idescriptor-journals"),
+        format!("import-{journal_key}.journal"),
+    )
+    .await;
 
     for local_path in local_paths {
         if cancel_flag.load(Ordering::Relaxed) {
@@ -564,8 +1046,8 @@ async fn handle_start_import(
             &local_path,
             &destination_dir,
             &job_id,
-            &qt_thread,
             &cancel_flag,
+            journal.as_ref(),
         )
         .await
         {
@@ -609,6 +1091,9 @@ async fn handle_start_import(
         }
     }
 
+    if let Some(journal) = journal {
+        close_journal(journal, cancelled || failed > 0);
+    }
     finish_import_job(
         &qt_thread,
         job_id.clone(),
@@ -623,281 +1108,1282 @@ async fn handle_start_import(
     unregister_job(&jobs, &job_id);
 }
 
-async fn export_single_item(
-    afc: &mut AfcClient,
+/// Walks `device_path` one level at a time: the level's directories are
+/// listed on one lease, then every entry found is stat'ed with
+/// `stat_device_paths`, so a large tree costs about one round trip per entry
+/// spread over several sessions instead of one after another.
+async fn build_directory_export_manifest(
+    pool: &AfcPool,
     device_path: &str,
-    destination_dir: &str,
-    job_id: &str,
-    qt_thread: &QtThread<IOManager>,
-    cancel_flag: &Arc<AtomicBool>,
-    allow_directories: bool,
-) -> Result<TransferItemResult, String> {
-    fs::create_dir_all(destination_dir)
-        .await
-        .map_err(|e| format!("Failed to create destination directory {destination_dir}: {e}"))?;
-
-    let file_name = file_name_for_path(device_path);
-    let base_path = Path::new(destination_dir).join(&file_name);
-    let output_path = unique_output_path(&base_path).await;
-    let output_path_str = output_path.to_string_lossy().to_string();
-    debug!(
-        "IOManager export item preparing: job_id={job_id} device_path={device_path} output_path={output_path_str}"
-    );
-
-    let resolved = afc
-        .get_file_info_resolved(device_path.to_string())
-        .await
-        .map_err(|e| format!("Failed to resolve device path {device_path}: {e}"))?;
-    let resolved_path = resolved.resolved_path;
-    let info = resolved.info;
+    cancel_flag: &AtomicBool,
+) -> Result<DirectoryExportManifest, String> {
+    let mut manifest = DirectoryExportManifest {
+        directories: vec![PathBuf::new()],
+        files: Vec::new(),
+        total_bytes: 0,
+    };
+    let mut root_ancestors = HashSet::new();
+    root_ancestors.insert(device_path.to_string());
+    let mut level = vec![(device_path.to_string(), PathBuf::new(), root_ancestors)];
 
-    if info.st_ifmt == "S_IFDIR" {
-        if !allow_directories {
-            return Err(format!("Directory export is not enabled for {device_path}"));
+    while !level.is_empty() {
+        if cancel_flag.load(Ordering::Relaxed) {
+            return Err("Export cancelled while enumerating directory".to_string());
         }
 
-        return export_directory(
-            afc,
-            &resolved_path,
-            &output_path,
-            &file_name,
-            job_id,
-            qt_thread,
-            cancel_flag,
-        )
-        .await;
-    }
+        // (remote path, relative path, index of the parent in `level`)
+        let mut children = Vec::new();
+        {
+            let mut afc = pool
+                .lease()
+                .await
+                .map(AfcHandle::Leased)
+                .map_err(|err| format!("No AFC session available: {err}"))?;
+            for (parent, (remote_directory, relative_directory, _)) in level.iter().enumerate() {
+                let entries = match afc.list_dir(remote_directory).await {
+                    Ok(entries) => entries,
+                    Err(err) => {
+                        afc.note_error(&err);
+                        return Err(format!(
+                            "Failed to list directory {remote_directory}: {err}"
+                        ));
+                    }
+                };
+                for name in entries {
+                    if name == "." || name == ".." {
+                        continue;
+                    }
+                    validate_remote_child_name(&name)?;
+                    children.push((
+                        remote_child_path(remote_directory, &name),
+                        relative_directory.join(&name),
+                        parent,
+                    ));
+                }
+            }
+        }
 
-    let transferred = export_remote_file(
-        afc,
-        &resolved_path,
-        &output_path,
-        &info,
-        job_id,
-        qt_thread,
-        &file_name,
-        0,
-        info.size as i64,
-        cancel_flag,
-    )
-    .await?;
+        let remote_paths: Vec<String> = children
+            .iter()
+            .map(|(remote_path, _, _)| remote_path.clone())
+            .collect();
+        let stats = stat_device_paths(pool, &remote_paths, cancel_flag).await;
+        let mut next_level = Vec::new();
+        for ((remote_path, relative_path, parent), stat) in children.into_iter().zip(stats) {
+            let (resolved_path, info) = stat?;
+            if info.st_ifmt == "S_IFDIR" {
+                let ancestors = &level[parent].2;
+                if ancestors.contains(&resolved_path) {
+                    return Err(format!(
+                        "Refusing symbolic-link directory cycle at {remote_path} -> {resolved_path}"
+                    ));
+                }
+                // only current ancestors are checked,
+                // so separate aliases may export the same target
+                // this should be ok
+                let mut child_ancestors = ancestors.clone();
+                child_ancestors.insert(resolved_path.clone());
+                manifest.directories.push(relative_path.clone());
+                next_level.push((resolved_path, relative_path, child_ancestors));
+            } else {
+                manifest.total_bytes = manifest.total_bytes.saturating_add(info.size as i64);
+                manifest.files.push(RemoteExportFile {
+                    remote_path: resolved_path,
+                    relative_path,
+                    info,
+                });
+            }
+        }
+        level = next_level;
+    }
 
-    Ok(TransferItemResult {
-        success: !cancel_flag.load(Ordering::Relaxed),
-        bytes_transferred: transferred,
-        destination_path: output_path_str,
-        error_message: cancel_flag
-            .load(Ordering::Relaxed)
-            .then(|| "Export cancelled".to_string()),
-    })
+    Ok(manifest)
 }
 
-async fn export_directory(
-    afc: &mut AfcClient,
-    device_path: &str,
-    output_path: &Path,
-    progress_name: &str,
-    job_id: &str,
-    qt_thread: &QtThread<IOManager>,
-    cancel_flag: &Arc<AtomicBool>,
-) -> Result<TransferItemResult, String> {
-    let manifest = build_directory_export_manifest(afc, device_path, cancel_flag).await?;
-    let output_path_str = output_path.to_string_lossy().to_string();
+/// One requested device path. Directories fan out into many files, and large
+/// files into many ranges; the item is finished once all of them are.
+struct ExportItem {
+    device_path: String,
+    progress_name: String,
+    output_path: PathBuf,
+    total_bytes: i64,
+    transferred: AtomicI64,
+    pending_units: AtomicUsize,
+    started: AtomicBool,
+    cancelled: AtomicBool,
+    error: Mutex<Option<String>>,
+    /// Where a single HEIC file ended up after conversion.
+    converted_path: Mutex<Option<PathBuf>>,
+}
 
-    for relative_directory in &manifest.directories {
-        if cancel_flag.load(Ordering::Relaxed) {
-            return Ok(TransferItemResult {
-                success: false,
-                bytes_transferred: 0,
-                destination_path: output_path_str,
-                error_message: Some("Export cancelled".to_string()),
+struct ExportFile {
+    item: usize,
+    remote_path: String,
+    local_path: PathBuf,
+    info: FileInfo,
+    pending_ranges: AtomicUsize,
+    /// Bytes a previous run already wrote, for whole-file units.
+    resume_from: u64,
+}
+
+enum ExportUnit {
+    File(Arc<ExportFile>),
+    Range {
+        file: Arc<ExportFile>,
+        offset: u64,
+        len: u64,
+    },
+}
+
+/// How a job's journal remembers the output path picked for each item.
+#[derive(Clone, Copy)]
+enum OutputKey {
+    /// By position in the request, which the journal key already fixes.
+    Index,
+    /// By device path, for feeds whose pages shift when the source changes.
+    Source,
+}
+
+struct ExportPlan {
+    items: Vec<ExportItem>,
+    units: VecDeque<ExportUnit>,
+}
+
+#[derive(Default)]
+struct ExportTally {
+    successful: i32,
+    failed: i32,
+    total_bytes: i64,
+    succeeded_items: HashSet<usize>,
+    /// Job-level progress carried from one feed page to the next.
+    progress_done: u64,
+    progress_total: u64,
+}
+
+/// Mirror-mode bookkeeping for one export job: what the previous sync copied
+/// and every file this run found on the device.
+struct SyncState {
+    destination: PathBuf,
+    delete_missing: bool,
+    previous: SyncManifest,
+    /// Manifest key, device size/mtime and owning item of each seen file.
+    seen: Vec<(String, ManifestEntry, usize)>,
+}
+
+impl SyncState {
+    /// A missing or unreadable manifest only means everything is copied.
+    async fn load(destination_dir: &str, delete_missing: bool) -> Self {
+        let destination = PathBuf::from(destination_dir);
+        let previous = SyncManifest::load(&destination)
+            .await
+            .unwrap_or_else(|err| {
+                warn!("IOManager sync ignoring unreadable manifest in {destination_dir}: {err}");
+                SyncManifest::default()
             });
+        debug!(
+            "IOManager sync manifest loaded: destination_dir={destination_dir} entries={}",
+            previous.len()
+        );
+        Self {
+            destination,
+            delete_missing,
+            previous,
+            seen: Vec::new(),
         }
+    }
 
-        let local_directory = output_path.join(relative_directory);
-        fs::create_dir_all(&local_directory).await.map_err(|err| {
-            format!(
-                "Failed to create exported directory {}: {err}",
-                local_directory.display()
-            )
-        })?;
+    /// Records a device file and tells whether the local copy is current:
+    /// the manifest has the same size and mtime and the file is still there
+    /// at full length.
+    fn observe(
+        &mut self,
+        local_path: &Path,
+        size: u64,
+        mtime: i64,
+        local_len: Option<u64>,
+        item: usize,
+    ) -> bool {
+        let Some(key) = manifest_key(&self.destination, local_path) else {
+            return false;
+        };
+        let entry = ManifestEntry { size, mtime };
+        let unchanged = local_len == Some(size) && self.previous.get(&key) == Some(entry);
+        self.seen.push((key, entry, item));
+        unchanged
     }
 
-    let mut transferred = 0_i64;
-    for file in manifest.files {
-        if cancel_flag.load(Ordering::Relaxed) {
-            break;
+    /// Writes the updated manifest and, for a sync that saw the whole device
+    /// side (`complete`), deletes local files that are gone from the device.
+    async fn finish(self, succeeded_items: &HashSet<usize>, complete: bool) {
+        let prune = self.delete_missing && complete;
+        let (entries, missing) =
+            merge_sync_manifest(&self.previous, &self.seen, succeeded_items, prune);
+
+        let mut deleted = 0;
+        for key in &missing {
+            let path = self.destination.join(key);
+            match fs::remove_file(&path).await {
+                Ok(()) => deleted += 1,
+                Err(err) if err.kind() == std::io::ErrorKind::NotFound => {}
+                Err(err) => warn!("IOManager sync failed to delete {}: {err}", path.display()),
+            }
         }
 
-        let local_path = output_path.join(&file.relative_path);
-        if let Some(parent) = local_path.parent() {
-            fs::create_dir_all(parent).await.map_err(|err| {
-                format!(
-                    "Failed to create exported directory {}: {err}",
-                    parent.display()
-                )
-            })?;
+        if let Err(err) = sync_manifest::store(&self.destination, &entries).await {
+            warn!(
+                "IOManager sync failed to write manifest in {}: {err}",
+                self.destination.display()
+            );
         }
+        info!(
+            "IOManager sync manifest updated: destination_dir={} entries={} deleted={deleted}",
+            self.destination.display(),
+            entries.len()
+        );
+    }
+}
 
-        transferred += export_remote_file(
-            afc,
-            &file.remote_path,
-            &local_path,
-            &file.info,
-            job_id,
-            qt_thread,
-            progress_name,
-            transferred,
-            manifest.total_bytes,
-            cancel_flag,
-        )
-        .await?;
+/// `local_path` relative to the sync destination, `/`-separated.
+fn manifest_key(destination: &Path, local_path: &Path) -> Option<String> {
+    let relative = local_path.strip_prefix(destination).ok()?;
+    let parts: Option<Vec<&str>> = relative
+        .components()
+        .map(|component| match component {
+            std::path::Component::Normal(part) => part.to_str(),
+            _ => None,
+        })
+        .collect();
+    let parts = parts?;
+    (!parts.is_empty()).then(|| parts.join("/"))
+}
+
+/// Next manifest after a sync, plus the keys of local files to delete.
+///
+/// Files of items that succeeded are recorded as seen. Files of failed items
+/// keep their previous entry, so a file that changed but failed to copy still
+/// mismatches next time. Entries the device no longer has are deleted when
+/// `prune` is set and otherwise kept, so a later pruning sync still finds
+/// them.
+fn merge_sync_manifest(
+    previous: &SyncManifest,
+    seen: &[(String, ManifestEntry, usize)],
+    succeeded_items: &HashSet<usize>,
+    prune: bool,
+) -> (BTreeMap<String, ManifestEntry>, Vec<String>) {
+    let mut entries = BTreeMap::new();
+    for (key, entry, item) in seen {
+        if succeeded_items.contains(item) {
+            entries.insert(key.clone(), *entry);
+        } else if let Some(previous) = previous.get(key) {
+            entries.insert(key.clone(), previous);
+        }
     }
 
-    Ok(TransferItemResult {
-        success: !cancel_flag.load(Ordering::Relaxed),
-        bytes_transferred: transferred,
-        destination_path: output_path_str,
-        error_message: cancel_flag
-            .load(Ordering::Relaxed)
-            .then(|| "Export cancelled".to_string()),
-    })
+    let seen_keys: HashSet<&str> = seen.iter().map(|(key, _, _)| key.as_str()).collect();
+    let mut missing = Vec::new();
+    for (key, entry) in previous.iter() {
+        if seen_keys.contains(key) {
+            continue;
+        }
+        // Keys come from disk; never delete outside the destination.
+        if prune && manifest_key(Path::new(""), Path::new(key)).as_deref() == Some(key) {
+            missing.push(key.to_string());
+        } else {
+            entries.insert(key.to_string(), entry);
+        }
+    }
+    (entries, missing)
 }
 
-async fn build_directory_export_manifest(
-    afc: &mut AfcClient,
-    device_path: &str,
-    cancel_flag: &Arc<AtomicBool>,
-) -> Result<DirectoryExportManifest, String> {
-    let mut manifest = DirectoryExportManifest {
-        directories: vec![PathBuf::new()],
-        files: Vec::new(),
-        total_bytes: 0,
-    };
-    let mut root_ancestors = HashSet::new();
-    root_ancestors.insert(device_path.to_string());
-    let mut pending_directories = vec![(device_path.to_string(), PathBuf::new(), root_ancestors)];
+/// Emits indices in order as soon as every earlier index has arrived.
+#[derive(Default)]
+struct ReorderBuffer {
+    next: usize,
+    pending: BTreeSet<usize>,
+}
 
-    while let Some((remote_directory, relative_directory, ancestors)) = pending_directories.pop() {
-        if cancel_flag.load(Ordering::Relaxed) {
-            return Err("Export cancelled while enumerating directory".to_string());
+impl ReorderBuffer {
+    fn push(&mut self, index: usize) -> Vec<usize> {
+        self.pending.insert(index);
+        let mut ready = Vec::new();
+        while self.pending.remove(&self.next) {
+            ready.push(self.next);
+            self.next += 1;
         }
+        ready
+    }
 
-        let entries = afc
-            .list_dir(&remote_directory)
+    fn next(&self) -> usize {
+        self.next
+    }
+}
+
+struct ExportEngine {
+    pool: AfcPool,
+    job_id: String,
+    qt_thread: QtThread<IOManager>,
+    cancel_flag: Arc<AtomicBool>,
+    items: Vec<ExportItem>,
+    queue: Mutex<VecDeque<ExportUnit>>,
+    done_tx: mpsc::UnboundedSender<usize>,
+    journal: Option<TransferJournal>,
+    content_index: Option<Arc<ContentIndex>>,
+    transcode: Option<TranscodeFormat>,
+    /// Finished HEIC files for the conversion stage; taken once the workers
+    /// are done so the stage drains and stops.
+    conversions: Mutex<Option<mpsc::UnboundedSender<Arc<ExportFile>>>>,
+    /// Every local path the plan writes, so converted files do not take a
+    /// name a worker has yet to create.
+    planned_paths: HashSet<PathBuf>,
+    /// Bytes done across all items against the planned total, so progress
+    /// stays job-level while the workers copy different files.
+    transferred: AtomicU64,
+    total_bytes: u64,
+}
+
+impl ExportItem {
+    fn new(device_path: String, output_path: PathBuf) -> Self {
+        Self {
+            progress_name: file_name_for_path(&device_path),
+            device_path,
+            output_path,
+            total_bytes: 0,
+            transferred: AtomicI64::new(0),
+            pending_units: AtomicUsize::new(0),
+            started: AtomicBool::new(false),
+            cancelled: AtomicBool::new(false),
+            error: Mutex::new(None),
+            converted_path: Mutex::new(None),
+        }
+    }
+
+    fn failed(device_path: String, error: String) -> Self {
+        let item = Self::new(device_path, PathBuf::new());
+        item.fail(error);
+        item
+    }
+
+    /// Keeps the first error; later units of a failed item are skipped.
+    fn fail(&self, error: String) {
+        let mut slot = self.error.lock().expect("export item mutex poisoned");
+        slot.get_or_insert(error);
+    }
+
+    fn has_failed(&self) -> bool {
+        self.error
+            .lock()
+            .expect("export item mutex poisoned")
+            .is_some()
+    }
+}
+
+impl ExportFile {
+    /// Journal key: the local path, which stays fixed across resumed runs.
+    fn key(&self) -> String {
+        self.local_path.to_string_lossy().to_string()
+    }
+
+    fn size(&self) -> u64 {
+        self.info.size as u64
+    }
+
+    fn mtime(&self) -> i64 {
+        self.info.modified.and_utc().timestamp()
+    }
+}
+
+impl ExportUnit {
+    fn file(&self) -> &Arc<ExportFile> {
+        match self {
+            Self::File(file) | Self::Range { file, .. } => file,
+        }
+    }
+
+    fn is_small(&self) -> bool {
+        matches!(self, Self::File(file) if (file.info.size as u64) < SMALL_FILE_LIMIT)
+    }
+}
+
+/// Splits `size` bytes into `range_size` pieces, the last one possibly short.
+fn split_ranges(size: u64, range_size: u64) -> Vec<(u64, u64)> {
+    let range_size = range_size.max(1);
+    (0..size.div_ceil(range_size))
+        .map(|index| {
+            let offset = index * range_size;
+            (offset, range_size.min(size - offset))
+        })
+        .collect()
+}
+
+/// Stats every requested path, builds directory manifests and picks output
+/// paths, then turns the files into transfer units in request order.
+async fn plan_export(
+    pool: &AfcPool,
+    job_id: &str,
+    device_paths: Vec<String>,
+    destination_dir: &str,
+    allow_directories: bool,
+    cancel_flag: &AtomicBool,
+    journal: Option<&TransferJournal>,
+    output_key: OutputKey,
+    mut sync: Option<&mut SyncState>,
+    content_index: Option<&Arc<ContentIndex>>,
+    transcode: Option<TranscodeFormat>,
+) -> ExportPlan {
+    let mut plan = ExportPlan {
+        items: Vec::with_capacity(device_paths.len()),
+        units: VecDeque::new(),
+    };
+
+    if let Err(err) = fs::create_dir_all(destination_dir).await {
+        let message = format!("Failed to create destination directory {destination_dir}: {err}");
+        plan.items = device_paths
+            .into_iter()
+            .map(|device_path| ExportItem::failed(device_path, message.clone()))
+            .collect();
+        return plan;
+    }
+
+    let stats = stat_device_paths(pool, &device_paths, cancel_flag).await;
+    let mut claimed = HashSet::new();
+    let mut files = Vec::new();
+
+    for (index, (device_path, stat)) in device_paths.into_iter().zip(stats).enumerate() {
+        let (resolved_path, info) = match stat {
+            Ok(resolved) => resolved,
+            Err(err) => {
+                plan.items.push(ExportItem::failed(device_path, err));
+                continue;
+            }
+        };
+
+        // A sync mirrors into fixed paths; a resumed job writes into the
+        // paths it picked the first time.
+        let resumed_output = journal.and_then(|journal| match output_key {
+            OutputKey::Index => journal.resumed().output(index),
+            OutputKey::Source => journal.resumed().source_output(&device_path),
+        });
+        let output_path = match resumed_output {
+            _ if sync.is_some() => {
+                Path::new(destination_dir).join(file_name_for_path(&device_path))
+            }
+            Some(path) => PathBuf::from(path),
+            None => {
+                let base_path = Path::new(destination_dir).join(file_name_for_path(&device_path));
+                let output_path = unique_output_path(&base_path, &claimed).await;
+                if let Some(journal) = journal {
+                    let path = output_path.to_string_lossy().to_string();
+                    journal.record(match output_key {
+                        OutputKey::Index => JournalEntry::Output { index, path },
+                        OutputKey::Source => JournalEntry::SourceOutput {
+                            source: device_path.clone(),
+                            path,
+                        },
+                    });
+                }
+                output_path
+            }
+        };
+        claimed.insert(output_path.clone());
+        debug!(
+            "IOManager export item preparing: job_id={job_id} device_path={device_path} output_path={}",
+            output_path.display()
+        );
+        let mut item = ExportItem::new(device_path, output_path);
+
+        if info.st_ifmt == "S_IFDIR" {
+            if !allow_directories {
+                item.fail(format!(
+                    "Directory export is not enabled for {}",
+                    item.device_path
+                ));
+            } else if let Err(err) = plan_directory(
+                pool,
+                index,
+                &mut item,
+                &resolved_path,
+                cancel_flag,
+                &mut files,
+            )
             .await
-            .map_err(|err| format!("Failed to list directory {remote_directory}: {err}"))?;
+            {
+                item.fail(err);
+            }
+        } else {
+            item.total_bytes = info.size as i64;
+            files.push(ExportFile {
+                item: index,
+                remote_path: resolved_path,
+                local_path: item.output_path.clone(),
+                info,
+                pending_ranges: AtomicUsize::new(0),
+                resume_from: 0,
+            });
+        }
+        plan.items.push(item);
+    }
+
+    let mut duplicates = match content_index {
+        Some(index) => find_duplicates(pool, index, &files, &plan.items, cancel_flag).await,
+        None => HashMap::new(),
+    };
+
+    for (position, mut file) in files.into_iter().enumerate() {
+        let item = &plan.items[file.item];
+        if item.has_failed() {
+            continue;
+        }
 
-        for name in entries {
-            if name == "." || name == ".." {
+        let (key, size, mtime) = (file.key(), file.size(), file.mtime());
+        let local_len = fs::metadata(&file.local_path)
+            .await
+            .map(|metadata| metadata.len())
+            .ok();
+        let resumed = journal.map(TransferJournal::resumed);
+        let unchanged = sync
+            .as_deref_mut()
+            .is_some_and(|sync| sync.observe(&file.local_path, size, mtime, local_len, file.item));
+        // A converted file is finished once its output exists; the HEIC it
+        // came from is gone. One finished without converting is redone.
+        let converting = converts(transcode, &file);
+        let converted_output = resumed
+            .filter(|_| converting)
+            .and_then(|state| state.converted(&key))
+            .map(PathBuf::from);
+        let output_intact = match &converted_output {
+            Some(output) => fs::try_exists(output).await.unwrap_or(false),
+            None => !converting && local_len == Some(size),
+        };
+        if unchanged
+            || (resumed.is_some_and(|state| state.is_done(&key, size, mtime)) && output_intact)
+        {
+            if let Some(output) = converted_output
+                && file.local_path == item.output_path
+            {
+                *item
+                    .converted_path
+                    .lock()
+                    .expect("export item mutex poisoned") = Some(output);
+            }
+            item.transferred.fetch_add(size as i64, Ordering::SeqCst);
+            continue;
+        }
+        // Linking would leave a HEIC file where a converted one belongs.
+        if let Some((existing, digest)) = duplicates.remove(&position).filter(|_| !converting) {
+            if local_len.is_none() && link_duplicate(&existing, &file.local_path).await {
+                // A resumed run skips it like any finished file.
+                if let Some(journal) = journal {
+                    journal.record(JournalEntry::Done {
+                        path: key,
+                        size,
+                        mtime,
+                    });
+                }
+                if let Some(index) = content_index {
+                    if let Err(err) = index.record(&file.local_path, digest) {
+                        warn!(
+                            "IOManager failed to index {}: {err}",
+                            file.local_path.display()
+                        );
+                    }
+                }
+                item.transferred.fetch_add(size as i64, Ordering::SeqCst);
                 continue;
             }
-            validate_remote_child_name(&name)?;
+        }
+        if let Some(journal) = journal {
+            journal.record(JournalEntry::Source {
+                path: key.clone(),
+                size,
+                mtime,
+            });
+        }
 
-            let remote_path = remote_child_path(&remote_directory, &name);
-            let relative_path = relative_directory.join(&name);
-            let resolved = afc
-                .get_file_info_resolved(&remote_path)
-                .await
-                .map_err(|err| format!("Failed to resolve {remote_path}: {err}"))?;
-            let resolved_path = resolved.resolved_path;
-            let info = resolved.info;
+        if size < RANGE_SPLIT_THRESHOLD {
+            // Only trust a checkpoint the local file actually reaches.
+            file.resume_from = resumed
+                .map(|state| state.partial_offset(&key, size, mtime))
+                .filter(|offset| local_len.is_some_and(|len| len >= *offset))
+                .unwrap_or(0);
+            item.transferred
+                .fetch_add(file.resume_from as i64, Ordering::SeqCst);
+            item.pending_units.fetch_add(1, Ordering::SeqCst);
+            plan.units.push_back(ExportUnit::File(Arc::new(file)));
+            continue;
+        }
 
-            if info.st_ifmt == "S_IFDIR" {
-                if ancestors.contains(&resolved_path) {
-                    return Err(format!(
-                        "Refusing symbolic-link directory cycle at {remote_path} -> {resolved_path}"
-                    ));
+        // Ranges write into a file that already has its final length. Ranges
+        // finished by an earlier run count only if that file is still intact.
+        let finished = match (resumed, local_len) {
+            (Some(state), Some(len)) if len == size => state.finished_ranges(&key, size, mtime),
+            _ => HashSet::new(),
+        };
+        // Starting over replaces the file rather than writing into it, since
+        // it may be a hard link to another exported copy.
+        if finished.is_empty() {
+            if let Err(err) = preallocate(&file.local_path, size).await {
+                item.fail(err);
+                continue;
+            }
+        }
+        let ranges: Vec<_> = split_ranges(size, RANGE_SIZE)
+            .into_iter()
+            .filter(|(offset, len)| {
+                let done = finished.contains(offset);
+                if done {
+                    item.transferred.fetch_add(*len as i64, Ordering::SeqCst);
                 }
-                // only current ancestors are checked,
-                // so separate aliases may export the same target
-                // this should be ok
-                let mut child_ancestors = ancestors.clone();
-                child_ancestors.insert(resolved_path.clone());
-                manifest.directories.push(relative_path.clone());
-                pending_directories.push((resolved_path, relative_path, child_ancestors));
-            } else {
-                manifest.total_bytes = manifest.total_bytes.saturating_add(info.size as i64);
-                manifest.files.push(RemoteExportFile {
-                    remote_path: resolved_path,
-                    relative_path,
-                    info,
+                !done
+            })
+            .collect();
+        if ranges.is_empty() {
+            preserve_modified_time(&file.local_path, &file.info);
+            if let Some(journal) = journal {
+                journal.record(JournalEntry::Done {
+                    path: key,
+                    size,
+                    mtime,
                 });
             }
+            continue;
+        }
+        file.pending_ranges.store(ranges.len(), Ordering::SeqCst);
+        item.pending_units.fetch_add(ranges.len(), Ordering::SeqCst);
+        let file = Arc::new(file);
+        for (offset, len) in ranges {
+            plan.units.push_back(ExportUnit::Range {
+                file: file.clone(),
+                offset,
+                len,
+            });
         }
     }
 
-    Ok(manifest)
+    plan
 }
 
-#[allow(clippy::too_many_arguments)]
-async fn export_remote_file(
-    afc: &mut AfcClient,
-    device_path: &str,
-    output_path: &Path,
-    info: &FileInfo,
-    job_id: &str,
-    qt_thread: &QtThread<IOManager>,
-    progress_name: &str,
-    progress_offset: i64,
-    progress_total: i64,
-    cancel_flag: &Arc<AtomicBool>,
-) -> Result<i64, String> {
-    use tokio::io::AsyncReadExt;
+/// Resolves `device_paths` in batches spread over several pooled sessions, so
+/// thousands of small items do not pay one round trip each in sequence.
+async fn stat_device_paths(
+    pool: &AfcPool,
+    device_paths: &[String],
+    cancel_flag: &AtomicBool,
+) -> Vec<Result<(String, FileInfo), String>> {
+    let cursor = &AtomicUsize::new(0);
+    let batches = futures::future::join_all((0..EXPORT_WORKERS).map(|_| async move {
+        let mut resolved = Vec::new();
+        loop {
+            let start = cursor.fetch_add(STAT_BATCH, Ordering::SeqCst);
+            if start >= device_paths.len() {
+                return resolved;
+            }
+            let end = (start + STAT_BATCH).min(device_paths.len());
 
-    let output_path_str = output_path.to_string_lossy().to_string();
-    let mut remote = afc
-        .open(device_path, AfcFopenMode::RdOnly)
-        .await
-        .map_err(|err| format!("Failed to open device file {device_path}: {err}"))?;
-    let mut local = fs::File::create(output_path)
+            let mut afc = match pool.lease().await {
+                Ok(afc) => AfcHandle::Leased(afc),
+                Err(err) => {
+                    for index in start..end {
+                        resolved.push((index, Err(format!("No AFC session available: {err}"))));
+                    }
+                    continue;
+                }
+            };
+            for (index, device_path) in device_paths.iter().enumerate().take(end).skip(start) {
+                if cancel_flag.load(Ordering::Relaxed) {
+                    resolved.push((index, Err("Export cancelled".to_string())));
+                    continue;
+                }
+                let result = match afc.get_file_info_resolved(device_path.to_string()).await {
+                    Ok(info) => Ok((info.resolved_path, info.info)),
+                    Err(err) => {
+                        afc.note_error(&err);
+                        Err(format!(
+                            "Failed to resolve device path {device_path}: {err}"
+                        ))
+                    }
+                };
+                resolved.push((index, result));
+            }
+        }
+    }))
+    .await;
+
+    let mut results: Vec<_> = batches.into_iter().flatten().collect();
+    results.sort_by_key(|(index, _)| *index);
+    results.into_iter().map(|(_, result)| result).collect()
+}
+
+/// Reads the head of every file whose size the content index knows, spread
+/// over several pooled sessions, and returns the files (by position in
+/// `files`) that already have a copy under the index root.
+async fn find_duplicates(
+    pool: &AfcPool,
+    index: &ContentIndex,
+    files: &[ExportFile],
+    items: &[ExportItem],
+    cancel_flag: &AtomicBool,
+) -> HashMap<usize, (PathBuf, ContentDigest)> {
+    let candidates: Vec<usize> = files
+        .iter()
+        .enumerate()
+        .filter(|(_, file)| !items[file.item].has_failed() && index.has_size(file.size()))
+        .map(|(position, _)| position)
+        .collect();
+    let cursor = &AtomicUsize::new(0);
+    let candidates = &candidates;
+    let batches = futures::future::join_all((0..EXPORT_WORKERS).map(|_| async move {
+        let mut found = Vec::new();
+        loop {
+            let start = cursor.fetch_add(STAT_BATCH, Ordering::SeqCst);
+            if start >= candidates.len() {
+                return found;
+            }
+            let end = (start + STAT_BATCH).min(candidates.len());
+
+            // A candidate that cannot be checked is simply copied.
+            let Ok(afc) = pool.lease().await else {
+                continue;
+            };
+            let mut afc = AfcHandle::Leased(afc);
+            for &position in &candidates[start..end] {
+                if cancel_flag.load(Ordering::Relaxed) {
+                    return found;
+                }
+                let file = &files[position];
+                match read_device_head(&mut afc, &file.remote_path).await {
+                    Ok(head) => {
+                        if let Some(existing) =
+                            index.find(file.size(), &content_index::head_digest(&head))
+                        {
+                            found.push((position, existing));
+                        }
+                    }
+                    Err(err) => debug!(
+                        "IOManager could not read {} for deduplication: {err}",
+                        file.remote_path
+                    ),
+                }
+            }
+        }
+    }))
+    .await;
+    batches.into_iter().flatten().collect()
+}
+
+async fn read_device_head(afc: &mut AfcHandle, device_path: &str) -> Result<Vec<u8>, String> {
+    let mut remote = match afc.open(device_path, AfcFopenMode::RdOnly).await {
+        Ok(remote) => remote,
+        Err(err) => {
+            afc.note_error(&err);
+            return Err(err.to_string());
+        }
+    };
+    let mut head = Vec::with_capacity(content_index::HEAD_BYTES);
+    let read = (&mut remote)
+        .take(content_index::HEAD_BYTES as u64)
+        .read_to_end(&mut head)
+        .await;
+    let _ = remote.close().await;
+    read.map(|_| head).map_err(|err| err.to_string())
+}
+
+/// Hard-links an already exported copy into place. Where links are not
+/// supported the file is copied from the device as usual.
+async fn link_duplicate(existing: &Path, output_path: &Path) -> bool {
+    match fs::hard_link(existing, output_path).await {
+        Ok(()) => {
+            debug!(
+                "IOManager linked duplicate {} to {}",
+                output_path.display(),
+                existing.display()
+            );
+            true
+        }
+        Err(err) => {
+            debug!(
+                "IOManager could not link {} to {}: {err}",
+                output_path.display(),
+                existing.display()
+            );
+            false
+        }
+    }
+}
+
+async fn plan_directory(
+    pool: &AfcPool,
+    index: usize,
+    item: &mut ExportItem,
+    resolved_path: &str,
+    cancel_flag: &AtomicBool,
+    files: &mut Vec<ExportFile>,
+) -> Result<(), String> {
+    let manifest = build_directory_export_manifest(pool, resolved_path, cancel_flag).await?;
+
+    for relative_directory in &manifest.directories {
+        let local_directory = item.output_path.join(relative_directory);
+        fs::create_dir_all(&local_directory).await.map_err(|err| {
+            format!(
+                "Failed to create exported directory {}: {err}",
+                local_directory.display()
+            )
+        })?;
+    }
+
+    item.total_bytes = manifest.total_bytes;
+    files.extend(manifest.files.into_iter().map(|file| ExportFile {
+        item: index,
+        remote_path: file.remote_path,
+        local_path: item.output_path.join(&file.relative_path),
+        info: file.info,
+        pending_ranges: AtomicUsize::new(0),
+        resume_from: 0,
+    }));
+    Ok(())
+}
+
+async fn preallocate(path: &Path, size: u64) -> Result<(), String> {
+    local_sink::preallocate(path.to_path_buf(), size)
         .await
-        .map_err(|err| format!("Failed to create local file {output_path_str}: {err}"))?;
-    let mut chunk = vec![0_u8; DEFAULT_CHUNK_SIZE];
-    let mut transferred = 0_i64;
+        .map_err(|err| format!("Failed to preallocate local file {}: {err}", path.display()))
+}
 
-    loop {
-        if cancel_flag.load(Ordering::Relaxed) {
-            break;
+impl ExportEngine {
+    /// Pulls units until the queue is empty. Small files are taken in
+    /// batches so one lease covers many open/read/close round trips; every
+    /// other unit gets its own lease so other jobs and the gallery can
+    /// interleave.
+    async fn run_worker(&self) {
+        loop {
+            if self.cancel_flag.load(Ordering::Relaxed) {
+                return;
+            }
+            let batch = self.next_batch();
+            if batch.is_empty() {
+                return;
+            }
+
+            let mut afc = match self.pool.lease().await {
+                Ok(afc) => AfcHandle::Leased(afc),
+                Err(err) => {
+                    for unit in batch {
+                        self.items[unit.file().item]
+                            .fail(format!("No AFC session available: {err}"));
+                        self.finish_unit(&unit);
+                    }
+                    continue;
+                }
+            };
+            for unit in batch {
+                if self.cancel_flag.load(Ordering::Relaxed) {
+                    return;
+                }
+                self.run_unit(&mut afc, &unit).await;
+                self.finish_unit(&unit);
+            }
         }
+    }
 
-        let read = remote
-            .read(&mut chunk)
-            .await
-            .map_err(|err| format!("Failed to read from device file {device_path}: {err}"))?;
-        if read == 0 {
-            break;
+    fn next_batch(&self) -> Vec<ExportUnit> {
+        let mut queue = self.queue.lock().expect("export queue mutex poisoned");
+        let Some(first) = queue.pop_front() else {
+            return Vec::new();
+        };
+        let small = first.is_small();
+        let mut batch = vec![first];
+        while small
+            && batch.len() < SMALL_BATCH_FILES
+            && queue.front().is_some_and(ExportUnit::is_small)
+        {
+            batch.extend(queue.pop_front());
         }
+        batch
+    }
 
-        local
-            .write_all(&chunk[..read])
+    async fn run_unit(&self, afc: &mut AfcHandle, unit: &ExportUnit) {
+        let file = unit.file();
+        let item = &self.items[file.item];
+        if item.has_failed() {
+            return;
+        }
+        item.started.store(true, Ordering::SeqCst);
+
+        let (offset, len) = match unit {
+            ExportUnit::File(file) => (file.resume_from, None),
+            ExportUnit::Range { offset, len, .. } => (*offset, Some(*len)),
+        };
+        match self.copy_remote_range(afc, item, file, offset, len).await {
+            Ok(_) if self.cancel_flag.load(Ordering::Relaxed) => {
+                item.cancelled.store(true, Ordering::SeqCst);
+            }
+            Ok(digest) => {
+                let last = match unit {
+                    ExportUnit::File(_) => true,
+                    ExportUnit::Range { offset, .. } => {
+                        self.checkpoint(JournalEntry::Range {
+                            path: file.key(),
+                            offset: *offset,
+                        });
+                        file.pending_ranges.fetch_sub(1, Ordering::SeqCst) == 1
+                    }
+                };
+                if last {
+                    if file.size() > 0 {
+                        preserve_modified_time(&file.local_path, &file.info);
+                    }
+                    // A converted file is journaled and indexed once it has
+                    // its final form.
+                    if !self.queue_conversion(file) {
+                        self.checkpoint(JournalEntry::Done {
+                            path: file.key(),
+                            size: file.size(),
+                            mtime: file.mtime(),
+                        });
+                        self.index_content(&file.local_path, digest).await;
+                    }
+                }
+            }
+            Err(err) => item.fail(err),
+        }
+    }
+
+    /// Records a finished file in the destination's content index. Files
+    /// that were not written in one stream are hashed from disk on a blocking
+    /// thread, while the other workers keep transferring.
+    async fn index_content(&self, local_path: &Path, digest: Option<ContentDigest>) {
+        let Some(index) = &self.content_index else {
+            return;
+        };
+        let digest = match digest {
+            Some(digest) => Ok(digest),
+            None => {
+                let local_path = local_path.to_path_buf();
+                tokio::task::spawn_blocking(move || content_index::hash_file(&local_path))
+                    .await
+                    .unwrap_or_else(|err| Err(io::Error::other(err)))
+            }
+        };
+        if let Err(err) = digest.and_then(|digest| index.record(local_path, digest)) {
+            warn!("IOManager failed to index {}: {err}", local_path.display());
+        }
+    }
+
+    /// Hands a finished HEIC file to the conversion stage, if it is one. Its
+    /// item stays pending until the file is converted.
+    fn queue_conversion(&self, file: &Arc<ExportFile>) -> bool {
+        if !converts(self.transcode, file) {
+            return false;
+        }
+        let conversions = self
+            .conversions
+            .lock()
+            .expect("export conversions mutex poisoned");
+        let Some(conversions) = conversions.as_ref() else {
+            return false;
+        };
+        let item = &self.items[file.item];
+        // The worker still holds this unit, so the count cannot reach zero
+        // here even if the send fails.
+        item.pending_units.fetch_add(1, Ordering::SeqCst);
+        if conversions.send(file.clone()).is_err() {
+            item.pending_units.fetch_sub(1, Ordering::SeqCst);
+            return false;
+        }
+        true
+    }
+
+    /// Converts HEIC files as the workers finish them, as many at a time as
+    /// the decode pool has workers, until the channel closes.
+    async fn run_conversions(&self, conversions: mpsc::UnboundedReceiver<Arc<ExportFile>>) {
+        let Some(format) = self.transcode else {
+            return;
+        };
+        futures::stream::unfold(conversions, |mut conversions| async move {
+            let file = conversions.recv().await?;
+            Some((file, conversions))
+        })
+        .for_each_concurrent(decode_pool::stats().workers.max(1), |file| async move {
+            self.convert(&file, format).await;
+            self.finish_pending(file.item);
+        })
+        .await;
+    }
+
+    async fn convert(&self, file: &ExportFile, format: TranscodeFormat) {
+        let item = &self.items[file.item];
+        if item.has_failed() {
+            return;
+        }
+        if self.cancel_flag.load(Ordering::Relaxed) {
+            item.cancelled.store(true, Ordering::SeqCst);
+            return;
+        }
+        // The name is journaled before anything is written, so a conversion
+        // redone after an interruption overwrites its own output rather than
+        // picking `name (1).ext`.
+        let key = file.key();
+        let output = match self
+            .journal
+            .as_ref()
+            .and_then(|journal| journal.resumed().converted(&key))
+        {
+            Some(output) => PathBuf::from(output),
+            None => {
+                unique_output_path(&format.output_path(&file.local_path), &self.planned_paths).await
+            }
+        };
+        self.checkpoint(JournalEntry::Converted {
+            path: key.clone(),
+            output: output.to_string_lossy().to_string(),
+        });
+        match transcode_export(file, format, &output).await {
+            Ok(()) => {
+                self.checkpoint(JournalEntry::Done {
+                    path: key,
+                    size: file.size(),
+                    mtime: file.mtime(),
+                });
+                self.index_content(&output, None).await;
+                if file.local_path == item.output_path {
+                    *item
+                        .converted_path
+                        .lock()
+                        .expect("export item mutex poisoned") = Some(output);
+                }
+            }
+            Err(err) => item.fail(err),
+        }
+    }
+
+    fn checkpoint(&self, entry: JournalEntry) {
+        if let Some(journal) = &self.journal {
+            journal.record(entry);
+        }
+    }
+
+    /// Copies `len` bytes from `offset` (or the rest of the file) of one
+    /// device file into the same place in its local file. A whole file is
+    /// hashed on its way to disk when the destination keeps a content index.
+    async fn copy_remote_range(
+        &self,
+        afc: &mut AfcHandle,
+        item: &ExportItem,
+        file: &ExportFile,
+        offset: u64,
+        len: Option<u64>,
+    ) -> Result<Option<ContentDigest>, String> {
+        let device_path = &file.remote_path;
+        let local_path = file.local_path.display();
+        let mut remote = match afc.open(device_path, AfcFopenMode::RdOnly).await {
+            Ok(remote) => remote,
+            Err(err) => {
+                afc.note_error(&err);
+                return Err(format!("Failed to open device file {device_path}: {err}"));
+            }
+        };
+
+        let mut local = match (offset, len) {
+            (0, None) => LocalSink::create(&file.local_path, Some(file.size())).await,
+            _ => LocalSink::open(&file.local_path).await,
+        }
+        .map_err(|err| format!("Failed to create local file {local_path}: {err}"))?;
+
+        let hasher = (self.content_index.is_some() && offset == 0 && len.is_none())
+            .then(StreamHasher::default);
+        let mut reported = 0_u64;
+        let mut checkpointed = offset;
+        let copied = async {
+            if len.is_none() && offset > 0 {
+                // Drop anything written after the last checkpoint.
+                local.set_len(offset).await.map_err(PipelineError::Write)?;
+            }
+            if offset > 0 {
+                remote
+                    .seek(SeekFrom::Start(offset))
+                    .await
+                    .map_err(PipelineError::Read)?;
+                local
+                    .seek(SeekFrom::Start(offset))
+                    .await
+                    .map_err(PipelineError::Write)?;
+            }
+            transfer_pipeline::copy_observed(
+                &mut remote,
+                &mut local,
+                DEFAULT_CHUNK_SIZE,
+                len,
+                &self.cancel_flag,
+                |bytes| {
+                    let delta = (bytes - reported) as i64;
+                    reported = bytes;
+                    item.transferred.fetch_add(delta, Ordering::SeqCst);
+                    let transferred =
+                        self.transferred.fetch_add(delta as u64, Ordering::SeqCst) + delta as u64;
+                    if len.is_none() && offset + bytes >= checkpointed + CHECKPOINT_BYTES {
+                        checkpointed = offset + bytes;
+                        self.checkpoint(JournalEntry::Partial {
+                            path: file.key(),
+                            offset: checkpointed,
+                        });
+                    }
+                    emit_progress(
+                        &self.job_id,
+                        &item.progress_name,
+                        transferred as i64,
+                        self.total_bytes as i64,
+                    );
+                },
+                hasher,
+            )
             .await
-            .map_err(|err| format!("Failed to write to local file {output_path_str}: {err}"))?;
-        transferred += read as i64;
-        emit_progress(
-            qt_thread,
-            job_id,
-            progress_name,
-            progress_offset.saturating_add(transferred),
-            progress_total,
-        );
+        }
+        .await;
+        let _ = remote.close().await;
+        // Writes out the tail even when the copy failed or was cancelled, so
+        // nothing lands after the journal has moved on.
+        let shutdown = local.shutdown().await.map_err(PipelineError::Write);
+        let copied = copied.and_then(|copied| shutdown.map(|()| copied));
+
+        let (stats, hasher) = copied.map_err(|err| match err {
+            PipelineError::Read(err) => {
+                format!("Failed to read from device file {device_path}: {err}")
+            }
+            PipelineError::Write(err) => {
+                format!("Failed to write to local file {local_path}: {err}")
+            }
+        })?;
+        if let Some(len) = len {
+            if stats.bytes < len && !self.cancel_flag.load(Ordering::Relaxed) {
+                return Err(format!(
+                    "Device file {device_path} ended at {} of {}",
+                    offset + stats.bytes,
+                    file.info.size
+                ));
+            }
+        }
+        Ok(hasher.map(StreamHasher::finish))
     }
 
-    let _ = remote.close().await;
-    let _ = local.flush().await;
+    fn finish_unit(&self, unit: &ExportUnit) {
+        self.finish_pending(unit.file().item);
+    }
 
-    if transferred > 0 {
-        let modified_utc = info.modified.and_utc();
-        let mtime = filetime::FileTime::from_unix_time(
-            modified_utc.timestamp(),
-            modified_utc.timestamp_subsec_nanos(),
-        );
-        if let Err(err) = filetime::set_file_times(output_path, mtime, mtime) {
-            warn!("Failed to preserve file time for {output_path_str}: {err}");
+    fn finish_pending(&self, index: usize) {
+        if self.items[index]
+            .pending_units
+            .fetch_sub(1, Ordering::SeqCst)
+            == 1
+        {
+            let _ = self.done_tx.send(index);
+        }
+    }
+
+    fn finish_item(&self, index: usize, tally: &mut ExportTally) {
+        let job_id = &self.job_id;
+        let item = &self.items[index];
+        let device_path = &item.device_path;
+        let error = item
+            .error
+            .lock()
+            .expect("export item mutex poisoned")
+            .take();
+        if let Some(err) = error {
+            tally.failed += 1;
+            error!(
+                "IOManager export item failed: job_id={job_id} device_path={device_path}: {err}"
+            );
+            emit_export_item_failed(&self.qt_thread, job_id, device_path, err);
+            return;
+        }
+
+        let cancelled =
+            item.cancelled.load(Ordering::SeqCst) || item.pending_units.load(Ordering::SeqCst) > 0;
+        let result = TransferItemResult {
+            success: !cancelled,
+            bytes_transferred: item.transferred.load(Ordering::SeqCst),
+            destination_path: item
+                .converted_path
+                .lock()
+                .expect("export item mutex poisoned")
+                .take()
+                .unwrap_or_else(|| item.output_path.clone())
+                .to_string_lossy()
+                .to_string(),
+            error_message: cancelled.then(|| "Export cancelled".to_string()),
+        };
+        if result.success {
+            tally.successful += 1;
+            tally.total_bytes += result.bytes_transferred;
+            tally.succeeded_items.insert(index);
+            debug!(
+                "IOManager export item finished: job_id={job_id} device_path={device_path} bytes={}",
+                result.bytes_transferred
+            );
+        } else {
+            tally.failed += 1;
+            warn!(
+                "IOManager export item did not complete successfully: job_id={job_id} device_path={device_path} bytes={} error={}",
+                result.bytes_transferred,
+                result.error_message.as_deref().unwrap_or("cancelled")
+            );
         }
+        let success = result.success;
+        emit_export_item_finished(&self.qt_thread, job_id, device_path, result, success);
+    }
+}
+
+fn preserve_modified_time(output_path: &Path, info: &FileInfo) {
+    let modified_utc = info.modified.and_utc();
+    let mtime = filetime::FileTime::from_unix_time(
+        modified_utc.timestamp(),
+        modified_utc.timestamp_subsec_nanos(),
+    );
+    if let Err(err) = filetime::set_file_times(output_path, mtime, mtime) {
+        warn!(
+            "Failed to preserve file time for {}: {err}",
+            output_path.display()
+        );
     }
+}
 
-    Ok(transferred)
+/// Whether an export with `transcode` set converts `file`.
+fn converts(transcode: Option<TranscodeFormat>, file: &ExportFile) -> bool {
+    transcode.is_some() && utils::media_file_type(&file.remote_path) == utils::MediaFileType::Heic
+}
+
+/// Replaces an exported HEIC file with `output` in `format`, keeping its
+/// modified time. Decoding and encoding run on the decode pool.
+async fn transcode_export(
+    file: &ExportFile,
+    format: TranscodeFormat,
+    output: &Path,
+) -> Result<(), String> {
+    let local_path = &file.local_path;
+    let heic = fs::read(local_path)
+        .await
+        .map_err(|err| format!("Failed to read {}: {err}", local_path.display()))?;
+    let encoded = decode_pool::run(move || heic_transcode::transcode(&heic, format))
+        .await
+        .ok_or_else(|| format!("HEIC conversion panicked for {}", local_path.display()))?
+        .map_err(|err| format!("{err}: {}", local_path.display()))?;
+
+    // An earlier conversion's output may be hard-linked elsewhere.
+    match fs::remove_file(output).await {
+        Ok(()) => {}
+        Err(err) if err.kind() == io::ErrorKind::NotFound => {}
+        Err(err) => return Err(format!("Failed to replace {}: {err}", output.display())),
+    }
+    fs::write(output, encoded)
+        .await
+        .map_err(|err| format!("Failed to write {}: {err}", output.display()))?;
+    preserve_modified_time(output, &file.info);
+    if let Err(err) = fs::remove_file(local_path).await {
+        warn!(
+            "Failed to remove converted HEIC file {}: {err}",
+            local_path.display()
+        );
+    }
+    Ok(())
 }
 
 fn remote_child_path(parent: &str, name: &str) -> String {
@@ -924,8 +2410,8 @@ async fn import_single_item(
     local_path: &str,
     destination_dir: &str,
     job_id: &str,
-    qt_thread: &QtThread<IOManager>,
     cancel_flag: &Arc<AtomicBool>,
+    journal: Option<&TransferJournal>,
 ) -> Result<TransferItemResult, String> {
     use tokio::io::AsyncReadExt;
 
@@ -947,14 +2433,72 @@ async fn import_single_item(
         .await
         .map_err(|e| format!("Failed to stat local file {local_path}: {e}"))?;
     let file_size = metadata.len() as i64;
+    let size = metadata.len();
+    let mtime = filetime::FileTime::from_last_modification_time(&metadata).unix_seconds();
+
+    // What an earlier run left on the device decides whether to skip the
+    // file, continue it, or start over.
+    let remote_size = match journal {
+        Some(_) => afc
+            .get_file_info(&device_path)
+            .await
+            .ok()
+            .map(|info| info.size as u64),
+        None => None,
+    };
+    let resumed = journal.map(TransferJournal::resumed);
+    if resumed.is_some_and(|state| state.is_done(&device_path, size, mtime))
+        && remote_size == Some(size)
+    {
+        debug!("IOManager import item already complete: job_id={job_id} device_path={device_path}");
+        return Ok(TransferItemResult {
+            success: true,
+            bytes_transferred: file_size,
+            destination_path: device_path,
+            error_message: None,
+        });
+    }
+    let resume_from = resumed
+        .map(|state| state.partial_offset(&device_path, size, mtime))
+        .filter(|offset| {
+            *offset > 0 && remote_size.is_some_and(|len| len >= *offset && len <= size)
+        })
+        .unwrap_or(0);
+    if let Some(journal) = journal {
+        journal.record(JournalEntry::Source {
+            path: device_path.clone(),
+            size,
+            mtime,
+        });
+    }
 
+    // Rw opens without truncating, so the checkpointed prefix survives.
+    let mode = if resume_from > 0 {
+        AfcFopenMode::Rw
+    } else {
+        AfcFopenMode::WrOnly
+    };
     let mut remote = afc
-        .open(&device_path, AfcFopenMode::WrOnly)
+        .open(&device_path, mode)
         .await
         .map_err(|e| format!("Failed to open device file {device_path} for writing: {e}"))?;
+    if resume_from > 0 {
+        debug!(
+            "IOManager import item resuming: job_id={job_id} device_path={device_path} offset={resume_from}"
+        );
+        remote
+            .seek(SeekFrom::Start(resume_from))
+            .await
+            .map_err(|e| format!("Failed to seek device file {device_path}: {e}"))?;
+        local
+            .seek(SeekFrom::Start(resume_from))
+            .await
+            .map_err(|e| format!("Failed to seek local file {local_path}: {e}"))?;
+    }
 
     let mut chunk = vec![0u8; DEFAULT_CHUNK_SIZE];
-    let mut transferred = 0_i64;
+    let mut transferred = resume_from as i64;
+    let mut checkpointed = resume_from;
 
     loop {
         if cancel_flag.load(Ordering::Relaxed) {
@@ -978,21 +2522,42 @@ async fn import_single_item(
             .map_err(|e| format!("Failed to write to device file {device_path}: {e}"))?;
         transferred += read as i64;
 
-        emit_progress(qt_thread, job_id, &file_name, transferred, file_size);
+        if let Some(journal) = journal {
+            if transferred as u64 >= checkpointed + CHECKPOINT_BYTES {
+                checkpointed = transferred as u64;
+                journal.record(JournalEntry::Partial {
+                    path: device_path.clone(),
+                    offset: checkpointed,
+                });
+            }
+        }
+        emit_progress(job_id, &file_name, transferred, file_size);
     }
 
     let _ = remote.close().await;
 
+    let success = !cancel_flag.load(Ordering::Relaxed);
+    if success {
+        if let Some(journal) = journal {
+            journal.record(JournalEntry::Done {
+                path: device_path.clone(),
+                size,
+                mtime,
+            });
+        }
+    }
     Ok(TransferItemResult {
-        success: !cancel_flag.load(Ordering::Relaxed),
+        success,
         bytes_transferred: transferred,
         destination_path: device_path,
         error_message: None,
     })
 }
 
-async fn unique_output_path(base_path: &Path) -> PathBuf {
-    if fs::try_exists(base_path).await.unwrap_or(false) {
+/// Picks a free name next to `base_path`, also avoiding paths already handed
+/// to other items of the same job that may not exist on disk yet.
+async fn unique_output_path(base_path: &Path, claimed: &HashSet<PathBuf>) -> PathBuf {
+    if claimed.contains(base_path) || fs::try_exists(base_path).await.unwrap_or(false) {
         let stem = base_path
             .file_stem()
             .and_then(|stem| stem.to_str())
@@ -1006,7 +2571,7 @@ async fn unique_output_path(base_path: &Path) -> PathBuf {
                 _ => format!("{stem} ({index})"),
             };
             let candidate = parent.join(file_name);
-            if !fs::try_exists(&candidate).await.unwrap_or(false) {
+            if !claimed.contains(&candidate) && !fs::try_exists(&candidate).await.unwrap_or(false) {
                 return candidate;
             }
         }
@@ -1015,6 +2580,79 @@ async fn unique_output_path(base_path: &Path) -> PathBuf {
     base_path.to_path_buf()
 }
 
+/// Identifies a request across runs so a repeated export or import finds the
+/// journal the interrupted one left behind.
+fn job_journal_key(
+    udid: &str,
+    afc_kind_description: &str,
+    destination_dir: &str,
+    paths: &[String],
+    flags: &str,
+) -> String {
+    journal_key(
+        [udid, afc_kind_description, destination_dir, flags]
+            .into_iter()
+            .chain(paths.iter().map(String::as_str)),
+    )
+}
+
+async fn open_journal(directory: &Path, file_name: String) -> Option<TransferJournal> {
+    if let Err(err) = fs::create_dir_all(directory).await {
+        warn!(
+            "IOManager cannot create journal directory {}: {err}",
+            directory.display()
+        );
+        return None;
+    }
+    match TransferJournal::open(directory.join(file_name)) {
+        Ok(journal) => {
+            if !journal.is_empty() {
+                info!(
+                    "IOManager resuming from journal {}",
+                    journal.path().display()
+                );
+            }
+            Some(journal)
+        }
+        Err(err) => {
+            warn!("IOManager continuing without a journal: {err}");
+            None
+        }
+    }
+}
+
+/// Loads the content index covering `destination_dir` off the runtime; an
+/// unreadable index only turns deduplication off for the job.
+async fn open_content_index(destination_dir: &str) -> Option<Arc<ContentIndex>> {
+    let destination = PathBuf::from(destination_dir);
+    match tokio::task::spawn_blocking(move || ContentIndex::open(&destination)).await {
+        Ok(Ok(index)) => {
+            debug!("IOManager deduplicating against {}", index.root().display());
+            Some(Arc::new(index))
+        }
+        Ok(Err(err)) => {
+            warn!("IOManager exporting without deduplication: {err}");
+            None
+        }
+        Err(err) => {
+            warn!("IOManager exporting without deduplication: {err}");
+            None
+        }
+    }
+}
+
+/// Keeps the journal of an interrupted or partly failed job for the retry.
+fn close_journal(journal: TransferJournal, keep: bool) {
+    if keep {
+        info!(
+            "IOManager kept journal {} for resuming",
+            journal.path().display()
+        );
+    } else {
+        journal.remove();
+    }
+}
+
 fn file_name_for_path(path: &str) -> String {
     Path::new(path)
         .file_name()
@@ -1023,43 +2661,55 @@ fn file_name_for_path(path: &str) -> String {
         .to_string()
 }
 
-fn emit_progress(
+/// Per-chunk progress goes through the progress bus, which publishes it to
+/// the status window at a bounded rate.
+fn emit_progress(job_id: &str, file_name: &str, transferred: i64, total: i64) {
+    progress_bus::report(
+        job_id,
+        file_name,
+        transferred.max(0) as u64,
+        total.max(0) as u64,
+    );
+}
+
+fn emit_export_item_finished(
     qt_thread: &QtThread<IOManager>,
     job_id: &str,
-    file_name: &str,
-    transferred: i64,
-    total: i64,
+    source_path: &str,
+    result: TransferItemResult,
+    success: bool,
 ) {
     let job_id = job_id.to_string();
-    let file_name = file_name.to_string();
+    let file_name = file_name_for_path(source_path);
+    let destination_path = result.destination_path;
+    let error_message = result.error_message.unwrap_or_default();
     qt_thread.queue(move |mgr| {
-        mgr.fileTransferProgress(
+        mgr.exportItemFinished(
             QString::from(job_id),
             QString::from(file_name),
-            transferred,
-            total,
+            QString::from(destination_path),
+            success,
+            result.bytes_transferred,
+            QString::from(error_message),
         );
     });
 }
 
-fn emit_export_item_finished(
+fn emit_export_item_failed(
     qt_thread: &QtThread<IOManager>,
     job_id: &str,
     source_path: &str,
-    result: TransferItemResult,
-    success: bool,
+    error_message: String,
 ) {
     let job_id = job_id.to_string();
     let file_name = file_name_for_path(source_path);
-    let destination_path = result.destination_path;
-    let error_message = result.error_message.unwrap_or_default();
     qt_thread.queue(move |mgr| {
         mgr.exportItemFinished(
             QString::from(job_id),
             QString::from(file_name),
-            QString::from(destination_path),
-            success,
-            result.bytes_transferred,
+            QString::default(),
+            false,
+            0,
             QString::from(error_message),
         );
     });
@@ -1096,6 +2746,7 @@ fn finish_export_job(
     failed: i32,
     total_bytes: i64,
 ) {
+    progress_bus::finish(&job_id);
     qt_thread.queue(move |mgr| {
         mgr.exportJobFinished(
             QString::from(job_id),
@@ -1115,6 +2766,7 @@ fn finish_import_job(
     failed: i32,
     total_bytes: i64,
 ) {
+    progress_bus::finish(&job_id);
     qt_thread.queue(move |mgr| {
         mgr.importJobFinished(
             QString::from(job_id),
@@ -1134,3 +2786,68 @@ fn unregister_job(jobs: &Arc<Mutex<HashMap<String, Arc<AtomicBool>>>>, job_id: &
         warn!("IOManager tried to unregister unknown job: job_id={job_id}");
     }
 }
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn reorder_buffer_releases_items_in_request_order() {
+        let mut reorder = ReorderBuffer::default();
+        assert!(reorder.push(2).is_empty());
+        assert!(reorder.push(1).is_empty());
+        assert_eq!(reorder.push(0), [0, 1, 2]);
+        assert_eq!(reorder.push(3), [3]);
+        assert_eq!(reorder.next(), 4);
+    }
+
+    #[test]
+    fn splits_large_files_into_covering_ranges() {
+        assert!(split_ranges(0, 10).is_empty());
+        assert_eq!(split_ranges(10, 10), [(0, 10)]);
+        assert_eq!(split_ranges(25, 10), [(0, 10), (10, 10), (20, 5)]);
+    }
+
+    #[test]
+    fn sync_merge_keeps_failed_items_and_prunes_only_when_asked() {
+        let entry = |size, mtime| ManifestEntry { size, mtime };
+        let previous = SyncManifest::from_entries(&BTreeMap::from([
+            ("DCIM/100APPLE/IMG_0001.HEIC".to_string(), entry(10, 1)),
+            ("DCIM/100APPLE/IMG_0002.HEIC".to_string(), entry(20, 2)),
+            ("DCIM/100APPLE/IMG_0003.HEIC".to_string(), entry(30, 3)),
+            ("../outside.txt".to_string(), entry(1, 1)),
+        ]));
+        let seen = vec![
+            ("DCIM/100APPLE/IMG_0001.HEIC".to_string(), entry(11, 5), 0),
+            ("DCIM/100APPLE/IMG_0002.HEIC".to_string(), entry(21, 6), 1),
+            ("DCIM/100APPLE/IMG_0004.HEIC".to_string(), entry(40, 4), 1),
+        ];
+        let succeeded = HashSet::from([0]);
+
+        let (entries, missing) = merge_sync_manifest(&previous, &seen, &succeeded, false);
+        assert!(missing.is_empty());
+        assert_eq!(entries["DCIM/100APPLE/IMG_0001.HEIC"], entry(11, 5));
+        assert_eq!(entries["DCIM/100APPLE/IMG_0002.HEIC"], entry(20, 2));
+        assert!(!entries.contains_key("DCIM/100APPLE/IMG_0004.HEIC"));
+        assert_eq!(entries["DCIM/100APPLE/IMG_0003.HEIC"], entry(30, 3));
+
+        let (entries, missing) = merge_sync_manifest(&previous, &seen, &succeeded, true);
+        assert_eq!(missing, ["DCIM/100APPLE/IMG_0003.HEIC"]);
+        assert!(entries.contains_key("../outside.txt"));
+    }
+
+    #[tokio::test]
+    async fn unique_output_path_skips_claimed_paths() {
+        let dir = std::env::temp_dir().join(format!("idescriptor-export-{}", uuid::Uuid::new_v4()));
+        let base = dir.join("IMG_0001.HEIC");
+        let mut claimed = HashSet::new();
+
+        let first = unique_output_path(&base, &claimed).await;
+        assert_eq!(first, base);
+        claimed.insert(first);
+        assert_eq!(
+            unique_output_path(&base, &claimed).await,
+            dir.join("IMG_0001 (1).HEIC")
+        );
+    }
+}
@@ -0,0 +1,270 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Streams IPAs into `PublicStaging` for installation_proxy.
+//!
+//! Uploads go through `transfer_pipeline`, so memory use is a few recycled
+//! chunks no matter how large the IPA is. The SHA-256 of the uploaded bytes
+//! is computed on the way through and stored next to the IPA as
+//! `<name>.sha256`. Installing the same IPA again finds a matching sidecar
+//! and skips the upload; the local file is only hashed up front when the
+//! staged copy already has the right size.
+
+use crate::io_manager::DEFAULT_CHUNK_SIZE;
+use crate::transfer_pipeline::{self, PipelineError};
+use crate::utils::{self, PUBLIC_STAGING};
+use anyhow::Context;
+use idevice::afc::AfcClient;
+use idevice::afc::opcode::AfcFopenMode;
+use sha2::{Digest, Sha256};
+use std::io::{self, Read};
+use std::path::Path;
+use std::pin::Pin;
+use std::sync::atomic::AtomicBool;
+use std::task::{Context as TaskContext, Poll};
+use tokio::io::{AsyncRead, ReadBuf};
+
+const HASH_BUFFER_SIZE: usize = 1024 * 1024;
+
+/// Where an IPA called `file_name` is staged on the device.
+pub fn staging_path(file_name: &str) -> String {
+    format!("/{PUBLIC_STAGING}/{file_name}")
+}
+
+fn sidecar_path(device_path: &str) -> String {
+    format!("{device_path}.sha256")
+}
+
+fn sidecar_contents(digest: &str, size: u64) -> String {
+    format!("{digest} {size}\n")
+}
+
+/// Hex SHA-256 of a local file, read in fixed-size chunks off the runtime.
+pub async fn sha256_file(path: &Path) -> io::Result<String> {
+    let path = path.to_path_buf();
+    tokio::task::spawn_blocking(move || sha256_reader(&mut std::fs::File::open(path)?))
+        .await
+        .map_err(io::Error::other)?
+}
+
+fn sha256_reader(reader: &mut impl Read) -> io::Result<String> {
+    let mut hasher = Sha256::new();
+    let mut buffer = vec![0u8; HASH_BUFFER_SIZE];
+    loop {
+        let read = match reader.read(&mut buffer) {
+            Ok(0) => return Ok(hex::encode(hasher.finalize())),
+            Ok(read) => read,
+            Err(err) if err.kind() == io::ErrorKind::Interrupted => continue,
+            Err(err) => return Err(err),
+        };
+        hasher.update(&buffer[..read]);
+    }
+}
+
+/// Hashes everything read through it.
+pub struct HashingReader<R> {
+    inner: R,
+    hasher: Sha256,
+}
+
+impl<R> HashingReader<R> {
+    pub fn new(inner: R) -> Self {
+        Self {
+            inner,
+            hasher: Sha256::new(),
+        }
+    }
+
+    /// Hex SHA-256 of the bytes read so far.
+    pub fn finish(self) -> String {
+        hex::encode(self.hasher.finalize())
+    }
+}
+
+impl<R: AsyncRead + Unpin> AsyncRead for HashingReader<R> {
+    fn poll_read(
+        mut self: Pin<&mut Self>,
+        cx: &mut TaskContext<'_>,
+        buf: &mut ReadBuf<'_>,
+    ) -> Poll<io::Result<()>> {
+        let before = buf.filled().len();
+        let poll = Pin::new(&mut self.inner).poll_read(cx, buf);
+        if let Poll::Ready(Ok(())) = poll {
+            self.hasher.update(&buf.filled()[before..]);
+        }
+        poll
+    }
+}
+
+/// Whether `device_path` already holds `size` bytes hashing to `digest`.
+pub async fn is_staged(afc: &mut AfcClient, device_path: &str, digest: &str, size: u64) -> bool {
+    match afc.get_file_info(device_path).await {
+        Ok(info) if info.size as u64 == size => {}
+        _ => return false,
+    }
+    let Ok(mut file) = afc
+        .open(sidecar_path(device_path), AfcFopenMode::RdOnly)
+        .await
+    else {
+        return false;
+    };
+    let contents = file.read_entire().await;
+    let _ = file.close().await;
+    contents.is_ok_and(|bytes| bytes == sidecar_contents(digest, size).as_bytes())
+}
+
+/// Forgets that `device_path` was staged. Call before writing into it, so
+/// an interrupted write is never mistaken for a staged file.
+pub async fn clear_staged(afc: &mut AfcClient, device_path: &str) {
+    let _ = afc.remove(sidecar_path(device_path)).await;
+}
+
+/// Streams `reader` into `device_path` and returns the bytes written with
+/// their hex SHA-256. Any old sidecar is removed first (see
+/// `clear_staged`).
+pub async fn upload<R, F>(
+    afc: &mut AfcClient,
+    reader: R,
+    device_path: &str,
+    cancel_flag: &AtomicBool,
+    on_progress: F,
+) -> anyhow::Result<(u64, String)>
+where
+    R: AsyncRead + Unpin,
+    F: FnMut(u64),
+{
+    clear_staged(afc, device_path).await;
+    let mut remote = afc
+        .open(device_path, AfcFopenMode::WrOnly)
+        .await
+        .with_context(|| format!("failed to create {device_path}"))?;
+
+    let mut reader = HashingReader::new(reader);
+    let copied = transfer_pipeline::copy(
+        &mut reader,
+        &mut remote,
+        DEFAULT_CHUNK_SIZE,
+        None,
+        cancel_flag,
+        on_progress,
+    )
+    .await;
+    let closed = remote.close().await;
+
+    let stats = copied.map_err(|err| match err {
+        PipelineError::Read(err) => anyhow::Error::new(err).context("failed to read IPA"),
+        PipelineError::Write(err) => {
+            anyhow::Error::new(err).context(format!("failed to write {device_path}"))
+        }
+    })?;
+    closed.with_context(|| format!("failed to close {device_path}"))?;
+    Ok((stats.bytes, reader.finish()))
+}
+
+/// Records that `device_path` holds `size` bytes hashing to `digest`.
+pub async fn mark_staged(
+    afc: &mut AfcClient,
+    device_path: &str,
+    digest: &str,
+    size: u64,
+) -> anyhow::Result<()> {
+    let mut file = afc
+        .open(sidecar_path(device_path), AfcFopenMode::WrOnly)
+        .await?;
+    let write_result = file
+        .write_entire(sidecar_contents(digest, size).as_bytes())
+        .await;
+    let close_result = file.close().await;
+    write_result?;
+    close_result?;
+    Ok(())
+}
+
+/// Stages the IPA at `local_path` as `device_path`. Returns `false` when an
+/// identical copy was already staged and nothing was uploaded.
+pub async fn stage_file<F>(
+    afc: &mut AfcClient,
+    local_path: &Path,
+    device_path: &str,
+    cancel_flag: &AtomicBool,
+    on_progress: F,
+) -> anyhow::Result<bool>
+where
+    F: FnMut(u64),
+{
+    utils::ensure_public_staging(afc)
+        .await
+        .context("failed to prepare PublicStaging")?;
+    let size = tokio::fs::metadata(local_path)
+        .await
+        .with_context(|| format!("failed to stat {}", local_path.display()))?
+        .len();
+
+    // Hashing costs a full local read, so only do it when the staged copy
+    // could match.
+    let staged_size = afc
+        .get_file_info(device_path)
+        .await
+        .ok()
+        .map(|info| info.size as u64);
+    if staged_size == Some(size) {
+        let digest = sha256_file(local_path)
+            .await
+            .with_context(|| format!("failed to hash {}", local_path.display()))?;
+        if is_staged(afc, device_path, &digest, size).await {
+            return Ok(false);
+        }
+    }
+
+    let local = tokio::fs::File::open(local_path)
+        .await
+        .with_context(|| format!("failed to open {}", local_path.display()))?;
+    let (written, digest) = upload(afc, local, device_path, cancel_flag, on_progress).await?;
+    if written != size {
+        anyhow::bail!("uploaded {written} of {size} bytes to {device_path}");
+    }
+    mark_staged(afc, device_path, &digest, size).await?;
+    Ok(true)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use tokio::io::AsyncReadExt;
+
+    const ABC_SHA256: &str = "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad";
+
+    #[test]
+    fn hashes_known_vector_and_names_sidecars() {
+        assert_eq!(sha256_reader(&mut &b"abc"[..]).expect("hashed"), ABC_SHA256);
+        assert_eq!(staging_path("App.ipa"), "/PublicStaging/App.ipa");
+        assert_eq!(
+            sidecar_path("/PublicStaging/App.ipa"),
+            "/PublicStaging/App.ipa.sha256"
+        );
+        assert_eq!(sidecar_contents(ABC_SHA256, 3), format!("{ABC_SHA256} 3\n"));
+    }
+
+    #[tokio::test]
+    async fn hashing_reader_matches_a_whole_file_hash() {
+        let data: Vec<u8> = (0..3 * HASH_BUFFER_SIZE + 17)
+            .map(|index| (index % 251) as u8)
+            .collect();
+        let mut reader = HashingReader::new(&data[..]);
+        let mut chunk = vec![0u8; 4096];
+        let mut total = 0;
+        loop {
+            let read = reader.read(&mut chunk).await.expect("read");
+            if read == 0 {
+                break;
+            }
+            total += read;
+        }
+
+        assert_eq!(total, data.len());
+        assert_eq!(
+            reader.finish(),
+            sha256_reader(&mut &data[..]).expect("hashed")
+        );
+    }
+}
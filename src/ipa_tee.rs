@@ -0,0 +1,330 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Uploads an App Store IPA to the device while it is still downloading.
+//!
+//! ipatool writes the download to disk, reports only a byte count, and
+//! patches the archive (metadata and sinf entries) before handing back the
+//! final path. So the tee follows the growing file: each progress tick says
+//! how much may be read, and every complete block is written to the staging
+//! file straight away and its hash kept. Once the download is done,
+//! `reconcile` walks the final file and rewrites only blocks that changed
+//! plus whatever came after the streamed part. A final file shorter than
+//! what was streamed cannot be fixed up in place (AFC writes do not
+//! shrink a file), so the caller uploads it again from scratch.
+
+use crate::io_manager::DEFAULT_CHUNK_SIZE;
+use sha2::{Digest, Sha256};
+use std::io::{self, SeekFrom};
+use std::path::Path;
+use tokio::fs::File;
+use tokio::io::{AsyncReadExt, AsyncSeek, AsyncSeekExt, AsyncWrite, AsyncWriteExt};
+use tokio::sync::watch;
+
+/// What the downloader has reported so far.
+#[derive(Clone, Copy, Debug, Default)]
+pub struct DownloadProgress {
+    pub downloaded: u64,
+    /// The download returned; `follow` stops and `reconcile` takes over.
+    pub finished: bool,
+}
+
+/// Blocks streamed while the download was running.
+#[derive(Debug, Default)]
+pub struct Followed {
+    blocks: Vec<[u8; 32]>,
+}
+
+impl Followed {
+    pub fn streamed(&self) -> u64 {
+        (self.blocks.len() * DEFAULT_CHUNK_SIZE) as u64
+    }
+}
+
+#[derive(Debug, PartialEq, Eq)]
+pub enum Reconciled {
+    /// The staging file now matches the final IPA.
+    Staged {
+        size: u64,
+        digest: String,
+        rewritten: u64,
+    },
+    /// The final IPA is shorter than what was streamed.
+    Shrunk,
+}
+
+/// The file ipatool is downloading into `dir`, once it exists. An open
+/// handle keeps following the file if it is renamed afterwards.
+async fn open_download(dir: &Path) -> io::Result<Option<File>> {
+    let mut entries = tokio::fs::read_dir(dir).await?;
+    while let Some(entry) = entries.next_entry().await? {
+        if entry.file_type().await?.is_file() {
+            return File::open(entry.path()).await.map(Some);
+        }
+    }
+    Ok(None)
+}
+
+/// Streams the file being downloaded into `dir` to `sink`, one full block at
+/// a time, until `progress` reports the download finished. Reads never go
+/// past the reported byte count; bytes reported but not yet flushed to disk
+/// are picked up on a later tick.
+pub async fn follow<W, F>(
+    dir: &Path,
+    mut progress: watch::Receiver<DownloadProgress>,
+    sink: &mut W,
+    mut on_progress: F,
+) -> io::Result<Followed>
+where
+    W: AsyncWrite + Unpin,
+    F: FnMut(u64),
+{
+    let mut followed = Followed::default();
+    let mut file = None;
+    let mut block = Vec::with_capacity(DEFAULT_CHUNK_SIZE);
+    let mut read_to = 0_u64;
+
+    loop {
+        let DownloadProgress {
+            downloaded,
+            finished,
+        } = *progress.borrow_and_update();
+        if finished {
+            break;
+        }
+        if file.is_none() {
+            file = open_download(dir).await?;
+        }
+
+        if let Some(file) = file.as_mut() {
+            while read_to < downloaded {
+                let start = block.len();
+                let want = (DEFAULT_CHUNK_SIZE - start).min((downloaded - read_to) as usize);
+                block.resize(start + want, 0);
+                let read = file.read(&mut block[start..]).await?;
+                block.truncate(start + read);
+                if read == 0 {
+                    break;
+                }
+                read_to += read as u64;
+
+                if block.len() == DEFAULT_CHUNK_SIZE {
+                    sink.write_all(&block).await?;
+                    followed.blocks.push(Sha256::digest(&block).into());
+                    block.clear();
+                    on_progress(followed.streamed());
+                }
+            }
+        }
+
+        if progress.changed().await.is_err() {
+            break;
+        }
+    }
+
+    sink.flush().await?;
+    Ok(followed)
+}
+
+/// Brings `sink`, positioned after the streamed blocks, in line with the
+/// final IPA at `path`. Also hashes the whole file for the staging sidecar.
+pub async fn reconcile<S>(path: &Path, followed: &Followed, sink: &mut S) -> io::Result<Reconciled>
+where
+    S: AsyncWrite + AsyncSeek + Unpin,
+{
+    let mut file = File::open(path).await?;
+    let size = file.metadata().await?.len();
+    if size < followed.streamed() {
+        return Ok(Reconciled::Shrunk);
+    }
+
+    let mut whole = Sha256::new();
+    let mut buffer = vec![0u8; DEFAULT_CHUNK_SIZE];
+    let mut sink_position = followed.streamed();
+    let mut rewritten = 0_u64;
+    for index in 0.. {
+        let read = read_block(&mut file, &mut buffer).await?;
+        if read == 0 {
+            break;
+        }
+        let block = &buffer[..read];
+        whole.update(block);
+
+        let unchanged = read == DEFAULT_CHUNK_SIZE
+            && followed
+                .blocks
+                .get(index)
+                .is_some_and(|hash| Sha256::digest(block)[..] == hash[..]);
+        if unchanged {
+            continue;
+        }
+        let offset = (index * DEFAULT_CHUNK_SIZE) as u64;
+        if sink_position != offset {
+            sink.seek(SeekFrom::Start(offset)).await?;
+        }
+        sink.write_all(block).await?;
+        sink_position = offset + read as u64;
+        rewritten += read as u64;
+    }
+    sink.flush().await?;
+
+    Ok(Reconciled::Staged {
+        size,
+        digest: hex::encode(whole.finalize()),
+        rewritten,
+    })
+}
+
+/// Fills `buffer` unless the file ends first.
+async fn read_block(file: &mut File, buffer: &mut [u8]) -> io::Result<usize> {
+    let mut filled = 0;
+    while filled < buffer.len() {
+        match file.read(&mut buffer[filled..]).await? {
+            0 => break,
+            read => filled += read,
+        }
+    }
+    Ok(filled)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::io::Cursor;
+    use std::path::PathBuf;
+    use std::time::Duration;
+    use tokio::io::{AsyncBufReadExt, BufReader};
+    use tokio::net::{TcpListener, TcpStream};
+
+    fn payload(len: usize) -> Vec<u8> {
+        (0..len).map(|index| (index % 251) as u8).collect()
+    }
+
+    fn temp_dir() -> PathBuf {
+        std::env::temp_dir().join(format!("idescriptor-tee-{}", uuid::Uuid::new_v4()))
+    }
+
+    /// Serves `body` over HTTP/1.1 in slow pieces, standing in for the App
+    /// Store CDN.
+    async fn serve(body: Vec<u8>) -> std::net::SocketAddr {
+        let listener = TcpListener::bind("127.0.0.1:0").await.expect("bind");
+        let address = listener.local_addr().expect("address");
+        tokio::spawn(async move {
+            let (mut stream, _) = listener.accept().await.expect("accept");
+            let mut request = BufReader::new(&mut stream);
+            let mut line = String::new();
+            while request.read_line(&mut line).await.expect("request") > 2 {
+                line.clear();
+            }
+            let header = format!(
+                "HTTP/1.1 200 OK\r\nContent-Length: {}\r\nConnection: close\r\n\r\n",
+                body.len()
+            );
+            stream.write_all(header.as_bytes()).await.expect("header");
+            for piece in body.chunks(DEFAULT_CHUNK_SIZE / 2) {
+                stream.write_all(piece).await.expect("body");
+                tokio::time::sleep(Duration::from_millis(2)).await;
+            }
+        });
+        address
+    }
+
+    /// Downloads like ipatool: body to a file in `dir`, progress after each
+    /// write.
+    async fn download(
+        address: std::net::SocketAddr,
+        dir: &Path,
+        progress: &watch::Sender<DownloadProgress>,
+    ) -> PathBuf {
+        let path = dir.join("App.ipa");
+        let mut output = File::create(&path).await.expect("create");
+        let mut stream = BufReader::new(TcpStream::connect(address).await.expect("connect"));
+        stream
+            .get_mut()
+            .write_all(b"GET /App.ipa HTTP/1.1\r\nHost: localhost\r\n\r\n")
+            .await
+            .expect("request");
+        let mut line = String::new();
+        while stream.read_line(&mut line).await.expect("response") > 2 {
+            line.clear();
+        }
+
+        let mut chunk = vec![0u8; 64 * 1024];
+        let mut downloaded = 0;
+        loop {
+            let read = stream.read(&mut chunk).await.expect("body");
+            if read == 0 {
+                break;
+            }
+            output.write_all(&chunk[..read]).await.expect("write");
+            output.flush().await.expect("flush");
+            downloaded += read as u64;
+            progress.send_modify(|state| state.downloaded = downloaded);
+        }
+        path
+    }
+
+    #[tokio::test]
+    async fn patched_download_is_reconciled_by_rewriting_changed_blocks() {
+        let dir = temp_dir();
+        tokio::fs::create_dir_all(&dir).await.expect("temp dir");
+        let body = payload(6 * DEFAULT_CHUNK_SIZE + 1234);
+        let address = serve(body.clone()).await;
+
+        let (sender, receiver) = watch::channel(DownloadProgress::default());
+        let mut sink = Cursor::new(Vec::new());
+        let downloading = async {
+            let path = download(address, &dir, &sender).await;
+            // Patch like ipatool: touch a block in the middle, then append.
+            let mut patched = tokio::fs::read(&path).await.expect("read");
+            patched[3 * DEFAULT_CHUNK_SIZE + 10] ^= 0xff;
+            patched.extend_from_slice(b"iTunesMetadata.plist");
+            tokio::fs::write(&path, &patched).await.expect("patch");
+            sender.send_modify(|state| state.finished = true);
+            path
+        };
+        let (path, followed) = tokio::join!(downloading, follow(&dir, receiver, &mut sink, |_| {}));
+        let followed = followed.expect("followed");
+        assert!(followed.streamed() > 0);
+
+        let reconciled = reconcile(&path, &followed, &mut sink)
+            .await
+            .expect("reconciled");
+        let final_bytes = tokio::fs::read(&path).await.expect("final");
+        assert_eq!(sink.get_ref(), &final_bytes);
+        let Reconciled::Staged {
+            size,
+            digest,
+            rewritten,
+        } = reconciled
+        else {
+            panic!("expected a staged IPA");
+        };
+        assert_eq!(size, final_bytes.len() as u64);
+        assert_eq!(digest, hex::encode(Sha256::digest(&final_bytes)));
+        assert!(rewritten < size);
+        let _ = tokio::fs::remove_dir_all(&dir).await;
+    }
+
+    #[tokio::test]
+    async fn shrunk_download_needs_a_full_upload() {
+        let dir = temp_dir();
+        tokio::fs::create_dir_all(&dir).await.expect("temp dir");
+        let path = dir.join("App.ipa");
+        tokio::fs::write(&path, payload(DEFAULT_CHUNK_SIZE / 2))
+            .await
+            .expect("write");
+
+        let followed = Followed {
+            blocks: vec![[0; 32]],
+        };
+        let mut sink = Cursor::new(Vec::new());
+        assert_eq!(
+            reconcile(&path, &followed, &mut sink)
+                .await
+                .expect("reconciled"),
+            Reconciled::Shrunk
+        );
+        let _ = tokio::fs::remove_dir_all(&dir).await;
+    }
+}
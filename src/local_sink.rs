@@ -0,0 +1,408 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Local file writer for exports.
+//!
+//! `tokio::fs::File` hands every write to a blocking thread and waits for it
+//! before accepting the next one, so a 1 MiB-chunk export pays a thread hop
+//! per chunk with nothing overlapping it. `LocalSink` collects writes into
+//! `BATCH_SIZE` batches and submits each as one positioned write, keeping a
+//! batch in flight while the next one fills. When the final size is known
+//! the file is reserved up front (`fallocate` on Linux), which keeps large
+//! exports contiguous and fails early on a full disk.
+//!
+//! Callers must `shutdown()` the sink on every path, errors and cancellation
+//! included; dropping it discards whatever is still buffered.
+
+use log::warn;
+use std::fs::{File, OpenOptions};
+use std::future::Future;
+use std::io::{self, SeekFrom};
+use std::path::{Path, PathBuf};
+use std::pin::Pin;
+use std::sync::Arc;
+use std::task::{Context, Poll, ready};
+use tokio::io::{AsyncSeek, AsyncWrite};
+use tokio::task::JoinHandle;
+
+pub const BATCH_SIZE: usize = 4 * 1024 * 1024;
+
+type Batch = JoinHandle<(io::Result<()>, Vec<u8>)>;
+
+pub struct LocalSink {
+    file: Arc<File>,
+    /// Where `buffer` starts in the file.
+    offset: u64,
+    buffer: Vec<u8>,
+    in_flight: Option<Batch>,
+    /// Buffer of the last finished batch, reused for the next one.
+    spare: Vec<u8>,
+    seek_to: Option<u64>,
+}
+
+impl LocalSink {
+    /// Replaces `path` with a new file (see `create_new_inode`), reserving
+    /// `size` bytes when known.
+    pub async fn create(path: &Path, size: Option<u64>) -> io::Result<Self> {
+        let path = path.to_path_buf();
+        let file = blocking(move || {
+            let file = create_new_inode(&path)?;
+            if let Some(size) = size {
+                reserve(&file, size)?;
+            }
+            Ok(file)
+        })
+        .await?;
+        Ok(Self::new(file))
+    }
+
+    /// Opens an existing file for writing without truncating it.
+    pub async fn open(path: &Path) -> io::Result<Self> {
+        let path = path.to_path_buf();
+        let file = blocking(move || OpenOptions::new().write(true).open(path)).await?;
+        Ok(Self::new(file))
+    }
+
+    fn new(file: File) -> Self {
+        Self {
+            file: Arc::new(file),
+            offset: 0,
+            buffer: Vec::with_capacity(BATCH_SIZE),
+            in_flight: None,
+            spare: Vec::new(),
+            seek_to: None,
+        }
+    }
+
+    /// Truncates or extends the file after writing out what is buffered.
+    pub async fn set_len(&mut self, len: u64) -> io::Result<()> {
+        std::future::poll_fn(|cx| self.poll_drain(cx)).await?;
+        let file = self.file.clone();
+        blocking(move || file.set_len(len)).await
+    }
+
+    /// Waits for the batch in flight, if any, and recycles its buffer.
+    fn poll_in_flight(&mut self, cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        if let Some(batch) = self.in_flight.as_mut() {
+            let joined = ready!(Pin::new(batch).poll(cx));
+            self.in_flight = None;
+            let (result, mut buffer) = joined.map_err(io::Error::other)?;
+            buffer.clear();
+            self.spare = buffer;
+            result?;
+        }
+        Poll::Ready(Ok(()))
+    }
+
+    /// Hands the buffered bytes to a blocking thread once the previous batch
+    /// is done.
+    fn poll_submit(&mut self, cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        ready!(self.poll_in_flight(cx))?;
+        if self.buffer.is_empty() {
+            return Poll::Ready(Ok(()));
+        }
+
+        let batch = std::mem::replace(&mut self.buffer, std::mem::take(&mut self.spare));
+        let offset = self.offset;
+        self.offset += batch.len() as u64;
+        let file = self.file.clone();
+        self.in_flight = Some(tokio::task::spawn_blocking(move || {
+            (write_all_at(&file, &batch, offset), batch)
+        }));
+        Poll::Ready(Ok(()))
+    }
+
+    /// Submits what is buffered and waits until everything is written.
+    fn poll_drain(&mut self, cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        ready!(self.poll_submit(cx))?;
+        self.poll_in_flight(cx)
+    }
+}
+
+impl AsyncWrite for LocalSink {
+    fn poll_write(
+        self: Pin<&mut Self>,
+        cx: &mut Context<'_>,
+        data: &[u8],
+    ) -> Poll<io::Result<usize>> {
+        let this = self.get_mut();
+        if this.buffer.len() >= BATCH_SIZE {
+            ready!(this.poll_submit(cx))?;
+        }
+        let accepted = data.len().min(BATCH_SIZE - this.buffer.len());
+        this.buffer.extend_from_slice(&data[..accepted]);
+        Poll::Ready(Ok(accepted))
+    }
+
+    fn poll_flush(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        self.get_mut().poll_drain(cx)
+    }
+
+    fn poll_shutdown(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+        self.get_mut().poll_drain(cx)
+    }
+}
+
+impl AsyncSeek for LocalSink {
+    fn start_seek(self: Pin<&mut Self>, position: SeekFrom) -> io::Result<()> {
+        let this = self.get_mut();
+        let current = this.offset + this.buffer.len() as u64;
+        this.seek_to = Some(match position {
+            SeekFrom::Start(offset) => offset,
+            SeekFrom::Current(delta) => current.checked_add_signed(delta).ok_or_else(|| {
+                io::Error::new(io::ErrorKind::InvalidInput, "seek before start of file")
+            })?,
+            SeekFrom::End(_) => {
+                return Err(io::Error::new(
+                    io::ErrorKind::Unsupported,
+                    "LocalSink cannot seek from the end",
+                ));
+            }
+        });
+        Ok(())
+    }
+
+    fn poll_complete(self: Pin<&mut Self>, cx: &mut Context<'_>) -> Poll<io::Result<u64>> {
+        let this = self.get_mut();
+        if let Some(target) = this.seek_to {
+            // Writes are positioned, so the batch in flight may finish later.
+            ready!(this.poll_submit(cx))?;
+            this.offset = target;
+            this.seek_to = None;
+        }
+        Poll::Ready(Ok(this.offset + this.buffer.len() as u64))
+    }
+}
+
+impl Drop for LocalSink {
+    fn drop(&mut self) {
+        // Callers shut the sink down on every path, so a write error is seen
+        // and nothing lands after they move on (journal checkpoints, renames).
+        // A sink dropped early loses its buffered tail. A batch already on the
+        // blocking pool cannot be stopped and still lands after the drop.
+        if !self.buffer.is_empty() || self.in_flight.is_some() {
+            warn!(
+                "LocalSink dropped without shutdown; discarding {} buffered bytes{}",
+                self.buffer.len(),
+                if self.in_flight.is_some() {
+                    ", an in-flight batch will still be written"
+                } else {
+                    ""
+                }
+            );
+        }
+    }
+}
+
+async fn blocking<T, F>(task: F) -> io::Result<T>
+where
+    T: Send + 'static,
+    F: FnOnce() -> io::Result<T> + Send + 'static,
+{
+    tokio::task::spawn_blocking(task)
+        .await
+        .map_err(io::Error::other)?
+}
+
+#[cfg(unix)]
+pub(crate) fn write_all_at(file: &File, data: &[u8], offset: u64) -> io::Result<()> {
+    use std::os::unix::fs::FileExt;
+    file.write_all_at(data, offset)
+}
+
+#[cfg(windows)]
+pub(crate) fn write_all_at(file: &File, data: &[u8], offset: u64) -> io::Result<()> {
+    use std::os::windows::fs::FileExt;
+    let mut written = 0;
+    while written < data.len() {
+        match file.seek_write(&data[written..], offset + written as u64)? {
+            0 => return Err(io::ErrorKind::WriteZero.into()),
+            count => written += count,
+        }
+    }
+    Ok(())
+}
+
+#[cfg(unix)]
+pub(crate) fn read_exact_at(file: &File, buffer: &mut [u8], offset: u64) -> io::Result<()> {
+    use std::os::unix::fs::FileExt;
+    file.read_exact_at(buffer, offset)
+}
+
+#[cfg(windows)]
+pub(crate) fn read_exact_at(file: &File, buffer: &mut [u8], offset: u64) -> io::Result<()> {
+    use std::os::windows::fs::FileExt;
+    let mut read = 0;
+    while read < buffer.len() {
+        match file.seek_read(&mut buffer[read..], offset + read as u64)? {
+            0 => return Err(io::ErrorKind::UnexpectedEof.into()),
+            count => read += count,
+        }
+    }
+    Ok(())
+}
+
+/// Creates an empty file at `path`. An existing file is unlinked rather than
+/// truncated: it may be a hard link to another exported copy (see
+/// `content_index`), which must keep its content.
+fn create_new_inode(path: &Path) -> io::Result<File> {
+    match std::fs::remove_file(path) {
+        Ok(()) => {}
+        Err(err) if err.kind() == io::ErrorKind::NotFound => {}
+        Err(err) => return Err(err),
+    }
+    File::create(path)
+}
+
+/// Allocates `size` bytes for `file` without changing its length, so an
+/// interrupted export never looks complete. Filesystems without support are
+/// left to allocate as they go.
+#[cfg(target_os = "linux")]
+pub fn reserve(file: &File, size: u64) -> io::Result<()> {
+    use std::os::fd::AsRawFd;
+
+    if size == 0 {
+        return Ok(());
+    }
+    let len =
+        libc::off_t::try_from(size).map_err(|_| io::Error::from(io::ErrorKind::InvalidInput))?;
+    // SAFETY: the descriptor stays open for the duration of the call.
+    let result = unsafe { libc::fallocate(file.as_raw_fd(), libc::FALLOC_FL_KEEP_SIZE, 0, len) };
+    if result == 0 {
+        return Ok(());
+    }
+    let err = io::Error::last_os_error();
+    match err.raw_os_error() {
+        Some(libc::EOPNOTSUPP) | Some(libc::ENOSYS) => Ok(()),
+        _ => Err(err),
+    }
+}
+
+#[cfg(not(target_os = "linux"))]
+pub fn reserve(_file: &File, _size: u64) -> io::Result<()> {
+    Ok(())
+}
+
+/// Creates `path` with room for `size` bytes and that length, for files
+/// whose ranges are written out of order.
+pub async fn preallocate(path: PathBuf, size: u64) -> io::Result<()> {
+    blocking(move || {
+        let file = create_new_inode(&path)?;
+        reserve(&file, size)?;
+        file.set_len(size)
+    })
+    .await
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::time::Instant;
+    use tokio::io::{AsyncReadExt, AsyncSeekExt, AsyncWriteExt};
+
+    fn temp_path(name: &str) -> PathBuf {
+        std::env::temp_dir().join(format!("idescriptor-sink-{}-{name}", uuid::Uuid::new_v4()))
+    }
+
+    fn payload(len: usize) -> Vec<u8> {
+        (0..len).map(|index| (index % 251) as u8).collect()
+    }
+
+    #[tokio::test]
+    async fn batched_writes_land_in_order_and_honour_seeks() {
+        let path = temp_path("ordered");
+        let data = payload(3 * BATCH_SIZE + 12_345);
+        let mut sink = LocalSink::create(&path, Some(data.len() as u64))
+            .await
+            .expect("created");
+        for chunk in data.chunks(1024 * 1024 + 7) {
+            sink.write_all(chunk).await.expect("written");
+        }
+        // Overwrite a span inside an earlier batch, as a resumed range does.
+        sink.seek(SeekFrom::Start(BATCH_SIZE as u64 - 3))
+            .await
+            .expect("seeked");
+        sink.write_all(b"patched").await.expect("patched");
+        sink.flush().await.expect("flushed");
+
+        let mut expected = data.clone();
+        expected[BATCH_SIZE - 3..BATCH_SIZE + 4].copy_from_slice(b"patched");
+        assert_eq!(tokio::fs::read(&path).await.expect("read back"), expected);
+
+        sink.set_len(10).await.expect("truncated");
+        assert_eq!(tokio::fs::metadata(&path).await.expect("stat").len(), 10);
+        let _ = tokio::fs::remove_file(&path).await;
+    }
+
+    #[tokio::test]
+    async fn creating_leaves_hard_links_intact() {
+        let path = temp_path("linked");
+        let link = temp_path("link");
+        tokio::fs::write(&path, b"archived").await.expect("written");
+        tokio::fs::hard_link(&path, &link).await.expect("linked");
+
+        let mut sink = LocalSink::create(&link, None).await.expect("created");
+        sink.write_all(b"new").await.expect("written");
+        sink.shutdown().await.expect("shut down");
+        assert_eq!(tokio::fs::read(&path).await.expect("read"), b"archived");
+
+        preallocate(path.clone(), 4).await.expect("preallocated");
+        assert_eq!(tokio::fs::read(&link).await.expect("read"), b"new");
+        let _ = tokio::fs::remove_file(&path).await;
+        let _ = tokio::fs::remove_file(&link).await;
+    }
+
+    #[tokio::test]
+    async fn reserving_space_keeps_the_visible_length() {
+        let path = temp_path("reserved");
+        let sink = LocalSink::create(&path, Some(8 * 1024 * 1024))
+            .await
+            .expect("created");
+        drop(sink);
+        assert_eq!(tokio::fs::metadata(&path).await.expect("stat").len(), 0);
+
+        preallocate(path.clone(), 4096).await.expect("preallocated");
+        assert_eq!(tokio::fs::metadata(&path).await.expect("stat").len(), 4096);
+        let _ = tokio::fs::remove_file(&path).await;
+    }
+
+    #[tokio::test]
+    #[ignore = "benchmark; run with --ignored --nocapture"]
+    async fn bench_tokio_file_vs_local_sink() {
+        const SIZE: usize = 512 * 1024 * 1024;
+        const CHUNK: usize = 1024 * 1024;
+
+        // A local file stands in for the device side of an export.
+        let source = temp_path("source");
+        tokio::fs::write(&source, payload(SIZE))
+            .await
+            .expect("source");
+
+        async fn export<W: AsyncWrite + Unpin>(source: &Path, mut sink: W) -> f64 {
+            let mut remote = tokio::fs::File::open(source).await.expect("open source");
+            let mut chunk = vec![0u8; CHUNK];
+            let started = Instant::now();
+            loop {
+                let read = remote.read(&mut chunk).await.expect("read");
+                if read == 0 {
+                    break;
+                }
+                sink.write_all(&chunk[..read]).await.expect("write");
+            }
+            sink.flush().await.expect("flush");
+            SIZE as f64 / 1024.0 / 1024.0 / started.elapsed().as_secs_f64()
+        }
+
+        let target = temp_path("target");
+        let tokio_file = tokio::fs::File::create(&target).await.expect("create");
+        let tokio_rate = export(&source, tokio_file).await;
+        let sink = LocalSink::create(&target, Some(SIZE as u64))
+            .await
+            .expect("create");
+        let sink_rate = export(&source, sink).await;
+
+        println!("tokio::fs::File: {tokio_rate:.0} MiB/s; LocalSink: {sink_rate:.0} MiB/s");
+        let _ = tokio::fs::remove_file(&source).await;
+        let _ = tokio::fs::remove_file(&target).await;
+    }
+}
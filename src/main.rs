@@ -13,12 +13,17 @@ use std::sync::mpsc;
 use tokio::runtime::Runtime;
 use tracing_subscriber::{EnvFilter, filter::LevelFilter, prelude::*};
 
+pub mod afc_metadata_cache;
+pub mod afc_pool;
 pub mod afc_services;
 pub mod airplay;
 pub mod apps;
 pub mod backup_manager;
+pub mod buffer_pool;
 pub mod constants;
+pub mod content_index;
 pub mod core;
+pub mod decode_pool;
 pub mod dev_imgs;
 pub mod dev_imgs_manager;
 pub mod device_ctx;
@@ -27,8 +32,12 @@ pub mod device_db;
 pub mod diagnose;
 pub mod gallery;
 pub mod gallery_fs_provider;
+pub mod gallery_index;
+pub mod gallery_snapshot_delta;
 pub mod gallery_sqlite_provider;
 pub mod gallery_sqlite_vfs;
+pub mod gallery_vfs_cache;
+pub mod heic_transcode;
 #[cfg(not(target_os = "macos"))]
 pub mod ifuse;
 #[cfg(any(target_os = "linux", target_os = "windows"))]
@@ -37,11 +46,15 @@ pub mod image_cache;
 pub mod image_loader;
 pub mod image_provider;
 pub mod io_manager;
+pub mod ipa_staging;
+pub mod ipa_tee;
 pub mod jailbroken;
 pub mod list_model;
+pub mod local_sink;
 pub mod media_streamer;
 pub mod native;
 pub mod platform;
+pub mod progress_bus;
 pub mod qml_image;
 pub mod qml_utils;
 pub mod qquickimageprovider_imp;
@@ -53,6 +66,9 @@ pub mod service_manager;
 pub mod settings_manager;
 pub mod springboard_services;
 pub mod status_window_controller;
+pub mod sync_manifest;
+pub mod transfer_journal;
+pub mod transfer_pipeline;
 pub mod transfer_speed_tester;
 #[cfg(not(debug_assertions))]
 pub mod ui_qrc;
@@ -258,6 +274,9 @@ fn main() {
     let io_manager = QObjectBox::new(io_manager::IOManager::default());
     engine.set_object_property("ioManager".into(), io_manager.pinned());
 
+    let progress_bus = QObjectBox::new(progress_bus::ProgressBus::default());
+    engine.set_object_property("progressBus".into(), progress_bus.pinned());
+
     let airplay = QObjectBox::new(airplay::Airplay::default());
     engine.set_object_property("AirplayImp".into(), airplay.pinned());
 
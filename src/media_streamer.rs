@@ -4,114 +4,275 @@
 use axum::{
     Router,
     body::{Body, Bytes},
-    extract::State,
+    extract::{Path, State},
     http::{HeaderMap, HeaderValue, Method, Response, StatusCode, header},
     routing::any,
 };
 use futures::stream;
 use http_range_header::parse_range_header;
-use idevice::afc::{AfcClient, opcode::AfcFopenMode};
+use idevice::afc::opcode::AfcFopenMode;
 use log::{debug, error, warn};
-use std::{io, io::SeekFrom, ops::RangeInclusive, sync::Arc};
+use lru::LruCache;
+use std::{
+    collections::HashMap,
+    io,
+    io::SeekFrom,
+    num::NonZeroUsize,
+    ops::RangeInclusive,
+    sync::{
+        Arc, Mutex as StdMutex,
+        atomic::{AtomicU64, Ordering},
+    },
+    time::{Duration, Instant},
+};
 use tokio::{
-    io::{AsyncReadExt, AsyncSeekExt},
+    io::{AsyncRead, AsyncReadExt, AsyncSeekExt},
     net::TcpListener,
-    sync::{Mutex, mpsc},
-    task::JoinHandle,
+    sync::{Notify, OnceCell, mpsc},
 };
 use tokio_util::{sync::CancellationToken, task::TaskTracker};
 
 use crate::RUNTIME;
+use crate::afc_pool::AfcSource;
+
+const CACHE_BLOCK_SIZE: u64 = 256 * 1024;
+// 32 MiB per open preview window.
+const BLOCK_CACHE_CAPACITY: NonZeroUsize = NonZeroUsize::new(128).unwrap();
+const READ_AHEAD_SECONDS: f64 = 4.0;
+const READ_AHEAD_INITIAL_BYTES: u64 = 4 * 1024 * 1024;
+const READ_AHEAD_MIN_BYTES: u64 = 1024 * 1024;
+const READ_AHEAD_MAX_BYTES: u64 = 16 * 1024 * 1024;
+// The byte budget above is what bounds the producer; the channel only needs
+// room for a full read-ahead window.
+const STREAM_CHANNEL_CAPACITY: usize = (READ_AHEAD_MAX_BYTES / CACHE_BLOCK_SIZE) as usize + 1;
+const BITRATE_SAMPLE_INTERVAL: Duration = Duration::from_millis(500);
+const BITRATE_SMOOTHING: f64 = 0.3;
 
-const STREAM_CHUNK_SIZE: usize = 256 * 1024;
-const STREAM_CHANNEL_CAPACITY: usize = 2;
-
-#[derive(Clone)]
 struct MediaStreamState {
-    afc: Arc<Mutex<AfcClient>>,
+    afc: AfcSource,
     path: Arc<str>,
     file_size: u64,
     mime_type: &'static str,
     cancellation: CancellationToken,
     producers: TaskTracker,
+    cache: StdMutex<BlockCache>,
+}
+
+type SessionRegistry = Arc<StdMutex<HashMap<String, Arc<MediaStreamState>>>>;
+
+/// One localhost server shared by every preview window. Sessions register
+/// under a random token and are served from `/media/{token}`.
+struct MediaServer {
+    port: u16,
+    sessions: SessionRegistry,
 }
 
-/// Owns one preview window's HTTP endpoint and all response producers spawned by it.
-/// Individual AFC file descriptors remain request-scoped so seeking and looping can
-/// open a fresh descriptor while this session stays alive.
+static MEDIA_SERVER: OnceCell<MediaServer> = OnceCell::const_new();
+
+async fn media_server() -> anyhow::Result<&'static MediaServer> {
+    MEDIA_SERVER
+        .get_or_try_init(|| async {
+            let listener = TcpListener::bind("127.0.0.1:0").await?;
+            let port = listener.local_addr()?.port();
+            let sessions = SessionRegistry::default();
+            let app = Router::new()
+                .route("/media/{token}", any(handle_media_request))
+                .with_state(sessions.clone());
+
+            RUNTIME.spawn(async move {
+                if let Err(err) = axum::serve(listener, app).await {
+                    error!("Media stream server failed: {err}");
+                }
+            });
+            debug!("Media stream server listening on 127.0.0.1:{port}");
+            Ok::<_, anyhow::Error>(MediaServer { port, sessions })
+        })
+        .await
+}
+
+/// One preview window's registration on the shared media server, plus all
+/// response producers spawned for it. Individual AFC file descriptors remain
+/// request-scoped so seeking and looping can open a fresh descriptor while
+/// this session stays alive; the block cache is what survives between them.
 pub struct MediaStreamSession {
-    cancellation: CancellationToken,
-    server_task: Option<JoinHandle<()>>,
+    token: String,
+    state: Arc<MediaStreamState>,
 }
 
 impl MediaStreamSession {
-    // TODO: expose the URL programmatically localhost:$PORT/idescriptor/media/$VIDEOPATH
-    pub async fn start(afc: Arc<Mutex<AfcClient>>, path: String) -> anyhow::Result<(String, Self)> {
+    pub async fn start(afc: AfcSource, path: String) -> anyhow::Result<(String, Self)> {
         let file_size = {
-            let mut afc = afc.lock().await;
+            let mut afc = afc.lease().await?;
             afc.get_file_info(path.clone()).await?.size as u64
         };
-        let listener = TcpListener::bind("127.0.0.1:0").await?;
-        let local_addr = listener.local_addr()?;
-        let cancellation = CancellationToken::new();
-        let producers = TaskTracker::new();
+        let server = media_server().await?;
+        let token = uuid::Uuid::new_v4().simple().to_string();
         let state = Arc::new(MediaStreamState {
             afc,
             file_size,
             mime_type: mime_type_for_path(&path),
             path: Arc::from(path),
-            cancellation: cancellation.clone(),
-            producers: producers.clone(),
+            cancellation: CancellationToken::new(),
+            producers: TaskTracker::new(),
+            cache: StdMutex::new(BlockCache::new(BLOCK_CACHE_CAPACITY)),
         });
 
-        let app = Router::new()
-            .route("/media", any(handle_media_request))
-            .with_state(state);
-        let server_cancellation = cancellation.clone();
-        let cleanup_cancellation = cancellation.clone();
-        let server_task = RUNTIME.spawn(async move {
-            let result = axum::serve(listener, app)
-                .with_graceful_shutdown(server_cancellation.cancelled_owned())
-                .await;
-            if let Err(err) = result {
-                error!("Media stream server failed: {err}");
-            }
+        server
+            .sessions
+            .lock()
+            .expect("media session registry poisoned")
+            .insert(token.clone(), state.clone());
 
-            // Also stop producers if the listener exits unexpectedly.
-            cleanup_cancellation.cancel();
-            producers.close();
-            producers.wait().await;
-            debug!("Media stream server and producers stopped");
-        });
+        let url = format!("http://127.0.0.1:{}/media/{token}", server.port);
+        Ok((url, Self { token, state }))
+    }
 
-        let url = format!("http://127.0.0.1:{}/media", local_addr.port());
-        Ok((
-            url,
-            Self {
-                cancellation,
-                server_task: Some(server_task),
-            },
-        ))
+    pub fn cache_stats(&self) -> BlockCacheStats {
+        self.state.cache_stats()
     }
 
     pub async fn shutdown(&mut self) {
-        self.cancellation.cancel();
-        if let Some(server_task) = self.server_task.take() {
-            if let Err(err) = server_task.await {
-                warn!("Media stream server task failed during shutdown: {err}");
-            }
+        self.unregister();
+        self.state.producers.close();
+        self.state.producers.wait().await;
+        let stats = self.cache_stats();
+        debug!(
+            "Media stream for {} stopped: cache hits={} misses={} hit_ratio={:.2}",
+            self.state.path,
+            stats.hits,
+            stats.misses,
+            stats.hit_ratio()
+        );
+    }
+
+    fn unregister(&self) {
+        if let Some(server) = MEDIA_SERVER.get() {
+            server
+                .sessions
+                .lock()
+                .expect("media session registry poisoned")
+                .remove(&self.token);
         }
+        self.state.cancellation.cancel();
     }
 }
 
 impl Drop for MediaStreamSession {
     fn drop(&mut self) {
-        // Drop cannot await the server task. Explicit shutdown remains responsible
-        // for draining producers; cancellation is the safety net for lost sessions.
-        self.cancellation.cancel();
+        // Drop cannot await the producers. Explicit shutdown remains responsible
+        // for draining them; cancellation is the safety net for lost sessions.
+        self.unregister();
     }
 }
 
+impl MediaStreamState {
+    fn cache_stats(&self) -> BlockCacheStats {
+        self.cache
+            .lock()
+            .map(|cache| cache.stats())
+            .unwrap_or_default()
+    }
+
+    fn cached_block(&self, index: u64) -> Option<Bytes> {
+        self.cache.lock().ok()?.get(index)
+    }
+
+    fn is_cached(&self, index: u64) -> bool {
+        self.cache
+            .lock()
+            .map(|cache| cache.contains(index))
+            .unwrap_or(false)
+    }
+
+    fn cache_block(&self, index: u64, block: Bytes) {
+        if let Ok(mut cache) = self.cache.lock() {
+            cache.insert(index, block);
+        }
+    }
+}
+
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct BlockCacheStats {
+    pub hits: u64,
+    pub misses: u64,
+    pub cached_blocks: usize,
+}
+
+impl BlockCacheStats {
+    pub fn hit_ratio(&self) -> f64 {
+        let lookups = self.hits + self.misses;
+        if lookups == 0 {
+            0.0
+        } else {
+            self.hits as f64 / lookups as f64
+        }
+    }
+}
+
+/// Recently served `CACHE_BLOCK_SIZE` blocks of one media file. Players probe
+/// the head and the tail (`moov`) before scrubbing, so keeping those blocks
+/// lets repeated and overlapping ranges skip AFC entirely.
+struct BlockCache {
+    blocks: LruCache<u64, Bytes>,
+    hits: u64,
+    misses: u64,
+}
+
+impl BlockCache {
+    fn new(capacity: NonZeroUsize) -> Self {
+        Self {
+            blocks: LruCache::new(capacity),
+            hits: 0,
+            misses: 0,
+        }
+    }
+
+    fn get(&mut self, index: u64) -> Option<Bytes> {
+        let block = self.blocks.get(&index).cloned();
+        if block.is_some() {
+            self.hits += 1;
+        }
+        block
+    }
+
+    fn contains(&self, index: u64) -> bool {
+        self.blocks.contains(&index)
+    }
+
+    /// Stores a block read from the device. Every insert is a block that had
+    /// to be fetched, so it is counted as a miss.
+    fn insert(&mut self, index: u64, block: Bytes) {
+        self.misses += 1;
+        self.blocks.put(index, block);
+    }
+
+    fn stats(&self) -> BlockCacheStats {
+        BlockCacheStats {
+            hits: self.hits,
+            misses: self.misses,
+            cached_blocks: self.blocks.len(),
+        }
+    }
+}
+
+fn block_index(position: u64) -> u64 {
+    position / CACHE_BLOCK_SIZE
+}
+
+fn block_start(index: u64) -> u64 {
+    index * CACHE_BLOCK_SIZE
+}
+
+/// The part of `block` (cached at `index`) that falls in `position..end`.
+fn block_slice(block: &Bytes, index: u64, position: u64, end: u64) -> Bytes {
+    let offset = position.saturating_sub(block_start(index)) as usize;
+    if offset >= block.len() {
+        return Bytes::new();
+    }
+    let take = (block.len() - offset).min((end - position) as usize);
+    block.slice(offset..offset + take)
+}
+
 #[derive(Debug, Clone, PartialEq, Eq)]
 enum RangeDecision {
     Full,
@@ -141,10 +302,22 @@ fn resolve_range(value: Option<&HeaderValue>, file_size: u64) -> Result<RangeDec
 }
 
 async fn handle_media_request(
-    State(state): State<Arc<MediaStreamState>>,
+    State(sessions): State<SessionRegistry>,
+    Path(token): Path<String>,
     method: Method,
     headers: HeaderMap,
 ) -> Response<Body> {
+    let state = sessions
+        .lock()
+        .ok()
+        .and_then(|sessions| sessions.get(&token).cloned());
+    let Some(state) = state else {
+        return empty_response(StatusCode::NOT_FOUND, None);
+    };
+    serve_media(state, method, headers)
+}
+
+fn serve_media(state: Arc<MediaStreamState>, method: Method, headers: HeaderMap) -> Response<Body> {
     if method != Method::GET && method != Method::HEAD {
         return empty_response(
             StatusCode::METHOD_NOT_ALLOWED,
@@ -197,91 +370,304 @@ async fn handle_media_request(
 
 fn start_body_producer(state: Arc<MediaStreamState>, start: u64, content_length: u64) -> Body {
     let (body_tx, body_rx) = mpsc::channel(STREAM_CHANNEL_CAPACITY);
+    let read_ahead = Arc::new(ReadAhead::new());
     let producer_state = state.clone();
+    let producer_read_ahead = read_ahead.clone();
 
     state.producers.spawn(async move {
-        produce_range(producer_state, start, content_length, body_tx).await;
+        produce_range(
+            producer_state,
+            producer_read_ahead,
+            start,
+            content_length,
+            body_tx,
+        )
+        .await;
     });
 
-    let body_stream = stream::unfold(body_rx, |mut receiver| async move {
-        receiver.recv().await.map(|item| (item, receiver))
-    });
+    let body_stream = stream::unfold(
+        (body_rx, read_ahead),
+        |(mut receiver, read_ahead)| async move {
+            let item = receiver.recv().await?;
+            if let Ok(bytes) = &item {
+                read_ahead.consumed(bytes.len() as u64);
+            }
+            Some((item, (receiver, read_ahead)))
+        },
+    );
     Body::from_stream(body_stream)
 }
 
+/// Shared between a range producer and its HTTP body. The producer keeps
+/// roughly `READ_AHEAD_SECONDS` of media buffered at the rate the player is
+/// actually consuming, and only holds an AFC session while refilling.
+struct ReadAhead {
+    buffered: AtomicU64,
+    bitrate: StdMutex<BitrateEstimator>,
+    drained: Notify,
+}
+
+impl ReadAhead {
+    fn new() -> Self {
+        Self {
+            buffered: AtomicU64::new(0),
+            bitrate: StdMutex::new(BitrateEstimator::new(Instant::now())),
+            drained: Notify::new(),
+        }
+    }
+
+    fn produced(&self, bytes: u64) {
+        self.buffered.fetch_add(bytes, Ordering::AcqRel);
+    }
+
+    fn consumed(&self, bytes: u64) {
+        self.buffered.fetch_sub(bytes, Ordering::AcqRel);
+        if let Ok(mut bitrate) = self.bitrate.lock() {
+            bitrate.record(bytes, Instant::now());
+        }
+        self.drained.notify_one();
+    }
+
+    fn buffered(&self) -> u64 {
+        self.buffered.load(Ordering::Acquire)
+    }
+
+    fn target(&self) -> u64 {
+        let bytes_per_sec = self
+            .bitrate
+            .lock()
+            .ok()
+            .and_then(|bitrate| bitrate.bytes_per_sec());
+        read_ahead_target(bytes_per_sec)
+    }
+}
+
+/// Exponentially weighted consumer throughput, sampled at most every
+/// `BITRATE_SAMPLE_INTERVAL` so single chunk timings do not dominate.
+struct BitrateEstimator {
+    window_start: Instant,
+    window_bytes: u64,
+    bytes_per_sec: Option<f64>,
+}
+
+impl BitrateEstimator {
+    fn new(now: Instant) -> Self {
+        Self {
+            window_start: now,
+            window_bytes: 0,
+            bytes_per_sec: None,
+        }
+    }
+
+    fn record(&mut self, bytes: u64, now: Instant) {
+        self.window_bytes += bytes;
+        let elapsed = now.saturating_duration_since(self.window_start);
+        if elapsed < BITRATE_SAMPLE_INTERVAL {
+            return;
+        }
+
+        let sample = self.window_bytes as f64 / elapsed.as_secs_f64();
+        self.bytes_per_sec = Some(match self.bytes_per_sec {
+            Some(current) => current + BITRATE_SMOOTHING * (sample - current),
+            None => sample,
+        });
+        self.window_start = now;
+        self.window_bytes = 0;
+    }
+
+    fn bytes_per_sec(&self) -> Option<f64> {
+        self.bytes_per_sec
+    }
+}
+
+fn read_ahead_target(bytes_per_sec: Option<f64>) -> u64 {
+    let Some(bytes_per_sec) = bytes_per_sec else {
+        return READ_AHEAD_INITIAL_BYTES;
+    };
+    ((bytes_per_sec * READ_AHEAD_SECONDS) as u64).clamp(READ_AHEAD_MIN_BYTES, READ_AHEAD_MAX_BYTES)
+}
+
+/// Waits until the buffer drops below half of the read-ahead target. Returns
+/// false when the session is cancelled or the HTTP body was dropped.
+async fn wait_for_refill(
+    state: &MediaStreamState,
+    read_ahead: &ReadAhead,
+    body_tx: &mpsc::Sender<Result<Bytes, io::Error>>,
+) -> bool {
+    loop {
+        if state.cancellation.is_cancelled() || body_tx.is_closed() {
+            return false;
+        }
+        if read_ahead.buffered() < read_ahead.target() / 2 {
+            return true;
+        }
+        tokio::select! {
+            _ = state.cancellation.cancelled() => return false,
+            _ = body_tx.closed() => return false,
+            _ = read_ahead.drained.notified() => {}
+        }
+    }
+}
+
 async fn produce_range(
     state: Arc<MediaStreamState>,
+    read_ahead: Arc<ReadAhead>,
     start: u64,
     content_length: u64,
     body_tx: mpsc::Sender<Result<Bytes, io::Error>>,
 ) {
-    let mut afc = tokio::select! {
-        _ = state.cancellation.cancelled() => {
+    let end = start + content_length;
+    let mut position = start;
+    let mut buffer = vec![0_u8; CACHE_BLOCK_SIZE as usize];
+
+    while position < end {
+        if !wait_for_refill(&state, &read_ahead, &body_tx).await {
             return;
         }
-        afc = state.afc.clone().lock_owned() => afc,
+
+        let index = block_index(position);
+        let result = match state.cached_block(index) {
+            Some(block) => {
+                send_block(
+                    &state,
+                    &read_ahead,
+                    &body_tx,
+                    &block,
+                    index,
+                    &mut position,
+                    end,
+                )
+                .await
+            }
+            None => {
+                refill(
+                    &state,
+                    &read_ahead,
+                    &mut buffer,
+                    &mut position,
+                    end,
+                    &body_tx,
+                )
+                .await
+            }
+        };
+
+        match result {
+            Ok(true) => {}
+            Ok(false) => return,
+            Err(message) => {
+                warn!("{message}");
+                // Error reporting must not delay cleanup when the HTTP consumer
+                // has stopped polling a full response channel.
+                let _ = body_tx.try_send(Err(io::Error::other(message)));
+                return;
+            }
+        }
+    }
+}
+
+/// Sends the part of a block that overlaps `position..end` and advances
+/// `position`. Returns `Ok(false)` once nothing more should be produced.
+async fn send_block(
+    state: &MediaStreamState,
+    read_ahead: &ReadAhead,
+    body_tx: &mpsc::Sender<Result<Bytes, io::Error>>,
+    block: &Bytes,
+    index: u64,
+    position: &mut u64,
+    end: u64,
+) -> Result<bool, String> {
+    let bytes = block_slice(block, index, *position, end);
+    if bytes.is_empty() {
+        // The file is shorter than its reported size.
+        return Ok(false);
+    }
+
+    let len = bytes.len() as u64;
+    read_ahead.produced(len);
+    let sent = tokio::select! {
+        _ = state.cancellation.cancelled() => false,
+        result = body_tx.send(Ok(bytes)) => result.is_ok(),
+    };
+    *position += len;
+    Ok(sent)
+}
+
+/// Leases a session and streams whole blocks from the one containing
+/// `position` until the read-ahead target is met, the range ends, or the next
+/// block is already cached. The lease is returned before waiting for the
+/// player again. Returns `Ok(false)` once nothing more should be produced.
+async fn refill(
+    state: &MediaStreamState,
+    read_ahead: &ReadAhead,
+    buffer: &mut [u8],
+    position: &mut u64,
+    end: u64,
+    body_tx: &mpsc::Sender<Result<Bytes, io::Error>>,
+) -> Result<bool, String> {
+    let mut afc = tokio::select! {
+        _ = state.cancellation.cancelled() => return Ok(false),
+        afc = state.afc.lease() => afc
+            .map_err(|err| format!("No AFC session for {}: {err}", state.path))?,
     };
 
     // Do not cancel an in-flight AFC protocol operation. Cancellation is checked
-    // between complete operations so the shared AFC connection remains usable.
+    // between complete operations so the leased AFC session remains reusable.
     let mut fd = match afc.open(state.path.to_string(), AfcFopenMode::RdOnly).await {
         Ok(fd) => fd,
         Err(err) => {
             let message = format!("Media file open failed for {}: {err}", state.path);
-            warn!("{message}");
-            let _ = body_tx.try_send(Err(io::Error::other(message)));
-            return;
+            afc.note_error(&err);
+            return Err(message);
         }
     };
 
-    if start > 0 {
-        if let Err(err) = fd.seek(SeekFrom::Start(start)).await {
-            let message = format!(
-                "Media file seek failed for {} at {start}: {err}",
-                state.path
-            );
-            warn!("{message}");
-            let _ = body_tx.try_send(Err(io::Error::other(message)));
-            if let Err(close_err) = fd.close().await {
-                warn!("Failed to close AFC descriptor after seek error: {close_err}");
-            }
-            return;
+    let mut result = Ok(true);
+    let mut index = block_index(*position);
+    if index > 0 {
+        if let Err(err) = fd.seek(SeekFrom::Start(block_start(index))).await {
+            result = Err(format!(
+                "Media file seek failed for {} at {}: {err}",
+                state.path,
+                block_start(index)
+            ));
         }
     }
 
-    if state.cancellation.is_cancelled() {
-        if let Err(err) = fd.close().await {
-            warn!("Failed to close cancelled AFC descriptor: {err}");
+    let target = read_ahead.target();
+    let mut first = true;
+    while result.is_ok() && *position < end && read_ahead.buffered() < target {
+        if state.cancellation.is_cancelled() {
+            result = Ok(false);
+            break;
         }
-        return;
-    }
+        // Hand a cached block back to the caller rather than re-reading it.
+        if !first && state.is_cached(index) {
+            break;
+        }
+        first = false;
 
-    let mut remaining = content_length;
-    let mut buffer = vec![0_u8; STREAM_CHUNK_SIZE];
-    while remaining > 0 && !state.cancellation.is_cancelled() {
-        let to_read = remaining.min(buffer.len() as u64) as usize;
-        let read = match fd.read(&mut buffer[..to_read]).await {
-            Ok(0) => break,
+        let read = match read_block(&mut fd, buffer).await {
+            Ok(0) => {
+                result = Ok(false);
+                break;
+            }
             Ok(read) => read,
             Err(err) => {
-                let message = format!("AFC read failed for {}: {err}", state.path);
-                error!("{message}");
-                // Error reporting must not delay descriptor cleanup when the HTTP
-                // consumer has stopped polling a full response channel.
-                let _ = body_tx.try_send(Err(io::Error::other(message)));
+                error!("AFC read failed for {}: {err}", state.path);
+                result = Err(format!("AFC read failed for {}: {err}", state.path));
                 break;
             }
         };
 
-        let bytes = Bytes::copy_from_slice(&buffer[..read]);
-        let sent = tokio::select! {
-            _ = state.cancellation.cancelled() => false,
-            result = body_tx.send(Ok(bytes)) => result.is_ok(),
-        };
-        if !sent {
+        let block = Bytes::copy_from_slice(&buffer[..read]);
+        state.cache_block(index, block.clone());
+        result = send_block(state, read_ahead, body_tx, &block, index, position, end).await;
+        if !matches!(result, Ok(true)) || read < buffer.len() {
+            // A short block is the end of the file.
             break;
         }
-        remaining -= read as u64;
+        index += 1;
     }
 
     if let Err(err) = fd.close().await {
@@ -290,6 +676,21 @@ async fn produce_range(
             state.path
         );
     }
+    result
+}
+
+/// Fills `buffer` unless the file ends first, so cached blocks are always
+/// complete and aligned.
+async fn read_block<R: AsyncRead + Unpin>(reader: &mut R, buffer: &mut [u8]) -> io::Result<usize> {
+    let mut filled = 0;
+    while filled < buffer.len() {
+        let read = reader.read(&mut buffer[filled..]).await?;
+        if read == 0 {
+            break;
+        }
+        filled += read;
+    }
+    Ok(filled)
 }
 
 fn empty_response(
@@ -430,6 +831,75 @@ mod tests {
         assert_eq!(response.headers()[header::CONTENT_LENGTH], "0");
     }
 
+    #[test]
+    fn read_ahead_target_follows_bitrate_within_bounds() {
+        assert_eq!(read_ahead_target(None), READ_AHEAD_INITIAL_BYTES);
+        assert_eq!(read_ahead_target(Some(1_000.0)), READ_AHEAD_MIN_BYTES);
+        assert_eq!(read_ahead_target(Some(1_000_000.0)), 4_000_000);
+        assert_eq!(
+            read_ahead_target(Some(1_000_000_000.0)),
+            READ_AHEAD_MAX_BYTES
+        );
+    }
+
+    #[test]
+    fn bitrate_estimator_waits_for_a_full_sample_window() {
+        let start = Instant::now();
+        let mut estimator = BitrateEstimator::new(start);
+        estimator.record(1_000, start + Duration::from_millis(100));
+        assert_eq!(estimator.bytes_per_sec(), None);
+
+        estimator.record(1_000, start + Duration::from_millis(500));
+        assert_eq!(estimator.bytes_per_sec(), Some(4_000.0));
+    }
+
+    #[test]
+    fn bitrate_estimator_smooths_later_samples() {
+        let start = Instant::now();
+        let mut estimator = BitrateEstimator::new(start);
+        estimator.record(1_000, start + Duration::from_secs(1));
+        estimator.record(2_000, start + Duration::from_secs(2));
+
+        let rate = estimator.bytes_per_sec().expect("two samples recorded");
+        assert!((rate - 1_300.0).abs() < 1e-9);
+    }
+
+    #[test]
+    fn maps_positions_to_aligned_blocks() {
+        assert_eq!(block_index(0), 0);
+        assert_eq!(block_index(CACHE_BLOCK_SIZE - 1), 0);
+        assert_eq!(block_index(CACHE_BLOCK_SIZE), 1);
+        assert_eq!(block_start(3), 3 * CACHE_BLOCK_SIZE);
+    }
+
+    #[test]
+    fn slices_the_requested_part_of_a_block() {
+        let block = Bytes::from((0..=255_u8).cycle().take(1024).collect::<Vec<_>>());
+        let base = block_start(2);
+
+        let slice = block_slice(&block, 2, base + 10, base + 20);
+        assert_eq!(&slice[..], &block[10..20]);
+        assert_eq!(block_slice(&block, 2, base + 1000, u64::MAX).len(), 24);
+        assert!(block_slice(&block, 2, base + 1024, base + 2048).is_empty());
+    }
+
+    #[test]
+    fn block_cache_tracks_hit_ratio_and_evicts_oldest() {
+        let mut cache = BlockCache::new(NonZeroUsize::new(2).unwrap());
+        assert_eq!(cache.get(0), None);
+        cache.insert(0, Bytes::from_static(b"moov"));
+        cache.insert(9, Bytes::from_static(b"tail"));
+        assert_eq!(cache.get(0), Some(Bytes::from_static(b"moov")));
+        cache.insert(4, Bytes::from_static(b"scrub"));
+
+        assert!(cache.contains(0));
+        assert!(!cache.contains(9));
+        let stats = cache.stats();
+        assert_eq!((stats.hits, stats.misses, stats.cached_blocks), (1, 3, 2));
+        assert!((stats.hit_ratio() - 0.25).abs() < 1e-9);
+        assert_eq!(BlockCacheStats::default().hit_ratio(), 0.0);
+    }
+
     #[test]
     fn detects_supported_video_mime_types() {
         assert_eq!(mime_type_for_path("/DCIM/example.MP4"), "video/mp4");
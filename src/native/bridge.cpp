@@ -259,15 +259,25 @@ QImage generate_thumbnail_with_reader_ffi(const void *reader_ptr,
 
 
 QImage heic_to_image_ffi(const uint8_t *input_data, size_t len)
+{
+    return heic_decode_ffi(input_data, len, nullptr);
+}
+
+/*
+ Decodes the primary image with its transformations (irot/imir) applied, so
+ the pixels are upright. If exif is given, it receives the raw Exif metadata
+ block of the primary image, or stays empty when there is none.
+*/
+QImage heic_decode_ffi(const uint8_t *input_data, size_t len, QByteArray *exif)
 {
     if (!input_data || len == 0) {
-        std::cerr << "heic_to_image_ffi: empty input" << std::endl;
+        std::cerr << "heic_decode_ffi: empty input" << std::endl;
         return QImage();
     }
 
     heif_context *ctx = heif_context_alloc();
     if (!ctx) {
-        std::cerr << "heic_to_image_ffi: failed to allocate heif_context"
+        std::cerr << "heic_decode_ffi: failed to allocate heif_context"
                   << std::endl;
         return QImage();
     }
@@ -275,7 +285,7 @@ QImage heic_to_image_ffi(const uint8_t *input_data, size_t len)
     heif_error err =
         heif_context_read_from_memory(ctx, input_data, len, nullptr);
     if (err.code != heif_error_Ok) {
-        std::cerr << "heic_to_image_ffi: failed to read HEIC from memory: "
+        std::cerr << "heic_decode_ffi: failed to read HEIC from memory: "
                   << err.message << std::endl;
         heif_context_free(ctx);
         return QImage();
@@ -284,17 +294,30 @@ QImage heic_to_image_ffi(const uint8_t *input_data, size_t len)
     heif_image_handle *handle;
     err = heif_context_get_primary_image_handle(ctx, &handle);
     if (err.code != heif_error_Ok) {
-        std::cerr << "heic_to_image_ffi: failed to get primary image handle: "
+        std::cerr << "heic_decode_ffi: failed to get primary image handle: "
                   << err.message << std::endl;
         heif_context_free(ctx);
         return QImage();
     }
 
+    if (exif) {
+        heif_item_id exif_id;
+        if (heif_image_handle_get_list_of_metadata_block_IDs(handle, "Exif",
+                                                             &exif_id, 1) > 0) {
+            exif->resize(static_cast<qsizetype>(
+                heif_image_handle_get_metadata_size(handle, exif_id)));
+            err = heif_image_handle_get_metadata(handle, exif_id, exif->data());
+            if (err.code != heif_error_Ok) {
+                exif->clear();
+            }
+        }
+    }
+
     heif_image *img;
     err = heif_decode_image(handle, &img, heif_colorspace_RGB,
                             heif_chroma_interleaved_RGB, nullptr);
     if (err.code != heif_error_Ok) {
-        std::cerr << "heic_to_image_ffi: failed to decode HEIC image: "
+        std::cerr << "heic_decode_ffi: failed to decode HEIC image: "
                   << err.message << std::endl;
         heif_image_handle_release(handle);
         heif_context_free(ctx);
@@ -312,7 +335,7 @@ QImage heic_to_image_ffi(const uint8_t *input_data, size_t len)
         heif_image_get_plane_readonly(img, heif_channel_interleaved, &stride);
 
     if (!data) {
-        std::cerr << "heic_to_image_ffi: failed to get image plane data"
+        std::cerr << "heic_decode_ffi: failed to get image plane data"
                   << std::endl;
         heif_image_release(img);
         heif_image_handle_release(handle);
@@ -1,4 +1,5 @@
 #pragma once
+#include <QByteArray>
 #include <QImage>
 #include <cstddef>
 #include <cstdint>
@@ -18,6 +19,8 @@ QImage generate_thumbnail_with_reader_ffi(const void *reader_ptr,
 
 QImage heic_to_image_ffi(const uint8_t *data, size_t len);
 
+QImage heic_decode_ffi(const uint8_t *data, size_t len, QByteArray *exif);
+
 #ifdef __cplusplus
 }
 #endif
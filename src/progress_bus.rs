@@ -0,0 +1,434 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Shared, rate-limited progress reporting for long-running jobs.
+//!
+//! Transfers produce a progress update per chunk, thousands a second on a
+//! fast link. Producers only store their latest numbers here. A ticker
+//! publishes every job that changed at most once per `PUBLISH_INTERVAL`,
+//! computing throughput and ETA once, as one batch for the `progressBus`
+//! model plus one call to the publisher a producer subscribed, if any.
+
+use crate::{
+    RUNTIME,
+    list_model::ListModel,
+    qt_threading::{QtThread, QtThreading},
+};
+use macros::QtThreading;
+use once_cell::sync::{Lazy, OnceCell};
+use qmetaobject::SimpleListItem;
+use qmetaobject::prelude::*;
+use std::cell::RefCell;
+use std::collections::HashMap;
+use std::sync::atomic::{AtomicU64, Ordering};
+use std::sync::{Arc, Mutex, Once};
+use std::time::{Duration, Instant};
+
+pub const PUBLISH_INTERVAL: Duration = Duration::from_millis(100);
+/// Weight of the newest throughput sample.
+const RATE_SMOOTHING: f64 = 0.3;
+
+pub type Publisher = Arc<dyn Fn(&ProgressSnapshot) + Send + Sync>;
+
+#[derive(Clone, Debug, PartialEq)]
+pub struct ProgressSnapshot {
+    pub job_id: String,
+    pub current_item: String,
+    pub done: u64,
+    pub total: u64,
+    pub bytes_per_second: f64,
+    /// Negative while unknown.
+    pub eta_seconds: f64,
+}
+
+impl ProgressSnapshot {
+    /// `done / total` in 0..=1, or 0 while the total is unknown.
+    pub fn fraction(&self) -> f64 {
+        if self.total == 0 {
+            return 0.0;
+        }
+        (self.done as f64 / self.total as f64).clamp(0.0, 1.0)
+    }
+}
+
+struct JobProgress {
+    current_item: String,
+    done: u64,
+    total: u64,
+    dirty: bool,
+    finished: bool,
+    bytes_per_second: f64,
+    sampled_at: Option<(Instant, u64)>,
+    publisher: Option<Publisher>,
+}
+
+#[derive(Default)]
+struct Registry {
+    jobs: HashMap<String, JobProgress>,
+}
+
+/// What one tick publishes.
+#[derive(Default)]
+struct Batch {
+    updates: Vec<(ProgressSnapshot, Option<Publisher>)>,
+    finished: Vec<String>,
+}
+
+static REGISTRY: Lazy<Mutex<Registry>> = Lazy::new(|| Mutex::new(Registry::default()));
+static BUS_QT_THREAD: OnceCell<QtThread<ProgressBus>> = OnceCell::new();
+static TICKER: Once = Once::new();
+static NEXT_JOB: AtomicU64 = AtomicU64::new(0);
+
+impl JobProgress {
+    fn new() -> Self {
+        Self {
+            current_item: String::new(),
+            done: 0,
+            total: 0,
+            dirty: false,
+            finished: false,
+            bytes_per_second: 0.0,
+            sampled_at: None,
+            publisher: None,
+        }
+    }
+
+    fn snapshot(&mut self, job_id: &str, now: Instant) -> ProgressSnapshot {
+        match self.sampled_at {
+            Some((at, done)) if self.done >= done => {
+                let elapsed = now.saturating_duration_since(at).as_secs_f64();
+                if elapsed > 0.0 {
+                    let sample = (self.done - done) as f64 / elapsed;
+                    self.bytes_per_second = if self.bytes_per_second == 0.0 {
+                        sample
+                    } else {
+                        self.bytes_per_second + RATE_SMOOTHING * (sample - self.bytes_per_second)
+                    };
+                    self.sampled_at = Some((now, self.done));
+                }
+            }
+            // First report, or the job went backwards (a retried file).
+            _ => self.sampled_at = Some((now, self.done)),
+        }
+
+        let eta_seconds = if self.total > 0 && self.done >= self.total {
+            0.0
+        } else if self.total > 0 && self.bytes_per_second > 0.0 {
+            (self.total - self.done) as f64 / self.bytes_per_second
+        } else {
+            -1.0
+        };
+        ProgressSnapshot {
+            job_id: job_id.to_string(),
+            current_item: self.current_item.clone(),
+            done: self.done,
+            total: self.total,
+            bytes_per_second: self.bytes_per_second,
+            eta_seconds,
+        }
+    }
+}
+
+impl Registry {
+    fn job(&mut self, job_id: &str) -> &mut JobProgress {
+        if !self.jobs.contains_key(job_id) {
+            self.jobs.insert(job_id.to_string(), JobProgress::new());
+        }
+        self.jobs.get_mut(job_id).expect("job inserted above")
+    }
+
+    fn report(&mut self, job_id: &str, current_item: &str, done: u64, total: u64) {
+        let job = self.job(job_id);
+        if job.current_item != current_item {
+            job.current_item = current_item.to_string();
+        }
+        job.done = done;
+        job.total = total;
+        job.dirty = true;
+    }
+
+    /// Re-subscribing revives a job id whose previous owner just finished.
+    fn subscribe(&mut self, job_id: &str, publisher: Publisher) {
+        let job = self.job(job_id);
+        job.publisher = Some(publisher);
+        job.finished = false;
+    }
+
+    fn finish(&mut self, job_id: &str) {
+        if let Some(job) = self.jobs.get_mut(job_id) {
+            job.finished = true;
+        }
+    }
+
+    /// Snapshots every job that changed since the last drain, and removes
+    /// finished jobs after their final snapshot.
+    fn drain(&mut self, now: Instant) -> Batch {
+        let mut batch = Batch::default();
+        self.jobs.retain(|job_id, job| {
+            if job.dirty {
+                job.dirty = false;
+                batch
+                    .updates
+                    .push((job.snapshot(job_id, now), job.publisher.clone()));
+            }
+            if job.finished {
+                batch.finished.push(job_id.clone());
+            }
+            !job.finished
+        });
+        batch
+    }
+}
+
+fn registry() -> std::sync::MutexGuard<'static, Registry> {
+    REGISTRY.lock().expect("progress bus mutex poisoned")
+}
+
+/// Calls `publisher` with each published snapshot of `job_id`, from the
+/// ticker task. Publishers typically queue one update onto their Qt object.
+pub fn subscribe(job_id: &str, publisher: impl Fn(&ProgressSnapshot) + Send + Sync + 'static) {
+    registry().subscribe(job_id, Arc::new(publisher));
+    start_ticker();
+}
+
+/// Records the latest progress of `job_id`. Cheap enough to call per chunk.
+pub fn report(job_id: &str, current_item: &str, done: u64, total: u64) {
+    registry().report(job_id, current_item, done, total);
+    start_ticker();
+}
+
+/// Publishes the last report of `job_id`, then forgets the job.
+pub fn finish(job_id: &str) {
+    registry().finish(job_id);
+}
+
+/// A subscribed job that finishes when dropped, so an aborted task cannot
+/// leave it behind. Clones of an owner should share it through an `Arc`.
+pub struct ProgressJob {
+    job_id: String,
+}
+
+impl ProgressJob {
+    /// Starts a job with a fresh id of the form `{kind}:{n}`, so two
+    /// operations on the same device or file never share an entry.
+    pub fn new(kind: &str, publisher: impl Fn(&ProgressSnapshot) + Send + Sync + 'static) -> Self {
+        let job_id = format!("{kind}:{}", NEXT_JOB.fetch_add(1, Ordering::Relaxed));
+        subscribe(&job_id, publisher);
+        Self { job_id }
+    }
+
+    pub fn report(&self, current_item: &str, done: u64, total: u64) {
+        report(&self.job_id, current_item, done, total);
+    }
+}
+
+impl Drop for ProgressJob {
+    fn drop(&mut self) {
+        finish(&self.job_id);
+    }
+}
+
+fn start_ticker() {
+    TICKER.call_once(|| {
+        RUNTIME.spawn(async {
+            let mut interval = tokio::time::interval(PUBLISH_INTERVAL);
+            interval.set_missed_tick_behavior(tokio::time::MissedTickBehavior::Skip);
+            loop {
+                interval.tick().await;
+                let batch = registry().drain(Instant::now());
+                if !batch.updates.is_empty() || !batch.finished.is_empty() {
+                    publish(batch);
+                }
+            }
+        });
+    });
+}
+
+fn publish(batch: Batch) {
+    let mut snapshots = Vec::with_capacity(batch.updates.len());
+    for (snapshot, publisher) in batch.updates {
+        if let Some(publisher) = publisher {
+            publisher(&snapshot);
+        }
+        snapshots.push(snapshot);
+    }
+
+    if let Some(qt_thread) = BUS_QT_THREAD.get() {
+        let finished = batch.finished;
+        qt_thread.queue(move |bus| bus.apply(snapshots, finished));
+    }
+}
+
+#[derive(SimpleListItem, Default, Clone)]
+struct ProgressItem {
+    pub job_id: QString,
+    pub current_item: QString,
+    pub transferred: i64,
+    pub total: i64,
+    pub bytes_per_second: f64,
+    pub eta_seconds: f64,
+}
+
+/// QML face of the bus: one row per running job, plus `jobProgress` for
+/// views that track their own job lists.
+#[allow(non_snake_case)]
+#[derive(QObject, Default, QtThreading)]
+pub struct ProgressBus {
+    base: qt_base_class!(trait QObject),
+    jobs: qt_property!(RefCell<ListModel<ProgressItem>>; NOTIFY jobsChanged),
+    init: qt_method!(fn(&self)),
+    jobsChanged: qt_signal!(),
+    jobProgress: qt_signal!(
+        job_id: QString,
+        current_item: QString,
+        transferred: i64,
+        total: i64,
+        bytes_per_second: f64,
+        eta_seconds: f64
+    ),
+}
+
+impl ProgressBus {
+    fn init(&self) {
+        BUS_QT_THREAD.get_or_init(|| self.qt_thread());
+        start_ticker();
+    }
+
+    fn apply(&mut self, snapshots: Vec<ProgressSnapshot>, finished: Vec<String>) {
+        for snapshot in snapshots {
+            let item = ProgressItem {
+                job_id: QString::from(snapshot.job_id.as_str()),
+                current_item: QString::from(snapshot.current_item.as_str()),
+                transferred: snapshot.done as i64,
+                total: snapshot.total as i64,
+                bytes_per_second: snapshot.bytes_per_second,
+                eta_seconds: snapshot.eta_seconds,
+            };
+            let row = self
+                .jobs
+                .borrow()
+                .iter()
+                .position(|row| row.job_id == item.job_id);
+            match row {
+                Some(row) => self.jobs.borrow_mut().change_line(row, item.clone()),
+                None => self.jobs.borrow_mut().push(item.clone()),
+            }
+            self.jobProgress(
+                item.job_id,
+                item.current_item,
+                item.transferred,
+                item.total,
+                item.bytes_per_second,
+                item.eta_seconds,
+            );
+        }
+
+        for job_id in finished {
+            let job_id = QString::from(job_id);
+            let row = self
+                .jobs
+                .borrow()
+                .iter()
+                .position(|row| row.job_id == job_id);
+            if let Some(row) = row {
+                self.jobs.borrow_mut().remove(row);
+            }
+        }
+    }
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    #[test]
+    fn drain_publishes_only_changed_jobs_with_the_latest_numbers() {
+        let mut registry = Registry::default();
+        let now = Instant::now();
+        for done in (0..=1000).step_by(10) {
+            registry.report("a", "IMG_0001.HEIC", done, 1000);
+        }
+        registry.report("b", "clip.mov", 5, 10);
+
+        let batch = registry.drain(now);
+        assert_eq!(batch.updates.len(), 2);
+        let a = batch
+            .updates
+            .iter()
+            .find(|(snapshot, _)| snapshot.job_id == "a")
+            .expect("a published");
+        assert_eq!((a.0.done, a.0.total), (1000, 1000));
+        assert_eq!(a.0.eta_seconds, 0.0);
+
+        registry.report("b", "clip.mov", 6, 10);
+        let batch = registry.drain(now + PUBLISH_INTERVAL);
+        assert_eq!(batch.updates.len(), 1);
+        assert_eq!(batch.updates[0].0.job_id, "b");
+    }
+
+    #[test]
+    fn throughput_and_eta_are_smoothed() {
+        let mut registry = Registry::default();
+        let start = Instant::now();
+        registry.report("job", "", 0, 10_000);
+        registry.drain(start);
+
+        registry.report("job", "", 1_000, 10_000);
+        let first = registry.drain(start + Duration::from_secs(1)).updates[0]
+            .0
+            .clone();
+        assert_eq!(first.bytes_per_second, 1_000.0);
+        assert_eq!(first.eta_seconds, 9.0);
+
+        // A burst moves the estimate only part of the way.
+        registry.report("job", "", 4_000, 10_000);
+        let second = registry.drain(start + Duration::from_secs(2)).updates[0]
+            .0
+            .clone();
+        assert!((second.bytes_per_second - 1_600.0).abs() < 1e-9);
+        assert!((second.eta_seconds - 6_000.0 / 1_600.0).abs() < 1e-9);
+    }
+
+    #[test]
+    fn interleaved_items_report_steady_job_totals() {
+        // Two workers copy 1000-byte files under one job, 100 bytes a chunk,
+        // adding to a shared job counter the way the export engine does.
+        let mut registry = Registry::default();
+        let start = Instant::now();
+        let job_done = AtomicU64::new(0);
+        let mut snapshots = Vec::new();
+        for step in 1..=10_u64 {
+            for name in ["a.mov", "b.mov"] {
+                let done = job_done.fetch_add(100, Ordering::SeqCst) + 100;
+                registry.report("job", name, done, 2_000);
+            }
+            let batch = registry.drain(start + Duration::from_secs(step));
+            snapshots.push(batch.updates[0].0.clone());
+        }
+
+        assert!(snapshots.windows(2).all(|pair| pair[0].done < pair[1].done));
+        let last = snapshots.last().expect("published");
+        assert_eq!((last.done, last.total), (2_000, 2_000));
+        // Not reset by either item, so the rate holds at the job's 200 B/s.
+        assert!(
+            snapshots[1..]
+                .iter()
+                .all(|snapshot| (snapshot.bytes_per_second - 200.0).abs() < 1e-9)
+        );
+        assert!((snapshots[4].eta_seconds - 5.0).abs() < 1e-9);
+    }
+
+    #[test]
+    fn finished_jobs_flush_once_and_are_removed() {
+        let mut registry = Registry::default();
+        let now = Instant::now();
+        registry.report("job", "a", 3, 3);
+        registry.finish("job");
+
+        let batch = registry.drain(now);
+        assert_eq!(batch.updates.len(), 1);
+        assert_eq!(batch.finished, ["job"]);
+        assert!(registry.jobs.is_empty());
+        assert!(registry.drain(now).updates.is_empty());
+    }
+}
@@ -9,6 +9,7 @@ use crate::{RUNTIME, device_ctx};
 
 use crate::utils::{empty_qjsvalue, engine_ptr_new_object, vend_app_documents};
 
+use crate::afc_pool::AfcSource;
 use crate::{afc_services::AfcServices, qt_threading::QtThreading, run_sync};
 use idevice::IdeviceService;
 use idevice::afc::AfcClient;
@@ -76,11 +77,7 @@ impl ServiceFactory {
                     }
                 };
 
-                if afc2 {
-                    device.afc2.clone().or(None)
-                } else {
-                    Some(device.afc.clone())
-                }
+                device.afc_source(afc2)
             }
         });
 
@@ -145,7 +142,7 @@ impl ServiceFactory {
                     }
 
                     let object = AfcServices::from_afc_client(
-                        Arc::new(Mutex::new(afc)),
+                        AfcSource::Shared(Arc::new(Mutex::new(afc))),
                         udid.to_string(),
                         Some(bundle_id.to_string()),
                     );
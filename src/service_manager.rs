@@ -2,8 +2,9 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
 use crate::device_ctx::DeviceServices;
+use crate::ipa_staging;
+use crate::progress_bus::ProgressJob;
 use crate::{RUNTIME, qt_threading::QtThreading, run_sync, utils};
-use idevice::afc::opcode::AfcFopenMode;
 use idevice::services::core_device_proxy::CoreDeviceProxy;
 use idevice::{
     IdeviceService, RsdService, amfi,
@@ -22,7 +23,9 @@ use qttypes::{QStringList, QVariantMap};
 use ::log::error;
 use plist_macro::plist;
 use serde_json;
+use std::path::PathBuf;
 use std::sync::Arc;
+use std::sync::atomic::AtomicBool;
 use std::{io::Read, time::Duration};
 use tokio::sync::Mutex;
 
@@ -682,106 +685,87 @@ impl ServiceManager {
     fn install_ipa(&self, local_ipa_path: QString) {
         let udid = self.udid.clone();
         let qt_t = self.qt_thread();
-        let local_ipa_path_owned = local_ipa_path.clone().to_string();
-        // FIXME: this is a bit hacky
-        let ipa_path_on_device = format!(
-            "/PublicStaging/{}",
-            local_ipa_path
-                .to_string()
-                .split('/')
-                .last()
-                .unwrap_or("app.ipa")
-        );
-        let cloned = self.device.as_ref().unwrap().clone();
-        let afc_guard = cloned.afc;
-        let provider_guard = cloned.provider;
+        let local_ipa_path = PathBuf::from(local_ipa_path.to_string());
+        let file_name = local_ipa_path
+            .file_name()
+            .and_then(|name| name.to_str())
+            .unwrap_or("app.ipa")
+            .to_string();
+        let ipa_path_on_device = ipa_staging::staging_path(&file_name);
+        let device = self.device.as_ref().unwrap().clone();
 
         RUNTIME.spawn(async move {
             let qt_thread = qt_t.clone();
 
-            let mut ins_client = match {
-
-                let mut afc = afc_guard.lock().await;
-
-                // Create the staging directory
-                match utils::ensure_public_staging(&mut afc).await {
-                    Ok(_) => (),
-                    Err(e) => {
-                        eprintln!("install_ipa: Failed to ensure /PublicStaging directory exists on device {udid}: {e}");
-                        qt_thread.queue(move |t| {
-                            t.installIpaInit(false, QString::from("Failed to prepare device for IPA upload"));
-                        });
-                        return;
-                    }
-                };
-
-                match std::fs::exists(&local_ipa_path_owned)  {
-                    Ok(true) => (),
-                    Ok(false) => {
-                        eprintln!("install_ipa: IPA file not found at path {local_ipa_path_owned}");
-                        qt_thread.queue(move |t| {
-                            t.installIpaInit(false, QString::from("IPA file not found"));
-                        });
-                        return;
-                    }
-                    Err(e) => {
-                        eprintln!("install_ipa: Failed to check if IPA file exists at path {local_ipa_path_owned}: {e}");
-                        qt_thread.queue(move |t| {
-                            t.installIpaInit(false, QString::from("Failed to access IPA file"));
-                        });
-                        return;
-                    }
+            let size = match tokio::fs::metadata(&local_ipa_path).await {
+                Ok(metadata) => metadata.len(),
+                Err(e) if e.kind() == std::io::ErrorKind::NotFound => {
+                    eprintln!(
+                        "install_ipa: IPA file not found at path {}",
+                        local_ipa_path.display()
+                    );
+                    qt_thread.queue(move |t| {
+                        t.installIpaInit(false, QString::from("IPA file not found"));
+                    });
+                    return;
                 }
+                Err(e) => {
+                    eprintln!(
+                        "install_ipa: Failed to access IPA file at path {}: {e}",
+                        local_ipa_path.display()
+                    );
+                    qt_thread.queue(move |t| {
+                        t.installIpaInit(false, QString::from("Failed to access IPA file"));
+                    });
+                    return;
+                }
+            };
 
-
-
-                match afc.open(&ipa_path_on_device, AfcFopenMode::WrOnly).await {
-                    Ok(mut fd) => {
-                        let mut local_file = match std::fs::File::open(&local_ipa_path_owned) {
-                            Ok(f) => f,
-                            Err(e) => {
-                                eprintln!("install_ipa: Failed to open local IPA file for device {udid}: {e}");
-                                qt_thread.queue(move |t| {
-                                    t.installIpaInit(false, QString::from("Failed to open local IPA file"));
-                                });
-                                return;
-                            }
-                        };
-
-                        let mut file_btytes = Vec::new();
-                        match local_file.read_to_end(&mut file_btytes) {
-                            Ok(bytes) => bytes,
-                            Err(e) => {
-                                eprintln!("install_ipa: Failed to read local IPA file for device {udid}: {e}");
-                                qt_thread.queue(move |t| {
-                                    t.installIpaInit(false, QString::from("Failed to read local IPA file"));
-                                });
-                                return;
-                            }
-                        };
-
-                        if let Err(e) = fd.write_entire(&file_btytes).await {
-                            eprintln!("install_ipa: Failed to upload IPA to device {udid}: {e}");
-                            qt_thread.queue(move |t| {
-                                t.installIpaInit(false, QString::from("Failed to upload IPA to device"));
-                            });
-                            return;
-                        }
-                    }
-                    Err(e) => {
-                        eprintln!("install_ipa: Failed to create file on device {udid} for IPA upload: {e}");
-                        qt_thread.queue(move |t| {
-                            t.installIpaInit(false, QString::from("Failed to create file on device for IPA upload"));
-                        });
-                        return;
-                    }
+            let upload_thread = qt_thread.clone();
+            let progress = ProgressJob::new("ipa-upload", move |snapshot| {
+                let progress = snapshot.fraction();
+                upload_thread.queue(move |t| {
+                    t.installIpaProgress(progress, QString::from("Uploading IPA"));
+                });
+            });
+            let staged: anyhow::Result<bool> = async {
+                let mut afc = device.afc_pool.lease().await?;
+                let result = ipa_staging::stage_file(
+                    &mut afc,
+                    &local_ipa_path,
+                    &ipa_path_on_device,
+                    &AtomicBool::new(false),
+                    |bytes| progress.report(&file_name, bytes, size),
+                )
+                .await;
+                if result.is_err() {
+                    afc.mark_broken();
                 }
+                result
+            }
+            .await;
+            drop(progress);
 
+            match staged {
+                Ok(true) => log::info!("install_ipa: Uploaded {ipa_path_on_device} to device {udid}"),
+                Ok(false) => log::info!(
+                    "install_ipa: {ipa_path_on_device} is already staged on device {udid}, skipping upload"
+                ),
+                Err(e) => {
+                    eprintln!("install_ipa: Failed to upload IPA to device {udid}: {e:#}");
+                    qt_thread.queue(move |t| {
+                        t.installIpaInit(false, QString::from("Failed to upload IPA to device"));
+                    });
+                    return;
+                }
+            }
 
-                let provider_guard = provider_guard.lock().await;
-                let provider_ref: &dyn IdeviceProvider = provider_guard.as_ref();
+            let connected = {
+                let provider = device.provider.lock().await;
+                let provider_ref: &dyn IdeviceProvider = provider.as_ref();
                 InstallationProxyClient::connect(provider_ref).await
-            } {
+            };
+            let mut ins_client = match connected {
                 Ok(c) => c,
                 Err(e) => {
                     eprintln!("install_ipa: Failed to connect to InstallationProxy service for device {udid}: {e}");
@@ -1,6 +1,7 @@
 // SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
+use crate::heic_transcode::TranscodeFormat;
 use cpp::cpp;
 use qmetaobject::prelude::*;
 use qttypes::{QStringList, QVariantList};
@@ -207,6 +208,10 @@ pub struct SettingsManager {
     set_upgrade_to_wireless_on_disconnect: qt_method!(fn(&self, enabled: bool)),
     unmount_ifuse_on_exit: qt_method!(fn(&self) -> bool),
     set_unmount_ifuse_on_exit: qt_method!(fn(&self, enabled: bool)),
+    dedupe_exports: qt_method!(fn(&self) -> bool),
+    set_dedupe_exports: qt_method!(fn(&self, enabled: bool)),
+    heic_export_format: qt_method!(fn(&self) -> i32),
+    set_heic_export_format: qt_method!(fn(&self, format: i32)),
     gallery_backend: qt_method!(fn(&self) -> i32),
     set_gallery_backend: qt_method!(fn(&self, backend: i32)),
     theme: qt_method!(fn(&self) -> QString),
@@ -264,6 +269,16 @@ impl SettingsManager {
         read_bool("unmountiFuseOnExit", false)
     }
 
+    /// Read on the Qt thread when an export starts.
+    pub(crate) fn dedupe_exports_enabled() -> bool {
+        read_bool("dedupeExports", false)
+    }
+
+    /// Read on the Qt thread when an export starts; `None` keeps HEIC files.
+    pub(crate) fn heic_export_transcode() -> Option<TranscodeFormat> {
+        TranscodeFormat::from_i32(read_i32("heicExportFormat", 0))
+    }
+
     pub fn clear_all() {
         cpp!(unsafe [] {
             auto &settings = settings_manager_settings();
@@ -571,6 +586,22 @@ impl SettingsManager {
         write_bool("unmountiFuseOnExit", enabled);
     }
 
+    fn dedupe_exports(&self) -> bool {
+        Self::dedupe_exports_enabled()
+    }
+
+    fn set_dedupe_exports(&self, enabled: bool) {
+        write_bool("dedupeExports", enabled);
+    }
+
+    fn heic_export_format(&self) -> i32 {
+        read_i32("heicExportFormat", 0).clamp(0, 2)
+    }
+
+    fn set_heic_export_format(&self, format: i32) {
+        write_i32("heicExportFormat", format.clamp(0, 2));
+    }
+
     fn gallery_backend(&self) -> i32 {
         read_i32("galleryBackend", 1).clamp(0, 2)
     }
@@ -673,6 +704,8 @@ impl SettingsManager {
         self.set_auto_enable_wifi_connections(true);
         self.set_upgrade_to_wireless_on_disconnect(true);
         self.set_unmount_ifuse_on_exit(false);
+        self.set_dedupe_exports(false);
+        self.set_heic_export_format(0);
         self.set_gallery_backend(1);
         self.set_theme(QString::from("system"));
         self.set_window_effect(QString::from("normal"));
@@ -0,0 +1,229 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! What a mirror sync last copied into a destination folder.
+//!
+//! The manifest lives in the destination as `.idescriptor-sync.manifest`:
+//!
+//! ```text
+//! magic "IDSM" | version u32 | count u32
+//! offset table: count x u32, pointing into the record area
+//! records sorted by path: path_len u16 | path | size u64 | mtime i64
+//! ```
+//!
+//! All integers are little-endian. Lookups binary-search the offset table
+//! over the raw bytes, so a 30k-file manifest is usable straight after one
+//! read, without building a map.
+
+use std::collections::BTreeMap;
+use std::io;
+use std::path::Path;
+
+pub const MANIFEST_FILE_NAME: &str = ".idescriptor-sync.manifest";
+
+const MAGIC: &[u8; 4] = b"IDSM";
+const VERSION: u32 = 1;
+const HEADER_LEN: usize = 12;
+
+#[derive(Clone, Copy, Debug, PartialEq, Eq)]
+pub struct ManifestEntry {
+    pub size: u64,
+    pub mtime: i64,
+}
+
+/// A loaded manifest. Paths are `/`-separated and relative to the
+/// destination folder.
+#[derive(Debug, Default)]
+pub struct SyncManifest {
+    bytes: Vec<u8>,
+    count: usize,
+}
+
+impl SyncManifest {
+    /// Loads the manifest, or an empty one if the folder was never synced.
+    /// A corrupt manifest is also treated as empty, which only costs a full
+    /// re-copy.
+    pub async fn load(destination: &Path) -> io::Result<Self> {
+        match tokio::fs::read(destination.join(MANIFEST_FILE_NAME)).await {
+            Ok(bytes) => Ok(Self::parse(bytes).unwrap_or_default()),
+            Err(err) if err.kind() == io::ErrorKind::NotFound => Ok(Self::default()),
+            Err(err) => Err(err),
+        }
+    }
+
+    pub fn from_entries(entries: &BTreeMap<String, ManifestEntry>) -> Self {
+        Self::parse(encode(entries)).unwrap_or_default()
+    }
+
+    fn parse(bytes: Vec<u8>) -> Option<Self> {
+        if bytes.len() < HEADER_LEN || &bytes[..4] != MAGIC || read_u32(&bytes, 4)? != VERSION {
+            return None;
+        }
+        let count = read_u32(&bytes, 8)? as usize;
+        let manifest = Self { bytes, count };
+        // Validate every record once so lookups can index without checks.
+        for index in 0..count {
+            manifest.record(index)?;
+        }
+        Some(manifest)
+    }
+
+    pub fn len(&self) -> usize {
+        self.count
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.count == 0
+    }
+
+    pub fn get(&self, path: &str) -> Option<ManifestEntry> {
+        let (mut low, mut high) = (0, self.count);
+        while low < high {
+            let middle = (low + high) / 2;
+            let (candidate, entry) = self.record(middle)?;
+            match candidate.cmp(path.as_bytes()) {
+                std::cmp::Ordering::Less => low = middle + 1,
+                std::cmp::Ordering::Greater => high = middle,
+                std::cmp::Ordering::Equal => return Some(entry),
+            }
+        }
+        None
+    }
+
+    pub fn iter(&self) -> impl Iterator<Item = (&str, ManifestEntry)> {
+        (0..self.count).filter_map(|index| {
+            let (path, entry) = self.record(index)?;
+            Some((std::str::from_utf8(path).ok()?, entry))
+        })
+    }
+
+    fn record(&self, index: usize) -> Option<(&[u8], ManifestEntry)> {
+        let records_start = HEADER_LEN + self.count * 4;
+        let offset = records_start + read_u32(&self.bytes, HEADER_LEN + index * 4)? as usize;
+        let path_len = u16::from_le_bytes(self.bytes.get(offset..offset + 2)?.try_into().ok()?);
+        let path_start = offset + 2;
+        let path_end = path_start + path_len as usize;
+        let path = self.bytes.get(path_start..path_end)?;
+        let size = u64::from_le_bytes(self.bytes.get(path_end..path_end + 8)?.try_into().ok()?);
+        let mtime = i64::from_le_bytes(
+            self.bytes
+                .get(path_end + 8..path_end + 16)?
+                .try_into()
+                .ok()?,
+        );
+        Some((path, ManifestEntry { size, mtime }))
+    }
+}
+
+/// Serializes `entries` into the manifest format. Paths longer than a `u16`
+/// can describe are left out, so those files are simply copied every time.
+pub fn encode(entries: &BTreeMap<String, ManifestEntry>) -> Vec<u8> {
+    let entries: Vec<_> = entries
+        .iter()
+        .filter(|(path, _)| path.len() <= u16::MAX as usize)
+        .collect();
+
+    let mut offsets = Vec::with_capacity(entries.len() * 4);
+    let mut records = Vec::new();
+    for (path, entry) in &entries {
+        offsets.extend_from_slice(&(records.len() as u32).to_le_bytes());
+        records.extend_from_slice(&(path.len() as u16).to_le_bytes());
+        records.extend_from_slice(path.as_bytes());
+        records.extend_from_slice(&entry.size.to_le_bytes());
+        records.extend_from_slice(&entry.mtime.to_le_bytes());
+    }
+
+    let mut bytes = Vec::with_capacity(HEADER_LEN + offsets.len() + records.len());
+    bytes.extend_from_slice(MAGIC);
+    bytes.extend_from_slice(&VERSION.to_le_bytes());
+    bytes.extend_from_slice(&(entries.len() as u32).to_le_bytes());
+    bytes.extend_from_slice(&offsets);
+    bytes.extend_from_slice(&records);
+    bytes
+}
+
+/// Replaces the manifest atomically, so an interrupted write leaves the
+/// previous one in place.
+pub async fn store(
+    destination: &Path,
+    entries: &BTreeMap<String, ManifestEntry>,
+) -> io::Result<()> {
+    let path = destination.join(MANIFEST_FILE_NAME);
+    let temp = destination.join(format!("{MANIFEST_FILE_NAME}.tmp"));
+    tokio::fs::write(&temp, encode(entries)).await?;
+    tokio::fs::rename(&temp, &path).await
+}
+
+fn read_u32(bytes: &[u8], offset: usize) -> Option<u32> {
+    Some(u32::from_le_bytes(
+        bytes.get(offset..offset + 4)?.try_into().ok()?,
+    ))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn entries() -> BTreeMap<String, ManifestEntry> {
+        (0..1000)
+            .map(|index| {
+                (
+                    format!("DCIM/{:03}APPLE/IMG_{index:04}.HEIC", 100 + index / 300),
+                    ManifestEntry {
+                        size: index as u64 * 1000,
+                        mtime: 1_700_000_000 + index as i64,
+                    },
+                )
+            })
+            .collect()
+    }
+
+    #[test]
+    fn encoded_manifest_supports_lookup_and_iteration() {
+        let entries = entries();
+        let manifest = SyncManifest::parse(encode(&entries)).expect("valid manifest");
+
+        assert_eq!(manifest.len(), entries.len());
+        for (path, entry) in &entries {
+            assert_eq!(manifest.get(path), Some(*entry));
+        }
+        assert_eq!(manifest.get("DCIM/100APPLE/IMG_9999.HEIC"), None);
+        assert!(
+            manifest
+                .iter()
+                .map(|(path, _)| path.to_string())
+                .eq(entries.keys().cloned())
+        );
+    }
+
+    #[test]
+    fn rejects_corrupt_manifests() {
+        let mut bytes = encode(&entries());
+        assert!(SyncManifest::parse(bytes[..bytes.len() - 3].to_vec()).is_none());
+        bytes[0] = b'X';
+        assert!(SyncManifest::parse(bytes).is_none());
+        assert!(
+            SyncManifest::parse(encode(&BTreeMap::new()))
+                .expect("empty manifest")
+                .is_empty()
+        );
+    }
+
+    #[tokio::test]
+    async fn store_and_load_round_trip() {
+        let dir = std::env::temp_dir().join(format!("idescriptor-sync-{}", uuid::Uuid::new_v4()));
+        tokio::fs::create_dir_all(&dir).await.expect("temp dir");
+        assert!(
+            SyncManifest::load(&dir)
+                .await
+                .expect("missing is empty")
+                .is_empty()
+        );
+
+        let entries = entries();
+        store(&dir, &entries).await.expect("stored");
+        let manifest = SyncManifest::load(&dir).await.expect("loaded");
+        assert_eq!(manifest.len(), entries.len());
+        let _ = tokio::fs::remove_dir_all(&dir).await;
+    }
+}
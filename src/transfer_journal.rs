@@ -0,0 +1,414 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Append-only checkpoint journal for IOManager jobs.
+//!
+//! A job that is cancelled or loses the device leaves its journal behind.
+//! Running the same request again (same device, sources and destination)
+//! reopens it, so finished files are skipped after checking size and mtime,
+//! partial files continue from their last checkpoint, and items keep the
+//! output paths they were given the first time instead of getting
+//! `name (1).ext` duplicates (converted files likewise keep the name their
+//! first conversion picked). The journal is deleted once a job completes
+//! without failures.
+//!
+//! Each line is one tab-separated entry. A torn last line from a crash simply
+//! fails to parse and is ignored.
+
+use log::warn;
+use std::collections::{HashMap, HashSet};
+use std::fs::{self, File, OpenOptions};
+use std::io::{self, BufRead, BufReader, Write};
+use std::path::{Path, PathBuf};
+use std::sync::Mutex;
+
+/// Bytes copied between two `Partial` checkpoints of one file.
+pub const CHECKPOINT_BYTES: u64 = 8 * 1024 * 1024;
+
+#[derive(Clone, Debug, PartialEq, Eq)]
+pub enum JournalEntry {
+    /// The output path chosen for request item `index`.
+    Output { index: usize, path: String },
+    /// The output path chosen for device path `source`, for jobs whose
+    /// items have no fixed position.
+    SourceOutput { source: String, path: String },
+    /// Size and mtime of a source file when copying it started.
+    Source { path: String, size: u64, mtime: i64 },
+    /// The first `offset` bytes of `path` are written.
+    Partial { path: String, offset: u64 },
+    /// The range starting at `offset` of `path` is written.
+    Range { path: String, offset: u64 },
+    /// `path` is complete and matched this size and mtime.
+    Done { path: String, size: u64, mtime: i64 },
+    /// `path` is converted into `output`, which replaces it once the
+    /// following `Done` for `path` is recorded.
+    Converted { path: String, output: String },
+}
+
+/// What an earlier run of the same job got through.
+#[derive(Debug, Default)]
+pub struct JournalState {
+    outputs: HashMap<usize, String>,
+    source_outputs: HashMap<String, String>,
+    sources: HashMap<String, (u64, i64)>,
+    partial: HashMap<String, u64>,
+    ranges: HashMap<String, HashSet<u64>>,
+    done: HashMap<String, (u64, i64)>,
+    converted: HashMap<String, String>,
+}
+
+pub struct TransferJournal {
+    path: PathBuf,
+    file: Mutex<File>,
+    state: JournalState,
+}
+
+/// Stable key for a job request. FNV-1a rather than `DefaultHasher`, whose
+/// output may change between Rust releases and orphan existing journals.
+pub fn journal_key<'a>(parts: impl IntoIterator<Item = &'a str>) -> String {
+    let mut hash = 0xcbf2_9ce4_8422_2325_u64;
+    for part in parts {
+        for byte in part.bytes().chain(std::iter::once(0)) {
+            hash ^= byte as u64;
+            hash = hash.wrapping_mul(0x0000_0100_0000_01b3);
+        }
+    }
+    format!("{hash:016x}")
+}
+
+impl JournalState {
+    fn apply(&mut self, entry: JournalEntry) {
+        match entry {
+            JournalEntry::Output { index, path } => {
+                self.outputs.insert(index, path);
+            }
+            JournalEntry::SourceOutput { source, path } => {
+                self.source_outputs.insert(source, path);
+            }
+            JournalEntry::Source { path, size, mtime } => {
+                // A changed source invalidates whatever was copied of it.
+                if self.sources.insert(path.clone(), (size, mtime)) != Some((size, mtime)) {
+                    self.partial.remove(&path);
+                    self.ranges.remove(&path);
+                    self.done.remove(&path);
+                }
+            }
+            JournalEntry::Partial { path, offset } => {
+                let current = self.partial.entry(path).or_default();
+                *current = (*current).max(offset);
+            }
+            JournalEntry::Range { path, offset } => {
+                self.ranges.entry(path).or_default().insert(offset);
+            }
+            JournalEntry::Done { path, size, mtime } => {
+                self.partial.remove(&path);
+                self.ranges.remove(&path);
+                self.done.insert(path, (size, mtime));
+            }
+            // Kept across source changes, so a redone conversion reuses the
+            // name instead of picking a new one.
+            JournalEntry::Converted { path, output } => {
+                self.converted.insert(path, output);
+            }
+        }
+    }
+
+    pub fn output(&self, index: usize) -> Option<&str> {
+        self.outputs.get(&index).map(String::as_str)
+    }
+
+    pub fn source_output(&self, source: &str) -> Option<&str> {
+        self.source_outputs.get(source).map(String::as_str)
+    }
+
+    /// Whether `path` was finished from a source of this size and mtime.
+    pub fn is_done(&self, path: &str, size: u64, mtime: i64) -> bool {
+        self.done.get(path) == Some(&(size, mtime))
+    }
+
+    /// The file `path` was converted into, if a conversion started.
+    pub fn converted(&self, path: &str) -> Option<&str> {
+        self.converted.get(path).map(String::as_str)
+    }
+
+    /// Checkpointed prefix of `path`, if its source is unchanged.
+    pub fn partial_offset(&self, path: &str, size: u64, mtime: i64) -> u64 {
+        if self.sources.get(path) != Some(&(size, mtime)) {
+            return 0;
+        }
+        self.partial.get(path).copied().unwrap_or(0).min(size)
+    }
+
+    /// Finished ranges of `path`, if its source is unchanged.
+    pub fn finished_ranges(&self, path: &str, size: u64, mtime: i64) -> HashSet<u64> {
+        if self.sources.get(path) != Some(&(size, mtime)) {
+            return HashSet::new();
+        }
+        self.ranges.get(path).cloned().unwrap_or_default()
+    }
+}
+
+impl TransferJournal {
+    /// Opens the journal at `path`, replaying whatever an earlier run wrote.
+    pub fn open(path: PathBuf) -> io::Result<Self> {
+        let mut state = JournalState::default();
+        match File::open(&path) {
+            Ok(existing) => {
+                for line in BufReader::new(existing).lines() {
+                    match parse_line(&line?) {
+                        Some(entry) => state.apply(entry),
+                        None => warn!("Ignoring malformed journal line in {}", path.display()),
+                    }
+                }
+            }
+            Err(err) if err.kind() == io::ErrorKind::NotFound => {}
+            Err(err) => return Err(err),
+        }
+
+        let file = OpenOptions::new().create(true).append(true).open(&path)?;
+        Ok(Self {
+            path,
+            file: Mutex::new(file),
+            state,
+        })
+    }
+
+    pub fn path(&self) -> &Path {
+        &self.path
+    }
+
+    /// State as of opening. Entries recorded by this run are not reflected.
+    pub fn resumed(&self) -> &JournalState {
+        &self.state
+    }
+
+    pub fn is_empty(&self) -> bool {
+        self.state.outputs.is_empty()
+            && self.state.source_outputs.is_empty()
+            && self.state.sources.is_empty()
+    }
+
+    /// Appends one entry. Failing to checkpoint only costs resumability, so
+    /// errors are logged rather than failing the transfer.
+    pub fn record(&self, entry: JournalEntry) {
+        let line = format_entry(&entry);
+        let mut file = self.file.lock().expect("journal mutex poisoned");
+        if let Err(err) = file.write_all(line.as_bytes()) {
+            warn!("Failed to write journal {}: {err}", self.path.display());
+        }
+    }
+
+    /// Deletes the journal after a job that needs no resuming.
+    pub fn remove(self) {
+        drop(self.file);
+        if let Err(err) = fs::remove_file(&self.path) {
+            warn!("Failed to remove journal {}: {err}", self.path.display());
+        }
+    }
+}
+
+fn escape(value: &str) -> String {
+    value
+        .replace('\\', "\\\\")
+        .replace('\t', "\\t")
+        .replace('\n', "\\n")
+}
+
+fn unescape(value: &str) -> String {
+    let mut out = String::with_capacity(value.len());
+    let mut chars = value.chars();
+    while let Some(ch) = chars.next() {
+        if ch != '\\' {
+            out.push(ch);
+            continue;
+        }
+        match chars.next() {
+            Some('t') => out.push('\t'),
+            Some('n') => out.push('\n'),
+            Some(other) => out.push(other),
+            None => out.push('\\'),
+        }
+    }
+    out
+}
+
+fn format_entry(entry: &JournalEntry) -> String {
+    match entry {
+        JournalEntry::Output { index, path } => format!("O\t{index}\t{}\n", escape(path)),
+        JournalEntry::SourceOutput { source, path } => {
+            format!("N\t{}\t{}\n", escape(source), escape(path))
+        }
+        JournalEntry::Source { path, size, mtime } => {
+            format!("S\t{}\t{size}\t{mtime}\n", escape(path))
+        }
+        JournalEntry::Partial { path, offset } => format!("P\t{}\t{offset}\n", escape(path)),
+        JournalEntry::Range { path, offset } => format!("R\t{}\t{offset}\n", escape(path)),
+        JournalEntry::Done { path, size, mtime } => {
+            format!("D\t{}\t{size}\t{mtime}\n", escape(path))
+        }
+        JournalEntry::Converted { path, output } => {
+            format!("C\t{}\t{}\n", escape(path), escape(output))
+        }
+    }
+}
+
+fn parse_line(line: &str) -> Option<JournalEntry> {
+    let fields: Vec<&str> = line.split('\t').collect();
+    let entry = match fields.as_slice() {
+        ["O", index, path] => JournalEntry::Output {
+            index: index.parse().ok()?,
+            path: unescape(path),
+        },
+        ["N", source, path] => JournalEntry::SourceOutput {
+            source: unescape(source),
+            path: unescape(path),
+        },
+        ["S", path, size, mtime] => JournalEntry::Source {
+            path: unescape(path),
+            size: size.parse().ok()?,
+            mtime: mtime.parse().ok()?,
+        },
+        ["P", path, offset] => JournalEntry::Partial {
+            path: unescape(path),
+            offset: offset.parse().ok()?,
+        },
+        ["R", path, offset] => JournalEntry::Range {
+            path: unescape(path),
+            offset: offset.parse().ok()?,
+        },
+        ["D", path, size, mtime] => JournalEntry::Done {
+            path: unescape(path),
+            size: size.parse().ok()?,
+            mtime: mtime.parse().ok()?,
+        },
+        ["C", path, output] => JournalEntry::Converted {
+            path: unescape(path),
+            output: unescape(output),
+        },
+        _ => return None,
+    };
+    Some(entry)
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+
+    fn temp_journal() -> PathBuf {
+        std::env::temp_dir().join(format!("idescriptor-journal-{}", uuid::Uuid::new_v4()))
+    }
+
+    #[test]
+    fn entries_round_trip_including_awkward_paths() {
+        let entries = [
+            JournalEntry::Output {
+                index: 3,
+                path: "/tmp/out\tdir\\IMG 1.HEIC".to_string(),
+            },
+            JournalEntry::SourceOutput {
+                source: "/DCIM/100APPLE/IMG_0001.HEIC".to_string(),
+                path: "/tmp/out/IMG_0001 (1).HEIC".to_string(),
+            },
+            JournalEntry::Source {
+                path: "a\nb".to_string(),
+                size: 10,
+                mtime: -5,
+            },
+            JournalEntry::Partial {
+                path: "a".to_string(),
+                offset: 8,
+            },
+            JournalEntry::Range {
+                path: "a".to_string(),
+                offset: 16,
+            },
+            JournalEntry::Done {
+                path: "a".to_string(),
+                size: 10,
+                mtime: 7,
+            },
+            JournalEntry::Converted {
+                path: "/out/IMG_0001.HEIC".to_string(),
+                output: "/out/IMG_0001.JPG".to_string(),
+            },
+        ];
+        for entry in entries {
+            let line = format_entry(&entry);
+            assert_eq!(parse_line(line.trim_end_matches('\n')), Some(entry));
+        }
+        assert_eq!(parse_line("D\tpath\t12"), None);
+    }
+
+    #[test]
+    fn reopening_resumes_recorded_progress() {
+        let path = temp_journal();
+        let journal = TransferJournal::open(path.clone()).expect("journal opens");
+        assert!(journal.is_empty());
+        journal.record(JournalEntry::Output {
+            index: 0,
+            path: "/out/a.mov".to_string(),
+        });
+        journal.record(JournalEntry::SourceOutput {
+            source: "/DCIM/100APPLE/IMG_0002.JPG".to_string(),
+            path: "/out/b.jpg".to_string(),
+        });
+        journal.record(JournalEntry::Source {
+            path: "/out/a.mov".to_string(),
+            size: 100,
+            mtime: 42,
+        });
+        journal.record(JournalEntry::Partial {
+            path: "/out/a.mov".to_string(),
+            offset: 64,
+        });
+        journal.record(JournalEntry::Done {
+            path: "/out/b.jpg".to_string(),
+            size: 5,
+            mtime: 1,
+        });
+        drop(journal);
+
+        let journal = TransferJournal::open(path).expect("journal reopens");
+        let state = journal.resumed();
+        assert_eq!(state.output(0), Some("/out/a.mov"));
+        assert_eq!(
+            state.source_output("/DCIM/100APPLE/IMG_0002.JPG"),
+            Some("/out/b.jpg")
+        );
+        assert_eq!(state.partial_offset("/out/a.mov", 100, 42), 64);
+        assert_eq!(state.partial_offset("/out/a.mov", 100, 43), 0);
+        assert!(state.is_done("/out/b.jpg", 5, 1));
+        assert!(!state.is_done("/out/b.jpg", 6, 1));
+        journal.remove();
+    }
+
+    #[test]
+    fn changed_source_discards_earlier_progress() {
+        let mut state = JournalState::default();
+        let path = "/out/clip.mov".to_string();
+        state.apply(JournalEntry::Source {
+            path: path.clone(),
+            size: 100,
+            mtime: 1,
+        });
+        state.apply(JournalEntry::Range {
+            path: path.clone(),
+            offset: 0,
+        });
+        assert_eq!(state.finished_ranges(&path, 100, 1).len(), 1);
+
+        state.apply(JournalEntry::Source {
+            path: path.clone(),
+            size: 200,
+            mtime: 2,
+        });
+        assert!(state.finished_ranges(&path, 200, 2).is_empty());
+    }
+
+    #[test]
+    fn journal_keys_are_stable_and_separate_parts() {
+        assert_eq!(journal_key(["a", "b"]), journal_key(["a", "b"]));
+        assert_ne!(journal_key(["ab", ""]), journal_key(["a", "b"]));
+        assert_eq!(journal_key([]).len(), 16);
+    }
+}
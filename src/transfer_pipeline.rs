@@ -0,0 +1,509 @@
+// SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
+// SPDX-License-Identifier: AGPL-3.0-or-later
+
+//! Overlapped read/write copy for AFC transfers.
+//!
+//! A plain read-then-write loop pays device latency and local disk latency
+//! back to back. Here the reader keeps issuing AFC reads into recycled
+//! buffers while the writer drains completed ones, so the two overlap. The
+//! number of buffers in flight starts at two and grows (up to four) while
+//! writes are measured to be slower than reads.
+//!
+//! A copy can also hand every written chunk to a `ChunkObserver` (such as a
+//! content hasher) on a blocking thread. Buffers go back to the reader only
+//! after the observer is done with them, so observing adds no copies and
+//! runs alongside the next read and write.
+
+use crate::buffer_pool::{self, PooledBuffer};
+use std::io;
+use std::sync::atomic::{AtomicBool, AtomicU64, AtomicUsize, Ordering};
+use std::time::{Duration, Instant};
+use tokio::io::{AsyncRead, AsyncReadExt, AsyncWrite, AsyncWriteExt};
+use tokio::sync::mpsc;
+
+const MIN_DEPTH: usize = 2;
+const MAX_DEPTH: usize = 4;
+const PROGRESS_INTERVAL: Duration = Duration::from_millis(100);
+
+#[derive(Debug)]
+pub enum PipelineError {
+    Read(io::Error),
+    Write(io::Error),
+}
+
+#[derive(Clone, Copy, Debug, Default, PartialEq, Eq)]
+pub struct PipelineStats {
+    pub bytes: u64,
+    pub max_depth: usize,
+    pub read_latency: Duration,
+    pub write_latency: Duration,
+}
+
+#[derive(Default)]
+struct Latency {
+    read_us: AtomicU64,
+    write_us: AtomicU64,
+    depth: AtomicUsize,
+}
+
+impl Latency {
+    fn record(average_us: &AtomicU64, elapsed: Duration) {
+        let sample = elapsed.as_micros().min(u64::MAX as u128) as u64;
+        let current = average_us.load(Ordering::Relaxed);
+        // Each average has a single writer, so a plain load/store is enough.
+        let next = if current == 0 {
+            sample
+        } else {
+            (current * 3 + sample) / 4
+        };
+        average_us.store(next.max(1), Ordering::Relaxed);
+    }
+
+    fn target_depth(&self) -> usize {
+        pipeline_depth(
+            self.read_us.load(Ordering::Relaxed),
+            self.write_us.load(Ordering::Relaxed),
+        )
+    }
+}
+
+/// Enough buffers that the reader never waits behind the writer: one being
+/// filled, plus as many reads as complete during a single write.
+fn pipeline_depth(read_us: u64, write_us: u64) -> usize {
+    if read_us == 0 || write_us == 0 {
+        return MIN_DEPTH;
+    }
+    (1 + write_us.div_ceil(read_us) as usize).clamp(MIN_DEPTH, MAX_DEPTH)
+}
+
+/// Sees every chunk a copy writes, in order.
+pub trait ChunkObserver: Send + 'static {
+    fn observe(&mut self, chunk: &[u8]);
+}
+
+impl ChunkObserver for () {
+    fn observe(&mut self, _chunk: &[u8]) {}
+}
+
+/// Copies `reader` into `writer` in `chunk_size` reads until EOF, `limit`
+/// bytes, or cancellation, overlapping reads with writes. `on_progress` gets
+/// the running byte count at most every `PROGRESS_INTERVAL` and once at the
+/// end. Callers check `cancel_flag` themselves to tell a cancelled copy from
+/// a finished one.
+pub async fn copy<R, W, F>(
+    reader: &mut R,
+    writer: &mut W,
+    chunk_size: usize,
+    limit: Option<u64>,
+    cancel_flag: &AtomicBool,
+    on_progress: F,
+) -> Result<PipelineStats, PipelineError>
+where
+    R: AsyncRead + Unpin,
+    W: AsyncWrite + Unpin,
+    F: FnMut(u64),
+{
+    copy_observed::<_, _, _, ()>(
+        reader,
+        writer,
+        chunk_size,
+        limit,
+        cancel_flag,
+        on_progress,
+        None,
+    )
+    .await
+    .map(|(stats, _)| stats)
+}
+
+/// Like `copy`, also feeding each written chunk to `observer` on a blocking
+/// thread. The observer is handed back once it has seen the last chunk.
+pub async fn copy_observed<R, W, F, O>(
+    reader: &mut R,
+    writer: &mut W,
+    chunk_size: usize,
+    limit: Option<u64>,
+    cancel_flag: &AtomicBool,
+    mut on_progress: F,
+    observer: Option<O>,
+) -> Result<(PipelineStats, Option<O>), PipelineError>
+where
+    R: AsyncRead + Unpin,
+    W: AsyncWrite + Unpin,
+    F: FnMut(u64),
+    O: ChunkObserver,
+{
+    let chunk_size = chunk_size.max(1);
+    let (filled_tx, mut filled_rx) = mpsc::channel::<PooledBuffer>(MAX_DEPTH);
+    let (free_tx, mut free_rx) = mpsc::channel::<PooledBuffer>(MAX_DEPTH);
+    let latency = Latency::default();
+    let (observed_tx, observing) = match observer {
+        Some(mut observer) => {
+            let (observed_tx, mut observed_rx) = mpsc::channel::<PooledBuffer>(MAX_DEPTH);
+            let free_tx = free_tx.clone();
+            let observing = tokio::task::spawn_blocking(move || {
+                while let Some(buffer) = observed_rx.blocking_recv() {
+                    observer.observe(&buffer);
+                    let _ = free_tx.try_send(buffer);
+                }
+                observer
+            });
+            (Some(observed_tx), Some(observing))
+        }
+        None => (None, None),
+    };
+
+    let read_side = async {
+        let filled_tx = filled_tx;
+        let mut allocated = 0_usize;
+        let mut remaining = limit;
+
+        loop {
+            if cancel_flag.load(Ordering::Relaxed) {
+                return Ok(());
+            }
+            let want = remaining.map_or(chunk_size, |left| left.min(chunk_size as u64) as usize);
+            if want == 0 {
+                return Ok(());
+            }
+
+            let mut buffer = match free_rx.try_recv() {
+                Ok(buffer) => buffer,
+                Err(_) if allocated < latency.target_depth() => {
+                    allocated += 1;
+                    latency.depth.fetch_max(allocated, Ordering::Relaxed);
+                    buffer_pool::take(chunk_size)
+                }
+                Err(_) => match free_rx.recv().await {
+                    Some(buffer) => buffer,
+                    // The writer stopped; its result carries the reason.
+                    None => return Ok(()),
+                },
+            };
+            buffer.grow_to(chunk_size);
+
+            let started = Instant::now();
+            let read = reader
+                .read(&mut buffer[..want])
+                .await
+                .map_err(PipelineError::Read)?;
+            Latency::record(&latency.read_us, started.elapsed());
+            if read == 0 {
+                return Ok(());
+            }
+
+            buffer.truncate(read);
+            if filled_tx.send(buffer).await.is_err() {
+                return Ok(());
+            }
+            if let Some(left) = remaining.as_mut() {
+                *left -= read as u64;
+            }
+        }
+    };
+
+    let write_side = async {
+        let free_tx = free_tx;
+        let observed_tx = observed_tx;
+        let mut written = 0_u64;
+        let mut last_progress = Instant::now();
+
+        while let Some(buffer) = filled_rx.recv().await {
+            let started = Instant::now();
+            writer
+                .write_all(&buffer)
+                .await
+                .map_err(PipelineError::Write)?;
+            Latency::record(&latency.write_us, started.elapsed());
+            written += buffer.len() as u64;
+
+            if last_progress.elapsed() >= PROGRESS_INTERVAL {
+                on_progress(written);
+                last_progress = Instant::now();
+            }
+            // Capacity covers every buffer the reader can allocate.
+            match &observed_tx {
+                Some(observed_tx) => {
+                    if observed_tx.send(buffer).await.is_err() {
+                        return Err(PipelineError::Write(io::Error::other(
+                            "Chunk observer stopped",
+                        )));
+                    }
+                }
+                None => {
+                    let _ = free_tx.try_send(buffer);
+                }
+            }
+        }
+        drop(observed_tx);
+
+        writer.flush().await.map_err(PipelineError::Write)?;
+        on_progress(written);
+        Ok(written)
+    };
+
+    let (read_result, write_result) = tokio::join!(read_side, write_side);
+    let observer = match observing {
+        Some(observing) => Some(
+            observing
+                .await
+                .map_err(|err| PipelineError::Write(io::Error::other(err)))?,
+        ),
+        None => None,
+    };
+    read_result?;
+    let bytes = write_result?;
+
+    let stats = PipelineStats {
+        bytes,
+        max_depth: latency.depth.load(Ordering::Relaxed),
+        read_latency: Duration::from_micros(latency.read_us.load(Ordering::Relaxed)),
+        write_latency: Duration::from_micros(latency.write_us.load(Ordering::Relaxed)),
+    };
+    Ok((stats, observer))
+}
+
+#[cfg(test)]
+mod tests {
+    use super::*;
+    use std::pin::Pin;
+    use std::sync::Arc;
+    use std::task::{Context, Poll};
+
+    /// Reads and writes in progress in the stand-ins below, and whether one
+    /// ever started while the other was running.
+    #[derive(Default)]
+    struct Activity {
+        reads: AtomicUsize,
+        writes: AtomicUsize,
+        overlapped: AtomicBool,
+    }
+
+    impl Activity {
+        fn begin(&self, mine: &AtomicUsize, other: &AtomicUsize) {
+            mine.fetch_add(1, Ordering::SeqCst);
+            if other.load(Ordering::SeqCst) > 0 {
+                self.overlapped.store(true, Ordering::SeqCst);
+            }
+        }
+    }
+
+    /// Reader whose every read takes `delay`, like an AFC round trip.
+    struct SlowReader {
+        data: Vec<u8>,
+        position: usize,
+        delay: Duration,
+        sleep: Option<Pin<Box<tokio::time::Sleep>>>,
+        activity: Arc<Activity>,
+    }
+
+    impl AsyncRead for SlowReader {
+        fn poll_read(
+            mut self: Pin<&mut Self>,
+            cx: &mut Context<'_>,
+            buf: &mut tokio::io::ReadBuf<'_>,
+        ) -> Poll<io::Result<()>> {
+            if self.sleep.is_none() {
+                self.activity
+                    .begin(&self.activity.reads, &self.activity.writes);
+                self.sleep = Some(Box::pin(tokio::time::sleep(self.delay)));
+            }
+            if let Some(sleep) = self.sleep.as_mut()
+                && sleep.as_mut().poll(cx).is_pending()
+            {
+                return Poll::Pending;
+            }
+            self.sleep = None;
+            self.activity.reads.fetch_sub(1, Ordering::SeqCst);
+
+            let end = (self.position + buf.remaining()).min(self.data.len());
+            buf.put_slice(&self.data[self.position..end]);
+            self.position = end;
+            Poll::Ready(Ok(()))
+        }
+    }
+
+    /// Writer whose every write takes `delay`, like a slow local disk.
+    struct SlowWriter {
+        data: Vec<u8>,
+        delay: Duration,
+        sleep: Option<Pin<Box<tokio::time::Sleep>>>,
+        activity: Arc<Activity>,
+    }
+
+    impl AsyncWrite for SlowWriter {
+        fn poll_write(
+            mut self: Pin<&mut Self>,
+            cx: &mut Context<'_>,
+            buf: &[u8],
+        ) -> Poll<io::Result<usize>> {
+            if self.sleep.is_none() {
+                self.activity
+                    .begin(&self.activity.writes, &self.activity.reads);
+                self.sleep = Some(Box::pin(tokio::time::sleep(self.delay)));
+            }
+            if let Some(sleep) = self.sleep.as_mut()
+                && sleep.as_mut().poll(cx).is_pending()
+            {
+                return Poll::Pending;
+            }
+            self.sleep = None;
+            self.activity.writes.fetch_sub(1, Ordering::SeqCst);
+            self.data.extend_from_slice(buf);
+            Poll::Ready(Ok(buf.len()))
+        }
+
+        fn poll_flush(self: Pin<&mut Self>, _cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+            Poll::Ready(Ok(()))
+        }
+
+        fn poll_shutdown(self: Pin<&mut Self>, _cx: &mut Context<'_>) -> Poll<io::Result<()>> {
+            Poll::Ready(Ok(()))
+        }
+    }
+
+    fn payload(len: usize) -> Vec<u8> {
+        (0..len).map(|index| (index % 251) as u8).collect()
+    }
+
+    #[test]
+    fn depth_tracks_write_to_read_latency() {
+        assert_eq!(pipeline_depth(0, 0), MIN_DEPTH);
+        assert_eq!(pipeline_depth(1_000, 200), MIN_DEPTH);
+        assert_eq!(pipeline_depth(1_000, 1_500), 3);
+        assert_eq!(pipeline_depth(1_000, 50_000), MAX_DEPTH);
+    }
+
+    #[tokio::test]
+    async fn copies_everything_and_reports_final_progress() {
+        let data = payload(1_000_000);
+        let mut reader = &data[..];
+        let mut output = Vec::new();
+        let mut last_progress = 0;
+
+        let stats = copy(
+            &mut reader,
+            &mut output,
+            64 * 1024,
+            None,
+            &AtomicBool::new(false),
+            |bytes| last_progress = bytes,
+        )
+        .await
+        .expect("copy succeeds");
+
+        assert_eq!(output, data);
+        assert_eq!(stats.bytes, data.len() as u64);
+        assert_eq!(last_progress, data.len() as u64);
+        assert!((1..=MAX_DEPTH).contains(&stats.max_depth));
+    }
+
+    #[tokio::test]
+    async fn observer_sees_every_written_chunk_in_order() {
+        #[derive(Default)]
+        struct Collect(Vec<u8>);
+
+        impl ChunkObserver for Collect {
+            fn observe(&mut self, chunk: &[u8]) {
+                self.0.extend_from_slice(chunk);
+            }
+        }
+
+        let data = payload(500_000);
+        let mut reader = &data[..];
+        let mut output = Vec::new();
+
+        let (stats, observer) = copy_observed(
+            &mut reader,
+            &mut output,
+            16 * 1024,
+            None,
+            &AtomicBool::new(false),
+            |_| {},
+            Some(Collect::default()),
+        )
+        .await
+        .expect("copy succeeds");
+
+        assert_eq!(stats.bytes, data.len() as u64);
+        assert_eq!(output, data);
+        assert_eq!(observer.expect("observer handed back").0, data);
+    }
+
+    #[tokio::test]
+    async fn stops_at_the_byte_limit() {
+        let data = payload(300_000);
+        let mut reader = &data[..];
+        let mut output = Vec::new();
+
+        let stats = copy(
+            &mut reader,
+            &mut output,
+            64 * 1024,
+            Some(100_000),
+            &AtomicBool::new(false),
+            |_| {},
+        )
+        .await
+        .expect("copy succeeds");
+
+        assert_eq!(stats.bytes, 100_000);
+        assert_eq!(output, data[..100_000]);
+    }
+
+    #[tokio::test]
+    async fn cancelled_copy_writes_nothing() {
+        let data = payload(10_000);
+        let mut reader = &data[..];
+        let mut output = Vec::new();
+
+        let stats = copy(
+            &mut reader,
+            &mut output,
+            1024,
+            None,
+            &AtomicBool::new(true),
+            |_| {},
+        )
+        .await
+        .expect("cancellation is not an error");
+
+        assert_eq!(stats.bytes, 0);
+        assert!(output.is_empty());
+    }
+
+    #[tokio::test]
+    async fn overlaps_reads_with_writes() {
+        const CHUNKS: usize = 8;
+        let data = payload(CHUNKS * 1024);
+        let activity = Arc::new(Activity::default());
+        let mut reader = SlowReader {
+            data: data.clone(),
+            position: 0,
+            delay: Duration::from_millis(2),
+            sleep: None,
+            activity: activity.clone(),
+        };
+        let mut writer = SlowWriter {
+            data: Vec::new(),
+            delay: Duration::from_millis(2),
+            sleep: None,
+            activity: activity.clone(),
+        };
+
+        copy(
+            &mut reader,
+            &mut writer,
+            1024,
+            None,
+            &AtomicBool::new(false),
+            |_| {},
+        )
+        .await
+        .expect("copy succeeds");
+
+        assert_eq!(writer.data, data);
+        // A read-then-write loop never has both in progress at once.
+        assert!(activity.overlapped.load(Ordering::SeqCst));
+    }
+}
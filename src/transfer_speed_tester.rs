@@ -2,6 +2,7 @@
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
 use crate::qt_threading::{QtThread, QtThreading};
+use crate::transfer_pipeline::{self, PipelineError};
 use crate::utils::{PUBLIC_STAGING, ensure_public_staging};
 use crate::{RUNTIME, qvariantmap_insert};
 use anyhow::{Context, anyhow};
@@ -13,7 +14,7 @@ use qttypes::QVariantMap;
 use std::sync::Arc;
 use std::sync::atomic::{AtomicBool, Ordering};
 use std::time::{Duration, Instant};
-use tokio::io::{AsyncReadExt, AsyncWriteExt};
+use tokio::io::AsyncWriteExt;
 use tokio::sync::Mutex;
 use uuid::Uuid;
 
@@ -423,10 +424,8 @@ async fn transfer_download(
         .open(remote_path, AfcFopenMode::RdOnly)
         .await
         .context("failed to open speed-test payload for download")?;
-    let mut buffer = vec![0_u8; CHUNK_SIZE];
     let started = Instant::now();
     let mut transferred = 0_u64;
-    let mut last_update = Instant::now();
     let mut failure = None;
 
     emit_progress(
@@ -439,41 +438,51 @@ async fn transfer_download(
         upload_duration.as_secs_f64(),
     );
 
-    while transferred < total_bytes {
-        if cancel_flag.load(Ordering::Relaxed) {
-            failure = Some(RunFailure::Cancelled);
-            break;
-        }
+    // Downloads go through the same overlapped pipeline as exports, with a
+    // sink standing in for the local file, so this measures what exports get.
+    let mut last_update = Instant::now();
+    let copied = transfer_pipeline::copy(
+        &mut remote,
+        &mut tokio::io::sink(),
+        CHUNK_SIZE,
+        Some(total_bytes),
+        cancel_flag,
+        |bytes| {
+            if last_update.elapsed() >= UPDATE_INTERVAL || bytes == total_bytes {
+                emit_progress(
+                    qt_thread,
+                    Phase::Download,
+                    bytes,
+                    total_bytes,
+                    started.elapsed(),
+                    throughput_mibps(total_bytes, upload_duration),
+                    upload_duration.as_secs_f64(),
+                );
+                last_update = Instant::now();
+            }
+        },
+    )
+    .await;
 
-        let remaining = (total_bytes - transferred) as usize;
-        let read_len = remaining.min(buffer.len());
-        match remote.read(&mut buffer[..read_len]).await {
-            Ok(0) => {
+    match copied {
+        Ok(_) if cancel_flag.load(Ordering::Relaxed) => failure = Some(RunFailure::Cancelled),
+        Ok(stats) => {
+            transferred = stats.bytes;
+            debug!(
+                "TransferSpeedTester: download pipeline depth={} read_ms={:.2}",
+                stats.max_depth,
+                stats.read_latency.as_secs_f64() * 1000.0
+            );
+            if transferred < total_bytes {
                 failure = Some(RunFailure::Error(anyhow!(
                     "download ended early after {transferred} of {total_bytes} bytes"
                 )));
-                break;
-            }
-            Ok(read) => transferred += read as u64,
-            Err(err) => {
-                failure = Some(RunFailure::Error(
-                    anyhow!(err).context("AFC download failed"),
-                ));
-                break;
             }
         }
-
-        if last_update.elapsed() >= UPDATE_INTERVAL || transferred == total_bytes {
-            emit_progress(
-                qt_thread,
-                Phase::Download,
-                transferred,
-                total_bytes,
-                started.elapsed(),
-                throughput_mibps(total_bytes, upload_duration),
-                upload_duration.as_secs_f64(),
-            );
-            last_update = Instant::now();
+        Err(PipelineError::Read(err) | PipelineError::Write(err)) => {
+            failure = Some(RunFailure::Error(
+                anyhow!(err).context("AFC download failed"),
+            ));
         }
     }
 
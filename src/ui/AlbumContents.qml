@@ -22,8 +22,15 @@ Item {
     property var pendingExportPaths: []
     property string pendingExportTitle: ""
     property string errorMessage: ""
+    // Cursor of the page to fetch next; empty once the album is fully listed.
+    property string nextCursor: ""
+    property string requestedCursor: ""
+    property bool fetchingPage: false
+    property bool exportAllPending: false
     readonly property int preferredTileSize: 178
     readonly property int tileSpacing: 4
+    readonly property int thumbnailSize: Math.round(240 * Screen.devicePixelRatio)
+    readonly property int prefetchRows: 4
 
     signal goBack()
 
@@ -37,6 +44,36 @@ Item {
         errorMessage = ""
         albumContentsModel.clear()
         selectedFileCount = 0
+        nextCursor = ""
+        exportAllPending = false
+        requestPage("")
+    }
+
+    function requestPage(cursor) {
+        fetchingPage = true
+        requestedCursor = cursor
+        query.query_album_page(albumId, mediaFilter, mostRecentFirst, cursor)
+    }
+
+    // Asks for the next page once less than a screen of tiles is left below
+    // the viewport.
+    function fetchMoreIfNeeded() {
+        if (loading || fetchingPage || nextCursor.length === 0)
+            return
+
+        const remaining = gallery.contentHeight - (gallery.contentY - gallery.originY) - gallery.height
+        if (remaining < gallery.height)
+            requestPage(nextCursor)
+    }
+
+    function exportAll() {
+        if (nextCursor.length === 0) {
+            chooseExportDestination(currentFilePaths(), qsTr("Exporting Files"))
+            return
+        }
+
+        // Not every page is loaded yet; list the whole album first.
+        exportAllPending = true
         query.query_album(albumId, mediaFilter, mostRecentFirst)
     }
 
@@ -80,6 +117,33 @@ Item {
         return paths
     }
 
+    // Warms the thumbnail cache for the rows just past the viewport in the
+    // direction the user is scrolling, nearest rows first.
+    function prefetchThumbnails(scrollingDown) {
+        if (albumContentsModel.count === 0 || gallery.cellHeight <= 0)
+            return
+
+        const columns = gallery.columnCount
+        const firstRow = Math.max(0, Math.floor((gallery.contentY - gallery.originY) / gallery.cellHeight))
+        const visibleRows = Math.ceil(gallery.height / gallery.cellHeight) + 1
+        const paths = []
+
+        if (scrollingDown) {
+            const start = (firstRow + visibleRows) * columns
+            const end = Math.min(albumContentsModel.count, start + root.prefetchRows * columns)
+            for (let i = start; i < end; i++)
+                paths.push(albumContentsModel.get(i).filePath)
+        } else {
+            const end = Math.min(albumContentsModel.count, firstRow * columns)
+            const start = Math.max(0, end - root.prefetchRows * columns)
+            for (let i = end - 1; i >= start; i--)
+                paths.push(albumContentsModel.get(i).filePath)
+        }
+
+        if (paths.length > 0)
+            imageLoader.prefetch_thumbnails(root.udid, paths, false, root.thumbnailSize, root.thumbnailSize)
+    }
+
     function chooseExportDestination(paths, title) {
         if (!paths || paths.length === 0)
             return
@@ -116,9 +180,14 @@ Item {
         }
 
         function onAlbumQueried(id, mediaFilter, mostRecentFirst, items) {
-            if (id !== albumId || mediaFilter !== root.mediaFilter || mostRecentFirst !== root.mostRecentFirst || !items) return
-            albumContentsModel.clear()
-            root.selectedFileCount = 0
+            if (!root.exportAllPending || id !== albumId || mediaFilter !== root.mediaFilter || mostRecentFirst !== root.mostRecentFirst || !items) return
+            root.exportAllPending = false
+            root.chooseExportDestination(items, qsTr("Exporting Files"))
+        }
+
+        function onAlbumPageQueried(id, mediaFilter, mostRecentFirst, cursor, items, nextCursor) {
+            if (id !== albumId || mediaFilter !== root.mediaFilter || mostRecentFirst !== root.mostRecentFirst
+                    || cursor !== root.requestedCursor || !root.fetchingPage || !items) return
 
             for (const item of items) {
                 albumContentsModel.append({
@@ -129,14 +198,24 @@ Item {
                 })
             }
 
+            root.nextCursor = nextCursor
+            root.fetchingPage = false
             root.errorMessage = ""
-            root.loading = false
+            if (cursor.length === 0) {
+                root.loading = false
+                prefetchTimer.scrollingDown = true
+                prefetchTimer.restart()
+            }
+            // A short first page may not fill the view.
+            Qt.callLater(root.fetchMoreIfNeeded)
         }
 
         function onAlbumQueryFailed(id, mediaFilter, mostRecentFirst, error) {
             if (id !== albumId || mediaFilter !== root.mediaFilter || mostRecentFirst !== root.mostRecentFirst)
                 return
 
+            root.fetchingPage = false
+            root.exportAllPending = false
             root.loading = false
             root.errorMessage = error || qsTr("Failed to load the album contents.")
 
@@ -154,6 +233,13 @@ Item {
         }
     }
 
+    Timer {
+        id: prefetchTimer
+        property bool scrollingDown: true
+        interval: 150
+        onTriggered: root.prefetchThumbnails(scrollingDown)
+    }
+
     StateView {
         id: stateView
         anchors.fill: parent
@@ -223,8 +309,8 @@ Item {
 
                 Button {
                     text: qsTr("Export All")
-                    enabled: albumContentsModel.count > 0
-                    onClicked: root.chooseExportDestination(root.currentFilePaths(), qsTr("Exporting Files"))
+                    enabled: albumContentsModel.count > 0 && !root.exportAllPending
+                    onClicked: root.exportAll()
                 }
             }
 
@@ -247,6 +333,15 @@ Item {
                     cellHeight: tileSize + root.tileSpacing
                     clip: true
                     model: albumContentsModel
+                    property real lastContentY: 0
+                    onContentYChanged: {
+                        if (contentY !== lastContentY)
+                            prefetchTimer.scrollingDown = contentY > lastContentY
+                        lastContentY = contentY
+                        prefetchTimer.restart()
+                        root.fetchMoreIfNeeded()
+                    }
+                    onHeightChanged: root.fetchMoreIfNeeded()
                     ScrollBar.vertical: ScrollBar {
                         id: galleryScrollBar
                         policy: ScrollBar.AsNeeded
@@ -304,8 +399,8 @@ Item {
                                     + "&afc2=false&index=" + index
                                     + "&v=" + thumbVersion
                             fillMode: Image.PreserveAspectCrop
-                            sourceSize.width: 240 * Screen.devicePixelRatio
-                            sourceSize.height: 240 * Screen.devicePixelRatio
+                            sourceSize.width: root.thumbnailSize
+                            sourceSize.height: root.thumbnailSize
                         }
 
                         Rectangle {
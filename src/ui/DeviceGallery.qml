@@ -25,7 +25,6 @@ Item {
     property int selectedAlbumCount: 0
     property var albumExportSelection: []
     property var is_init: false
-    property var pendingAlbumExportRequests: ({})
 
     signal gallerySizeQueried(real size)
 
@@ -92,17 +91,37 @@ Item {
             const requestId = QmlUtils.generate_uuid()
             const albumName = album.fileName || qsTr("Album")
             const destinationDir = QmlUtils.join_path(destinationRoot, QmlUtils.safe_path_segment(albumName))
-            root.pendingAlbumExportRequests[requestId] = {
-                albumId: album.albumId,
-                albumName: albumName,
-                destinationDir: destinationDir
-            }
-            query.resolve_album_export(requestId, album.albumId, albumName)
+            if (album.itemCount === 0)
+                continue
+
+            // The gallery lists the album into a feed the export job copies
+            // from as pages arrive, instead of handing the whole list to QML.
+            query.feed_album_export(requestId, album.albumId)
+            App.StatusWindow.addProcess(
+                requestId,
+                qsTr("Exporting %1").arg(albumName),
+                "Export",
+                album.itemCount,
+                destinationDir
+            )
+            ioManager.start_feed_export(root.udid, requestId, "album/" + album.albumId, destinationDir)
         }
 
         root.albumExportSelection = []
     }
 
+    function startCameraRollSync(destinationDir, deleteMissing) {
+        const requestId = QmlUtils.generate_uuid()
+        App.StatusWindow.addProcess(
+            requestId,
+            qsTr("Syncing Camera Roll"),
+            "Export",
+            1,
+            destinationDir
+        )
+        ioManager.start_sync(root.udid, requestId, ["/DCIM"], destinationDir, deleteMissing)
+    }
+
     Connections {
         target: query
 
@@ -135,6 +154,18 @@ Item {
                     thumbVersion: 0
                 })
             })
+
+            // Album covers further down the list are not loaded until they
+            // scroll into view; warm them while the device is otherwise idle.
+            const previews = []
+            for (let i = 0; i < albumModel.count; i++) {
+                const path = albumModel.get(i).filePath
+                if (path)
+                    previews.push(path)
+            }
+            const thumbnailSize = Math.round(240 * Screen.devicePixelRatio)
+            if (previews.length > 0)
+                imageLoader.prefetch_thumbnails(root.udid, previews, false, thumbnailSize, thumbnailSize)
         }
 
         function onReloadFinished(success, revision, error) {
@@ -146,25 +177,6 @@ Item {
                 albumRemovedDialog.open()
             }
         }
-
-        function onAlbumExportResolved(requestId, albumId, albumName, items) {
-            const pending = root.pendingAlbumExportRequests[requestId]
-            if (!pending)
-                return
-
-            delete root.pendingAlbumExportRequests[requestId]
-            if (!items || items.length === 0)
-                return
-
-            App.StatusWindow.addProcess(
-                requestId,
-                qsTr("Exporting %1").arg(albumName),
-                "Export",
-                items.length,
-                pending.destinationDir
-            )
-            ioManager.start_export(root.udid, requestId, items, pending.destinationDir, false)
-        }
     }
 
     Connections {
@@ -275,6 +287,11 @@ Item {
 
                     Item { Layout.fillWidth: true }
 
+                    Button {
+                        text: qsTr("Sync Camera Roll")
+                        onClicked: cameraRollSyncDialog.open()
+                    }
+
                     Button {
                         text: qsTr("Export Selected")
                         enabled: root.selectedAlbumCount > 0
@@ -361,8 +378,8 @@ Item {
                                             + "&afc2=false&index=" + index
                                             + "&v=" + thumbVersion
                                     fillMode: Image.PreserveAspectCrop
-                                    sourceSize.width: 240 * Screen.devicePixelRatio
-                                    sourceSize.height: 240 * Screen.devicePixelRatio
+                                    sourceSize.width: Math.round(240 * Screen.devicePixelRatio)
+                                    sourceSize.height: Math.round(240 * Screen.devicePixelRatio)
                                 }
 
                                 Rectangle {
@@ -445,6 +462,83 @@ Item {
         onAccepted: root.startAlbumExports(QmlUtils.url_to_path(selectedFolder))
     }
 
+    FolderDialog {
+        id: cameraRollSyncDialog
+        title: qsTr("Choose Sync Folder")
+        onAccepted: {
+            cameraRollSyncOptionsDialog.destinationDir = QmlUtils.url_to_path(selectedFolder)
+            cameraRollSyncOptionsDialog.open()
+        }
+    }
+
+    AnimatedDialog {
+        id: cameraRollSyncOptionsDialog
+
+        property string destinationDir: ""
+
+        parent: Overlay.overlay
+        anchors.centerIn: parent
+        width: Math.min(480, parent ? parent.width - 40 : 480)
+        modal: true
+        focus: true
+        title: qsTr("Sync Camera Roll")
+        standardButtons: Dialog.NoButton
+        closePolicy: Popup.CloseOnEscape | Popup.CloseOnPressOutside
+        onAboutToShow: deleteMissingCheckBox.checked = false
+
+        contentItem: ColumnLayout {
+            spacing: 16
+
+            Label {
+                Layout.fillWidth: true
+                text: qsTr("Copy new and changed photos from the device to %1.")
+                    .arg(cameraRollSyncOptionsDialog.destinationDir)
+                color: App.Theme.text
+                wrapMode: Text.WordWrap
+                font.pixelSize: 14
+            }
+
+            CheckBox {
+                id: deleteMissingCheckBox
+
+                Layout.fillWidth: true
+                text: qsTr("Delete local files that are no longer on the device")
+            }
+
+            Label {
+                Layout.fillWidth: true
+                visible: deleteMissingCheckBox.checked
+                text: qsTr("Only files an earlier sync copied into this folder are deleted. This cannot be undone.")
+                color: App.Theme.dangerText
+                wrapMode: Text.WordWrap
+                font.pixelSize: 13
+            }
+
+            RowLayout {
+                Layout.fillWidth: true
+                spacing: 10
+
+                Item { Layout.fillWidth: true }
+
+                Button {
+                    text: qsTr("Cancel")
+                    onClicked: cameraRollSyncOptionsDialog.reject()
+                }
+
+                Button {
+                    text: qsTr("Sync")
+                    onClicked: {
+                        root.startCameraRollSync(
+                            cameraRollSyncOptionsDialog.destinationDir,
+                            deleteMissingCheckBox.checked
+                        )
+                        cameraRollSyncOptionsDialog.accept()
+                    }
+                }
+            }
+        }
+    }
+
     MessageDialog {
         id: albumRemovedDialog
         title: qsTr("Album unavailable")
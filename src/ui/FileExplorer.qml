@@ -26,6 +26,8 @@ Item {
     property bool loading: false
     property string errorMessage: ""
     property bool refreshAfterLoad: false
+    // Whether the listing in flight has already replaced the old entries.
+    property bool showingPartialListing: false
     property var pendingImportJobs: ({})
     property var pendingExternalOpenJobs: ({})
     property bool deleting: false
@@ -62,6 +64,7 @@ Item {
             return
         }
         setLoading(true)
+        showingPartialListing = false
         afcClient.check_is_dir_and_list(currentPath)
     }
 
@@ -74,6 +77,18 @@ Item {
         refresh()
     }
 
+    function entryItem(name, isDir) {
+        return {
+            "name": name,
+            "path": root.fullPath(name),
+            "isDir": isDir,
+            "selected": false,
+            "iconSource": isDir
+                ? "qrc:/resources/icons/material-symbols_folder.svg"
+                : "qrc:/resources/icons/ic_baseline-insert-drive-file.svg"
+        }
+    }
+
     function finishDirectoryLoad() {
         loading = false
 
@@ -450,7 +465,22 @@ Item {
         target: afcClient
         enabled: !!afcClient
 
+        // Large folders stream in unsorted; the finished signal re-sorts them.
+        function onCheck_is_dir_and_list_partial(path, entries) {
+            if (!root.loading || root.normalizePath(path) !== root.normalizePath(root.currentPath))
+                return
+
+            if (!root.showingPartialListing) {
+                root.showingPartialListing = true
+                selectionLayer.reset()
+                entriesModel.clear()
+            }
+            for (var name in entries)
+                entriesModel.append(root.entryItem(name, !!entries[name]))
+        }
+
         function onCheck_is_dir_and_list_finished(success, entries) {
+            root.showingPartialListing = false
             selectionLayer.reset()
             entriesModel.clear()
 
@@ -470,18 +500,8 @@ Item {
             var files = []
             for (var i = 0; i < names.length; i++) {
                 var name = names[i]
-                var isDir = !!entries[name]
-                var iconSource = isDir
-                    ? "qrc:/resources/icons/material-symbols_folder.svg"
-                    : "qrc:/resources/icons/ic_baseline-insert-drive-file.svg"
-                var item = {
-                    "name": name,
-                    "path": root.fullPath(name),
-                    "isDir": isDir,
-                    "selected": false,
-                    "iconSource": iconSource
-                }
-                if (isDir) dirs.push(item); else files.push(item)
+                var item = root.entryItem(name, !!entries[name])
+                if (item.isDir) dirs.push(item); else files.push(item)
             }
 
             for (var d = 0; d < dirs.length; d++) entriesModel.append(dirs[d])
@@ -36,6 +36,8 @@ DefaultWindow {
     property string backupRootPath: ""
     property int wireless_file_server_port: 8080
     property bool unmount_ifuse_on_exit: false
+    property bool dedupe_exports: false
+    property int heic_export_format: 0
     property bool auto_check_updates: true
     property bool z_linux_window: false
     property bool auto_enable_wifi_connections: true
@@ -121,6 +123,13 @@ DefaultWindow {
         return 1
     }
 
+    function normalizeHeicExportFormat(value) {
+        const parsedFormat = Number(value)
+        if (parsedFormat === 1 || parsedFormat === 2)
+            return parsedFormat
+        return 0
+    }
+
     function normalizeTheme(value) {
         return App.Theme.normalizeColorScheme(value)
     }
@@ -136,6 +145,8 @@ DefaultWindow {
         backupRootPath = backendValue("backup_root_path", "")
         wireless_file_server_port = backendValue("wireless_file_server_port", 8080)
         unmount_ifuse_on_exit = backendValue("unmount_ifuse_on_exit", false)
+        dedupe_exports = backendValue("dedupe_exports", false)
+        heic_export_format = normalizeHeicExportFormat(backendValue("heic_export_format", 0))
         auto_check_updates = backendValue("auto_check_updates", true)
         z_linux_window = backendValue("z_linux_window", false)
         auto_enable_wifi_connections = backendValue("auto_enable_wifi_connections", true)
@@ -165,6 +176,8 @@ DefaultWindow {
         callBackend("set_backup_root_path", backupRootPath)
         callBackend("set_wireless_file_server_port", wireless_file_server_port)
         callBackend("set_unmount_ifuse_on_exit", unmount_ifuse_on_exit)
+        callBackend("set_dedupe_exports", dedupe_exports)
+        callBackend("set_heic_export_format", heic_export_format)
         callBackend("set_auto_check_updates", auto_check_updates)
         callBackend("set_z_linux_window", z_linux_window)
         callBackend("set_auto_enable_wifi_connections", auto_enable_wifi_connections)
@@ -388,6 +401,44 @@ DefaultWindow {
                         }
                     }
 
+                    Switch {
+                        Layout.fillWidth: true
+                        text: qsTr("Link duplicate files when exporting")
+                        checked: root.dedupe_exports
+                        ToolTip.visible: hovered
+                        ToolTip.text: qsTr("Exports keep an index of file contents in the destination folder. Files already exported there, from any device, are hard-linked instead of copied again.")
+                        onToggled: {
+                            root.dedupe_exports = checked
+                            root.markDirty(false)
+                        }
+                    }
+
+                    RowLayout {
+                        Layout.fillWidth: true
+                        spacing: 10
+
+                        Label {
+                            text: qsTr("Export HEIC photos as")
+                            Layout.preferredWidth: 175
+                        }
+
+                        ComboBox {
+                            Layout.fillWidth: true
+                            model: [
+                                qsTr("HEIC (unchanged)"),
+                                qsTr("JPEG"),
+                                qsTr("PNG")
+                            ]
+                            currentIndex: root.normalizeHeicExportFormat(root.heic_export_format)
+                            ToolTip.visible: hovered
+                            ToolTip.text: qsTr("Convert HEIC photos while copying them to this computer. Sync exports always keep the original files.")
+                            onActivated: function(index) {
+                                root.heic_export_format = root.normalizeHeicExportFormat(index)
+                                root.markDirty(false)
+                            }
+                        }
+                    }
+
                     Switch {
                         Layout.fillWidth: true
                         text: qsTr("Automatically check for updates")
@@ -36,13 +36,23 @@ DefaultWindow {
     }
 
 
+    Component.onCompleted: {
+        if (progressBus)
+            progressBus.init()
+    }
+
     Connections {
-        target: ioManager
-        enabled: !!ioManager
+        target: progressBus
+        enabled: !!progressBus
 
-        function onFileTransferProgress(jobId, fileName, bytesTransferred, totalBytes) {
-            window.updateProgress(jobId, fileName, bytesTransferred, totalBytes)
+        function onJobProgress(jobId, currentItem, transferred, total, bytesPerSecond, etaSeconds) {
+            window.updateProgress(jobId, currentItem, transferred, total, bytesPerSecond, etaSeconds)
         }
+    }
+
+    Connections {
+        target: ioManager
+        enabled: !!ioManager
 
         function onExportItemFinished(jobId, fileName, destinationPath, success, bytesTransferred, errorMessage) {
             window.finishItem(jobId, success)
@@ -115,6 +125,8 @@ DefaultWindow {
                                 failedItems: model.failedItems
                                 destinationPath: model.destinationPath
                                 onComplete: model.onComplete
+                                bytesPerSecond: model.bytesPerSecond
+                                etaSeconds: model.etaSeconds
                                 processId: model.processId
                                 onRemoveRequested: (processId) => window.removeProcess(processId)
                             }
@@ -233,7 +245,9 @@ DefaultWindow {
             "completedItems": 0,
             "failedItems": 0,
             "destinationPath": destinationPath,
-            "onComplete": null
+            "onComplete": null,
+            "bytesPerSecond": 0,
+            "etaSeconds": -1
         })
         openAtRegisteredOpener()
     }
@@ -248,14 +262,17 @@ DefaultWindow {
             window.hide()
     }
 
-    function updateProgress(processId, fileName, transferredBytes, totalBytes) {
+    function updateProgress(processId, fileName, transferredBytes, totalBytes, bytesPerSecond, etaSeconds) {
         const index = findProcessIndex(processId)
-        if (index === -1)
+        // The bus may flush a last update after the job finished.
+        if (index === -1 || processesList.get(index).status !== "Running")
             return
 
         processesList.setProperty(index, "currentFile", fileName)
         processesList.setProperty(index, "transferredBytes", transferredBytes)
         processesList.setProperty(index, "totalBytes", totalBytes)
+        processesList.setProperty(index, "bytesPerSecond", bytesPerSecond)
+        processesList.setProperty(index, "etaSeconds", etaSeconds)
     }
 
     function finishItem(processId, success) {
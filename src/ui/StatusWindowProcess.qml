@@ -22,13 +22,12 @@ Rectangle {
     required property string type
     required property string destinationPath
     required property var onComplete
+    required property real bytesPerSecond
+    required property real etaSeconds
     signal removeRequested(string processId)
     property bool  onCompleteRan: false
 
     // Internal state
-    property int lastBytesTransferred: 0
-    property var lastUpdateTime: new Date()
-    property string lastSpeedText: ""
     property bool isHovered: false
     property bool isRemoveButtonHovered: false
     readonly property color mutedTextColor: "#aaa"
@@ -222,25 +221,11 @@ Rectangle {
             stats += " • " + qsTr("%1 failed").arg(root.failedItems)
         }
 
-        if (root.status === "Running" && root.transferredBytes > 0) {
-            var now = new Date()
-            var elapsed = root.lastUpdateTime ? (now - root.lastUpdateTime) : 0
-
-            if (!root.lastUpdateTime || elapsed >= 750) {
-                if (elapsed > 0) {
-                    var bytesDiff = root.transferredBytes - root.lastBytesTransferred
-                    var bytesPerSecond = (bytesDiff * 1000) / elapsed
-                    if (bytesPerSecond > 0) {
-                        root.lastSpeedText = " • " + formatTransferRate(bytesPerSecond)
-                    }
-                }
-                root.lastBytesTransferred = root.transferredBytes
-                root.lastUpdateTime = now
-            }
-
-            if (root.lastSpeedText !== "") {
-                stats += root.lastSpeedText
-            }
+        // Throughput and ETA are smoothed by the progress bus.
+        if (root.status === "Running" && root.bytesPerSecond > 0) {
+            stats += " • " + formatTransferRate(root.bytesPerSecond)
+            if (root.etaSeconds > 0)
+                stats += " • " + formatEta(root.etaSeconds)
         }
 
         statsLabel.text = stats
@@ -254,6 +239,13 @@ Rectangle {
         return (bytesPerSecond / (1024 * 1024 * 1024)).toFixed(1) + " GB/s"
     }
 
+    function formatEta(seconds) {
+        seconds = Math.ceil(seconds)
+        if (seconds < 60) return qsTr("%1 s left").arg(seconds)
+        if (seconds < 3600) return qsTr("%1 min left").arg(Math.ceil(seconds / 60))
+        return qsTr("%1 h %2 min left").arg(Math.floor(seconds / 3600)).arg(Math.ceil((seconds % 3600) / 60))
+    }
+
     function localFileUrl(path) {
         var normalized = String(path).replace(/\\/g, "/")
         if (normalized.indexOf("file://") === 0)
@@ -272,6 +264,7 @@ Rectangle {
 
     // Update UI when properties change
     onTransferredBytesChanged: updateStats()
+    onBytesPerSecondChanged: updateStats()
     onCompletedItemsChanged: updateStats()
     onFailedItemsChanged: updateStats()
     onStatusChanged: {
@@ -286,10 +279,7 @@ Rectangle {
         }
     }
 
-    Component.onCompleted: {
-        root.lastUpdateTime = new Date()
-        updateStats()
-    }
+    Component.onCompleted: updateStats()
 
     // Hover handling
     HoverHandler {
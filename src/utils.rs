@@ -1,6 +1,8 @@
 // SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
+use crate::afc_pool::AfcSource;
+use crate::buffer_pool::{self, PooledBuffer};
 use crate::{POSSIBLE_ROOT, run_sync};
 use ::log::{debug, error, info, warn};
 use anyhow::Context;
@@ -22,9 +24,7 @@ use serde_json::json;
 use std::ffi::c_void;
 use std::io::SeekFrom;
 use std::path::{Path, PathBuf};
-use std::sync::Arc;
 use tokio::io::{AsyncReadExt, AsyncSeekExt};
-use tokio::sync::Mutex;
 
 cpp! {{
     struct TraitObject2 { void *data; void *vtable; };
@@ -987,20 +987,16 @@ pub struct AfcReader {
     #[allow(dead_code)]
     udid: String,
     path: String,
-    afc_arc: Arc<Mutex<AfcClient>>,
+    afc: AfcSource,
 }
 
 impl AfcReader {
-    pub fn new(udid: String, path: String, afc_arc: Arc<Mutex<AfcClient>>) -> Self {
-        Self {
-            udid,
-            path,
-            afc_arc,
-        }
+    pub fn new(udid: String, path: String, afc: AfcSource) -> Self {
+        Self { udid, path, afc }
     }
 
     pub async fn get_size(&self) -> anyhow::Result<i64> {
-        let mut afc = self.afc_arc.lock().await;
+        let mut afc = self.afc.lease().await?;
         let info = afc
             .get_file_info(self.path.clone())
             .await
@@ -1008,22 +1004,30 @@ impl AfcReader {
         i64::try_from(info.size).context("Video file size exceeds FFmpeg's signed 64-bit limit")
     }
 
-    pub fn read_at(&self, offset: i64, size: i32) -> Vec<u8> {
+    /// Reads up to `size` bytes at `offset`. Video probing issues thousands of
+    /// small reads, so the returned buffer is recycled once the caller drops it.
+    pub fn read_at(&self, offset: i64, size: i32) -> PooledBuffer {
         if size <= 0 || offset < 0 {
-            return Vec::new();
+            return PooledBuffer::empty();
         }
 
         let path = self.path.clone();
-        let afc_arc = self.afc_arc.clone();
+        let afc_source = self.afc.clone();
         // FIXME: is run_sync safe in this context?
         run_sync(async move {
-            let mut afc = afc_arc.lock().await;
+            let mut afc = match afc_source.lease().await {
+                Ok(afc) => afc,
+                Err(e) => {
+                    eprintln!("read_at: no AFC session for {}: {}", path, e);
+                    return PooledBuffer::empty();
+                }
+            };
 
             let mut fd = match afc.open(path.clone(), AfcFopenMode::RdOnly).await {
                 Ok(f) => f,
                 Err(e) => {
                     eprintln!("read_at: open({}) failed: {}", path, e);
-                    return Vec::new();
+                    return PooledBuffer::empty();
                 }
             };
 
@@ -1031,17 +1035,17 @@ impl AfcReader {
                 if let Err(e) = fd.seek(SeekFrom::Start(offset as u64)).await {
                     eprintln!("read_at: seek({}, {}) failed: {}", path, offset, e);
                     let _ = fd.close().await;
-                    return Vec::new();
+                    return PooledBuffer::empty();
                 }
             }
 
-            let mut buf = vec![0u8; size as usize];
+            let mut buf = buffer_pool::take(size as usize);
             let n = match fd.read(&mut buf).await {
                 Ok(n) => n,
                 Err(e) => {
                     eprintln!("read_at: read({}, {}) failed: {}", path, offset, e);
                     let _ = fd.close().await;
-                    return Vec::new();
+                    return PooledBuffer::empty();
                 }
             };
             buf.truncate(n);
@@ -1112,6 +1116,44 @@ pub fn heic_to_qimage(buf: &[u8]) -> QImage {
     })
 }
 
+/// Decodes a HEIC image upright, along with its raw Exif metadata block
+/// (empty if it has none).
+pub fn heic_to_qimage_with_exif(buf: &[u8]) -> (QImage, Vec<u8>) {
+    let data = buf.as_ptr();
+    let len = buf.len();
+    let mut exif = QByteArray::default();
+    let exif_ptr = &mut exif as *mut QByteArray;
+
+    let image = cpp!(unsafe [
+        data as "const uint8_t *",
+        len as "size_t",
+        exif_ptr as "QByteArray *"
+    ] -> QImage as "QImage" {
+        return heic_decode_ffi(data, len, exif_ptr);
+    });
+    (image, exif.to_slice().to_vec())
+}
+
+/// Encodes `img` as PNG, or as JPEG at `quality`. Empty if the image is null
+/// or could not be encoded.
+pub fn encode_qimage(img: &QImage, png: bool, quality: i32) -> Vec<u8> {
+    let encoded = cpp!(unsafe [
+        img as "const QImage *",
+        png as "bool",
+        quality as "int"
+    ] -> QByteArray as "QByteArray" {
+        QByteArray bytes;
+        if (img->isNull())
+            return bytes;
+        QBuffer buffer(&bytes);
+        buffer.open(QIODevice::WriteOnly);
+        if (!img->save(&buffer, png ? "PNG" : "JPEG", png ? -1 : quality))
+            bytes.clear();
+        return bytes;
+    });
+    encoded.to_slice().to_vec()
+}
+
 //FIXME: this may be called multiple times?
 pub fn force_load_gst_gl() -> bool {
     /*
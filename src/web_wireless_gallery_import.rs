@@ -1,7 +1,10 @@
 // SPDX-FileCopyrightText: 2025-2026 Uncore <https://github.com/uncor3>
 // SPDX-License-Identifier: AGPL-3.0-or-later
 
-use crate::{RUNTIME, qt_threading::QtThreading, qvariantmap_insert, settings_manager};
+use crate::{
+    RUNTIME, progress_bus::ProgressJob, qt_threading::QtThreading, qvariantmap_insert,
+    settings_manager,
+};
 use anyhow::{Context, anyhow};
 use chrono::Local;
 use image::{DynamicImage, ImageFormat, Luma};
@@ -323,6 +326,14 @@ async fn serve_file(
         Err(_) => return,
     };
 
+    let progress = ProgressJob::new("wireless-import", move |snapshot| {
+        let file_name = snapshot.current_item.clone();
+        let (done, total) = (snapshot.done as i64, snapshot.total as i64);
+        q_thread.queue(move |q| {
+            q.download_progress(QString::from(file_name), done, total);
+        });
+    });
+
     let mut sent = 0u64;
     let mut chunk = vec![0u8; 128 * 1024];
     loop {
@@ -337,10 +348,7 @@ async fn serve_file(
         }
 
         sent += n as u64;
-        let file_name = file_name.clone();
-        q_thread.queue(move |q| {
-            q.download_progress(QString::from(file_name), sent as i64, total as i64);
-        });
+        progress.report(&file_name, sent, total);
     }
 }
 